@@ -0,0 +1,260 @@
+#!/usr/bin/env python
+#
+# nghttp2 - HTTP/2 C Library
+#
+# Copyright (c) 2017 Tatsuhiro Tsujikawa
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+# This script decodes the access log written by nghttpx with
+# --accesslog-binary, and prints it in text, or in JSON lines.
+#
+# Each binary record consists of 4 bytes length of the rest of the
+# record in network byte order, and the fields which hold the values
+# of the variables in --accesslog-format in order.  Each field is 1
+# byte variable type (LogFragmentType in src/shrpx_log.h), 2 bytes
+# length of the value in network byte order, and the value.  Integers
+# are written in network byte order using the minimum number of
+# bytes.  The literal strings in the format are not written, so the
+# same format given to nghttpx must be given to this script.
+#
+# Usage: nghttpx-accesslog-decode.py [OPTIONS] [FILE...]
+#
+# FILE is the binary access log file.  If it is not given, the
+# records are read from standard input.
+#
+import sys, argparse, json, re, struct
+
+DEFAULT_FORMAT = '$remote_addr - - [$time_local] ' \
+                 '"$request" $status $body_bytes_sent ' \
+                 '"$http_referer" "$http_user_agent"'
+
+# The values of LogFragmentType in src/shrpx_log.h.
+LOGF_REMOTE_ADDR = 2
+LOGF_TIME_LOCAL = 3
+LOGF_TIME_ISO8601 = 4
+LOGF_REQUEST = 5
+LOGF_STATUS = 6
+LOGF_BODY_BYTES_SENT = 7
+LOGF_HTTP = 8
+LOGF_AUTHORITY = 9
+LOGF_REMOTE_PORT = 10
+LOGF_SERVER_PORT = 11
+LOGF_REQUEST_TIME = 12
+LOGF_PID = 13
+LOGF_ALPN = 14
+LOGF_TLS_CIPHER = 15
+LOGF_TLS_PROTOCOL = 16
+LOGF_TLS_SESSION_ID = 17
+LOGF_TLS_SESSION_REUSED = 18
+LOGF_TLS_SNI = 19
+LOGF_BACKEND_HOST = 20
+LOGF_BACKEND_PORT = 21
+
+LOGVARS = {
+    'remote_addr': LOGF_REMOTE_ADDR,
+    'time_local': LOGF_TIME_LOCAL,
+    'time_iso8601': LOGF_TIME_ISO8601,
+    'request': LOGF_REQUEST,
+    'status': LOGF_STATUS,
+    'body_bytes_sent': LOGF_BODY_BYTES_SENT,
+    'remote_port': LOGF_REMOTE_PORT,
+    'server_port': LOGF_SERVER_PORT,
+    'request_time': LOGF_REQUEST_TIME,
+    'pid': LOGF_PID,
+    'alpn': LOGF_ALPN,
+    'tls_cipher': LOGF_TLS_CIPHER,
+    'ssl_cipher': LOGF_TLS_CIPHER,
+    'tls_protocol': LOGF_TLS_PROTOCOL,
+    'ssl_protocol': LOGF_TLS_PROTOCOL,
+    'tls_session_id': LOGF_TLS_SESSION_ID,
+    'ssl_session_id': LOGF_TLS_SESSION_ID,
+    'tls_session_reused': LOGF_TLS_SESSION_REUSED,
+    'ssl_session_reused': LOGF_TLS_SESSION_REUSED,
+    'tls_sni': LOGF_TLS_SNI,
+    'backend_host': LOGF_BACKEND_HOST,
+    'backend_port': LOGF_BACKEND_PORT,
+}
+
+# The variables whose values are integers.
+INTEGER_TYPES = (LOGF_STATUS, LOGF_BODY_BYTES_SENT, LOGF_SERVER_PORT,
+                 LOGF_REQUEST_TIME, LOGF_PID, LOGF_BACKEND_PORT)
+
+# The variables whose values are escaped in text access log.
+ESCAPE_TYPES = (LOGF_REQUEST, LOGF_HTTP, LOGF_ALPN, LOGF_TLS_SNI)
+
+def parse_format(fmt):
+    '''Parses access log format |fmt| in the same way as nghttpx, and
+    returns the list of literal strings and variables.  Each variable
+    is a tuple of its name and type.'''
+    res = []
+    literal_start = 0
+    pos = 0
+    var_re = re.compile(r'\$(?:\{([A-Za-z0-9_]*)\}|([A-Za-z0-9_]*))')
+    while True:
+        pos = fmt.find('$', pos)
+        if pos == -1:
+            break
+        m = var_re.match(fmt, pos)
+        if m.group(1) is None and fmt.startswith('${', pos):
+            # Missing '}'
+            pos += 2
+            continue
+        name = m.group(1) if m.group(1) is not None else m.group(2)
+        var_start = pos
+        pos = m.end()
+        lname = name.lower()
+        if lname in LOGVARS:
+            vartype = LOGVARS[lname]
+        elif lname == 'http_host':
+            vartype = LOGF_AUTHORITY
+        elif lname.startswith('http_'):
+            vartype = LOGF_HTTP
+        else:
+            # nghttpx leaves unknown variable in the literal string.
+            continue
+        if literal_start < var_start:
+            res.append(fmt[literal_start:var_start])
+        literal_start = pos
+        res.append((name, vartype))
+    if literal_start < len(fmt):
+        res.append(fmt[literal_start:])
+    return res
+
+def escape(value):
+    res = []
+    for c in bytearray(value):
+        if c < 0x20 or c >= 0x7f or c == 0x22 or c == 0x5c:
+            res.append('\\x{:02x}'.format(c))
+        else:
+            res.append(chr(c))
+    return ''.join(res)
+
+def to_int(value):
+    n = 0
+    for c in bytearray(value):
+        n = (n << 8) | c
+    return n
+
+def to_text(vartype, value):
+    if vartype in INTEGER_TYPES:
+        if not value:
+            return '-'
+        n = to_int(value)
+        if vartype == LOGF_REQUEST_TIME:
+            return '{}.{:03d}'.format(n // 1000, n % 1000)
+        return str(n)
+    if vartype == LOGF_TLS_SESSION_ID:
+        if not value:
+            return '-'
+        return ''.join('{:02x}'.format(c) for c in bytearray(value))
+    if vartype in ESCAPE_TYPES:
+        return escape(value)
+    return value.decode('latin-1')
+
+def to_json_value(vartype, value):
+    if vartype in INTEGER_TYPES:
+        if not value:
+            return None
+        n = to_int(value)
+        if vartype == LOGF_REQUEST_TIME:
+            return n / 1000.0
+        return n
+    if vartype == LOGF_TLS_SESSION_ID:
+        if not value:
+            return None
+        return ''.join('{:02x}'.format(c) for c in bytearray(value))
+    return value.decode('utf-8', 'replace')
+
+def read_records(f):
+    while True:
+        hd = f.read(4)
+        if not hd:
+            return
+        if len(hd) < 4:
+            raise IOError('truncated record header')
+        length = struct.unpack('!I', hd)[0]
+        record = f.read(length)
+        if len(record) < length:
+            raise IOError('truncated record')
+        yield record
+
+def decode_record(record, variables):
+    '''Returns the list of values in |record| which correspond to
+    |variables|.  If the record is truncated by nghttpx, the missing
+    values are None.'''
+    res = []
+    pos = 0
+    for name, vartype in variables:
+        if pos == len(record):
+            res.append(None)
+            continue
+        if len(record) - pos < 3:
+            raise IOError('malformed field')
+        fieldtype, length = struct.unpack('!BH', record[pos:pos + 3])
+        if fieldtype != vartype:
+            raise IOError('field type {} does not match ${}'.format(
+                fieldtype, name))
+        pos += 3
+        res.append(record[pos:pos + length])
+        pos += length
+    return res
+
+def main():
+    ap = argparse.ArgumentParser(
+        description='nghttpx binary access log decoder')
+    ap.add_argument('-f', '--format', default=DEFAULT_FORMAT,
+                    help='value of --accesslog-format given to nghttpx')
+    ap.add_argument('-j', '--json', action='store_true',
+                    help='print JSON lines instead of text')
+    ap.add_argument('files', nargs='*', metavar='FILE',
+                    help='binary access log file')
+    args = ap.parse_args()
+
+    fmt = parse_format(args.format)
+    variables = [x for x in fmt if isinstance(x, tuple)]
+
+    out = sys.stdout
+    stdin = getattr(sys.stdin, 'buffer', sys.stdin)
+    files = [open(path, 'rb') for path in args.files] or [stdin]
+
+    for f in files:
+        for record in read_records(f):
+            values = iter(decode_record(record, variables))
+            if args.json:
+                obj = {}
+                for name, vartype in variables:
+                    value = next(values)
+                    if value is not None:
+                        obj[name] = to_json_value(vartype, value)
+                out.write(json.dumps(obj, sort_keys=True))
+            else:
+                for x in fmt:
+                    if not isinstance(x, tuple):
+                        out.write(x)
+                        continue
+                    value = next(values)
+                    if value is not None:
+                        out.write(to_text(x[1], value))
+            out.write('\n')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,107 @@
+#!/bin/sh
+#
+# nghttp2 - HTTP/2 C Library
+#
+# Copyright (c) 2017 Tatsuhiro Tsujikawa
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# Measures the rate of new connections nghttpx can take, with and
+# without --reuseport.  h2load opens all connections at once (or at
+# the rate given by RATE), and sends one request on each, so its
+# req/s is the connection rate.  nghttpd is used as backend.  Raise
+# the open file limit (ulimit -n) above CONNS before running this.
+#
+# Usage: nghttpx-connbench.sh [SRCDIR]
+#
+# SRCDIR is the directory which contains nghttpx, nghttpd and h2load
+# binaries (default: ../src).  The following environment variables
+# change the parameters:
+#
+#   WORKERS     number of nghttpx worker threads (default: 4)
+#   CONNS       number of connections per run (default: 10000)
+#   RATE        if given, h2load creates this many connections per
+#               second instead of all at once
+#   THREADS     number of h2load threads (default: 4)
+#   RUNS        number of runs per mode (default: 3)
+#   PORT        nghttpx frontend port (default: 3000)
+
+set -e
+
+SRCDIR=${1:-../src}
+WORKERS=${WORKERS:-4}
+CONNS=${CONNS:-10000}
+THREADS=${THREADS:-4}
+RUNS=${RUNS:-3}
+PORT=${PORT:-3000}
+BACKEND_PORT=$((PORT + 1))
+
+workdir=$(mktemp -d)
+echo ok > "$workdir/index.html"
+
+cleanup() {
+    [ -n "$nghttpx_pid" ] && kill "$nghttpx_pid" 2>/dev/null || true
+    [ -n "$nghttpd_pid" ] && kill "$nghttpd_pid" 2>/dev/null || true
+    rm -rf "$workdir"
+}
+trap cleanup EXIT
+
+"$SRCDIR/nghttpd" --no-tls -d "$workdir" "$BACKEND_PORT" > /dev/null 2>&1 &
+nghttpd_pid=$!
+
+h2load_opts=
+if [ -n "$RATE" ]; then
+    h2load_opts="-r$RATE --rate-period=1s"
+fi
+
+run() {
+    mode=$1
+    shift
+
+    "$SRCDIR/nghttpx" -b"127.0.0.1,$BACKEND_PORT;;proto=h2" \
+        -f"127.0.0.1,$PORT;no-tls" -n"$WORKERS" \
+        --backlog=4096 --worker-frontend-connections=0 \
+        --accesslog-file=/dev/null --errorlog-file="$workdir/error.log" \
+        "$@" &
+    nghttpx_pid=$!
+    sleep 1
+
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        "$SRCDIR/h2load" -n"$CONNS" -c"$CONNS" -t"$THREADS" $h2load_opts \
+            "http://127.0.0.1:$PORT/index.html" |
+            awk -v mode="$mode" '
+                /^finished in/ { rate = $4 }
+                /^requests:/ { failed = $10 + $12 }
+                END { printf "%-10s %12s conn/s %6d failed\n", mode, rate,
+                      failed }'
+        i=$((i + 1))
+    done
+
+    kill "$nghttpx_pid"
+    wait "$nghttpx_pid" 2>/dev/null || true
+    nghttpx_pid=
+    # The worker process may still hold the listening socket for a
+    # while.
+    sleep 2
+}
+
+run dispatch
+run reuseport --reuseport
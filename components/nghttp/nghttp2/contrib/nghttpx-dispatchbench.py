@@ -0,0 +1,185 @@
+#!/usr/bin/env python
+#
+# nghttp2 - HTTP/2 C Library
+#
+# Copyright (c) 2017 Tatsuhiro Tsujikawa
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+# LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+# OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+# WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+# This script compares the latency of short connections to nghttpx
+# under the --worker-dispatch policies, when long lived, busy
+# connections are mixed with them.
+#
+# Long connections are opened interleaved with short ones: each long
+# connection is followed by (WORKERS - 1) short connections.  With
+# round-robin, this pattern puts all long connections on the same
+# worker thread.  Then the long connections keep downloading a large
+# file, while the short connections (one request per connection) are
+# made in parallel, and their latency percentiles are reported.
+# nghttpd is used as backend.
+#
+# Usage: nghttpx-dispatchbench.py [OPTIONS] [SRCDIR]
+#
+# SRCDIR is the directory which contains nghttpx and nghttpd binaries
+# (default: ../src).
+#
+import sys, os, argparse, socket, subprocess, shutil, tempfile, threading, \
+    time
+
+def request(port, path, sock=None):
+    close = sock is None
+    if close:
+        sock = socket.create_connection(('127.0.0.1', port))
+    req = 'GET {} HTTP/1.1\r\nHost: 127.0.0.1\r\n{}\r\n'.format(
+        path, 'Connection: close\r\n' if close else '')
+    sock.sendall(req.encode('ascii'))
+
+    buf = b''
+    while b'\r\n\r\n' not in buf:
+        data = sock.recv(4096)
+        if not data:
+            raise IOError('connection closed')
+        buf += data
+    header, body = buf.split(b'\r\n\r\n', 1)
+    length = None
+    for line in header.split(b'\r\n')[1:]:
+        name, value = line.split(b':', 1)
+        if name.strip().lower() == b'content-length':
+            length = int(value)
+    left = length - len(body)
+    while left > 0:
+        data = sock.recv(min(left, 65536))
+        if not data:
+            raise IOError('connection closed')
+        left -= len(data)
+
+    if close:
+        sock.close()
+
+def long_client(port, sock, stop):
+    while not stop.is_set():
+        request(port, '/large', sock)
+
+def short_client(port, stop, latencies):
+    while not stop.is_set():
+        start = time.time()
+        request(port, '/small')
+        latencies.append(time.time() - start)
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+def run(args, policy, workdir):
+    port = args.port
+    nghttpx = subprocess.Popen([
+        os.path.join(args.srcdir, 'nghttpx'),
+        '-b127.0.0.1,{};;proto=h2'.format(port + 1),
+        '-f127.0.0.1,{};no-tls'.format(port),
+        '-n{}'.format(args.workers),
+        '--worker-dispatch={}'.format(policy),
+        '--accesslog-file=/dev/null',
+        '--errorlog-file={}'.format(os.path.join(workdir, 'error.log'))])
+    time.sleep(1)
+
+    try:
+        socks = []
+        for _ in range(args.long):
+            socks.append(socket.create_connection(('127.0.0.1', port)))
+            # Let nghttpx take the connection before the next ones.
+            time.sleep(0.01)
+            for _ in range(args.workers - 1):
+                request(port, '/small')
+
+        stop = threading.Event()
+        latencies = []
+        threads = [threading.Thread(target=long_client,
+                                    args=(port, sock, stop)) \
+                   for sock in socks]
+        threads += [threading.Thread(target=short_client,
+                                     args=(port, stop, latencies)) \
+                    for _ in range(args.short)]
+        for t in threads:
+            t.start()
+        time.sleep(args.duration)
+        stop.set()
+        for t in threads:
+            t.join()
+        for sock in socks:
+            sock.close()
+    finally:
+        nghttpx.terminate()
+        nghttpx.wait()
+        # The worker process may still hold the listening socket for a
+        # while.
+        time.sleep(2)
+
+    latencies.sort()
+    sys.stdout.write(
+        '{:12} {:8} {:8.2f} {:8.2f} {:8.2f} {:8.2f}\n'.format(
+            policy, len(latencies),
+            *[x * 1000 for x in [percentile(latencies, 50),
+                                 percentile(latencies, 90),
+                                 percentile(latencies, 99),
+                                 latencies[-1]]]))
+
+if __name__ == '__main__':
+    ap = argparse.ArgumentParser(
+        description='nghttpx worker dispatch policy benchmark')
+    ap.add_argument('-n', '--workers', help='number of nghttpx worker threads',
+                    type=int, default=4)
+    ap.add_argument('-l', '--long', help='number of long connections',
+                    type=int, default=8)
+    ap.add_argument('-s', '--short',
+                    help='number of concurrent short connection clients',
+                    type=int, default=8)
+    ap.add_argument('-d', '--duration', help='seconds to measure',
+                    type=float, default=10)
+    ap.add_argument('-p', '--port', help='nghttpx frontend port', type=int,
+                    default=3000)
+    ap.add_argument('--large-size', help='size of file long connections get',
+                    type=int, default=1 << 20)
+    ap.add_argument('-P', '--policies',
+                    help='comma separated list of dispatch policies',
+                    default='round-robin,least-conn,p2c')
+    ap.add_argument('srcdir', nargs='?', default='../src',
+                    help='directory which contains nghttpx and nghttpd')
+    args = ap.parse_args()
+
+    workdir = tempfile.mkdtemp()
+    with open(os.path.join(workdir, 'small'), 'wb') as f:
+        f.write(b'ok\n')
+    with open(os.path.join(workdir, 'large'), 'wb') as f:
+        f.write(b'x' * args.large_size)
+
+    nghttpd = subprocess.Popen(
+        [os.path.join(args.srcdir, 'nghttpd'), '--no-tls', '-d', workdir,
+         str(args.port + 1)],
+        stdout=open(os.devnull, 'w'), stderr=subprocess.STDOUT)
+    time.sleep(1)
+
+    try:
+        sys.stdout.write('{:12} {:>8} {:>8} {:>8} {:>8} {:>8}\n'.format(
+            'policy', 'requests', 'p50(ms)', 'p90(ms)', 'p99(ms)', 'max(ms)'))
+        for policy in args.policies.split(','):
+            run(args, policy, workdir)
+    finally:
+        nghttpd.terminate()
+        nghttpd.wait()
+        shutil.rmtree(workdir)
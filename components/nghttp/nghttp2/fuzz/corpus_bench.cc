@@ -0,0 +1,457 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Replays fuzzer corpus, or any other captured client traffic,
+// through nghttp2_session_mem_recv() and reports receive path
+// throughput.  See README.rst for usage.
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <nghttp2/nghttp2.h>
+
+namespace {
+struct Input {
+  std::string path;
+  std::vector<uint8_t> data;
+};
+} // namespace
+
+namespace {
+struct Result {
+  // The number of bytes and frames fed to nghttp2_session_mem_recv()
+  // in total.
+  uint64_t bytes;
+  uint64_t frames;
+  // The number of allocations, including reallocations, the sessions
+  // made after their setup.  This includes the ones made while
+  // sending the frames queued in response, which are not timed.
+  uint64_t allocations;
+  // The time spent inside nghttp2_session_mem_recv() in nanoseconds.
+  uint64_t elapsed;
+};
+} // namespace
+
+namespace {
+struct Metrics {
+  double bytes_per_sec;
+  double frames_per_sec;
+  double allocs_per_frame;
+  // The number of frames processed in one round
+  uint64_t frames;
+};
+} // namespace
+
+namespace {
+int on_frame_recv_callback(nghttp2_session *, const nghttp2_frame *, void *) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int on_begin_headers_callback(nghttp2_session *, const nghttp2_frame *,
+                              void *) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int on_header_callback2(nghttp2_session *, const nghttp2_frame *,
+                        nghttp2_rcbuf *, nghttp2_rcbuf *, uint8_t, void *) {
+  return 0;
+}
+} // namespace
+
+namespace {
+int on_data_chunk_recv_callback(nghttp2_session *, uint8_t, int32_t,
+                                const uint8_t *, size_t, void *) {
+  return 0;
+}
+} // namespace
+
+namespace {
+void send_pending(nghttp2_session *session) {
+  for (;;) {
+    const uint8_t *data;
+    auto n = nghttp2_session_mem_send(session, &data);
+    if (n <= 0) {
+      return;
+    }
+  }
+}
+} // namespace
+
+namespace {
+bool read_file(std::vector<Input> &inputs, const std::string &path) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    return false;
+  }
+
+  Input in;
+  in.path = path;
+  in.data.assign(std::istreambuf_iterator<char>(f),
+                 std::istreambuf_iterator<char>());
+
+  if (!in.data.empty()) {
+    inputs.push_back(std::move(in));
+  }
+
+  return true;
+}
+} // namespace
+
+namespace {
+// Reads |path| if it is a file, or all files under |path|
+// recursively if it is a directory.  Files in a directory are read
+// in lexicographical order so that runs are reproducible.
+bool read_inputs(std::vector<Input> &inputs, const std::string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    fprintf(stderr, "Could not stat %s\n", path.c_str());
+    return false;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    return read_file(inputs, path);
+  }
+
+  auto dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    fprintf(stderr, "Could not open directory %s\n", path.c_str());
+    return false;
+  }
+
+  std::vector<std::string> names;
+  for (auto ent = readdir(dir); ent; ent = readdir(dir)) {
+    if (ent->d_name[0] == '.') {
+      continue;
+    }
+    names.emplace_back(ent->d_name);
+  }
+  closedir(dir);
+
+  std::sort(std::begin(names), std::end(names));
+
+  for (auto &name : names) {
+    if (!read_inputs(inputs, path + "/" + name)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+} // namespace
+
+namespace {
+uint64_t count_frames(const nghttp2_session_stats *stats) {
+  uint64_t n = 0;
+  for (auto v : stats->frames_recv) {
+    n += v;
+  }
+  return n;
+}
+} // namespace
+
+namespace {
+// Feeds |in| to a fresh server session in chunks of at most
+// |chunklen| bytes, and adds what happened to |res|.  Only the time
+// spent in nghttp2_session_mem_recv() is measured; session setup and
+// draining of the frames the session queues in response are not.
+void replay(Result &res, nghttp2_session_callbacks *callbacks,
+            const Input &in, size_t chunklen) {
+  nghttp2_session *session;
+
+  nghttp2_session_server_new(&session, callbacks, nullptr);
+
+  nghttp2_settings_entry iv{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100};
+  nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, &iv, 1);
+  send_pending(session);
+
+  auto stats = nghttp2_session_get_stats(session);
+  auto allocations = stats->allocations;
+  auto frames = count_frames(stats);
+
+  auto p = in.data.data();
+  auto end = p + in.data.size();
+
+  while (p != end) {
+    auto len = std::min(static_cast<size_t>(end - p), chunklen);
+
+    auto start = std::chrono::steady_clock::now();
+    auto rv = nghttp2_session_mem_recv(session, p, len);
+    res.elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+    if (rv < 0) {
+      break;
+    }
+
+    res.bytes += len;
+    p += len;
+
+    send_pending(session);
+  }
+
+  stats = nghttp2_session_get_stats(session);
+  res.allocations += stats->allocations - allocations;
+  res.frames += count_frames(stats) - frames;
+
+  nghttp2_session_del(session);
+}
+} // namespace
+
+namespace {
+bool write_baseline(const std::string &path, const Metrics &m) {
+  auto fp = fopen(path.c_str(), "w");
+  if (fp == nullptr) {
+    fprintf(stderr, "Could not open %s for writing\n", path.c_str());
+    return false;
+  }
+
+  fprintf(fp, "bytes_per_sec %.6e\n", m.bytes_per_sec);
+  fprintf(fp, "frames_per_sec %.6e\n", m.frames_per_sec);
+  fprintf(fp, "allocs_per_frame %.6f\n", m.allocs_per_frame);
+  fprintf(fp, "frames %llu\n", static_cast<unsigned long long>(m.frames));
+
+  fclose(fp);
+
+  return true;
+}
+} // namespace
+
+namespace {
+bool read_baseline(Metrics &m, const std::string &path) {
+  auto fp = fopen(path.c_str(), "r");
+  if (fp == nullptr) {
+    fprintf(stderr, "Could not open %s\n", path.c_str());
+    return false;
+  }
+
+  memset(&m, 0, sizeof(m));
+
+  char key[64];
+  double v;
+  while (fscanf(fp, "%63s %lf", key, &v) == 2) {
+    if (strcmp(key, "bytes_per_sec") == 0) {
+      m.bytes_per_sec = v;
+    } else if (strcmp(key, "frames_per_sec") == 0) {
+      m.frames_per_sec = v;
+    } else if (strcmp(key, "allocs_per_frame") == 0) {
+      m.allocs_per_frame = v;
+    } else if (strcmp(key, "frames") == 0) {
+      m.frames = static_cast<uint64_t>(v);
+    }
+  }
+
+  fclose(fp);
+
+  if (m.bytes_per_sec == 0 || m.frames_per_sec == 0) {
+    fprintf(stderr, "%s is not a valid baseline\n", path.c_str());
+    return false;
+  }
+
+  return true;
+}
+} // namespace
+
+namespace {
+// Compares |m| against |base|, and returns true if throughput did
+// not drop by more than |threshold| percent, and the number of
+// allocations per frame did not grow.
+bool compare_baseline(const Metrics &m, const Metrics &base,
+                      double threshold) {
+  auto ok = true;
+
+  auto check_rate = [&](const char *name, double cur, double prev) {
+    auto delta = (cur - prev) * 100. / prev;
+    auto fail = delta < -threshold;
+    printf("%-18s %14.2f -> %14.2f %+7.2f%%%s\n", name, prev, cur, delta,
+           fail ? "  REGRESSION" : "");
+    ok = ok && !fail;
+  };
+
+  check_rate("bytes/s", m.bytes_per_sec, base.bytes_per_sec);
+  check_rate("frames/s", m.frames_per_sec, base.frames_per_sec);
+
+  // Allocation counts are deterministic, so any growth is reported.
+  auto fail = m.allocs_per_frame > base.allocs_per_frame + 1e-6;
+  printf("%-18s %14.6f -> %14.6f%s\n", "allocations/frame",
+         base.allocs_per_frame, m.allocs_per_frame,
+         fail ? "  REGRESSION" : "");
+  ok = ok && !fail;
+
+  if (base.frames && base.frames != m.frames) {
+    printf("warning: baseline processed %llu frames, but this run processed "
+           "%llu; the corpus or the parser behaviour changed\n",
+           static_cast<unsigned long long>(base.frames),
+           static_cast<unsigned long long>(m.frames));
+  }
+
+  return ok;
+}
+} // namespace
+
+namespace {
+void print_usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [OPTIONS] PATH...\n"
+          "Replay files under PATHs through nghttp2_session_mem_recv().\n"
+          "\n"
+          "Options:\n"
+          "  -n N                 Replay the whole input N times (default: "
+          "100)\n"
+          "  --chunk=N            Feed at most N bytes per mem_recv call\n"
+          "  --save-baseline=FILE Write the result to FILE\n"
+          "  --baseline=FILE      Compare the result with FILE, and exit "
+          "with\n"
+          "                       status 1 on regression\n"
+          "  --threshold=PCT      Allowed throughput drop against the "
+          "baseline\n"
+          "                       in percent (default: 10)\n",
+          prog);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t rounds = 100;
+  size_t chunklen = SIZE_MAX;
+  double threshold = 10.;
+  std::string baseline, save_baseline;
+  std::vector<Input> inputs;
+
+  for (int i = 1; i < argc; ++i) {
+    auto arg = argv[i];
+
+    if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+      print_usage(argv[0]);
+      return 0;
+    }
+    if (strcmp(arg, "-n") == 0 && i + 1 < argc) {
+      rounds = strtoul(argv[++i], nullptr, 10);
+      continue;
+    }
+    if (strncmp(arg, "--chunk=", 8) == 0) {
+      chunklen = strtoul(arg + 8, nullptr, 10);
+      continue;
+    }
+    if (strncmp(arg, "--save-baseline=", 16) == 0) {
+      save_baseline = arg + 16;
+      continue;
+    }
+    if (strncmp(arg, "--baseline=", 11) == 0) {
+      baseline = arg + 11;
+      continue;
+    }
+    if (strncmp(arg, "--threshold=", 12) == 0) {
+      threshold = strtod(arg + 12, nullptr);
+      continue;
+    }
+    if (arg[0] == '-') {
+      print_usage(argv[0]);
+      return 1;
+    }
+    if (!read_inputs(inputs, arg)) {
+      return 1;
+    }
+  }
+
+  if (inputs.empty() || rounds == 0 || chunklen == 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  nghttp2_session_callbacks *callbacks;
+
+  nghttp2_session_callbacks_new(&callbacks);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks,
+                                                       on_frame_recv_callback);
+  nghttp2_session_callbacks_set_on_begin_headers_callback(
+      callbacks, on_begin_headers_callback);
+  nghttp2_session_callbacks_set_on_header_callback2(callbacks,
+                                                    on_header_callback2);
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+      callbacks, on_data_chunk_recv_callback);
+
+  // One untimed round warms up caches and the allocator.
+  Result res{};
+  for (auto &in : inputs) {
+    replay(res, callbacks, in, chunklen);
+  }
+
+  res = Result{};
+  for (size_t i = 0; i < rounds; ++i) {
+    for (auto &in : inputs) {
+      replay(res, callbacks, in, chunklen);
+    }
+  }
+
+  nghttp2_session_callbacks_del(callbacks);
+
+  auto sec = std::max(res.elapsed, static_cast<uint64_t>(1)) / 1e9;
+
+  Metrics m;
+  m.bytes_per_sec = res.bytes / sec;
+  m.frames_per_sec = res.frames / sec;
+  m.allocs_per_frame =
+      res.frames ? static_cast<double>(res.allocations) / res.frames : 0.;
+  m.frames = res.frames / rounds;
+
+  printf("%zu inputs, %zu rounds, %llu bytes, %llu frames, %.3f ms in "
+         "mem_recv\n",
+         inputs.size(), rounds, static_cast<unsigned long long>(res.bytes),
+         static_cast<unsigned long long>(res.frames), sec * 1e3);
+  printf("%.2f MiB/s, %.0f frames/s, %.3f allocations/frame\n",
+         m.bytes_per_sec / (1024 * 1024), m.frames_per_sec,
+         m.allocs_per_frame);
+
+  if (!save_baseline.empty() && !write_baseline(save_baseline, m)) {
+    return 1;
+  }
+
+  if (!baseline.empty()) {
+    Metrics base;
+    if (!read_baseline(base, baseline)) {
+      return 1;
+    }
+    if (!compare_baseline(m, base, threshold)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
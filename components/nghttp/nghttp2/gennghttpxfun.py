@@ -168,6 +168,17 @@ OPTIONS = [
     "no-strip-incoming-x-forwarded-proto",
     "ocsp-startup",
     "no-verify-ocsp",
+    "reuseport",
+    "worker-cpu-affinity",
+    "worker-dispatch",
+    "accesslog-async",
+    "accesslog-buffer-size",
+    "accesslog-flush-interval",
+    "accesslog-overflow",
+    "accesslog-binary",
+    "cache-size",
+    "cache-max-object-size",
+    "cache-lock-timeout",
 ]
 
 LOGVARS = [
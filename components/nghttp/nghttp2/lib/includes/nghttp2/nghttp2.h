@@ -180,6 +180,34 @@ typedef struct {
  */
 #define NGHTTP2_MIN_WEIGHT 1
 
+/**
+ * @macro
+ *
+ * The highest urgency of extensible priority (RFC 9218).
+ */
+#define NGHTTP2_EXTPRI_URGENCY_HIGH 0
+
+/**
+ * @macro
+ *
+ * The lowest urgency of extensible priority (RFC 9218).
+ */
+#define NGHTTP2_EXTPRI_URGENCY_LOW 7
+
+/**
+ * @macro
+ *
+ * The default urgency of extensible priority (RFC 9218).
+ */
+#define NGHTTP2_EXTPRI_DEFAULT_URGENCY 3
+
+/**
+ * @macro
+ *
+ * The number of urgency levels of extensible priority (RFC 9218).
+ */
+#define NGHTTP2_EXTPRI_URGENCY_LEVELS (NGHTTP2_EXTPRI_URGENCY_LOW + 1)
+
 /**
  * @macro
  *
@@ -817,7 +845,8 @@ typedef enum {
   NGHTTP2_DATA_FLAG_NO_END_STREAM = 0x02,
   /**
    * Indicates that application will send complete DATA frame in
-   * :type:`nghttp2_send_data_callback`.
+   * :type:`nghttp2_send_data_callback`, or provide its payload in
+   * :type:`nghttp2_ref_data_callback`.
    */
   NGHTTP2_DATA_FLAG_NO_COPY = 0x04
 } nghttp2_data_flag;
@@ -839,7 +868,10 @@ typedef enum {
  * bytes to send without copying data into |buf|.  The library, seeing
  * :enum:`NGHTTP2_DATA_FLAG_NO_COPY`, will invoke
  * :type:`nghttp2_send_data_callback`.  The application must send
- * complete DATA frame in that callback.
+ * complete DATA frame in that callback.  If
+ * `nghttp2_session_mem_send_iov()` is used, the library invokes
+ * :type:`nghttp2_ref_data_callback` instead to reference the data
+ * without copying.
  *
  * If this callback is set by `nghttp2_submit_request()`,
  * `nghttp2_submit_response()` or `nghttp2_submit_headers()` and
@@ -1330,6 +1362,41 @@ typedef int (*nghttp2_send_data_callback)(nghttp2_session *session,
                                           nghttp2_data_source *source,
                                           void *user_data);
 
+/**
+ * @functypedef
+ *
+ * Callback function invoked when :enum:`NGHTTP2_DATA_FLAG_NO_COPY` is
+ * used in :type:`nghttp2_data_source_read_callback`, and DATA frame
+ * is serialized by `nghttp2_session_mem_send_iov()`.
+ *
+ * The |frame| is a DATA frame to send.  The |length| is the length of
+ * application data to send (this does not include padding).  The
+ * |source| is the same pointer passed to
+ * :type:`nghttp2_data_source_read_callback`.
+ *
+ * The application must assign the pointer to exactly |length| bytes
+ * of application data to |*data_ptr|.  The library does not copy the
+ * data; it is referenced from the vector returned by
+ * `nghttp2_session_mem_send_iov()`.  Therefore, the data must stay
+ * valid until the application finishes writing the vector, that is,
+ * at least until the next call of `nghttp2_session_mem_send_iov()`.
+ * The frame header and padding are produced by the library.
+ *
+ * If it succeeds, return 0.  If application decided to reset this
+ * stream, return :enum:`NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE`, then
+ * the library will send RST_STREAM with INTERNAL_ERROR as error code.
+ * The application can also return
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`, which will result in
+ * connection closure.  Returning any other value is treated as
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE` is returned.
+ */
+typedef int (*nghttp2_ref_data_callback)(nghttp2_session *session,
+                                         nghttp2_frame *frame,
+                                         const uint8_t **data_ptr,
+                                         size_t length,
+                                         nghttp2_data_source *source,
+                                         void *user_data);
+
 /**
  * @functypedef
  *
@@ -1460,6 +1527,30 @@ typedef int (*nghttp2_on_data_chunk_recv_callback)(nghttp2_session *session,
                                                    const uint8_t *data,
                                                    size_t len, void *user_data);
 
+/**
+ * @functypedef
+ *
+ * Callback function invoked when a chunk of data in DATA frame is
+ * received.  The parameters and behaviour are similar to
+ * :type:`nghttp2_on_data_chunk_recv_callback`.  The difference is
+ * that if the input bytes were passed by
+ * `nghttp2_session_mem_recv_rcbuf()`, |buf| is the reference counted
+ * buffer given to that function, and |data| points to the region
+ * inside it.  The application can call `nghttp2_rcbuf_incref()` to
+ * keep the |data| beyond the callback, for example, to forward it
+ * without copying it, and must call `nghttp2_rcbuf_decref()` when it
+ * no longer needs it.  If the input bytes were passed by
+ * `nghttp2_session_mem_recv()` or `nghttp2_session_recv()`, |buf| is
+ * ``NULL``, and the |data| must be copied if it is needed after the
+ * memory it refers to is reused.
+ *
+ * To set this callback to :type:`nghttp2_session_callbacks`, use
+ * `nghttp2_session_callbacks_set_on_data_chunk_recv_callback2()`.
+ */
+typedef int (*nghttp2_on_data_chunk_recv_callback2)(
+    nghttp2_session *session, uint8_t flags, int32_t stream_id,
+    nghttp2_rcbuf *buf, const uint8_t *data, size_t len, void *user_data);
+
 /**
  * @functypedef
  *
@@ -2081,12 +2172,26 @@ nghttp2_session_callbacks_set_on_invalid_frame_recv_callback(
  * @function
  *
  * Sets callback function invoked when a chunk of data in DATA frame
- * is received.
+ * is received.  If both
+ * `nghttp2_session_callbacks_set_on_data_chunk_recv_callback()` and
+ * `nghttp2_session_callbacks_set_on_data_chunk_recv_callback2()` are
+ * used to set callbacks, the latter has the precedence.
  */
 NGHTTP2_EXTERN void nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
     nghttp2_session_callbacks *cbs,
     nghttp2_on_data_chunk_recv_callback on_data_chunk_recv_callback);
 
+/**
+ * @function
+ *
+ * Sets callback function invoked when a chunk of data in DATA frame
+ * is received, which receives the reference counted buffer holding
+ * the data.
+ */
+NGHTTP2_EXTERN void nghttp2_session_callbacks_set_on_data_chunk_recv_callback2(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_on_data_chunk_recv_callback2 on_data_chunk_recv_callback2);
+
 /**
  * @function
  *
@@ -2222,6 +2327,18 @@ NGHTTP2_EXTERN void nghttp2_session_callbacks_set_send_data_callback(
     nghttp2_session_callbacks *cbs,
     nghttp2_send_data_callback send_data_callback);
 
+/**
+ * @function
+ *
+ * Sets callback function invoked when
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY` is used in
+ * :type:`nghttp2_data_source_read_callback`, and DATA frame is
+ * serialized by `nghttp2_session_mem_send_iov()`.
+ */
+NGHTTP2_EXTERN void nghttp2_session_callbacks_set_ref_data_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_ref_data_callback ref_data_callback);
+
 /**
  * @function
  *
@@ -2568,6 +2685,121 @@ nghttp2_option_set_max_deflate_dynamic_table_size(nghttp2_option *option,
 NGHTTP2_EXTERN void nghttp2_option_set_no_closed_streams(nghttp2_option *option,
                                                          int val);
 
+/**
+ * @function
+ *
+ * This option makes the session allocate small fixed size objects,
+ * such as streams, outbound frames, HPACK dynamic table entries and
+ * header field buffers, from the built-in slab allocator.  The slab
+ * allocator keeps a freelist per size class, and refills it from the
+ * allocator given to `nghttp2_session_client_new3()` or
+ * `nghttp2_session_server_new3()` in pages of several objects.  This
+ * reduces the number of calls to the underlying allocator and heap
+ * fragmentation.  Memory is returned to the underlying allocator
+ * when the session is deleted.  If application retains
+ * :type:`nghttp2_rcbuf` beyond the lifetime of the session, the slab
+ * is deleted when the last such buffer is released.  By default,
+ * this option is set to zero.
+ */
+NGHTTP2_EXTERN void nghttp2_option_set_slab_allocator(nghttp2_option *option,
+                                                      int val);
+
+/**
+ * @function
+ *
+ * This option makes `nghttp2_session_mem_send()` coalesce frames.
+ * If |val| is nonzero, the function serializes as many frames as
+ * possible into the internal buffer of |val| bytes, and returns them
+ * in one call.  The frames may belong to different streams, and they
+ * are chosen in the same order as they are sent without this option.
+ * This reduces the number of calls to `nghttp2_session_mem_send()`,
+ * and the number of writes to the underlying transport when many
+ * small frames, such as HEADERS, WINDOW_UPDATE and SETTINGS ACK, are
+ * queued.  A frame which does not fit in the buffer is returned
+ * alone without copy.  A DATA frame produced with
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY` is not coalesced, and the frames
+ * coalesced so far are returned before it.  This option does not
+ * affect `nghttp2_session_send()`.  By default, this option is set
+ * to zero.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_send_coalesce_length(nghttp2_option *option, size_t val);
+
+/**
+ * @function
+ *
+ * This option replaces the RFC 7540 dependency tree with a flat
+ * scheduler for DATA frames.  If |val| is nonzero, streams are
+ * scheduled by urgency and incremental parameters of extensible
+ * priority (RFC 9218), and priority signals of RFC 7540, such as
+ * PRIORITY frame, priority information in HEADERS frame and
+ * :type:`nghttp2_priority_spec` given to the library functions, are
+ * ignored.  Streams with lower urgency value are served first.
+ * Among streams with the same urgency, non-incremental streams are
+ * served one by one in the order they become ready to send, and
+ * incremental streams share the bandwidth in round-robin fashion,
+ * one DATA frame at a time.  Every operation of the scheduler takes
+ * constant time regardless of the number of streams.  All streams
+ * start with urgency :macro:`NGHTTP2_EXTPRI_DEFAULT_URGENCY` and
+ * non-incremental.  Use
+ * `nghttp2_session_change_extpri_stream_priority()` to change them.
+ * By default, this option is set to zero.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_no_rfc7540_priorities(nghttp2_option *option, int val);
+
+/**
+ * @function
+ *
+ * This option lets the library pass received header fields to the
+ * application without allocating memory for each of them.  If |val|
+ * is nonzero, a header field which is not added to the dynamic header
+ * table refers to the received header block directly if it is not
+ * Huffman encoded, and is decoded into a buffer reused within a
+ * header block otherwise.  Name from the header table is referenced
+ * as before.  Header fields added to the dynamic header table are
+ * unaffected.
+ *
+ * With this option, |name| and |value| passed to
+ * :type:`nghttp2_on_header_callback` and
+ * :type:`nghttp2_on_invalid_header_callback` are not guaranteed to be
+ * NULL-terminated, and they are only valid during the callback.
+ * :type:`nghttp2_rcbuf` passed to
+ * :type:`nghttp2_on_header_callback2` and
+ * :type:`nghttp2_on_invalid_header_callback2` may be static one for
+ * which `nghttp2_rcbuf_incref()` has no effect, and the application
+ * must copy the data if it needs it after the callback returns.  By
+ * default, this option is set to zero.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_borrow_header_fields(nghttp2_option *option, int val);
+
+/**
+ * @function
+ *
+ * This option lets the library grow the receive windows automatically
+ * up to |val| bytes.  The library estimates the bandwidth-delay
+ * product of the connection by counting the bytes of DATA received
+ * during the round trip of a PING frame it sends.  If the remote
+ * endpoint sends a third of the current window or more in one round
+ * trip, that is, its sending rate is limited by flow control rather
+ * than by the network or the application, the connection window is
+ * doubled by WINDOW_UPDATE, and the initial window size of streams is
+ * doubled by SETTINGS.  The windows settle at a few times the
+ * bandwidth-delay product.  Windows are never shrunk, and a window
+ * which is already larger than the new size is left untouched.  At
+ * most one PING frame is outstanding at a time, and it is only sent
+ * while DATA is being received and the windows have not reached
+ * |val|.  These PING and SETTINGS frames, and their ACKs, are passed
+ * to the callbacks like the other frames.  This option works with
+ * `nghttp2_option_set_no_auto_window_update()`.  |val| larger than
+ * :macro:`NGHTTP2_MAX_WINDOW_SIZE` is treated as
+ * :macro:`NGHTTP2_MAX_WINDOW_SIZE`.  By default, this option is set to
+ * zero, and automatic window tuning is disabled.
+ */
+NGHTTP2_EXTERN void
+nghttp2_option_set_max_auto_window_size(nghttp2_option *option, int32_t val);
+
 /**
  * @function
  *
@@ -2827,6 +3059,53 @@ NGHTTP2_EXTERN int nghttp2_session_send(nghttp2_session *session);
 NGHTTP2_EXTERN ssize_t nghttp2_session_mem_send(nghttp2_session *session,
                                                 const uint8_t **data_ptr);
 
+/**
+ * @function
+ *
+ * Returns the serialized data to send as a vector of buffers.
+ *
+ * This function behaves like `nghttp2_session_mem_send()` except
+ * that it serializes as many frames as possible in one invocation,
+ * and assigns the buffers which contain them to |vec|.  At most
+ * |veccnt| elements are filled.  The |veccnt| must be at least 3.
+ * The other callbacks are called in the same way as they are in
+ * `nghttp2_session_mem_send()`.
+ *
+ * Frames other than DATA are serialized into the buffer owned by
+ * |session|.  If DATA frame is produced with
+ * :enum:`NGHTTP2_DATA_FLAG_NO_COPY`, its payload is not copied;
+ * :type:`nghttp2_ref_data_callback` is called to get the pointer to
+ * the application data, and it is referenced from |vec| directly.
+ * If :type:`nghttp2_ref_data_callback` is not set, this function
+ * falls back to :type:`nghttp2_send_data_callback` for such frames,
+ * after returning the frames serialized before them.  The buffers
+ * in |vec| can be passed to ``writev(2)`` or ``sendmsg(2)`` as they
+ * are, and they are valid until the next call of
+ * `nghttp2_session_mem_send_iov()`, `nghttp2_session_mem_send()` or
+ * `nghttp2_session_send()`.
+ *
+ * If no data is available to send, this function returns 0.
+ *
+ * This function may not return all serialized data in one invocation.
+ * To get all data, call this function repeatedly until it returns 0
+ * or one of negative error codes.
+ *
+ * The caller must send all data before calling this function again.
+ *
+ * This function returns the number of elements filled in |vec| if it
+ * succeeds, or one of the following negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     The |veccnt| is less than 3.
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ * :enum:`NGHTTP2_ERR_CALLBACK_FAILURE`
+ *     The callback function failed.
+ */
+NGHTTP2_EXTERN ssize_t nghttp2_session_mem_send_iov(nghttp2_session *session,
+                                                    nghttp2_vec *vec,
+                                                    size_t veccnt);
+
 /**
  * @function
  *
@@ -2938,6 +3217,49 @@ NGHTTP2_EXTERN ssize_t nghttp2_session_mem_recv(nghttp2_session *session,
                                                 const uint8_t *in,
                                                 size_t inlen);
 
+/**
+ * @function
+ *
+ * Allocates reference counted buffer of |size| bytes, and assigns it
+ * to |*rcbuf_ptr|.  The reference count of the buffer is 1.  The
+ * memory is allocated by |mem|, or by the default allocator if |mem|
+ * is ``NULL``.  The buffer is obtained by `nghttp2_rcbuf_get_buf()`,
+ * and it is writable.  The application typically reads input bytes
+ * from the network into it, and passes them to
+ * `nghttp2_session_mem_recv_rcbuf()`.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_NOMEM`
+ *     Out of memory.
+ */
+NGHTTP2_EXTERN int nghttp2_rcbuf_alloc(nghttp2_rcbuf **rcbuf_ptr, size_t size,
+                                       nghttp2_mem *mem);
+
+/**
+ * @function
+ *
+ * Processes data |in| as an input from the remote endpoint just like
+ * `nghttp2_session_mem_recv()`.  The |in| of length |inlen| must lie
+ * inside the buffer managed by |buf|.  DATA payload in |in| is passed
+ * to :type:`nghttp2_on_data_chunk_recv_callback2` along with |buf|,
+ * so that the application can retain it instead of copying it.  The
+ * library itself does not keep a reference to |buf| after this
+ * function returns.
+ *
+ * This function returns the number of processed bytes, or one of the
+ * negative error codes that `nghttp2_session_mem_recv()` returns,
+ * and the following:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     The |in| is not inside the buffer managed by |buf|.
+ */
+NGHTTP2_EXTERN ssize_t nghttp2_session_mem_recv_rcbuf(nghttp2_session *session,
+                                                      nghttp2_rcbuf *buf,
+                                                      const uint8_t *in,
+                                                      size_t inlen);
+
 /**
  * @function
  *
@@ -3194,6 +3516,132 @@ nghttp2_session_get_hd_inflate_dynamic_table_size(nghttp2_session *session);
 NGHTTP2_EXTERN size_t
 nghttp2_session_get_hd_deflate_dynamic_table_size(nghttp2_session *session);
 
+/**
+ * @macro
+ *
+ * The number of elements of frame counters in
+ * :type:`nghttp2_session_stats`.  Frames whose type is greater than
+ * or equal to this value are counted in the last element.
+ */
+#define NGHTTP2_STATS_FRAME_TYPES 16
+
+/**
+ * @struct
+ *
+ * The counters of the work which :type:`nghttp2_session` has done.
+ * All counters start with 0 when session is created, and only
+ * increase.  Frames are counted as sent when the library has
+ * serialized them for the application to write, and as received when
+ * their frame header is read.
+ */
+typedef struct {
+  /**
+   * The number of frames sent, indexed by frame type.
+   */
+  uint64_t frames_sent[NGHTTP2_STATS_FRAME_TYPES];
+  /**
+   * The number of frames received, indexed by frame type.
+   */
+  uint64_t frames_recv[NGHTTP2_STATS_FRAME_TYPES];
+  /**
+   * The number of bytes of frames sent, including frame header.
+   */
+  uint64_t bytes_sent;
+  /**
+   * The number of bytes of frames received, including frame header.
+   */
+  uint64_t bytes_recv;
+  /**
+   * The number of bytes of DATA payload sent, including padding.
+   */
+  uint64_t data_bytes_sent;
+  /**
+   * The number of bytes of DATA payload received, including padding.
+   */
+  uint64_t data_bytes_recv;
+  /**
+   * The number of header fields sent as an index of name/value pair
+   * in the header table, that is, header table hits.
+   */
+  uint64_t hd_deflate_indexed;
+  /**
+   * The number of header fields sent as a literal with an index of
+   * name in the header table.
+   */
+  uint64_t hd_deflate_indexed_name;
+  /**
+   * The number of header fields sent as a literal with a literal
+   * name, that is, header table misses.
+   */
+  uint64_t hd_deflate_literal;
+  /**
+   * The sum of lengths of name and value of header fields sent.
+   */
+  uint64_t hd_deflate_nvlen;
+  /**
+   * The number of bytes of header blocks sent.  The bytes saved by
+   * header compression is :member:`hd_deflate_nvlen` minus this
+   * value.
+   */
+  uint64_t hd_deflate_blocklen;
+  /**
+   * The number of header fields received as an index of name/value
+   * pair in the header table.
+   */
+  uint64_t hd_inflate_indexed;
+  /**
+   * The number of header fields received as a literal with an index
+   * of name in the header table.
+   */
+  uint64_t hd_inflate_indexed_name;
+  /**
+   * The number of header fields received as a literal with a literal
+   * name.
+   */
+  uint64_t hd_inflate_literal;
+  /**
+   * The sum of lengths of name and value of header fields received.
+   */
+  uint64_t hd_inflate_nvlen;
+  /**
+   * The number of bytes of header blocks received.
+   */
+  uint64_t hd_inflate_blocklen;
+  /**
+   * The number of times a stream which has DATA to send is deferred
+   * because its flow control window is exhausted.
+   */
+  uint64_t data_deferred_flow_control;
+  /**
+   * The number of times a stream which has DATA to send is deferred
+   * because :type:`nghttp2_data_source_read_callback` returned
+   * :enum:`NGHTTP2_ERR_DEFERRED`.
+   */
+  uint64_t data_deferred_user;
+  /**
+   * The number of times the connection level flow control window of
+   * the remote endpoint is exhausted by DATA sent.
+   */
+  uint64_t connection_window_exhausted;
+  /**
+   * The number of memory allocations, including reallocations, the
+   * session has made.
+   */
+  uint64_t allocations;
+} nghttp2_session_stats;
+
+/**
+ * @function
+ *
+ * Returns the counters of the work which |session| has done.  The
+ * returned object is owned by |session|, and is valid until |session|
+ * is deleted.  Its contents are current until the next call of the
+ * functions which process |session|.  The counters are always
+ * maintained, and retrieving them is cheap.
+ */
+NGHTTP2_EXTERN const nghttp2_session_stats *
+nghttp2_session_get_stats(nghttp2_session *session);
+
 /**
  * @function
  *
@@ -3480,11 +3928,84 @@ nghttp2_session_change_stream_priority(nghttp2_session *session,
  *     stream (in other words, local endpoint has already opened
  *     stream ID greater than or equal to the given stream ID; or
  *     |stream_id| is 0
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     Dependency tree is disabled by
+ *     `nghttp2_option_set_no_rfc7540_priorities()`.
  */
 NGHTTP2_EXTERN int
 nghttp2_session_create_idle_stream(nghttp2_session *session, int32_t stream_id,
                                    const nghttp2_priority_spec *pri_spec);
 
+/**
+ * @struct
+ *
+ * :type:`nghttp2_extpri` is extensible priority specification (RFC
+ * 9218).  It is used by the flat scheduler enabled by
+ * `nghttp2_option_set_no_rfc7540_priorities()`.
+ */
+typedef struct nghttp2_extpri {
+  /**
+   * :member:`urgency` is the urgency of a stream, it must be in
+   * [:macro:`NGHTTP2_EXTPRI_URGENCY_HIGH`,
+   * :macro:`NGHTTP2_EXTPRI_URGENCY_LOW`], inclusive, and 0 is the
+   * highest urgency.
+   */
+  uint32_t urgency;
+  /**
+   * :member:`inc` indicates that a content can be processed
+   * incrementally or not.  If inc is 0, it cannot be processed
+   * incrementally.  If inc is 1, it can be processed incrementally.
+   * Other value is not permitted.
+   */
+  int inc;
+} nghttp2_extpri;
+
+/**
+ * @function
+ *
+ * Changes the extensible priority of the stream denoted by
+ * |stream_id| to |extpri|.  ``extpri->urgency`` larger than
+ * :macro:`NGHTTP2_EXTPRI_URGENCY_LOW` is treated as
+ * :macro:`NGHTTP2_EXTPRI_URGENCY_LOW`, and nonzero ``extpri->inc``
+ * is treated as 1.
+ *
+ * The priority is changed silently and instantly.  Nothing is sent
+ * to the peer.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     The flat scheduler is not enabled by
+ *     `nghttp2_option_set_no_rfc7540_priorities()`.
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     No stream exist for the given |stream_id|; or |stream_id| is 0
+ */
+NGHTTP2_EXTERN int
+nghttp2_session_change_extpri_stream_priority(nghttp2_session *session,
+                                              int32_t stream_id,
+                                              const nghttp2_extpri *extpri);
+
+/**
+ * @function
+ *
+ * Stores the extensible priority of the stream denoted by
+ * |stream_id| in the object pointed by |extpri|.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * :enum:`NGHTTP2_ERR_INVALID_STATE`
+ *     The flat scheduler is not enabled by
+ *     `nghttp2_option_set_no_rfc7540_priorities()`.
+ * :enum:`NGHTTP2_ERR_INVALID_ARGUMENT`
+ *     No stream exist for the given |stream_id|; or |stream_id| is 0
+ */
+NGHTTP2_EXTERN int
+nghttp2_session_get_extpri_stream_priority(nghttp2_session *session,
+                                           nghttp2_extpri *extpri,
+                                           int32_t stream_id);
+
 /**
  * @function
  *
@@ -4793,6 +5314,64 @@ NGHTTP2_EXTERN
 size_t
 nghttp2_hd_deflate_get_max_dynamic_table_size(nghttp2_hd_deflater *deflater);
 
+/**
+ * @struct
+ *
+ * The counters of the work which :type:`nghttp2_hd_deflater` or
+ * :type:`nghttp2_hd_inflater` has done.  All counters start with 0
+ * when the object is created, and only increase.
+ */
+typedef struct {
+  /**
+   * The number of header fields represented as an index of
+   * name/value pair in the header table.
+   */
+  uint64_t indexed;
+  /**
+   * The number of header fields represented as a literal with an
+   * index of name in the header table.
+   */
+  uint64_t indexed_name;
+  /**
+   * The number of header fields represented as a literal with a
+   * literal name.
+   */
+  uint64_t literal;
+  /**
+   * The sum of lengths of name and value of header fields.
+   */
+  uint64_t nvlen;
+  /**
+   * The number of bytes of header blocks.
+   */
+  uint64_t blocklen;
+  /**
+   * The number of string literals, that is literal names and values,
+   * in header blocks.
+   */
+  uint64_t strings;
+  /**
+   * The number of string literals which are Huffman encoded.
+   */
+  uint64_t huffman;
+  /**
+   * The number of entries evicted from the dynamic table to make room
+   * for new entries, or because the table size was reduced.
+   */
+  uint64_t evicted;
+} nghttp2_hd_stats;
+
+/**
+ * @function
+ *
+ * Returns the counters of the work which |deflater| has done.  The
+ * returned object is owned by |deflater|, and is valid until
+ * |deflater| is deleted.  Its contents are current until the next
+ * call of the functions which process |deflater|.
+ */
+NGHTTP2_EXTERN const nghttp2_hd_stats *
+nghttp2_hd_deflate_get_stats(nghttp2_hd_deflater *deflater);
+
 struct nghttp2_hd_inflater;
 
 /**
@@ -5118,6 +5697,17 @@ NGHTTP2_EXTERN
 size_t
 nghttp2_hd_inflate_get_max_dynamic_table_size(nghttp2_hd_inflater *inflater);
 
+/**
+ * @function
+ *
+ * Returns the counters of the work which |inflater| has done.  The
+ * returned object is owned by |inflater|, and is valid until
+ * |inflater| is deleted.  Its contents are current until the next
+ * call of the functions which process |inflater|.
+ */
+NGHTTP2_EXTERN const nghttp2_hd_stats *
+nghttp2_hd_inflate_get_stats(nghttp2_hd_inflater *inflater);
+
 struct nghttp2_stream;
 
 /**
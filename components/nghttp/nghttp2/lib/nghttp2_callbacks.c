@@ -68,6 +68,12 @@ void nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
   cbs->on_data_chunk_recv_callback = on_data_chunk_recv_callback;
 }
 
+void nghttp2_session_callbacks_set_on_data_chunk_recv_callback2(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_on_data_chunk_recv_callback2 on_data_chunk_recv_callback2) {
+  cbs->on_data_chunk_recv_callback2 = on_data_chunk_recv_callback2;
+}
+
 void nghttp2_session_callbacks_set_before_frame_send_callback(
     nghttp2_session_callbacks *cbs,
     nghttp2_before_frame_send_callback before_frame_send_callback) {
@@ -146,6 +152,12 @@ void nghttp2_session_callbacks_set_send_data_callback(
   cbs->send_data_callback = send_data_callback;
 }
 
+void nghttp2_session_callbacks_set_ref_data_callback(
+    nghttp2_session_callbacks *cbs,
+    nghttp2_ref_data_callback ref_data_callback) {
+  cbs->ref_data_callback = ref_data_callback;
+}
+
 void nghttp2_session_callbacks_set_pack_extension_callback(
     nghttp2_session_callbacks *cbs,
     nghttp2_pack_extension_callback pack_extension_callback) {
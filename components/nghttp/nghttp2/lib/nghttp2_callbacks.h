@@ -64,6 +64,7 @@ struct nghttp2_session_callbacks {
    * received.
    */
   nghttp2_on_data_chunk_recv_callback on_data_chunk_recv_callback;
+  nghttp2_on_data_chunk_recv_callback2 on_data_chunk_recv_callback2;
   /**
    * Callback function invoked before a non-DATA frame is sent.
    */
@@ -119,6 +120,7 @@ struct nghttp2_session_callbacks {
   nghttp2_unpack_extension_callback unpack_extension_callback;
   nghttp2_on_extension_chunk_recv_callback on_extension_chunk_recv_callback;
   nghttp2_error_callback error_callback;
+  nghttp2_ref_data_callback ref_data_callback;
 };
 
 #endif /* NGHTTP2_CALLBACKS_H */
@@ -41,72 +41,84 @@
         T, H                                                                   \
   }
 
-/* Generated by mkstatictbl.py */
+/* Generated by mkstatichdtbl.py */
 /* 3rd parameter is nghttp2_token value for header field name.  We use
    first enum value if same header names are repeated (e.g.,
    :status). */
 static nghttp2_hd_static_entry static_table[] = {
-    MAKE_STATIC_ENT(":authority", "", 0, 3153725150u),
-    MAKE_STATIC_ENT(":method", "GET", 1, 695666056u),
-    MAKE_STATIC_ENT(":method", "POST", 1, 695666056u),
-    MAKE_STATIC_ENT(":path", "/", 3, 3292848686u),
-    MAKE_STATIC_ENT(":path", "/index.html", 3, 3292848686u),
-    MAKE_STATIC_ENT(":scheme", "http", 5, 2510477674u),
-    MAKE_STATIC_ENT(":scheme", "https", 5, 2510477674u),
-    MAKE_STATIC_ENT(":status", "200", 7, 4000288983u),
-    MAKE_STATIC_ENT(":status", "204", 7, 4000288983u),
-    MAKE_STATIC_ENT(":status", "206", 7, 4000288983u),
-    MAKE_STATIC_ENT(":status", "304", 7, 4000288983u),
-    MAKE_STATIC_ENT(":status", "400", 7, 4000288983u),
-    MAKE_STATIC_ENT(":status", "404", 7, 4000288983u),
-    MAKE_STATIC_ENT(":status", "500", 7, 4000288983u),
-    MAKE_STATIC_ENT("accept-charset", "", 14, 3664010344u),
-    MAKE_STATIC_ENT("accept-encoding", "gzip, deflate", 15, 3379649177u),
-    MAKE_STATIC_ENT("accept-language", "", 16, 1979086614u),
-    MAKE_STATIC_ENT("accept-ranges", "", 17, 1713753958u),
-    MAKE_STATIC_ENT("accept", "", 18, 136609321u),
-    MAKE_STATIC_ENT("access-control-allow-origin", "", 19, 2710797292u),
-    MAKE_STATIC_ENT("age", "", 20, 742476188u),
-    MAKE_STATIC_ENT("allow", "", 21, 2930878514u),
-    MAKE_STATIC_ENT("authorization", "", 22, 2436257726u),
-    MAKE_STATIC_ENT("cache-control", "", 23, 1355326669u),
-    MAKE_STATIC_ENT("content-disposition", "", 24, 3889184348u),
-    MAKE_STATIC_ENT("content-encoding", "", 25, 65203592u),
-    MAKE_STATIC_ENT("content-language", "", 26, 24973587u),
-    MAKE_STATIC_ENT("content-length", "", 27, 1308181789u),
-    MAKE_STATIC_ENT("content-location", "", 28, 2302364718u),
-    MAKE_STATIC_ENT("content-range", "", 29, 3555523146u),
-    MAKE_STATIC_ENT("content-type", "", 30, 4244048277u),
-    MAKE_STATIC_ENT("cookie", "", 31, 2007449791u),
-    MAKE_STATIC_ENT("date", "", 32, 3564297305u),
-    MAKE_STATIC_ENT("etag", "", 33, 113792960u),
-    MAKE_STATIC_ENT("expect", "", 34, 2530896728u),
-    MAKE_STATIC_ENT("expires", "", 35, 1049544579u),
-    MAKE_STATIC_ENT("from", "", 36, 2513272949u),
-    MAKE_STATIC_ENT("host", "", 37, 2952701295u),
-    MAKE_STATIC_ENT("if-match", "", 38, 3597694698u),
-    MAKE_STATIC_ENT("if-modified-since", "", 39, 2213050793u),
-    MAKE_STATIC_ENT("if-none-match", "", 40, 2536202615u),
-    MAKE_STATIC_ENT("if-range", "", 41, 2340978238u),
-    MAKE_STATIC_ENT("if-unmodified-since", "", 42, 3794814858u),
-    MAKE_STATIC_ENT("last-modified", "", 43, 3226950251u),
-    MAKE_STATIC_ENT("link", "", 44, 232457833u),
-    MAKE_STATIC_ENT("location", "", 45, 200649126u),
-    MAKE_STATIC_ENT("max-forwards", "", 46, 1826162134u),
-    MAKE_STATIC_ENT("proxy-authenticate", "", 47, 2709445359u),
-    MAKE_STATIC_ENT("proxy-authorization", "", 48, 2686392507u),
-    MAKE_STATIC_ENT("range", "", 49, 4208725202u),
-    MAKE_STATIC_ENT("referer", "", 50, 3969579366u),
-    MAKE_STATIC_ENT("refresh", "", 51, 3572655668u),
-    MAKE_STATIC_ENT("retry-after", "", 52, 3336180598u),
-    MAKE_STATIC_ENT("server", "", 53, 1085029842u),
-    MAKE_STATIC_ENT("set-cookie", "", 54, 1848371000u),
-    MAKE_STATIC_ENT("strict-transport-security", "", 55, 4138147361u),
-    MAKE_STATIC_ENT("transfer-encoding", "", 56, 3719590988u),
-    MAKE_STATIC_ENT("user-agent", "", 57, 606444526u),
-    MAKE_STATIC_ENT("vary", "", 58, 1085005381u),
-    MAKE_STATIC_ENT("via", "", 59, 1762798611u),
-    MAKE_STATIC_ENT("www-authenticate", "", 60, 779865858u),
+    MAKE_STATIC_ENT(":authority", "", 0, 990776486u),
+    MAKE_STATIC_ENT(":method", "GET", 1, 699065498u),
+    MAKE_STATIC_ENT(":method", "POST", 1, 699065498u),
+    MAKE_STATIC_ENT(":path", "/", 3, 185272405u),
+    MAKE_STATIC_ENT(":path", "/index.html", 3, 185272405u),
+    MAKE_STATIC_ENT(":scheme", "http", 5, 4265862261u),
+    MAKE_STATIC_ENT(":scheme", "https", 5, 4265862261u),
+    MAKE_STATIC_ENT(":status", "200", 7, 691550801u),
+    MAKE_STATIC_ENT(":status", "204", 7, 691550801u),
+    MAKE_STATIC_ENT(":status", "206", 7, 691550801u),
+    MAKE_STATIC_ENT(":status", "304", 7, 691550801u),
+    MAKE_STATIC_ENT(":status", "400", 7, 691550801u),
+    MAKE_STATIC_ENT(":status", "404", 7, 691550801u),
+    MAKE_STATIC_ENT(":status", "500", 7, 691550801u),
+    MAKE_STATIC_ENT("accept-charset", "", 14, 3407940578u),
+    MAKE_STATIC_ENT("accept-encoding", "gzip, deflate", 15, 2562835789u),
+    MAKE_STATIC_ENT("accept-language", "", 16, 2855290832u),
+    MAKE_STATIC_ENT("accept-ranges", "", 17, 3009711835u),
+    MAKE_STATIC_ENT("accept", "", 18, 4089074468u),
+    MAKE_STATIC_ENT("access-control-allow-origin", "", 19, 2673184362u),
+    MAKE_STATIC_ENT("age", "", 20, 1128409682u),
+    MAKE_STATIC_ENT("allow", "", 21, 3027880756u),
+    MAKE_STATIC_ENT("authorization", "", 22, 2112058208u),
+    MAKE_STATIC_ENT("cache-control", "", 23, 2150785941u),
+    MAKE_STATIC_ENT("content-disposition", "", 24, 1353054612u),
+    MAKE_STATIC_ENT("content-encoding", "", 25, 2361859114u),
+    MAKE_STATIC_ENT("content-language", "", 26, 511619388u),
+    MAKE_STATIC_ENT("content-length", "", 27, 2755628972u),
+    MAKE_STATIC_ENT("content-location", "", 28, 2878867842u),
+    MAKE_STATIC_ENT("content-range", "", 29, 2209209494u),
+    MAKE_STATIC_ENT("content-type", "", 30, 2543967094u),
+    MAKE_STATIC_ENT("cookie", "", 31, 4198255204u),
+    MAKE_STATIC_ENT("date", "", 32, 2620198702u),
+    MAKE_STATIC_ENT("etag", "", 33, 2990646879u),
+    MAKE_STATIC_ENT("expect", "", 34, 2938012416u),
+    MAKE_STATIC_ENT("expires", "", 35, 824442864u),
+    MAKE_STATIC_ENT("from", "", 36, 2555365936u),
+    MAKE_STATIC_ENT("host", "", 37, 1257036073u),
+    MAKE_STATIC_ENT("if-match", "", 38, 3336578245u),
+    MAKE_STATIC_ENT("if-modified-since", "", 39, 2479155767u),
+    MAKE_STATIC_ENT("if-none-match", "", 40, 593443111u),
+    MAKE_STATIC_ENT("if-range", "", 41, 2346268125u),
+    MAKE_STATIC_ENT("if-unmodified-since", "", 42, 315527982u),
+    MAKE_STATIC_ENT("last-modified", "", 43, 497016522u),
+    MAKE_STATIC_ENT("link", "", 44, 1092976970u),
+    MAKE_STATIC_ENT("location", "", 45, 1221207728u),
+    MAKE_STATIC_ENT("max-forwards", "", 46, 149290193u),
+    MAKE_STATIC_ENT("proxy-authenticate", "", 47, 3247945479u),
+    MAKE_STATIC_ENT("proxy-authorization", "", 48, 557789330u),
+    MAKE_STATIC_ENT("range", "", 49, 841866417u),
+    MAKE_STATIC_ENT("referer", "", 50, 4007456746u),
+    MAKE_STATIC_ENT("refresh", "", 51, 3851201643u),
+    MAKE_STATIC_ENT("retry-after", "", 52, 1452299603u),
+    MAKE_STATIC_ENT("server", "", 53, 1085158917u),
+    MAKE_STATIC_ENT("set-cookie", "", 54, 3745199899u),
+    MAKE_STATIC_ENT("strict-transport-security", "", 55, 1524319016u),
+    MAKE_STATIC_ENT("transfer-encoding", "", 56, 4137215059u),
+    MAKE_STATIC_ENT("user-agent", "", 57, 3390647739u),
+    MAKE_STATIC_ENT("vary", "", 58, 3656766092u),
+    MAKE_STATIC_ENT("via", "", 59, 3190453953u),
+    MAKE_STATIC_ENT("www-authenticate", "", 60, 250579714u),
+};
+
+/* Generated by mkstatichdtbl.py.  Perfect hash table which maps
+   token and value to 1-based static table index, or 0.  Only entries
+   with non-empty value are included, since entries with empty value
+   are the only ones for their names. */
+#define STATIC_NV_HASH_BITS 5
+#define STATIC_NV_HASH_MUL 2588382471u
+
+static const uint8_t static_nv_hash_table[] = {
+    0, 6, 0, 0, 4, 0, 0, 2, 9, 0, 0, 3, 12, 7, 10, 0, 0, 11, 0, 0, 16, 14, 5,
+    0, 0, 0, 13, 8, 0, 0, 0, 0,
 };
 
 static int memeq(const void *s1, const void *s2, size_t n) {
@@ -499,16 +511,44 @@ static int value_eq(const nghttp2_hd_nv *a, const nghttp2_nv *b) {
          memeq(a->value->base, b->value, b->valuelen);
 }
 
+/*
+ * Returns the hash of nv->name.  The name is processed 4 bytes at a
+ * time, which are taken in little endian regardless of the host byte
+ * order, so that the result matches the precomputed values in
+ * static_table.  mkstatichdtbl.py has the same function.
+ */
 static uint32_t name_hash(const nghttp2_nv *nv) {
-  /* 32 bit FNV-1a: http://isthe.com/chongo/tech/comp/fnv/ */
-  uint32_t h = 2166136261u;
-  size_t i;
+  const uint8_t *p = nv->name, *end = nv->name + nv->namelen;
+  uint32_t h = (uint32_t)nv->namelen;
+  uint32_t w;
 
-  for (i = 0; i < nv->namelen; ++i) {
-    h ^= nv->name[i];
-    h += (h << 1) + (h << 4) + (h << 7) + (h << 8) + (h << 24);
+  for (; end - p >= 4; p += 4) {
+    w = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+        (uint32_t)p[3] << 24;
+    h = ((h << 5 | h >> 27) ^ w) * 0x27220a95u;
   }
 
+  if (p != end) {
+    w = 0;
+    switch (end - p) {
+    case 3:
+      w |= (uint32_t)p[2] << 16;
+    /* fall through */
+    case 2:
+      w |= (uint32_t)p[1] << 8;
+    /* fall through */
+    case 1:
+      w |= p[0];
+    }
+    h = ((h << 5 | h >> 27) ^ w) * 0x27220a95u;
+  }
+
+  /* Bucket is chosen by lower bits, which the multiplications above
+     do not mix well. */
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+
   return h;
 }
 
@@ -670,6 +710,7 @@ static int hd_context_init(nghttp2_hd_context *context, nghttp2_mem *mem) {
   }
 
   context->hd_table_bufsize = 0;
+  context->evicted = 0;
   context->next_seq = 0;
 
   return 0;
@@ -695,6 +736,8 @@ int nghttp2_hd_deflate_init2(nghttp2_hd_deflater *deflater,
 
   hd_map_init(&deflater->map);
 
+  memset(&deflater->stats, 0, sizeof(deflater->stats));
+
   if (max_deflate_dynamic_table_size < NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE) {
     deflater->notify_table_size_change = 1;
     deflater->ctx.hd_table_bufsize_max = max_deflate_dynamic_table_size;
@@ -716,6 +759,8 @@ int nghttp2_hd_inflate_init(nghttp2_hd_inflater *inflater, nghttp2_mem *mem) {
     goto fail;
   }
 
+  memset(&inflater->stats, 0, sizeof(inflater->stats));
+
   inflater->settings_hd_table_bufsize_max = NGHTTP2_HD_DEFAULT_MAX_BUFFER_SIZE;
   inflater->min_hd_table_bufsize_max = UINT32_MAX;
 
@@ -731,6 +776,8 @@ int nghttp2_hd_inflate_init(nghttp2_hd_inflater *inflater, nghttp2_mem *mem) {
   inflater->namercbuf = NULL;
   inflater->valuercbuf = NULL;
 
+  inflater->rcbuf_mem = mem;
+
   inflater->huffman_encoded = 0;
   inflater->index = 0;
   inflater->left = 0;
@@ -738,6 +785,18 @@ int nghttp2_hd_inflate_init(nghttp2_hd_inflater *inflater, nghttp2_mem *mem) {
   inflater->index_required = 0;
   inflater->no_index = 0;
 
+  nghttp2_buf_init(&inflater->arena);
+
+  memset(&inflater->name_view, 0, sizeof(inflater->name_view));
+  memset(&inflater->value_view, 0, sizeof(inflater->value_view));
+
+  inflater->name_view.ref = -1;
+  inflater->value_view.ref = -1;
+
+  inflater->borrow = 0;
+  inflater->name_borrowed = 0;
+  inflater->name_in_arena = 0;
+
   return 0;
 
 fail:
@@ -762,6 +821,8 @@ void nghttp2_hd_inflate_free(nghttp2_hd_inflater *inflater) {
   nghttp2_rcbuf_decref(inflater->valuercbuf);
   nghttp2_rcbuf_decref(inflater->namercbuf);
 
+  nghttp2_buf_free(&inflater->arena, inflater->ctx.mem);
+
   hd_context_free(&inflater->ctx);
 }
 
@@ -770,8 +831,8 @@ static size_t entry_room(size_t namelen, size_t valuelen) {
 }
 
 static void emit_header(nghttp2_hd_nv *nv_out, nghttp2_hd_nv *nv) {
-  DEBUGF("inflatehd: header emission: %s: %s\n", nv->name->base,
-         nv->value->base);
+  DEBUGF("inflatehd: header emission: %.*s: %.*s\n", (int)nv->name->len,
+         nv->name->base, (int)nv->value->len, nv->value->base);
   /* ent->ref may be 0. This happens if the encoder emits literal
      block larger than header table capacity with indexing. */
   *nv_out = *nv;
@@ -954,7 +1015,8 @@ static int emit_indexed_block(nghttp2_bufs *bufs, size_t idx) {
   return 0;
 }
 
-static int emit_string(nghttp2_bufs *bufs, const uint8_t *str, size_t len) {
+static int emit_string(nghttp2_hd_stats *stats, nghttp2_bufs *bufs,
+                       const uint8_t *str, size_t len) {
   int rv;
   uint8_t sb[16];
   uint8_t *bufp;
@@ -966,10 +1028,13 @@ static int emit_string(nghttp2_bufs *bufs, const uint8_t *str, size_t len) {
 
   if (enclen < len) {
     huffman = 1;
+    ++stats->huffman;
   } else {
     enclen = len;
   }
 
+  ++stats->strings;
+
   blocklen = count_encoded_length(enclen, 7);
 
   DEBUGF("deflatehd: emit string str=%.*s, length=%zu, huffman=%d, "
@@ -1015,8 +1080,9 @@ static uint8_t pack_first_byte(int indexing_mode) {
   return 0;
 }
 
-static int emit_indname_block(nghttp2_bufs *bufs, size_t idx,
-                              const nghttp2_nv *nv, int indexing_mode) {
+static int emit_indname_block(nghttp2_hd_stats *stats, nghttp2_bufs *bufs,
+                              size_t idx, const nghttp2_nv *nv,
+                              int indexing_mode) {
   int rv;
   uint8_t *bufp;
   size_t blocklen;
@@ -1049,7 +1115,7 @@ static int emit_indname_block(nghttp2_bufs *bufs, size_t idx,
     return rv;
   }
 
-  rv = emit_string(bufs, nv->value, nv->valuelen);
+  rv = emit_string(stats, bufs, nv->value, nv->valuelen);
   if (rv != 0) {
     return rv;
   }
@@ -1057,8 +1123,8 @@ static int emit_indname_block(nghttp2_bufs *bufs, size_t idx,
   return 0;
 }
 
-static int emit_newname_block(nghttp2_bufs *bufs, const nghttp2_nv *nv,
-                              int indexing_mode) {
+static int emit_newname_block(nghttp2_hd_stats *stats, nghttp2_bufs *bufs,
+                              const nghttp2_nv *nv, int indexing_mode) {
   int rv;
 
   DEBUGF(
@@ -1070,12 +1136,12 @@ static int emit_newname_block(nghttp2_bufs *bufs, const nghttp2_nv *nv,
     return rv;
   }
 
-  rv = emit_string(bufs, nv->name, nv->namelen);
+  rv = emit_string(stats, bufs, nv->name, nv->namelen);
   if (rv != 0) {
     return rv;
   }
 
-  rv = emit_string(bufs, nv->value, nv->valuelen);
+  rv = emit_string(stats, bufs, nv->value, nv->valuelen);
   if (rv != 0) {
     return rv;
   }
@@ -1110,6 +1176,7 @@ static int add_hd_table_incremental(nghttp2_hd_context *context,
     if (map) {
       hd_map_remove(map, ent);
     }
+    ++context->evicted;
 
     nghttp2_hd_entry_free(ent);
     nghttp2_mem_free(mem, ent);
@@ -1158,24 +1225,38 @@ typedef struct {
 static search_result search_static_table(const nghttp2_nv *nv, int32_t token,
                                          int name_only) {
   search_result res = {token, 0};
-  int i;
   nghttp2_hd_static_entry *ent;
+  uint32_t key;
+  size_t idx;
 
   if (name_only) {
     return res;
   }
 
-  for (i = token;
-       i <= NGHTTP2_TOKEN_WWW_AUTHENTICATE && static_table[i].token == token;
-       ++i) {
-    ent = &static_table[i];
-    if (ent->value.len == nv->valuelen &&
-        memcmp(ent->value.base, nv->value, nv->valuelen) == 0) {
-      res.index = i;
+  if (nv->valuelen == 0) {
+    if (static_table[token].value.len == 0) {
       res.name_value_match = 1;
-      return res;
     }
+    return res;
+  }
+
+  key = (uint32_t)token << 24 ^ (uint32_t)nv->valuelen << 16 ^
+        (uint32_t)nv->value[0] << 8 ^ nv->value[nv->valuelen - 1];
+
+  idx = static_nv_hash_table[(key * STATIC_NV_HASH_MUL) >>
+                             (32 - STATIC_NV_HASH_BITS)];
+  if (idx == 0) {
+    return res;
+  }
+
+  ent = &static_table[idx - 1];
+
+  if (ent->token == token && ent->value.len == nv->valuelen &&
+      memeq(ent->value.base, nv->value, nv->valuelen)) {
+    res.index = (ssize_t)(idx - 1);
+    res.name_value_match = 1;
   }
+
   return res;
 }
 
@@ -1222,6 +1303,7 @@ static void hd_context_shrink_table_size(nghttp2_hd_context *context,
     if (map) {
       hd_map_remove(map, ent);
     }
+    ++context->evicted;
 
     nghttp2_hd_entry_free(ent);
     nghttp2_mem_free(mem, ent);
@@ -1361,6 +1443,8 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
 
   idx = res.index;
 
+  deflater->stats.nvlen += nv->namelen + nv->valuelen;
+
   if (res.name_value_match) {
 
     DEBUGF("deflatehd: name/value match index=%zd\n", idx);
@@ -1370,6 +1454,8 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
       return rv;
     }
 
+    ++deflater->stats.indexed;
+
     return 0;
   }
 
@@ -1410,9 +1496,12 @@ static int deflate_nv(nghttp2_hd_deflater *deflater, nghttp2_bufs *bufs,
     }
   }
   if (idx == -1) {
-    rv = emit_newname_block(bufs, nv, indexing_mode);
+    rv = emit_newname_block(&deflater->stats, bufs, nv, indexing_mode);
+    ++deflater->stats.literal;
   } else {
-    rv = emit_indname_block(bufs, (size_t)idx, nv, indexing_mode);
+    rv = emit_indname_block(&deflater->stats, bufs, (size_t)idx, nv,
+                            indexing_mode);
+    ++deflater->stats.indexed_name;
   }
   if (rv != 0) {
     return rv;
@@ -1426,11 +1515,14 @@ int nghttp2_hd_deflate_hd_bufs(nghttp2_hd_deflater *deflater,
                                size_t nvlen) {
   size_t i;
   int rv = 0;
+  size_t buflen;
 
   if (deflater->ctx.bad) {
     return NGHTTP2_ERR_HEADER_COMP;
   }
 
+  buflen = nghttp2_bufs_len(bufs);
+
   if (deflater->notify_table_size_change) {
     size_t min_hd_table_bufsize_max;
 
@@ -1464,6 +1556,8 @@ int nghttp2_hd_deflate_hd_bufs(nghttp2_hd_deflater *deflater,
 
   DEBUGF("deflatehd: all input name/value pairs were deflated\n");
 
+  deflater->stats.blocklen += nghttp2_bufs_len(bufs) - buflen;
+
   return 0;
 fail:
   DEBUGF("deflatehd: error return %d\n", rv);
@@ -1612,6 +1706,9 @@ void nghttp2_hd_deflate_del(nghttp2_hd_deflater *deflater) {
 static void hd_inflate_set_huffman_encoded(nghttp2_hd_inflater *inflater,
                                            const uint8_t *in) {
   inflater->huffman_encoded = (*in & (1 << 7)) != 0;
+
+  ++inflater->stats.strings;
+  inflater->stats.huffman += inflater->huffman_encoded;
 }
 
 /*
@@ -1812,6 +1909,183 @@ static int hd_inflate_commit_indname(nghttp2_hd_inflater *inflater,
   return 0;
 }
 
+/*
+ * Returns nonzero if the current header field can be emitted without
+ * nghttp2_rcbuf allocation.  Header field which is added to header
+ * table must outlive header block, so it is not eligible.
+ */
+static int hd_inflate_borrowable(nghttp2_hd_inflater *inflater) {
+  return inflater->borrow && !inflater->index_required;
+}
+
+static void hd_inflate_set_view(nghttp2_rcbuf *view, const uint8_t *base,
+                                size_t len) {
+  view->base = (uint8_t *)base;
+  view->len = len;
+}
+
+/*
+ * Allocates nghttp2_rcbuf of |size| bytes using inflater->ctx.mem,
+ * and makes it freed by inflater->rcbuf_mem.
+ */
+static int hd_inflate_rcbuf_new(nghttp2_hd_inflater *inflater,
+                                nghttp2_rcbuf **rcbuf_ptr, size_t size) {
+  int rv;
+
+  rv = nghttp2_rcbuf_new(rcbuf_ptr, size, inflater->ctx.mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  (*rcbuf_ptr)->free = inflater->rcbuf_mem->free;
+  (*rcbuf_ptr)->mem_user_data = inflater->rcbuf_mem->mem_user_data;
+
+  return 0;
+}
+
+/*
+ * Makes sure that arena has at least |n| bytes available after the
+ * data already stored, and initializes |buf| to refer to them.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory
+ */
+static int hd_inflate_arena_wrap(nghttp2_hd_inflater *inflater,
+                                 nghttp2_buf *buf, size_t n) {
+  int rv;
+
+  rv = nghttp2_buf_reserve(&inflater->arena,
+                           nghttp2_buf_len(&inflater->arena) + n,
+                           inflater->ctx.mem);
+  if (rv != 0) {
+    return rv;
+  }
+
+  /* arena might be reallocated.  Name is always stored at the
+     beginning of arena. */
+  if (inflater->name_in_arena) {
+    inflater->name_view.base = inflater->arena.pos;
+  }
+
+  nghttp2_buf_wrap_init(buf, inflater->arena.last, n);
+
+  return 0;
+}
+
+/*
+ * Copies name which refers to input into arena, so that it survives
+ * when input ends before the header field is completed.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory
+ */
+static int hd_inflate_stash_name(nghttp2_hd_inflater *inflater) {
+  int rv;
+
+  rv = hd_inflate_arena_wrap(inflater, &inflater->namebuf,
+                             inflater->name_view.len + 1);
+  if (rv != 0) {
+    return rv;
+  }
+
+  inflater->namebuf.last =
+      nghttp2_cpymem(inflater->namebuf.last, inflater->name_view.base,
+                     inflater->name_view.len);
+  *inflater->namebuf.last = '\0';
+
+  inflater->name_view.base = inflater->namebuf.pos;
+  inflater->arena.last = inflater->namebuf.last + 1;
+
+  inflater->name_borrowed = 0;
+  inflater->name_in_arena = 1;
+
+  return 0;
+}
+
+/*
+ * Finishes reading name into inflater->namebuf.
+ */
+static void hd_inflate_finish_name(nghttp2_hd_inflater *inflater) {
+  *inflater->namebuf.last = '\0';
+
+  if (inflater->namercbuf) {
+    inflater->namercbuf->len = nghttp2_buf_len(&inflater->namebuf);
+    return;
+  }
+
+  hd_inflate_set_view(&inflater->name_view, inflater->namebuf.pos,
+                      nghttp2_buf_len(&inflater->namebuf));
+  inflater->arena.last = inflater->namebuf.last + 1;
+}
+
+/*
+ * Finishes reading value into inflater->valuebuf.
+ */
+static void hd_inflate_finish_value(nghttp2_hd_inflater *inflater) {
+  *inflater->valuebuf.last = '\0';
+
+  if (inflater->valuercbuf) {
+    inflater->valuercbuf->len = nghttp2_buf_len(&inflater->valuebuf);
+    return;
+  }
+
+  hd_inflate_set_view(&inflater->value_view, inflater->valuebuf.pos,
+                      nghttp2_buf_len(&inflater->valuebuf));
+  inflater->arena.last = inflater->valuebuf.last + 1;
+}
+
+/*
+ * Finalize literal header representation which is not added to
+ * header table, and whose value is in inflater->value_view.  Header
+ * is always emitted, and |*nv_out| is filled with that value.
+ */
+static void hd_inflate_commit_view(nghttp2_hd_inflater *inflater,
+                                   nghttp2_hd_nv *nv_out) {
+  nghttp2_hd_nv nv;
+
+  if (inflater->opcode == NGHTTP2_HD_OPCODE_NEWNAME) {
+    nv.name = &inflater->name_view;
+    nv.token = lookup_token(nv.name->base, nv.name->len);
+  } else {
+    /* Header table is not altered until next call, so we don't have
+       to keep reference to name. */
+    nv = nghttp2_hd_table_get(&inflater->ctx, inflater->index);
+  }
+
+  if (inflater->no_index) {
+    nv.flags = NGHTTP2_NV_FLAG_NO_INDEX;
+  } else {
+    nv.flags = NGHTTP2_NV_FLAG_NONE;
+  }
+
+  nv.value = &inflater->value_view;
+
+  emit_header(nv_out, &nv);
+}
+
+/*
+ * Finalize literal header representation after its value is read.
+ */
+static int hd_inflate_commit_value(nghttp2_hd_inflater *inflater,
+                                   nghttp2_hd_nv *nv_out) {
+  if (inflater->valuercbuf == NULL) {
+    hd_inflate_commit_view(inflater, nv_out);
+    return 0;
+  }
+
+  if (inflater->opcode == NGHTTP2_HD_OPCODE_NEWNAME) {
+    return hd_inflate_commit_newname(inflater, nv_out);
+  }
+
+  return hd_inflate_commit_indname(inflater, nv_out);
+}
+
 ssize_t nghttp2_hd_inflate_hd(nghttp2_hd_inflater *inflater, nghttp2_nv *nv_out,
                               int *inflate_flags, uint8_t *in, size_t inlen,
                               int in_final) {
@@ -1845,18 +2119,15 @@ ssize_t nghttp2_hd_inflate_hd2(nghttp2_hd_inflater *inflater,
   return rv;
 }
 
-ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
-                                 nghttp2_hd_nv *nv_out, int *inflate_flags,
-                                 const uint8_t *in, size_t inlen,
-                                 int in_final) {
+static ssize_t hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
+                                nghttp2_hd_nv *nv_out, int *inflate_flags,
+                                const uint8_t *in, size_t inlen, int in_final) {
   ssize_t rv = 0;
   const uint8_t *first = in;
   const uint8_t *last = in + inlen;
   int rfin = 0;
   int busy = 0;
-  nghttp2_mem *mem;
-
-  mem = inflater->ctx.mem;
+  size_t buflen;
 
   if (inflater->ctx.bad) {
     return NGHTTP2_ERR_HEADER_COMP;
@@ -1913,6 +2184,11 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
       }
       inflater->left = 0;
       inflater->shift = 0;
+
+      nghttp2_buf_reset(&inflater->arena);
+      inflater->name_borrowed = 0;
+      inflater->name_in_arena = 0;
+
       break;
     case NGHTTP2_HD_STATE_READ_TABLE_SIZE:
       rfin = 0;
@@ -2006,13 +2282,39 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
 
         inflater->state = NGHTTP2_HD_STATE_NEWNAME_READ_NAMEHUFF;
 
-        rv = nghttp2_rcbuf_new(&inflater->namercbuf, inflater->left * 2 + 1,
-                               mem);
+        buflen = inflater->left * 2 + 1;
       } else {
         inflater->state = NGHTTP2_HD_STATE_NEWNAME_READ_NAME;
-        rv = nghttp2_rcbuf_new(&inflater->namercbuf, inflater->left + 1, mem);
+
+        buflen = inflater->left + 1;
       }
 
+      if (hd_inflate_borrowable(inflater)) {
+        if (!inflater->huffman_encoded &&
+            (size_t)(last - in) >= inflater->left) {
+          /* Whole name is in input; just refer to it */
+          hd_inflate_set_view(&inflater->name_view, in, inflater->left);
+          inflater->name_borrowed = 1;
+
+          in += inflater->left;
+          inflater->left = 0;
+
+          inflater->state = NGHTTP2_HD_STATE_CHECK_VALUELEN;
+
+          break;
+        }
+
+        rv = hd_inflate_arena_wrap(inflater, &inflater->namebuf, buflen);
+        if (rv != 0) {
+          goto fail;
+        }
+
+        inflater->name_in_arena = 1;
+
+        break;
+      }
+
+      rv = hd_inflate_rcbuf_new(inflater, &inflater->namercbuf, buflen);
       if (rv != 0) {
         goto fail;
       }
@@ -2037,8 +2339,7 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
         goto almost_ok;
       }
 
-      *inflater->namebuf.last = '\0';
-      inflater->namercbuf->len = nghttp2_buf_len(&inflater->namebuf);
+      hd_inflate_finish_name(inflater);
 
       inflater->state = NGHTTP2_HD_STATE_CHECK_VALUELEN;
 
@@ -2058,8 +2359,7 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
         goto almost_ok;
       }
 
-      *inflater->namebuf.last = '\0';
-      inflater->namercbuf->len = nghttp2_buf_len(&inflater->namebuf);
+      hd_inflate_finish_name(inflater);
 
       inflater->state = NGHTTP2_HD_STATE_CHECK_VALUELEN;
 
@@ -2091,14 +2391,48 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
 
         inflater->state = NGHTTP2_HD_STATE_READ_VALUEHUFF;
 
-        rv = nghttp2_rcbuf_new(&inflater->valuercbuf, inflater->left * 2 + 1,
-                               mem);
+        buflen = inflater->left * 2 + 1;
       } else {
         inflater->state = NGHTTP2_HD_STATE_READ_VALUE;
 
-        rv = nghttp2_rcbuf_new(&inflater->valuercbuf, inflater->left + 1, mem);
+        buflen = inflater->left + 1;
       }
 
+      if (hd_inflate_borrowable(inflater)) {
+        if (!inflater->huffman_encoded &&
+            (size_t)(last - in) >= inflater->left) {
+          /* Whole value is in input; just refer to it */
+          hd_inflate_set_view(&inflater->value_view, in, inflater->left);
+
+          in += inflater->left;
+          inflater->left = 0;
+
+          hd_inflate_commit_view(inflater, nv_out);
+
+          inflater->state = NGHTTP2_HD_STATE_OPCODE;
+          *inflate_flags |= NGHTTP2_HD_INFLATE_EMIT;
+
+          return (ssize_t)(in - first);
+        }
+
+        if (inflater->name_borrowed) {
+          rv = hd_inflate_stash_name(inflater);
+          if (rv != 0) {
+            goto fail;
+          }
+        }
+
+        rv = hd_inflate_arena_wrap(inflater, &inflater->valuebuf, buflen);
+        if (rv != 0) {
+          goto fail;
+        }
+
+        busy = 1;
+
+        break;
+      }
+
+      rv = hd_inflate_rcbuf_new(inflater, &inflater->valuercbuf, buflen);
       if (rv != 0) {
         goto fail;
       }
@@ -2125,14 +2459,9 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
         goto almost_ok;
       }
 
-      *inflater->valuebuf.last = '\0';
-      inflater->valuercbuf->len = nghttp2_buf_len(&inflater->valuebuf);
+      hd_inflate_finish_value(inflater);
 
-      if (inflater->opcode == NGHTTP2_HD_OPCODE_NEWNAME) {
-        rv = hd_inflate_commit_newname(inflater, nv_out);
-      } else {
-        rv = hd_inflate_commit_indname(inflater, nv_out);
-      }
+      rv = hd_inflate_commit_value(inflater, nv_out);
 
       if (rv != 0) {
         goto fail;
@@ -2159,14 +2488,9 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
         goto almost_ok;
       }
 
-      *inflater->valuebuf.last = '\0';
-      inflater->valuercbuf->len = nghttp2_buf_len(&inflater->valuebuf);
+      hd_inflate_finish_value(inflater);
 
-      if (inflater->opcode == NGHTTP2_HD_OPCODE_NEWNAME) {
-        rv = hd_inflate_commit_newname(inflater, nv_out);
-      } else {
-        rv = hd_inflate_commit_indname(inflater, nv_out);
-      }
+      rv = hd_inflate_commit_value(inflater, nv_out);
 
       if (rv != 0) {
         goto fail;
@@ -2183,6 +2507,14 @@ ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
 
   DEBUGF("inflatehd: all input bytes were processed\n");
 
+  /* Input is not available in the next call */
+  if (inflater->name_borrowed) {
+    rv = hd_inflate_stash_name(inflater);
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
   if (in_final) {
     DEBUGF("inflatehd: in_final set\n");
 
@@ -2205,6 +2537,14 @@ almost_ok:
 
     goto fail;
   }
+
+  if (inflater->name_borrowed) {
+    rv = hd_inflate_stash_name(inflater);
+    if (rv != 0) {
+      goto fail;
+    }
+  }
+
   return (ssize_t)(in - first);
 
 fail:
@@ -2214,9 +2554,49 @@ fail:
   return rv;
 }
 
+ssize_t nghttp2_hd_inflate_hd_nv(nghttp2_hd_inflater *inflater,
+                                 nghttp2_hd_nv *nv_out, int *inflate_flags,
+                                 const uint8_t *in, size_t inlen,
+                                 int in_final) {
+  ssize_t rv;
+
+  rv = hd_inflate_hd_nv(inflater, nv_out, inflate_flags, in, inlen, in_final);
+  if (rv < 0) {
+    return rv;
+  }
+
+  inflater->stats.blocklen += (size_t)rv;
+
+  if (!(*inflate_flags & NGHTTP2_HD_INFLATE_EMIT)) {
+    return rv;
+  }
+
+  switch (inflater->opcode) {
+  case NGHTTP2_HD_OPCODE_INDEXED:
+    ++inflater->stats.indexed;
+    break;
+  case NGHTTP2_HD_OPCODE_INDNAME:
+    ++inflater->stats.indexed_name;
+    break;
+  default:
+    ++inflater->stats.literal;
+    break;
+  }
+
+  inflater->stats.nvlen += nv_out->name->len + nv_out->value->len;
+
+  return rv;
+}
+
 int nghttp2_hd_inflate_end_headers(nghttp2_hd_inflater *inflater) {
   hd_inflate_keep_free(inflater);
   inflater->state = NGHTTP2_HD_STATE_INFLATE_START;
+
+  if (nghttp2_buf_cap(&inflater->arena) > NGHTTP2_HD_MAX_INFLATE_ARENA_KEEP) {
+    nghttp2_buf_free(&inflater->arena, inflater->ctx.mem);
+    nghttp2_buf_init(&inflater->arena);
+  }
+
   return 0;
 }
 
@@ -2263,13 +2643,20 @@ void nghttp2_hd_inflate_del(nghttp2_hd_inflater *inflater) {
 
 int nghttp2_hd_emit_indname_block(nghttp2_bufs *bufs, size_t idx,
                                   nghttp2_nv *nv, int indexing_mode) {
+  nghttp2_hd_stats stats;
+
+  memset(&stats, 0, sizeof(stats));
 
-  return emit_indname_block(bufs, idx, nv, indexing_mode);
+  return emit_indname_block(&stats, bufs, idx, nv, indexing_mode);
 }
 
 int nghttp2_hd_emit_newname_block(nghttp2_bufs *bufs, nghttp2_nv *nv,
                                   int indexing_mode) {
-  return emit_newname_block(bufs, nv, indexing_mode);
+  nghttp2_hd_stats stats;
+
+  memset(&stats, 0, sizeof(stats));
+
+  return emit_newname_block(&stats, bufs, nv, indexing_mode);
 }
 
 int nghttp2_hd_emit_table_size(nghttp2_bufs *bufs, size_t table_size) {
@@ -2316,6 +2703,13 @@ nghttp2_hd_deflate_get_max_dynamic_table_size(nghttp2_hd_deflater *deflater) {
   return deflater->ctx.hd_table_bufsize_max;
 }
 
+const nghttp2_hd_stats *
+nghttp2_hd_deflate_get_stats(nghttp2_hd_deflater *deflater) {
+  deflater->stats.evicted = deflater->ctx.evicted;
+
+  return &deflater->stats;
+}
+
 size_t nghttp2_hd_inflate_get_num_table_entries(nghttp2_hd_inflater *inflater) {
   return get_max_index(&inflater->ctx);
 }
@@ -2334,3 +2728,10 @@ size_t
 nghttp2_hd_inflate_get_max_dynamic_table_size(nghttp2_hd_inflater *inflater) {
   return inflater->ctx.hd_table_bufsize_max;
 }
+
+const nghttp2_hd_stats *
+nghttp2_hd_inflate_get_stats(nghttp2_hd_inflater *inflater) {
+  inflater->stats.evicted = inflater->ctx.evicted;
+
+  return &inflater->stats;
+}
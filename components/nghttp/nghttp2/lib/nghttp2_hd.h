@@ -49,6 +49,11 @@
    encoder only uses the memory up to this value. */
 #define NGHTTP2_HD_DEFAULT_MAX_DEFLATE_BUFFER_SIZE (1 << 12)
 
+/* The maximum capacity of decoder arena which is kept after header
+   block ends.  Larger arena is freed so that a single large header
+   field does not pin memory for the lifetime of the decoder. */
+#define NGHTTP2_HD_MAX_INFLATE_ARENA_KEEP (1 << 12)
+
 /* Exported for unit test */
 #define NGHTTP2_STATIC_TABLE_LENGTH 61
 
@@ -201,6 +206,8 @@ typedef struct {
   size_t hd_table_bufsize;
   /* The effective header table size. */
   size_t hd_table_bufsize_max;
+  /* The number of entries evicted from hd_table */
+  uint64_t evicted;
   /* Next sequence number for nghttp2_hd_entry */
   uint32_t next_seq;
   /* If inflate/deflate error occurred, this value is set to 1 and
@@ -209,13 +216,22 @@ typedef struct {
   uint8_t bad;
 } nghttp2_hd_context;
 
-#define HD_MAP_SIZE 128
+/* The number of buckets of the hash map which indexes the dynamic
+   table of deflater.  It must be a power of 2.  It can be overridden
+   at build time, for example, to reduce collisions when peers
+   allow the dynamic table larger than 4096 bytes. */
+#ifndef NGHTTP2_HD_MAP_SIZE
+#define NGHTTP2_HD_MAP_SIZE 128
+#endif /* NGHTTP2_HD_MAP_SIZE */
+
+#define HD_MAP_SIZE NGHTTP2_HD_MAP_SIZE
 
 typedef struct { nghttp2_hd_entry *table[HD_MAP_SIZE]; } nghttp2_hd_map;
 
 struct nghttp2_hd_deflater {
   nghttp2_hd_context ctx;
   nghttp2_hd_map map;
+  nghttp2_hd_stats stats;
   /* The upper limit of the header table size the deflater accepts. */
   size_t deflate_hd_table_bufsize_max;
   /* Minimum header table size notified in the next context update */
@@ -227,14 +243,28 @@ struct nghttp2_hd_deflater {
 
 struct nghttp2_hd_inflater {
   nghttp2_hd_context ctx;
+  nghttp2_hd_stats stats;
   /* Stores current state of huffman decoding */
   nghttp2_hd_huff_decode_context huff_decode_ctx;
   /* header buffer */
   nghttp2_buf namebuf, valuebuf;
   nghttp2_rcbuf *namercbuf, *valuercbuf;
+  /* Memory allocator which frees namercbuf and valuercbuf.  They may
+     outlive the inflater, so this must not refer to its owner.  It
+     must be able to free memory allocated by ctx.mem.  By default, it
+     is ctx.mem. */
+  nghttp2_mem *rcbuf_mem;
   /* Pointer to the name/value pair which are used in the current
      header emission. */
   nghttp2_rcbuf *nv_name_keep, *nv_value_keep;
+  /* Buffer which holds decoded name and value of the current header
+     field if it is emitted without nghttp2_rcbuf allocation.  It is
+     reused across header fields in a header block. */
+  nghttp2_buf arena;
+  /* Name and value of the current header field which refer to either
+     input or arena.  They are statically allocated (ref == -1), and
+     valid until the next call of nghttp2_hd_inflate_hd_nv(). */
+  nghttp2_rcbuf name_view, value_view;
   /* The number of bytes to read */
   size_t left;
   /* The index in indexed repr or indexed name */
@@ -255,6 +285,14 @@ struct nghttp2_hd_inflater {
   /* nonzero if deflater requires that current entry must not be
      indexed */
   uint8_t no_index;
+  /* nonzero if header fields which are not added to header table are
+     emitted without nghttp2_rcbuf allocation.  In this case, name and
+     value may refer to input directly, and are not NULL-terminated. */
+  uint8_t borrow;
+  /* nonzero if name_view refers to input */
+  uint8_t name_borrowed;
+  /* nonzero if name_view refers to arena */
+  uint8_t name_in_arena;
 };
 
 /*
@@ -29,6 +29,15 @@
 
 #include "nghttp2_net.h"
 
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NGHTTP2_HELPER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NGHTTP2_HELPER_NEON
+#include <arm_neon.h>
+#endif /* defined(__ARM_NEON) || defined(__ARM_NEON__) */
+
 void nghttp2_put_uint16be(uint8_t *buf, uint16_t n) {
   uint16_t x = htons(n);
   memcpy(buf, &x, sizeof(uint16_t));
@@ -337,7 +346,7 @@ const char *nghttp2_strerror(int error_code) {
 }
 
 /* Generated by gennmchartbl.py */
-static int VALID_HD_NAME_CHARS[] = {
+static const int VALID_HD_NAME_CHARS[] = {
     0 /* NUL  */, 0 /* SOH  */, 0 /* STX  */, 0 /* ETX  */,
     0 /* EOT  */, 0 /* ENQ  */, 0 /* ACK  */, 0 /* BEL  */,
     0 /* BS   */, 0 /* HT   */, 0 /* LF   */, 0 /* VT   */,
@@ -404,28 +413,8 @@ static int VALID_HD_NAME_CHARS[] = {
     0 /* 0xfc */, 0 /* 0xfd */, 0 /* 0xfe */, 0 /* 0xff */
 };
 
-int nghttp2_check_header_name(const uint8_t *name, size_t len) {
-  const uint8_t *last;
-  if (len == 0) {
-    return 0;
-  }
-  if (*name == ':') {
-    if (len == 1) {
-      return 0;
-    }
-    ++name;
-    --len;
-  }
-  for (last = name + len; name != last; ++name) {
-    if (!VALID_HD_NAME_CHARS[*name]) {
-      return 0;
-    }
-  }
-  return 1;
-}
-
 /* Generated by genvchartbl.py */
-static int VALID_HD_VALUE_CHARS[] = {
+static const int VALID_HD_VALUE_CHARS[] = {
     0 /* NUL  */, 0 /* SOH  */, 0 /* STX  */, 0 /* ETX  */,
     0 /* EOT  */, 0 /* ENQ  */, 0 /* ACK  */, 0 /* BEL  */,
     0 /* BS   */, 1 /* HT   */, 0 /* LF   */, 0 /* VT   */,
@@ -492,8 +481,274 @@ static int VALID_HD_VALUE_CHARS[] = {
     1 /* 0xfc */, 1 /* 0xfd */, 1 /* 0xfe */, 1 /* 0xff */
 };
 
+/* SWAR (SIMD within a register) constants; every byte of a word is
+   0x01, and 0x80 respectively. */
+#define SWAR_ONES ((size_t)-1 / 0xff)
+#define SWAR_HIGHS (SWAR_ONES * 0x80)
+
+/*
+ * Returns nonzero if every byte in |w| is one of [0-9a-z-], which
+ * covers almost all header field names seen in practice.
+ */
+static int swar_is_name_word(size_t w) {
+  size_t lower, digit, dash;
+
+  if (w & SWAR_HIGHS) {
+    return 0;
+  }
+
+  /* Since every byte is less than 0x80, adding constant less than
+     0x80 to each byte never carries into the next byte, and the most
+     significant bit of each byte tells the result of comparison. */
+  lower = (w + SWAR_ONES * (0x80 - 'a')) & ~(w + SWAR_ONES * (0x80 - 'z' - 1));
+  digit = (w + SWAR_ONES * (0x80 - '0')) & ~(w + SWAR_ONES * (0x80 - '9' - 1));
+  dash = ~((w ^ (SWAR_ONES * '-')) + SWAR_ONES * 0x7f);
+
+  return ((lower | digit | dash) & SWAR_HIGHS) == SWAR_HIGHS;
+}
+
+/*
+ * Returns nonzero if no byte in |w| is a control character or DEL.
+ * HT is also rejected, and it is left to the table.
+ */
+static int swar_is_value_word(size_t w) {
+  size_t x = w ^ (SWAR_ONES * 0x7f);
+
+  return !((w - SWAR_ONES * 0x20) & ~w & SWAR_HIGHS) &&
+         !((x - SWAR_ONES) & ~x & SWAR_HIGHS);
+}
+
+/*
+ * Returns nonzero if all bytes in [p, last) are allowed by table
+ * |tbl|.
+ */
+static int check_bytes(const int *tbl, const uint8_t *p,
+                       const uint8_t *last) {
+  for (; p != last; ++p) {
+    if (!tbl[*p]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Returns nonzero if all bytes in [p, last) are allowed by table
+ * |tbl|.  |first| is the beginning of the string, and [first, p) must
+ * have been checked already.  The string is checked word by word
+ * using |is_valid_word|, and only the word which it does not accept
+ * is checked using |tbl|.  If the last word is partial, the last word
+ * of the string is checked instead, which overlaps with the bytes
+ * already checked.
+ */
+static int swar_check(const uint8_t *first, const uint8_t *p,
+                      const uint8_t *last, int (*is_valid_word)(size_t),
+                      const int *tbl) {
+  size_t w;
+
+  for (; (size_t)(last - p) >= sizeof(w); p += sizeof(w)) {
+    memcpy(&w, p, sizeof(w));
+
+    if (!is_valid_word(w) && !check_bytes(tbl, p, p + sizeof(w))) {
+      return 0;
+    }
+  }
+
+  if (p == last) {
+    return 1;
+  }
+
+  if ((size_t)(last - first) >= sizeof(w)) {
+    memcpy(&w, last - sizeof(w), sizeof(w));
+
+    if (is_valid_word(w)) {
+      return 1;
+    }
+  }
+
+  return check_bytes(tbl, p, last);
+}
+
+#if defined(NGHTTP2_HELPER_SSE2)
+
+/*
+ * Returns the mask whose byte is 0xff if the corresponding byte in
+ * |x| is in range [lo, hi].  lo must be greater than 0, and hi must
+ * be less than 0x7f.  Since bytes are compared as signed integers,
+ * bytes larger than 0x7f are never in range.
+ */
+static __m128i sse2_in_range(__m128i x, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8((char)(lo - 1))),
+                       _mm_cmplt_epi8(x, _mm_set1_epi8((char)(hi + 1))));
+}
+
+static int simd_is_name_block(const uint8_t *p) {
+  __m128i x, ok;
+
+  x = _mm_loadu_si128((const __m128i *)(const void *)p);
+
+  ok = _mm_or_si128(sse2_in_range(x, 0x23, 0x27),  /* #$%&' */
+                    sse2_in_range(x, 0x2a, 0x2b)); /* *+ */
+  ok = _mm_or_si128(ok, sse2_in_range(x, 0x2d, 0x2e)); /* -. */
+  ok = _mm_or_si128(ok, sse2_in_range(x, 0x30, 0x39)); /* 0-9 */
+  ok = _mm_or_si128(ok, sse2_in_range(x, 0x5e, 0x7a)); /* ^_` a-z */
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('!')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('|')));
+  ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('~')));
+
+  return _mm_movemask_epi8(ok) == 0xffff;
+}
+
+static int simd_is_value_block(const uint8_t *p) {
+  __m128i x, ctl, bad;
+
+  x = _mm_loadu_si128((const __m128i *)(const void *)p);
+
+  /* Control characters in [0x00, 0x1f].  Bytes larger than 0x7f are
+     negative, and they are allowed. */
+  ctl = _mm_andnot_si128(_mm_cmplt_epi8(x, _mm_setzero_si128()),
+                         _mm_cmplt_epi8(x, _mm_set1_epi8(0x20)));
+  bad = _mm_andnot_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\t')), ctl);
+  bad = _mm_or_si128(bad, _mm_cmpeq_epi8(x, _mm_set1_epi8(0x7f)));
+
+  return _mm_movemask_epi8(bad) == 0;
+}
+
+#elif defined(NGHTTP2_HELPER_NEON)
+
+/*
+ * Returns nonzero if any byte in |x| is nonzero.
+ */
+static int neon_any(uint8x16_t x) {
+#if defined(__aarch64__)
+  return vmaxvq_u8(x) != 0;
+#else  /* !defined(__aarch64__) */
+  uint8x8_t y = vorr_u8(vget_low_u8(x), vget_high_u8(x));
+  return vget_lane_u64(vreinterpret_u64_u8(y), 0) != 0;
+#endif /* !defined(__aarch64__) */
+}
+
+/*
+ * Returns the mask whose byte is 0xff if the corresponding byte in
+ * |x| is in range [lo, hi].
+ */
+static uint8x16_t neon_in_range(uint8x16_t x, uint8_t lo, uint8_t hi) {
+  return vcleq_u8(vsubq_u8(x, vdupq_n_u8(lo)), vdupq_n_u8((uint8_t)(hi - lo)));
+}
+
+static int simd_is_name_block(const uint8_t *p) {
+  uint8x16_t x, ok;
+
+  x = vld1q_u8(p);
+
+  ok = vorrq_u8(neon_in_range(x, 0x23, 0x27),  /* #$%&' */
+                neon_in_range(x, 0x2a, 0x2b)); /* *+ */
+  ok = vorrq_u8(ok, neon_in_range(x, 0x2d, 0x2e)); /* -. */
+  ok = vorrq_u8(ok, neon_in_range(x, 0x30, 0x39)); /* 0-9 */
+  ok = vorrq_u8(ok, neon_in_range(x, 0x5e, 0x7a)); /* ^_` a-z */
+  ok = vorrq_u8(ok, vceqq_u8(x, vdupq_n_u8('!')));
+  ok = vorrq_u8(ok, vceqq_u8(x, vdupq_n_u8('|')));
+  ok = vorrq_u8(ok, vceqq_u8(x, vdupq_n_u8('~')));
+
+  return !neon_any(vmvnq_u8(ok));
+}
+
+static int simd_is_value_block(const uint8_t *p) {
+  uint8x16_t x, bad;
+
+  x = vld1q_u8(p);
+
+  bad =
+      vbicq_u8(vcltq_u8(x, vdupq_n_u8(0x20)), vceqq_u8(x, vdupq_n_u8('\t')));
+  bad = vorrq_u8(bad, vceqq_u8(x, vdupq_n_u8(0x7f)));
+
+  return !neon_any(bad);
+}
+
+#endif /* defined(NGHTTP2_HELPER_NEON) */
+
+#if defined(NGHTTP2_HELPER_SSE2) || defined(NGHTTP2_HELPER_NEON)
+
+/*
+ * Returns the pointer to the first block in [p, last) which may
+ * contain the byte not allowed, skipping 16 bytes blocks which
+ * |is_valid_block| accepts.  |first| is the beginning of the string.
+ * If the last block is partial, the last block of the string is
+ * checked instead, which overlaps with the bytes already checked.
+ */
+static const uint8_t *simd_skip(const uint8_t *first, const uint8_t *p,
+                                const uint8_t *last,
+                                int (*is_valid_block)(const uint8_t *)) {
+  for (; last - p >= 16; p += 16) {
+    if (!is_valid_block(p)) {
+      return p;
+    }
+  }
+
+  if (p != last && last - first >= 16 && is_valid_block(last - 16)) {
+    return last;
+  }
+
+  return p;
+}
+
+#endif /* defined(NGHTTP2_HELPER_SSE2) || defined(NGHTTP2_HELPER_NEON) */
+
+/*
+ * The following two functions return nonzero if all bytes in [first,
+ * last), which is at least 16 bytes long, are allowed in header field
+ * name and value respectively, checking them in blocks.
+ */
+static int check_header_name_block(const uint8_t *first,
+                                   const uint8_t *last) {
+  const uint8_t *p = first;
+#if defined(NGHTTP2_HELPER_SSE2) || defined(NGHTTP2_HELPER_NEON)
+  p = simd_skip(first, p, last, simd_is_name_block);
+#endif /* defined(NGHTTP2_HELPER_SSE2) || defined(NGHTTP2_HELPER_NEON) */
+  return swar_check(first, p, last, swar_is_name_word, VALID_HD_NAME_CHARS);
+}
+
+static int check_header_value_block(const uint8_t *first,
+                                    const uint8_t *last) {
+  const uint8_t *p = first;
+#if defined(NGHTTP2_HELPER_SSE2) || defined(NGHTTP2_HELPER_NEON)
+  p = simd_skip(first, p, last, simd_is_value_block);
+#endif /* defined(NGHTTP2_HELPER_SSE2) || defined(NGHTTP2_HELPER_NEON) */
+  return swar_check(first, p, last, swar_is_value_word, VALID_HD_VALUE_CHARS);
+}
+
+int nghttp2_check_header_name(const uint8_t *name, size_t len) {
+  const uint8_t *last;
+  if (len == 0) {
+    return 0;
+  }
+  if (*name == ':') {
+    if (len == 1) {
+      return 0;
+    }
+    ++name;
+    --len;
+  }
+  /* Most header field names are shorter than 16 bytes, and checking
+     them byte by byte is faster than setting up the block checks. */
+  if (len >= 16) {
+    return check_header_name_block(name, name + len);
+  }
+  for (last = name + len; name != last; ++name) {
+    if (!VALID_HD_NAME_CHARS[*name]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
 int nghttp2_check_header_value(const uint8_t *value, size_t len) {
   const uint8_t *last;
+  /* Checking short value byte by byte is faster for the same reason
+     as nghttp2_check_header_name(). */
+  if (len >= 16) {
+    return check_header_value_block(value, value + len);
+  }
   for (last = value + len; value != last; ++value) {
     if (!VALID_HD_VALUE_CHARS[*value]) {
       return 0;
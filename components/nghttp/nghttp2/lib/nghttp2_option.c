@@ -112,3 +112,32 @@ void nghttp2_option_set_no_closed_streams(nghttp2_option *option, int val) {
   option->opt_set_mask |= NGHTTP2_OPT_NO_CLOSED_STREAMS;
   option->no_closed_streams = val;
 }
+
+void nghttp2_option_set_slab_allocator(nghttp2_option *option, int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_SLAB_ALLOCATOR;
+  option->slab_allocator = val;
+}
+
+void nghttp2_option_set_send_coalesce_length(nghttp2_option *option,
+                                             size_t val) {
+  option->opt_set_mask |= NGHTTP2_OPT_SEND_COALESCE_LENGTH;
+  option->send_coalesce_length = val;
+}
+
+void nghttp2_option_set_no_rfc7540_priorities(nghttp2_option *option,
+                                              int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_NO_RFC7540_PRIORITIES;
+  option->no_rfc7540_priorities = val;
+}
+
+void nghttp2_option_set_borrow_header_fields(nghttp2_option *option,
+                                             int val) {
+  option->opt_set_mask |= NGHTTP2_OPT_BORROW_HEADER_FIELDS;
+  option->borrow_header_fields = val;
+}
+
+void nghttp2_option_set_max_auto_window_size(nghttp2_option *option,
+                                             int32_t val) {
+  option->opt_set_mask |= NGHTTP2_OPT_MAX_AUTO_WINDOW_SIZE;
+  option->max_auto_window_size = val;
+}
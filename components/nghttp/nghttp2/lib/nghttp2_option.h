@@ -66,6 +66,11 @@ typedef enum {
   NGHTTP2_OPT_MAX_SEND_HEADER_BLOCK_LENGTH = 1 << 8,
   NGHTTP2_OPT_MAX_DEFLATE_DYNAMIC_TABLE_SIZE = 1 << 9,
   NGHTTP2_OPT_NO_CLOSED_STREAMS = 1 << 10,
+  NGHTTP2_OPT_SLAB_ALLOCATOR = 1 << 11,
+  NGHTTP2_OPT_SEND_COALESCE_LENGTH = 1 << 12,
+  NGHTTP2_OPT_NO_RFC7540_PRIORITIES = 1 << 13,
+  NGHTTP2_OPT_BORROW_HEADER_FIELDS = 1 << 14,
+  NGHTTP2_OPT_MAX_AUTO_WINDOW_SIZE = 1 << 15,
 } nghttp2_option_flag;
 
 /**
@@ -80,6 +85,10 @@ struct nghttp2_option {
    * NGHTTP2_OPT_MAX_DEFLATE_DYNAMIC_TABLE_SIZE
    */
   size_t max_deflate_dynamic_table_size;
+  /**
+   * NGHTTP2_OPT_SEND_COALESCE_LENGTH
+   */
+  size_t send_coalesce_length;
   /**
    * Bitwise OR of nghttp2_option_flag to determine that which fields
    * are specified.
@@ -97,6 +106,10 @@ struct nghttp2_option {
    * NGHTTP2_OPT_BUILTIN_RECV_EXT_TYPES
    */
   uint32_t builtin_recv_ext_types;
+  /**
+   * NGHTTP2_OPT_MAX_AUTO_WINDOW_SIZE
+   */
+  int32_t max_auto_window_size;
   /**
    * NGHTTP2_OPT_NO_AUTO_WINDOW_UPDATE
    */
@@ -117,6 +130,18 @@ struct nghttp2_option {
    * NGHTTP2_OPT_NO_CLOSED_STREAMS
    */
   int no_closed_streams;
+  /**
+   * NGHTTP2_OPT_SLAB_ALLOCATOR
+   */
+  int slab_allocator;
+  /**
+   * NGHTTP2_OPT_NO_RFC7540_PRIORITIES
+   */
+  int no_rfc7540_priorities;
+  /**
+   * NGHTTP2_OPT_BORROW_HEADER_FIELDS
+   */
+  int borrow_header_fields;
   /**
    * NGHTTP2_OPT_USER_RECV_EXT_TYPES
    */
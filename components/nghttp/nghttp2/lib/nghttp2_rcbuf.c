@@ -65,6 +65,15 @@ int nghttp2_rcbuf_new2(nghttp2_rcbuf **rcbuf_ptr, const uint8_t *src,
   return 0;
 }
 
+int nghttp2_rcbuf_alloc(nghttp2_rcbuf **rcbuf_ptr, size_t size,
+                        nghttp2_mem *mem) {
+  if (mem == NULL) {
+    mem = nghttp2_mem_default();
+  }
+
+  return nghttp2_rcbuf_new(rcbuf_ptr, size, mem);
+}
+
 /*
  * Frees |rcbuf| itself, regardless of its reference cout.
  */
@@ -37,6 +37,8 @@
 #include "nghttp2_http.h"
 #include "nghttp2_pq.h"
 #include "nghttp2_debug.h"
+#include "nghttp2_extpri.h"
+#include "nghttp2_rcbuf.h"
 
 /*
  * Returns non-zero if the number of outgoing opened streams is larger
@@ -383,6 +385,58 @@ static void active_outbound_item_reset(nghttp2_active_outbound_item *aob,
 
 int nghttp2_enable_strict_preface = 1;
 
+/*
+ * Frees |session| itself.  If slab allocator is enabled, |session| is
+ * allocated from its parent allocator, and the slab is released here.
+ */
+static void session_free_self(nghttp2_session *session) {
+  nghttp2_mem mem;
+
+  if (session->slab == NULL) {
+    mem = session->mem_parent;
+    nghttp2_mem_free(&mem, session);
+    return;
+  }
+
+  mem = session->slab->parent;
+  nghttp2_slab_release(session->slab);
+  nghttp2_mem_free(&mem, session);
+}
+
+static void *session_mem_malloc(size_t size, void *mem_user_data) {
+  nghttp2_session *session = mem_user_data;
+
+  ++session->stats.allocations;
+
+  return session->mem_parent.malloc(size, session->mem_parent.mem_user_data);
+}
+
+static void session_mem_free(void *ptr, void *mem_user_data) {
+  nghttp2_session *session = mem_user_data;
+
+  session->mem_parent.free(ptr, session->mem_parent.mem_user_data);
+}
+
+static void *session_mem_calloc(size_t nmemb, size_t size,
+                                void *mem_user_data) {
+  nghttp2_session *session = mem_user_data;
+
+  ++session->stats.allocations;
+
+  return session->mem_parent.calloc(nmemb, size,
+                                    session->mem_parent.mem_user_data);
+}
+
+static void *session_mem_realloc(void *ptr, size_t size,
+                                 void *mem_user_data) {
+  nghttp2_session *session = mem_user_data;
+
+  ++session->stats.allocations;
+
+  return session->mem_parent.realloc(ptr, size,
+                                     session->mem_parent.mem_user_data);
+}
+
 static int session_new(nghttp2_session **session_ptr,
                        const nghttp2_session_callbacks *callbacks,
                        void *user_data, int server,
@@ -391,6 +445,8 @@ static int session_new(nghttp2_session **session_ptr,
   size_t nbuffer;
   size_t max_deflate_dynamic_table_size =
       NGHTTP2_HD_DEFAULT_MAX_DEFLATE_BUFFER_SIZE;
+  int slab_allocator = 0;
+  int borrow_header_fields = 0;
 
   if (mem == NULL) {
     mem = nghttp2_mem_default();
@@ -403,6 +459,7 @@ static int session_new(nghttp2_session **session_ptr,
   }
 
   (*session_ptr)->mem = *mem;
+  (*session_ptr)->mem_parent = *mem;
   mem = &(*session_ptr)->mem;
 
   /* next_stream_id is initialized in either
@@ -499,8 +556,52 @@ static int session_new(nghttp2_session **session_ptr,
         option->no_closed_streams) {
       (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_NO_CLOSED_STREAMS;
     }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_SLAB_ALLOCATOR) &&
+        option->slab_allocator) {
+      slab_allocator = 1;
+    }
+
+    if (option->opt_set_mask & NGHTTP2_OPT_SEND_COALESCE_LENGTH) {
+      (*session_ptr)->send_coalesce_length = option->send_coalesce_length;
+    }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_NO_RFC7540_PRIORITIES) &&
+        option->no_rfc7540_priorities) {
+      (*session_ptr)->opt_flags |= NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES;
+    }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_BORROW_HEADER_FIELDS) &&
+        option->borrow_header_fields) {
+      borrow_header_fields = 1;
+    }
+
+    if ((option->opt_set_mask & NGHTTP2_OPT_MAX_AUTO_WINDOW_SIZE) &&
+        option->max_auto_window_size > 0) {
+      (*session_ptr)->max_auto_window_size =
+          nghttp2_min(option->max_auto_window_size, NGHTTP2_MAX_WINDOW_SIZE);
+    }
+  }
+
+  if (slab_allocator) {
+    rv = nghttp2_slab_new(&(*session_ptr)->slab, mem);
+    if (rv != 0) {
+      goto fail_slab;
+    }
+
+    /* From now on, everything allocated through |mem| comes from the
+       slab. */
+    (*session_ptr)->mem = *nghttp2_slab_get_mem((*session_ptr)->slab);
   }
 
+  (*session_ptr)->mem_parent = (*session_ptr)->mem;
+
+  (*session_ptr)->mem.mem_user_data = *session_ptr;
+  (*session_ptr)->mem.malloc = session_mem_malloc;
+  (*session_ptr)->mem.free = session_mem_free;
+  (*session_ptr)->mem.calloc = session_mem_calloc;
+  (*session_ptr)->mem.realloc = session_mem_realloc;
+
   rv = nghttp2_hd_deflate_init2(&(*session_ptr)->hd_deflater,
                                 max_deflate_dynamic_table_size, mem);
   if (rv != 0) {
@@ -510,6 +611,11 @@ static int session_new(nghttp2_session **session_ptr,
   if (rv != 0) {
     goto fail_hd_inflater;
   }
+
+  (*session_ptr)->hd_inflater.borrow = (uint8_t)borrow_header_fields;
+  /* Application may keep header fields after the session is deleted,
+     so they must not be freed through |session|. */
+  (*session_ptr)->hd_inflater.rcbuf_mem = &(*session_ptr)->mem_parent;
   rv = nghttp2_map_init(&(*session_ptr)->streams, mem);
   if (rv != 0) {
     goto fail_map;
@@ -566,7 +672,8 @@ fail_map:
 fail_hd_inflater:
   nghttp2_hd_deflate_free(&(*session_ptr)->hd_deflater);
 fail_hd_deflater:
-  nghttp2_mem_free(mem, *session_ptr);
+fail_slab:
+  session_free_self(*session_ptr);
 fail_session:
   return rv;
 }
@@ -737,7 +844,9 @@ void nghttp2_session_del(nghttp2_session *session) {
   nghttp2_hd_deflate_free(&session->hd_deflater);
   nghttp2_hd_inflate_free(&session->hd_inflater);
   nghttp2_bufs_free(&session->aob.framebufs);
-  nghttp2_mem_free(mem, session);
+  nghttp2_buf_free(&session->iovbuf, mem);
+  nghttp2_buf_free(&session->coalescebuf, mem);
+  session_free_self(session);
 }
 
 int nghttp2_session_reprioritize_stream(
@@ -815,6 +924,193 @@ int nghttp2_session_reprioritize_stream(
   return 0;
 }
 
+/*
+ * Appends |stream| to the queue of its urgency.  This function is
+ * used only if NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES is set.
+ */
+static void session_ob_data_push(nghttp2_session *session,
+                                 nghttp2_stream *stream) {
+  nghttp2_sched *sched;
+
+  assert(!stream->queued);
+
+  sched = &session->sched[nghttp2_extpri_uint8_urgency(stream->extpri)];
+
+  stream->sched_prev = sched->tail;
+  stream->sched_next = NULL;
+
+  if (sched->tail) {
+    sched->tail->sched_next = stream;
+  } else {
+    sched->head = stream;
+  }
+
+  sched->tail = stream;
+
+  stream->queued = 1;
+}
+
+/*
+ * Removes |stream| from the queue of its urgency.
+ */
+static void session_ob_data_remove(nghttp2_session *session,
+                                   nghttp2_stream *stream) {
+  nghttp2_sched *sched;
+
+  assert(stream->queued);
+
+  sched = &session->sched[nghttp2_extpri_uint8_urgency(stream->extpri)];
+
+  if (stream->sched_prev) {
+    stream->sched_prev->sched_next = stream->sched_next;
+  } else {
+    sched->head = stream->sched_next;
+  }
+
+  if (stream->sched_next) {
+    stream->sched_next->sched_prev = stream->sched_prev;
+  } else {
+    sched->tail = stream->sched_prev;
+  }
+
+  stream->sched_prev = NULL;
+  stream->sched_next = NULL;
+
+  stream->queued = 0;
+}
+
+/*
+ * Moves incremental |stream| to the end of the queue after it sent a
+ * DATA frame.  Non-incremental stream keeps its position until it
+ * finishes.
+ */
+static void session_sched_reschedule_stream(nghttp2_session *session,
+                                            nghttp2_stream *stream) {
+  nghttp2_sched *sched;
+
+  assert(stream->queued);
+
+  if (!nghttp2_extpri_uint8_inc(stream->extpri)) {
+    return;
+  }
+
+  sched = &session->sched[nghttp2_extpri_uint8_urgency(stream->extpri)];
+
+  if (sched->tail == stream) {
+    return;
+  }
+
+  session_ob_data_remove(session, stream);
+  session_ob_data_push(session, stream);
+}
+
+static nghttp2_outbound_item *
+session_sched_get_next_outbound_item(nghttp2_session *session) {
+  size_t i;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    return nghttp2_stream_next_outbound_item(&session->root);
+  }
+
+  for (i = 0; i < NGHTTP2_EXTPRI_URGENCY_LEVELS; ++i) {
+    if (session->sched[i].head) {
+      return session->sched[i].head->item;
+    }
+  }
+
+  return NULL;
+}
+
+static int session_sched_empty(nghttp2_session *session) {
+  size_t i;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    return nghttp2_pq_empty(&session->root.obq);
+  }
+
+  for (i = 0; i < NGHTTP2_EXTPRI_URGENCY_LEVELS; ++i) {
+    if (session->sched[i].head) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * The following functions wrap the nghttp2_stream functions of the
+ * same name to keep the flat scheduler in sync with |stream|'s item.
+ */
+static int session_attach_stream_item(nghttp2_session *session,
+                                      nghttp2_stream *stream,
+                                      nghttp2_outbound_item *item) {
+  int rv;
+
+  rv = nghttp2_stream_attach_item(stream, item);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if (stream->flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES) {
+    session_ob_data_push(session, stream);
+  }
+
+  return 0;
+}
+
+static int session_detach_stream_item(nghttp2_session *session,
+                                      nghttp2_stream *stream) {
+  int rv;
+
+  rv = nghttp2_stream_detach_item(stream);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((stream->flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES) &&
+      stream->queued) {
+    session_ob_data_remove(session, stream);
+  }
+
+  return 0;
+}
+
+static int session_defer_stream_item(nghttp2_session *session,
+                                     nghttp2_stream *stream, uint8_t flags) {
+  int rv;
+
+  rv = nghttp2_stream_defer_item(stream, flags);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((stream->flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES) &&
+      stream->queued) {
+    session_ob_data_remove(session, stream);
+  }
+
+  return 0;
+}
+
+static int session_resume_deferred_stream_item(nghttp2_session *session,
+                                               nghttp2_stream *stream,
+                                               uint8_t flags) {
+  int rv;
+
+  rv = nghttp2_stream_resume_deferred_item(stream, flags);
+  if (rv != 0) {
+    return rv;
+  }
+
+  if ((stream->flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES) &&
+      (stream->flags & NGHTTP2_STREAM_FLAG_DEFERRED_ALL) == 0 &&
+      !stream->queued) {
+    session_ob_data_push(session, stream);
+  }
+
+  return 0;
+}
+
 int nghttp2_session_add_item(nghttp2_session *session,
                              nghttp2_outbound_item *item) {
   /* TODO Return error if stream is not found for the frame requiring
@@ -836,7 +1132,7 @@ int nghttp2_session_add_item(nghttp2_session *session,
       return NGHTTP2_ERR_DATA_EXIST;
     }
 
-    rv = nghttp2_stream_attach_item(stream, item);
+    rv = session_attach_stream_item(session, stream, item);
 
     if (rv != 0) {
       return rv;
@@ -1001,6 +1297,14 @@ nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
   mem = &session->mem;
   stream = nghttp2_session_get_stream_raw(session, stream_id);
 
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    /* Dependency tree is not used.  Idle streams are never created
+       in this mode. */
+    flags |= NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES;
+    nghttp2_priority_spec_default_init(&pri_spec_default);
+    pri_spec = &pri_spec_default;
+  }
+
   if (stream) {
     assert(stream->state == NGHTTP2_STREAM_IDLE);
     assert(nghttp2_stream_in_dep_tree(stream));
@@ -1103,6 +1407,10 @@ nghttp2_stream *nghttp2_session_open_stream(nghttp2_session *session,
     }
   }
 
+  if (flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES) {
+    return stream;
+  }
+
   if (pri_spec->stream_id == 0) {
     dep_stream = &session->root;
   }
@@ -1142,7 +1450,7 @@ int nghttp2_session_close_stream(nghttp2_session *session, int32_t stream_id,
 
     item = stream->item;
 
-    rv = nghttp2_stream_detach_item(stream);
+    rv = session_detach_stream_item(session, stream);
 
     if (rv != 0) {
       return rv;
@@ -1933,6 +2241,60 @@ static int session_pack_extension(nghttp2_session *session, nghttp2_bufs *bufs,
   return 0;
 }
 
+/*
+ * Returns the index of frame counters in nghttp2_session_stats for
+ * frame |type|.
+ */
+static size_t stats_frame_index(uint8_t type) {
+  return nghttp2_min(type, NGHTTP2_STATS_FRAME_TYPES - 1);
+}
+
+/*
+ * Counts the frame in |item| which has just been serialized into
+ * session->aob.framebufs.
+ */
+static void session_count_frame_sent(nghttp2_session *session,
+                                     nghttp2_outbound_item *item) {
+  nghttp2_session_stats *stats = &session->stats;
+  nghttp2_frame *frame = &item->frame;
+  nghttp2_buf_chain *ci;
+
+  ++stats->frames_sent[stats_frame_index(frame->hd.type)];
+
+  if (frame->hd.type == NGHTTP2_DATA) {
+    /* Payload of DATA may not be in framebufs if it is sent without
+       copy */
+    stats->bytes_sent += NGHTTP2_FRAME_HDLEN + frame->hd.length;
+    stats->data_bytes_sent += frame->hd.length;
+
+    return;
+  }
+
+  stats->bytes_sent += nghttp2_bufs_len(&session->aob.framebufs);
+
+  /* Each CONTINUATION frame following HEADERS or PUSH_PROMISE is
+     serialized in its own buffer. */
+  for (ci = session->aob.framebufs.head->next;
+       ci && nghttp2_buf_len(&ci->buf); ci = ci->next) {
+    ++stats->frames_sent[NGHTTP2_CONTINUATION];
+  }
+}
+
+/*
+ * Counts the frame whose header is |hd| which has just been received.
+ */
+static void session_count_frame_recv(nghttp2_session *session,
+                                     const nghttp2_frame_hd *hd) {
+  nghttp2_session_stats *stats = &session->stats;
+
+  ++stats->frames_recv[stats_frame_index(hd->type)];
+  stats->bytes_recv += NGHTTP2_FRAME_HDLEN + hd->length;
+
+  if (hd->type == NGHTTP2_DATA) {
+    stats->data_bytes_recv += hd->length;
+  }
+}
+
 /*
  * This function serializes frame for transmission.
  *
@@ -1968,7 +2330,7 @@ static int session_prep_frame(nghttp2_session *session,
       if (stream) {
         int rv2;
 
-        rv2 = nghttp2_stream_detach_item(stream);
+        rv2 = session_detach_stream_item(session, stream);
 
         if (nghttp2_is_fatal(rv2)) {
           return rv2;
@@ -1987,13 +2349,15 @@ static int session_prep_frame(nghttp2_session *session,
          queue when session->remote_window_size > 0 */
       assert(session->remote_window_size > 0);
 
-      rv = nghttp2_stream_defer_item(stream,
-                                     NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
+      rv = session_defer_stream_item(
+          session, stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
+      ++session->stats.data_deferred_flow_control;
+
       session->aob.item = NULL;
       active_outbound_item_reset(&session->aob, mem);
       return NGHTTP2_ERR_DEFERRED;
@@ -2006,18 +2370,21 @@ static int session_prep_frame(nghttp2_session *session,
       return rv;
     }
     if (rv == NGHTTP2_ERR_DEFERRED) {
-      rv = nghttp2_stream_defer_item(stream, NGHTTP2_STREAM_FLAG_DEFERRED_USER);
+      rv = session_defer_stream_item(session, stream,
+                                     NGHTTP2_STREAM_FLAG_DEFERRED_USER);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
+      ++session->stats.data_deferred_user;
+
       session->aob.item = NULL;
       active_outbound_item_reset(&session->aob, mem);
       return NGHTTP2_ERR_DEFERRED;
     }
     if (rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
-      rv = nghttp2_stream_detach_item(stream);
+      rv = session_detach_stream_item(session, stream);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
@@ -2033,7 +2400,7 @@ static int session_prep_frame(nghttp2_session *session,
     if (rv != 0) {
       int rv2;
 
-      rv2 = nghttp2_stream_detach_item(stream);
+      rv2 = session_detach_stream_item(session, stream);
 
       if (nghttp2_is_fatal(rv2)) {
         return rv2;
@@ -2296,7 +2663,7 @@ nghttp2_session_get_next_ob_item(nghttp2_session *session) {
   }
 
   if (session->remote_window_size > 0) {
-    return nghttp2_stream_next_outbound_item(&session->root);
+    return session_sched_get_next_outbound_item(session);
   }
 
   return NULL;
@@ -2330,7 +2697,7 @@ nghttp2_session_pop_next_ob_item(nghttp2_session *session) {
   }
 
   if (session->remote_window_size > 0) {
-    return nghttp2_stream_next_outbound_item(&session->root);
+    return session_sched_get_next_outbound_item(session);
   }
 
   return NULL;
@@ -2443,9 +2810,15 @@ static int session_close_stream_on_goaway(nghttp2_session *session,
   return 0;
 }
 
-static void reschedule_stream(nghttp2_stream *stream) {
+static void reschedule_stream(nghttp2_session *session,
+                              nghttp2_stream *stream) {
   stream->last_writelen = stream->item->frame.hd.length;
 
+  if (stream->flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES) {
+    session_sched_reschedule_stream(session, stream);
+    return;
+  }
+
   nghttp2_stream_reschedule(stream);
 }
 
@@ -2502,14 +2875,18 @@ static int session_after_frame_sent1(nghttp2_session *session) {
       stream->remote_window_size -= (int32_t)frame->hd.length;
     }
 
+    if (session->remote_window_size <= 0 && frame->hd.length) {
+      ++session->stats.connection_window_exhausted;
+    }
+
     if (stream && aux_data->eof) {
-      rv = nghttp2_stream_detach_item(stream);
+      rv = session_detach_stream_item(session, stream);
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
       /* Call on_frame_send_callback after
-         nghttp2_stream_detach_item(), so that application can issue
+         session_detach_stream_item(), so that application can issue
          nghttp2_submit_data() in the callback. */
       if (session->callbacks.on_frame_send_callback) {
         rv = session_call_on_frame_send(session, frame);
@@ -2628,7 +3005,8 @@ static int session_after_frame_sent1(nghttp2_session *session) {
     }
   }
   case NGHTTP2_PRIORITY:
-    if (session->server) {
+    if (session->server ||
+        (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
       return 0;
       ;
     }
@@ -2804,7 +3182,7 @@ static int session_after_frame_sent2(nghttp2_session *session) {
      further data. */
   if (nghttp2_session_predicate_data_send(session, stream) != 0) {
     if (stream) {
-      rv = nghttp2_stream_detach_item(stream);
+      rv = session_detach_stream_item(session, stream);
 
       if (nghttp2_is_fatal(rv)) {
         return rv;
@@ -2831,6 +3209,13 @@ static int session_call_send_data(nghttp2_session *session,
   nghttp2_frame *frame;
   nghttp2_data_aux_data *aux_data;
 
+  if (session->callbacks.send_data_callback == NULL) {
+    DEBUGF("send: NGHTTP2_DATA_FLAG_NO_COPY with ref_data_callback "
+           "requires nghttp2_session_mem_send_iov\n");
+
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
   buf = &framebufs->cur->buf;
   frame = &item->frame;
   length = frame->hd.length - frame->data.padlen;
@@ -2851,9 +3236,134 @@ static int session_call_send_data(nghttp2_session *session,
   }
 }
 
+/* The vector of buffers filled by nghttp2_session_mem_send_iov() */
+typedef struct {
+  nghttp2_vec *vec;
+  /* The capacity of |vec| */
+  size_t veccnt;
+  /* The number of elements filled in |vec| */
+  size_t nvec;
+} nghttp2_iov_batch;
+
+/*
+ * Appends |len| bytes of data pointed by |data| to |batch|.  If it is
+ * contiguous to the last element of |batch|, that element is
+ * extended.  The caller must ensure that |batch| has room for one
+ * element.
+ */
+static void iov_batch_add(nghttp2_iov_batch *batch, const uint8_t *data,
+                          size_t len) {
+  nghttp2_vec *vec;
+
+  if (len == 0) {
+    return;
+  }
+
+  if (batch->nvec) {
+    vec = &batch->vec[batch->nvec - 1];
+
+    if (vec->base + vec->len == data) {
+      vec->len += len;
+      return;
+    }
+  }
+
+  vec = &batch->vec[batch->nvec++];
+
+  vec->base = (uint8_t *)data;
+  vec->len = len;
+}
+
+/*
+ * Appends DATA frame produced with NGHTTP2_DATA_FLAG_NO_COPY to
+ * |batch|.  The frame header and padding are written to
+ * session->iovbuf, and application data obtained by
+ * ref_data_callback is referenced without copy.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_WOULDBLOCK
+ *   |batch| or session->iovbuf does not have enough room.
+ * NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE
+ *   The callback function wants to reset stream.
+ * NGHTTP2_ERR_CALLBACK_FAILURE
+ *   The callback function failed.
+ */
+static int session_call_ref_data(nghttp2_session *session,
+                                 nghttp2_outbound_item *item,
+                                 nghttp2_bufs *framebufs,
+                                 nghttp2_iov_batch *batch) {
+  int rv;
+  nghttp2_buf *buf;
+  nghttp2_buf *iovbuf;
+  size_t length, hdlen, padlen;
+  nghttp2_frame *frame;
+  nghttp2_data_aux_data *aux_data;
+  const uint8_t *data = NULL;
+  uint8_t *p;
+
+  buf = &framebufs->cur->buf;
+  iovbuf = &session->iovbuf;
+  frame = &item->frame;
+  length = frame->hd.length - frame->data.padlen;
+  aux_data = &item->aux_data.data;
+
+  /* framebufs contains frame header and Pad Length field.  Padding
+     itself is not written there. */
+  hdlen = NGHTTP2_FRAME_HDLEN + (frame->data.padlen > 0 ? 1 : 0);
+  padlen = frame->data.padlen > 1 ? frame->data.padlen - 1 : 0;
+
+  /* Frame header, application data and padding */
+  if (batch->veccnt - batch->nvec < 3 ||
+      nghttp2_buf_avail(iovbuf) < hdlen + padlen) {
+    return NGHTTP2_ERR_WOULDBLOCK;
+  }
+
+  rv = session->callbacks.ref_data_callback(session, frame, &data, length,
+                                            &aux_data->data_prd.source,
+                                            session->user_data);
+
+  switch (rv) {
+  case 0:
+    break;
+  case NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE:
+    return rv;
+  default:
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  p = iovbuf->last;
+  iovbuf->last = nghttp2_cpymem(iovbuf->last, buf->pos, hdlen);
+  iov_batch_add(batch, p, hdlen);
+
+  iov_batch_add(batch, data, length);
+
+  if (padlen) {
+    p = iovbuf->last;
+    memset(p, 0, padlen);
+    iovbuf->last += padlen;
+    iov_batch_add(batch, p, padlen);
+  }
+
+  return 0;
+}
+
+/*
+ * Serializes the next chunk of outbound frames, and assigns the
+ * pointer to it to |*data_ptr|.  If |batch| is not NULL, DATA frames
+ * produced with NGHTTP2_DATA_FLAG_NO_COPY are appended to |batch|.
+ * If |maxlen| is nonzero, and the next chunk is longer than |maxlen|
+ * bytes, this function returns 0 without consuming it.
+ *
+ * This function returns the length of chunk, or 0 if there is
+ * nothing to send at the moment, or negative error code.
+ */
 static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
                                                  const uint8_t **data_ptr,
-                                                 int fast_cb) {
+                                                 int fast_cb,
+                                                 nghttp2_iov_batch *batch,
+                                                 size_t maxlen) {
   int rv;
   nghttp2_active_outbound_item *aob;
   nghttp2_bufs *framebufs;
@@ -3022,9 +3532,13 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
 
           break;
         }
+
+        session_count_frame_sent(session, item);
       } else {
         DEBUGF("send: next frame: DATA\n");
 
+        session_count_frame_sent(session, item);
+
         if (item->aux_data.data.no_copy) {
           aob->state = NGHTTP2_OB_SEND_NO_COPY;
           break;
@@ -3069,9 +3583,14 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
         break;
       }
 
-      *data_ptr = buf->pos;
       datalen = nghttp2_buf_len(buf);
 
+      if (maxlen && datalen > maxlen) {
+        return 0;
+      }
+
+      *data_ptr = buf->pos;
+
       /* We increment the offset here. If send_callback does not send
          everything, we will adjust it. */
       buf->pos += datalen;
@@ -3096,13 +3615,23 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
         break;
       }
 
-      rv = session_call_send_data(session, aob->item, framebufs);
+      if (batch && session->callbacks.ref_data_callback) {
+        rv = session_call_ref_data(session, aob->item, framebufs, batch);
+      } else {
+        if ((batch && batch->nvec) || maxlen) {
+          /* Frames serialized so far must be written before
+             send_data_callback writes this frame. */
+          return 0;
+        }
+
+        rv = session_call_send_data(session, aob->item, framebufs);
+      }
       if (nghttp2_is_fatal(rv)) {
         return rv;
       }
 
       if (rv == NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE) {
-        rv = nghttp2_stream_detach_item(stream);
+        rv = session_detach_stream_item(session, stream);
 
         if (nghttp2_is_fatal(rv)) {
           return rv;
@@ -3142,6 +3671,10 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
         return 0;
       }
 
+      if (batch && batch->nvec == batch->veccnt) {
+        return 0;
+      }
+
       break;
     }
     case NGHTTP2_OB_SEND_CLIENT_MAGIC: {
@@ -3156,9 +3689,14 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
         break;
       }
 
-      *data_ptr = buf->pos;
       datalen = nghttp2_buf_len(buf);
 
+      if (maxlen && datalen > maxlen) {
+        return 0;
+      }
+
+      *data_ptr = buf->pos;
+
       buf->pos += datalen;
 
       return (ssize_t)datalen;
@@ -3167,6 +3705,75 @@ static ssize_t nghttp2_session_mem_send_internal(nghttp2_session *session,
   }
 }
 
+/*
+ * Copies the chunk of |len| bytes pointed by |*data_ptr| to
+ * session->coalescebuf, and appends following frames as long as they
+ * fit in it.  |*data_ptr| is updated to point to the coalesced
+ * frames.
+ *
+ * This function returns the length of coalesced frames, or one of
+ * the negative error codes that nghttp2_session_mem_send() returns.
+ */
+static ssize_t session_mem_send_coalesce(nghttp2_session *session,
+                                         const uint8_t **data_ptr,
+                                         size_t len) {
+  int rv;
+  ssize_t nextlen;
+  const uint8_t *data;
+  nghttp2_buf *buf;
+
+  buf = &session->coalescebuf;
+
+  if (buf->begin == NULL) {
+    rv = nghttp2_buf_init2(buf, session->send_coalesce_length,
+                           &session->mem);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  /* The caller has consumed the previous chunk. */
+  nghttp2_buf_reset(buf);
+
+  if (nghttp2_buf_avail(buf) < len + NGHTTP2_FRAME_HDLEN) {
+    /* No other frame fits with this chunk.  Return it without
+       copy. */
+    return (ssize_t)len;
+  }
+
+  buf->last = nghttp2_cpymem(buf->last, *data_ptr, len);
+
+  /* The smallest frame is a frame header without payload. */
+  while (nghttp2_buf_avail(buf) >= NGHTTP2_FRAME_HDLEN) {
+    data = NULL;
+
+    nextlen = nghttp2_session_mem_send_internal(session, &data, 1, NULL,
+                                                nghttp2_buf_avail(buf));
+    if (nextlen < 0) {
+      return nextlen;
+    }
+
+    if (nextlen == 0) {
+      break;
+    }
+
+    if (session->aob.item) {
+      /* See nghttp2_session_mem_send() */
+      rv = session_after_frame_sent1(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return (ssize_t)rv;
+      }
+    }
+
+    buf->last = nghttp2_cpymem(buf->last, data, (size_t)nextlen);
+  }
+
+  *data_ptr = buf->pos;
+
+  return (ssize_t)nghttp2_buf_len(buf);
+}
+
 ssize_t nghttp2_session_mem_send(nghttp2_session *session,
                                  const uint8_t **data_ptr) {
   int rv;
@@ -3174,7 +3781,7 @@ ssize_t nghttp2_session_mem_send(nghttp2_session *session,
 
   *data_ptr = NULL;
 
-  len = nghttp2_session_mem_send_internal(session, data_ptr, 1);
+  len = nghttp2_session_mem_send_internal(session, data_ptr, 1, NULL, 0);
   if (len <= 0) {
     return len;
   }
@@ -3191,9 +3798,86 @@ ssize_t nghttp2_session_mem_send(nghttp2_session *session,
     }
   }
 
+  if (session->send_coalesce_length) {
+    return session_mem_send_coalesce(session, data_ptr, (size_t)len);
+  }
+
   return len;
 }
 
+ssize_t nghttp2_session_mem_send_iov(nghttp2_session *session,
+                                     nghttp2_vec *vec, size_t veccnt) {
+  int rv;
+  ssize_t len;
+  const uint8_t *data;
+  nghttp2_iov_batch batch;
+  nghttp2_buf *iovbuf;
+  nghttp2_outbound_item *item;
+  uint8_t *p;
+
+  if (veccnt < 3) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  iovbuf = &session->iovbuf;
+
+  if (iovbuf->begin == NULL) {
+    rv = nghttp2_buf_init2(iovbuf, NGHTTP2_IOVBUF_LENGTH, &session->mem);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  /* The caller has written the previous batch. */
+  nghttp2_buf_reset(iovbuf);
+
+  batch.vec = vec;
+  batch.veccnt = veccnt;
+  batch.nvec = 0;
+
+  while (batch.nvec < batch.veccnt) {
+    data = NULL;
+
+    len = nghttp2_session_mem_send_internal(session, &data, 1, &batch, 0);
+    if (len < 0) {
+      return len;
+    }
+
+    if (len == 0) {
+      break;
+    }
+
+    item = session->aob.item;
+
+    if (item) {
+      /* See nghttp2_session_mem_send() */
+      rv = session_after_frame_sent1(session);
+      if (rv < 0) {
+        assert(nghttp2_is_fatal(rv));
+        return (ssize_t)rv;
+      }
+    }
+
+    if (nghttp2_buf_avail(iovbuf) >= (size_t)len &&
+        (item == NULL || item->frame.hd.type != NGHTTP2_DATA ||
+         (size_t)len <= NGHTTP2_IOVBUF_MAX_DATA_COPY)) {
+      p = iovbuf->last;
+      iovbuf->last = nghttp2_cpymem(iovbuf->last, data, (size_t)len);
+      iov_batch_add(&batch, p, (size_t)len);
+
+      continue;
+    }
+
+    /* Refer to the frame buffer directly.  It is reused for the next
+       frame, so we have to stop here. */
+    iov_batch_add(&batch, data, (size_t)len);
+
+    break;
+  }
+
+  return (ssize_t)batch.nvec;
+}
+
 int nghttp2_session_send(nghttp2_session *session) {
   const uint8_t *data = NULL;
   ssize_t datalen;
@@ -3203,7 +3887,7 @@ int nghttp2_session_send(nghttp2_session *session) {
   framebufs = &session->aob.framebufs;
 
   for (;;) {
-    datalen = nghttp2_session_mem_send_internal(session, &data, 0);
+    datalen = nghttp2_session_mem_send_internal(session, &data, 0, NULL, 0);
     if (datalen <= 0) {
       return (int)datalen;
     }
@@ -4047,8 +4731,10 @@ int nghttp2_session_on_priority_received(nghttp2_session *session,
         session, NGHTTP2_PROTOCOL_ERROR, "depend on itself");
   }
 
-  if (!session->server) {
-    /* Re-prioritization works only in server */
+  if (!session->server ||
+      (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    /* Re-prioritization works only in server, and only if RFC 7540
+       priorities are used. */
     return session_call_on_frame_received(session, frame);
   }
 
@@ -4161,8 +4847,8 @@ static int update_remote_initial_window_size_func(nghttp2_map_entry *entry,
   if (stream->remote_window_size > 0 &&
       nghttp2_stream_check_deferred_by_flow_control(stream)) {
 
-    rv = nghttp2_stream_resume_deferred_item(
-        stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
+    rv = session_resume_deferred_stream_item(
+        arg->session, stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
 
     if (nghttp2_is_fatal(rv)) {
       return rv;
@@ -4618,6 +5304,137 @@ static int session_process_push_promise_frame(nghttp2_session *session) {
   return nghttp2_session_on_push_promise_received(session, frame);
 }
 
+/* Opaque data of PING for automatic window tuning */
+static const uint8_t BDP_PING_OPAQUE[] = {'n', 'g', 'h', '2', 'b', 'd', 'p', 0};
+
+/*
+ * Returns the initial window size of streams which the remote
+ * endpoint will use after it acknowledges all SETTINGS we have sent.
+ */
+static uint32_t session_get_pending_initial_window_size(
+    nghttp2_session *session) {
+  nghttp2_inflight_settings *settings;
+  uint32_t window_size = session->local_settings.initial_window_size;
+  size_t i;
+
+  for (settings = session->inflight_settings_head; settings;
+       settings = settings->next) {
+    for (i = 0; i < settings->niv; ++i) {
+      if (settings->iv[i].settings_id == NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE) {
+        window_size = settings->iv[i].value;
+      }
+    }
+  }
+
+  return window_size;
+}
+
+/*
+ * Counts |delta_size| bytes of DATA received for automatic window
+ * tuning, and sends PING to measure the round trip if it has not been
+ * sent yet.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ */
+static int session_sample_bdp(nghttp2_session *session, size_t delta_size) {
+  int rv;
+
+  if (session->bdp_ping_inflight) {
+    session->bdp_sample = (int32_t)nghttp2_min(
+        (size_t)session->bdp_sample + delta_size, NGHTTP2_MAX_WINDOW_SIZE);
+    return 0;
+  }
+
+  if (session->auto_window_size == 0) {
+    session->auto_window_size =
+        nghttp2_min(session->local_window_size,
+                    (int32_t)session->local_settings.initial_window_size);
+  }
+
+  if (delta_size == 0 ||
+      session->auto_window_size >= session->max_auto_window_size ||
+      session_is_closing(session)) {
+    return 0;
+  }
+
+  rv = nghttp2_session_add_ping(session, NGHTTP2_FLAG_NONE, BDP_PING_OPAQUE);
+  if (rv != 0) {
+    return rv;
+  }
+
+  session->bdp_ping_inflight = 1;
+  session->bdp_sample =
+      (int32_t)nghttp2_min(delta_size, NGHTTP2_MAX_WINDOW_SIZE);
+
+  return 0;
+}
+
+/*
+ * Grows the windows using the bytes of DATA received in the last
+ * round trip of PING, if the remote endpoint appears to be limited by
+ * flow control.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *     Out of memory.
+ * NGHTTP2_ERR_FLOW_CONTROL
+ *     The window size overflowed.
+ */
+static int session_update_auto_window_size(nghttp2_session *session) {
+  nghttp2_settings_entry iv;
+  int32_t window_size;
+  int rv;
+
+  session->bdp_ping_inflight = 0;
+
+  /* WINDOW_UPDATE is sent when half of the window is consumed, and
+     the remote endpoint can send at most about half of the window in
+     one round trip.  If it sent less than 1/3 of the window,
+     something other than flow control limits the throughput. */
+  if (session->bdp_sample < session->auto_window_size / 3) {
+    return 0;
+  }
+
+  window_size = (int32_t)nghttp2_min((int64_t)session->auto_window_size * 2,
+                                     session->max_auto_window_size);
+
+  if (window_size <= session->auto_window_size) {
+    return 0;
+  }
+
+  DEBUGF("recv: auto window size %d -> %d\n", session->auto_window_size,
+         window_size);
+
+  session->auto_window_size = window_size;
+
+  if (window_size > session->local_window_size) {
+    rv = nghttp2_session_set_local_window_size(session, NGHTTP2_FLAG_NONE, 0,
+                                               window_size);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  if ((uint32_t)window_size >
+      session_get_pending_initial_window_size(session)) {
+    iv.settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+    iv.value = (uint32_t)window_size;
+
+    rv = nghttp2_session_add_settings(session, NGHTTP2_FLAG_NONE, &iv, 1);
+    if (rv != 0) {
+      return rv;
+    }
+  }
+
+  return 0;
+}
+
 int nghttp2_session_on_ping_received(nghttp2_session *session,
                                      nghttp2_frame *frame) {
   int rv = 0;
@@ -4625,6 +5442,14 @@ int nghttp2_session_on_ping_received(nghttp2_session *session,
     return session_handle_invalid_connection(session, frame, NGHTTP2_ERR_PROTO,
                                              "PING: stream_id != 0");
   }
+  if ((frame->hd.flags & NGHTTP2_FLAG_ACK) && session->bdp_ping_inflight &&
+      memcmp(frame->ping.opaque_data, BDP_PING_OPAQUE,
+             sizeof(BDP_PING_OPAQUE)) == 0) {
+    rv = session_update_auto_window_size(session);
+    if (nghttp2_is_fatal(rv)) {
+      return rv;
+    }
+  }
   if ((session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_PING_ACK) == 0 &&
       (frame->hd.flags & NGHTTP2_FLAG_ACK) == 0 &&
       !session_is_closing(session)) {
@@ -4745,8 +5570,8 @@ static int session_on_stream_window_update_received(nghttp2_session *session,
   if (stream->remote_window_size > 0 &&
       nghttp2_stream_check_deferred_by_flow_control(stream)) {
 
-    rv = nghttp2_stream_resume_deferred_item(
-        stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
+    rv = session_resume_deferred_stream_item(
+        session, stream, NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL);
 
     if (nghttp2_is_fatal(rv)) {
       return rv;
@@ -4986,6 +5811,12 @@ static int session_update_recv_connection_window_size(nghttp2_session *session,
     return nghttp2_session_terminate_session(session,
                                              NGHTTP2_FLOW_CONTROL_ERROR);
   }
+  if (session->max_auto_window_size) {
+    rv = session_sample_bdp(session, delta_size);
+    if (rv != 0) {
+      return rv;
+    }
+  }
   if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_AUTO_WINDOW_UPDATE) &&
       session->window_update_queued == 0 &&
       nghttp2_should_send_window_update(session->local_window_size,
@@ -5381,6 +6212,8 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
       nghttp2_frame_unpack_frame_hd(&iframe->frame.hd, iframe->sbuf.pos);
       iframe->payloadleft = iframe->frame.hd.length;
 
+      session_count_frame_recv(session, &iframe->frame.hd);
+
       DEBUGF("recv: payloadlen=%zu, type=%u, flags=0x%02x, stream_id=%d\n",
              iframe->frame.hd.length, iframe->frame.hd.type,
              iframe->frame.hd.flags, iframe->frame.hd.stream_id);
@@ -6236,6 +7069,8 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
       nghttp2_frame_unpack_frame_hd(&cont_hd, iframe->sbuf.pos);
       iframe->payloadleft = cont_hd.length;
 
+      session_count_frame_recv(session, &cont_hd);
+
       DEBUGF("recv: payloadlen=%zu, type=%u, flags=0x%02x, stream_id=%d\n",
              cont_hd.length, cont_hd.type, cont_hd.flags, cont_hd.stream_id);
 
@@ -6416,17 +7251,25 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
               break;
             }
           }
-          if (session->callbacks.on_data_chunk_recv_callback) {
+          if (session->callbacks.on_data_chunk_recv_callback2) {
+            rv = session->callbacks.on_data_chunk_recv_callback2(
+                session, iframe->frame.hd.flags, iframe->frame.hd.stream_id,
+                session->recv_rcbuf, in - readlen, (size_t)data_readlen,
+                session->user_data);
+          } else if (session->callbacks.on_data_chunk_recv_callback) {
             rv = session->callbacks.on_data_chunk_recv_callback(
                 session, iframe->frame.hd.flags, iframe->frame.hd.stream_id,
                 in - readlen, (size_t)data_readlen, session->user_data);
-            if (rv == NGHTTP2_ERR_PAUSE) {
-              return in - first;
-            }
+          } else {
+            rv = 0;
+          }
 
-            if (nghttp2_is_fatal(rv)) {
-              return NGHTTP2_ERR_CALLBACK_FAILURE;
-            }
+          if (rv == NGHTTP2_ERR_PAUSE) {
+            return in - first;
+          }
+
+          if (nghttp2_is_fatal(rv)) {
+            return NGHTTP2_ERR_CALLBACK_FAILURE;
           }
         }
       }
@@ -6563,6 +7406,25 @@ ssize_t nghttp2_session_mem_recv(nghttp2_session *session, const uint8_t *in,
   return in - first;
 }
 
+ssize_t nghttp2_session_mem_recv_rcbuf(nghttp2_session *session,
+                                       nghttp2_rcbuf *buf, const uint8_t *in,
+                                       size_t inlen) {
+  ssize_t rv;
+
+  if (in < buf->base || (size_t)(in - buf->base) > buf->len ||
+      inlen > buf->len - (size_t)(in - buf->base)) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  session->recv_rcbuf = buf;
+
+  rv = nghttp2_session_mem_recv(session, in, inlen);
+
+  session->recv_rcbuf = NULL;
+
+  return rv;
+}
+
 int nghttp2_session_recv(nghttp2_session *session) {
   uint8_t buf[NGHTTP2_INBOUND_BUFFER_LENGTH];
   while (1) {
@@ -6632,7 +7494,7 @@ int nghttp2_session_want_write(nghttp2_session *session) {
    */
   return session->aob.item || nghttp2_outbound_queue_top(&session->ob_urgent) ||
          nghttp2_outbound_queue_top(&session->ob_reg) ||
-         (!nghttp2_pq_empty(&session->root.obq) &&
+         (!session_sched_empty(session) &&
           session->remote_window_size > 0) ||
          (nghttp2_outbound_queue_top(&session->ob_syn) &&
           !session_is_outgoing_concurrent_streams_max(session));
@@ -6967,8 +7829,10 @@ int nghttp2_session_pack_data(nghttp2_session *session, nghttp2_bufs *bufs,
   }
 
   if (data_flags & NGHTTP2_DATA_FLAG_NO_COPY) {
-    if (session->callbacks.send_data_callback == NULL) {
-      DEBUGF("NGHTTP2_DATA_FLAG_NO_COPY requires send_data_callback set\n");
+    if (session->callbacks.send_data_callback == NULL &&
+        session->callbacks.ref_data_callback == NULL) {
+      DEBUGF("NGHTTP2_DATA_FLAG_NO_COPY requires send_data_callback or "
+             "ref_data_callback set\n");
 
       return NGHTTP2_ERR_CALLBACK_FAILURE;
     }
@@ -6997,7 +7861,7 @@ int nghttp2_session_pack_data(nghttp2_session *session, nghttp2_bufs *bufs,
     return rv;
   }
 
-  reschedule_stream(stream);
+  reschedule_stream(session, stream);
 
   if (frame->hd.length == 0 && (data_flags & NGHTTP2_DATA_FLAG_EOF) &&
       (data_flags & NGHTTP2_DATA_FLAG_NO_END_STREAM)) {
@@ -7041,7 +7905,7 @@ int nghttp2_session_resume_data(nghttp2_session *session, int32_t stream_id) {
     return NGHTTP2_ERR_INVALID_ARGUMENT;
   }
 
-  rv = nghttp2_stream_resume_deferred_item(stream,
+  rv = session_resume_deferred_stream_item(session, stream,
                                            NGHTTP2_STREAM_FLAG_DEFERRED_USER);
 
   if (nghttp2_is_fatal(rv)) {
@@ -7478,6 +8342,10 @@ int nghttp2_session_create_idle_stream(nghttp2_session *session,
   nghttp2_stream *stream;
   nghttp2_priority_spec pri_spec_copy;
 
+  if (session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
   if (stream_id == 0 || stream_id == pri_spec->stream_id ||
       !session_detect_idle_stream(session, stream_id)) {
     return NGHTTP2_ERR_INVALID_ARGUMENT;
@@ -7506,6 +8374,73 @@ int nghttp2_session_create_idle_stream(nghttp2_session *session,
   return 0;
 }
 
+int nghttp2_session_change_extpri_stream_priority(
+    nghttp2_session *session, int32_t stream_id,
+    const nghttp2_extpri *extpri_in) {
+  nghttp2_stream *stream;
+  nghttp2_extpri extpri = *extpri_in;
+  uint8_t u8extpri;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
+  if (stream_id == 0) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  stream = nghttp2_session_get_stream_raw(session, stream_id);
+  if (!stream) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  if (extpri.urgency > NGHTTP2_EXTPRI_URGENCY_LOW) {
+    extpri.urgency = NGHTTP2_EXTPRI_URGENCY_LOW;
+  }
+  extpri.inc = extpri.inc != 0;
+
+  u8extpri = nghttp2_extpri_to_uint8(&extpri);
+
+  if (stream->extpri == u8extpri) {
+    return 0;
+  }
+
+  if (stream->queued) {
+    session_ob_data_remove(session, stream);
+    stream->extpri = u8extpri;
+    session_ob_data_push(session, stream);
+
+    return 0;
+  }
+
+  stream->extpri = u8extpri;
+
+  return 0;
+}
+
+int nghttp2_session_get_extpri_stream_priority(nghttp2_session *session,
+                                               nghttp2_extpri *extpri,
+                                               int32_t stream_id) {
+  nghttp2_stream *stream;
+
+  if (!(session->opt_flags & NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES)) {
+    return NGHTTP2_ERR_INVALID_STATE;
+  }
+
+  if (stream_id == 0) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  stream = nghttp2_session_get_stream_raw(session, stream_id);
+  if (!stream) {
+    return NGHTTP2_ERR_INVALID_ARGUMENT;
+  }
+
+  nghttp2_extpri_from_uint8(extpri, stream->extpri);
+
+  return 0;
+}
+
 size_t
 nghttp2_session_get_hd_inflate_dynamic_table_size(nghttp2_session *session) {
   return nghttp2_hd_inflate_get_dynamic_table_size(&session->hd_inflater);
@@ -7515,3 +8450,29 @@ size_t
 nghttp2_session_get_hd_deflate_dynamic_table_size(nghttp2_session *session) {
   return nghttp2_hd_deflate_get_dynamic_table_size(&session->hd_deflater);
 }
+
+const nghttp2_session_stats *
+nghttp2_session_get_stats(nghttp2_session *session) {
+  nghttp2_session_stats *stats = &session->stats;
+  const nghttp2_hd_stats *hd_stats;
+
+  /* HPACK counters are maintained by deflater and inflater, which are
+     also used without session. */
+  hd_stats = &session->hd_deflater.stats;
+
+  stats->hd_deflate_indexed = hd_stats->indexed;
+  stats->hd_deflate_indexed_name = hd_stats->indexed_name;
+  stats->hd_deflate_literal = hd_stats->literal;
+  stats->hd_deflate_nvlen = hd_stats->nvlen;
+  stats->hd_deflate_blocklen = hd_stats->blocklen;
+
+  hd_stats = &session->hd_inflater.stats;
+
+  stats->hd_inflate_indexed = hd_stats->indexed;
+  stats->hd_inflate_indexed_name = hd_stats->indexed_name;
+  stats->hd_inflate_literal = hd_stats->literal;
+  stats->hd_inflate_nvlen = hd_stats->nvlen;
+  stats->hd_inflate_blocklen = hd_stats->blocklen;
+
+  return stats;
+}
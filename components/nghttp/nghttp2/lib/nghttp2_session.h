@@ -39,6 +39,7 @@
 #include "nghttp2_buf.h"
 #include "nghttp2_callbacks.h"
 #include "nghttp2_mem.h"
+#include "nghttp2_slab.h"
 
 /* The global variable for tests where we want to disable strict
    preface handling. */
@@ -52,7 +53,8 @@ typedef enum {
   NGHTTP2_OPTMASK_NO_RECV_CLIENT_MAGIC = 1 << 1,
   NGHTTP2_OPTMASK_NO_HTTP_MESSAGING = 1 << 2,
   NGHTTP2_OPTMASK_NO_AUTO_PING_ACK = 1 << 3,
-  NGHTTP2_OPTMASK_NO_CLOSED_STREAMS = 1 << 4
+  NGHTTP2_OPTMASK_NO_CLOSED_STREAMS = 1 << 4,
+  NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES = 1 << 5
 } nghttp2_optmask;
 
 /*
@@ -101,6 +103,15 @@ typedef struct {
 /* The default value of maximum number of concurrent streams. */
 #define NGHTTP2_DEFAULT_MAX_CONCURRENT_STREAMS 0xffffffffu
 
+/* Buffer length to store frames serialized by
+   nghttp2_session_mem_send_iov(). */
+#define NGHTTP2_IOVBUF_LENGTH 16384
+
+/* DATA frame which is larger than this value is not copied into the
+   buffer for nghttp2_session_mem_send_iov(), and it is referenced
+   from the frame buffer instead. */
+#define NGHTTP2_IOVBUF_MAX_DATA_COPY 1024
+
 /* Internal state when receiving incoming frame */
 typedef enum {
   /* Receiving frame header */
@@ -187,10 +198,20 @@ struct nghttp2_inflight_settings {
 
 typedef struct nghttp2_inflight_settings nghttp2_inflight_settings;
 
+/* nghttp2_sched is the FIFO queue of streams of the same urgency
+   which have DATA to send.  Streams are linked through sched_prev
+   and sched_next. */
+typedef struct {
+  nghttp2_stream *head, *tail;
+} nghttp2_sched;
+
 struct nghttp2_session {
   nghttp2_map /* <nghttp2_stream*> */ streams;
   /* root of dependency tree*/
   nghttp2_stream root;
+  /* Queues of streams per urgency used instead of dependency tree if
+     NGHTTP2_OPTMASK_NO_RFC7540_PRIORITIES is set. */
+  nghttp2_sched sched[NGHTTP2_EXTPRI_URGENCY_LEVELS];
   /* Queue for outbound urgent frames (PING and SETTINGS) */
   nghttp2_outbound_queue ob_urgent;
   /* Queue for non-DATA frames */
@@ -200,12 +221,31 @@ struct nghttp2_session {
      SETTINGS_MAX_CONCURRENT_STREAMS limit. */
   nghttp2_outbound_queue ob_syn;
   nghttp2_active_outbound_item aob;
+  /* Buffer to store frames serialized by
+     nghttp2_session_mem_send_iov().  It is allocated when that
+     function is first called. */
+  nghttp2_buf iovbuf;
+  /* Buffer to coalesce frames returned by nghttp2_session_mem_send().
+     It is allocated when that function first coalesces frames. */
+  nghttp2_buf coalescebuf;
   nghttp2_inbound_frame iframe;
   nghttp2_hd_deflater hd_deflater;
   nghttp2_hd_inflater hd_inflater;
   nghttp2_session_callbacks callbacks;
-  /* Memory allocator */
+  /* Memory allocator.  It counts allocations in |stats|, and routes
+     requests to |mem_parent|. */
   nghttp2_mem mem;
+  /* Memory allocator given by application, or the slab allocator if
+     it is enabled */
+  nghttp2_mem mem_parent;
+  nghttp2_session_stats stats;
+  /* Slab allocator which |mem| routes requests to.  NULL if slab
+     allocator is not enabled. */
+  nghttp2_slab *slab;
+  /* Reference counted buffer holding the input bytes while
+     nghttp2_session_mem_recv_rcbuf() is in progress.  NULL
+     otherwise. */
+  nghttp2_rcbuf *recv_rcbuf;
   /* Base value when we schedule next DATA frame write.  This is
      updated when one frame was written. */
   uint64_t last_cycle;
@@ -263,6 +303,9 @@ struct nghttp2_session {
   /* The maximum length of header block to send.  Calculated by the
      same way as nghttp2_hd_deflate_bound() does. */
   size_t max_send_header_block_length;
+  /* The length of buffer to coalesce frames in
+     nghttp2_session_mem_send().  0 disables coalescing. */
+  size_t send_coalesce_length;
   /* Next Stream ID. Made unsigned int to detect >= (1 << 31). */
   uint32_t next_stream_id;
   /* The last stream ID this session initiated.  For client session,
@@ -306,6 +349,16 @@ struct nghttp2_session {
   nghttp2_settings_storage remote_settings;
   /* Settings value of the local endpoint. */
   nghttp2_settings_storage local_settings;
+  /* The maximum window size automatic window tuning grows the windows
+     to.  0 if automatic window tuning is disabled. */
+  int32_t max_auto_window_size;
+  /* The window size automatic window tuning has grown the windows
+     to.  0 if it has not been initialized yet. */
+  int32_t auto_window_size;
+  /* The number of bytes of DATA received since PING for automatic
+     window tuning was sent.  This is saturated at
+     NGHTTP2_MAX_WINDOW_SIZE. */
+  int32_t bdp_sample;
   /* Option flags. This is bitwise-OR of 0 or more of nghttp2_optmask. */
   uint32_t opt_flags;
   /* Unacked local SETTINGS_MAX_CONCURRENT_STREAMS value. We use this
@@ -326,6 +379,9 @@ struct nghttp2_session {
      this session.  The nonzero does not necessarily mean
      WINDOW_UPDATE is not queued. */
   uint8_t window_update_queued;
+  /* Nonzero if PING for automatic window tuning has been sent, and
+     its ACK has not been received yet. */
+  uint8_t bdp_ping_inflight;
   /* Bitfield of extension frame types that application is willing to
      receive.  To designate the bit of given frame type i, use
      user_recv_ext_types[i / 8] & (1 << (i & 0x7)).  First 10 frame
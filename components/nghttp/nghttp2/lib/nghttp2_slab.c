@@ -0,0 +1,288 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_slab.h"
+
+#include <string.h>
+#include <assert.h>
+
+/* Header prepended to each object to remember its size class.  It
+   is 8 bytes long to keep the alignment of the object. */
+typedef union {
+  uint32_t cls;
+  int64_t pad;
+} nghttp2_slab_hdr;
+
+/* Object size of each size class.  They are chosen to fit
+   nghttp2_rcbuf with short header field, nghttp2_hd_entry,
+   nghttp2_outbound_item and nghttp2_stream both on 32 and 64 bit
+   platforms. */
+static const size_t slab_class_size[NGHTTP2_SLAB_NCLASS] = {32,  64,  96,
+                                                            128, 192, 256};
+
+static uint32_t slab_find_class(size_t size) {
+  uint32_t i;
+
+  for (i = 0; i < NGHTTP2_SLAB_NCLASS; ++i) {
+    if (size <= slab_class_size[i]) {
+      return i;
+    }
+  }
+
+  return NGHTTP2_SLAB_CLASS_NONE;
+}
+
+static nghttp2_slab_hdr *slab_get_hdr(void *ptr) {
+  return (nghttp2_slab_hdr *)(void *)((uint8_t *)ptr -
+                                      sizeof(nghttp2_slab_hdr));
+}
+
+/*
+ * Allocates new page for the size class |cls|, and pushes all
+ * objects in it to the freelist.
+ */
+static int slab_add_page(nghttp2_slab *slab, uint32_t cls) {
+  nghttp2_slab_page *page;
+  nghttp2_slab_hdr *hdr;
+  nghttp2_slab_free_entry *ent;
+  uint8_t *p;
+  size_t objlen, i;
+
+  objlen = sizeof(nghttp2_slab_hdr) + slab_class_size[cls];
+
+  page = nghttp2_mem_malloc(&slab->parent, sizeof(nghttp2_slab_page) +
+                                               objlen * NGHTTP2_SLAB_PAGE_NOBJ);
+  if (page == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  page->next = slab->pages;
+  slab->pages = page;
+
+  p = (uint8_t *)page + sizeof(nghttp2_slab_page);
+
+  for (i = 0; i < NGHTTP2_SLAB_PAGE_NOBJ; ++i, p += objlen) {
+    hdr = (nghttp2_slab_hdr *)(void *)p;
+    hdr->cls = cls;
+
+    ent = (nghttp2_slab_free_entry *)(void *)(p + sizeof(nghttp2_slab_hdr));
+    ent->next = slab->freelist[cls];
+    slab->freelist[cls] = ent;
+  }
+
+  ++slab->stat[cls].npage;
+
+  return 0;
+}
+
+static void slab_del(nghttp2_slab *slab) {
+  nghttp2_mem parent;
+  nghttp2_slab_page *page, *next;
+
+  parent = slab->parent;
+
+  for (page = slab->pages; page;) {
+    next = page->next;
+    nghttp2_mem_free(&parent, page);
+    page = next;
+  }
+
+  nghttp2_mem_free(&parent, slab);
+}
+
+static void *slab_malloc(size_t size, void *mem_user_data) {
+  nghttp2_slab *slab;
+  nghttp2_slab_hdr *hdr;
+  nghttp2_slab_free_entry *ent;
+  uint32_t cls;
+
+  slab = mem_user_data;
+  cls = slab_find_class(size);
+
+  if (cls == NGHTTP2_SLAB_CLASS_NONE) {
+    hdr = nghttp2_mem_malloc(&slab->parent, sizeof(nghttp2_slab_hdr) + size);
+    if (hdr == NULL) {
+      return NULL;
+    }
+
+    hdr->cls = NGHTTP2_SLAB_CLASS_NONE;
+
+    ++slab->nlarge;
+    ++slab->nlarge_alloc;
+
+    return (uint8_t *)hdr + sizeof(nghttp2_slab_hdr);
+  }
+
+  if (slab->freelist[cls] == NULL && slab_add_page(slab, cls) != 0) {
+    return NULL;
+  }
+
+  ent = slab->freelist[cls];
+  slab->freelist[cls] = ent->next;
+
+  ++slab->stat[cls].nused;
+  ++slab->stat[cls].nalloc;
+
+  return ent;
+}
+
+static void slab_free(void *ptr, void *mem_user_data) {
+  nghttp2_slab *slab;
+  nghttp2_slab_hdr *hdr;
+  nghttp2_slab_free_entry *ent;
+  uint32_t cls;
+
+  if (ptr == NULL) {
+    return;
+  }
+
+  slab = mem_user_data;
+  hdr = slab_get_hdr(ptr);
+  cls = hdr->cls;
+
+  if (cls == NGHTTP2_SLAB_CLASS_NONE) {
+    assert(slab->nlarge > 0);
+
+    --slab->nlarge;
+    nghttp2_mem_free(&slab->parent, hdr);
+  } else {
+    assert(cls < NGHTTP2_SLAB_NCLASS);
+    assert(slab->stat[cls].nused > 0);
+
+    ent = ptr;
+    ent->next = slab->freelist[cls];
+    slab->freelist[cls] = ent;
+
+    --slab->stat[cls].nused;
+  }
+
+  if (slab->released && nghttp2_slab_get_num_outstanding(slab) == 0) {
+    slab_del(slab);
+  }
+}
+
+static void *slab_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  void *p;
+
+  if (size && nmemb > SIZE_MAX / size) {
+    return NULL;
+  }
+
+  p = slab_malloc(nmemb * size, mem_user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memset(p, 0, nmemb * size);
+
+  return p;
+}
+
+static void *slab_realloc(void *ptr, size_t size, void *mem_user_data) {
+  nghttp2_slab *slab;
+  nghttp2_slab_hdr *hdr;
+  void *p;
+  uint32_t cls;
+
+  if (ptr == NULL) {
+    return slab_malloc(size, mem_user_data);
+  }
+
+  slab = mem_user_data;
+  hdr = slab_get_hdr(ptr);
+  cls = hdr->cls;
+
+  if (cls == NGHTTP2_SLAB_CLASS_NONE) {
+    hdr = nghttp2_mem_realloc(&slab->parent, hdr,
+                              sizeof(nghttp2_slab_hdr) + size);
+    if (hdr == NULL) {
+      return NULL;
+    }
+
+    return (uint8_t *)hdr + sizeof(nghttp2_slab_hdr);
+  }
+
+  if (size <= slab_class_size[cls]) {
+    return ptr;
+  }
+
+  p = slab_malloc(size, mem_user_data);
+  if (p == NULL) {
+    return NULL;
+  }
+
+  memcpy(p, ptr, slab_class_size[cls]);
+
+  slab_free(ptr, mem_user_data);
+
+  return p;
+}
+
+int nghttp2_slab_new(nghttp2_slab **slab_ptr, nghttp2_mem *parent) {
+  nghttp2_slab *slab;
+
+  slab = nghttp2_mem_calloc(parent, 1, sizeof(nghttp2_slab));
+  if (slab == NULL) {
+    return NGHTTP2_ERR_NOMEM;
+  }
+
+  slab->parent = *parent;
+
+  slab->mem.mem_user_data = slab;
+  slab->mem.malloc = slab_malloc;
+  slab->mem.free = slab_free;
+  slab->mem.calloc = slab_calloc;
+  slab->mem.realloc = slab_realloc;
+
+  *slab_ptr = slab;
+
+  return 0;
+}
+
+void nghttp2_slab_release(nghttp2_slab *slab) {
+  if (slab == NULL) {
+    return;
+  }
+
+  if (nghttp2_slab_get_num_outstanding(slab) == 0) {
+    slab_del(slab);
+    return;
+  }
+
+  slab->released = 1;
+}
+
+nghttp2_mem *nghttp2_slab_get_mem(nghttp2_slab *slab) { return &slab->mem; }
+
+size_t nghttp2_slab_get_num_outstanding(nghttp2_slab *slab) {
+  size_t i, n;
+
+  n = slab->nlarge;
+
+  for (i = 0; i < NGHTTP2_SLAB_NCLASS; ++i) {
+    n += slab->stat[i].nused;
+  }
+
+  return n;
+}
@@ -0,0 +1,130 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_SLAB_H
+#define NGHTTP2_SLAB_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <nghttp2/nghttp2.h>
+#include "nghttp2_int.h"
+#include "nghttp2_mem.h"
+
+/* Implementation of slab allocator for small fixed size objects
+   (nghttp2_stream, nghttp2_outbound_item, nghttp2_hd_entry and
+   nghttp2_rcbuf).  Each size class has its own freelist, which is
+   refilled by carving a page of NGHTTP2_SLAB_PAGE_NOBJ objects
+   obtained from the parent allocator.  Memory freed to the slab is
+   kept in the freelist, and returned to the parent allocator when
+   the slab is destroyed.  Requests larger than the largest size class
+   are forwarded to the parent allocator. */
+
+/* The number of size classes */
+#define NGHTTP2_SLAB_NCLASS 6
+
+/* The number of objects carved from one page */
+#define NGHTTP2_SLAB_PAGE_NOBJ 8
+
+/* The class index for objects allocated by parent allocator */
+#define NGHTTP2_SLAB_CLASS_NONE 0xffu
+
+typedef struct nghttp2_slab_page {
+  struct nghttp2_slab_page *next;
+#if SIZEOF_INT_P == 4
+  /* we requires 8 bytes aligment */
+  int64_t pad;
+#endif
+} nghttp2_slab_page;
+
+typedef struct nghttp2_slab_free_entry {
+  struct nghttp2_slab_free_entry *next;
+} nghttp2_slab_free_entry;
+
+typedef struct {
+  /* The number of objects currently handed out from this class */
+  size_t nused;
+  /* The number of allocations served from this class */
+  size_t nalloc;
+  /* The number of pages allocated for this class */
+  size_t npage;
+} nghttp2_slab_class_stat;
+
+typedef struct {
+  /* Allocator functions which route requests to this slab.
+     mem.mem_user_data points to this object. */
+  nghttp2_mem mem;
+  /* Parent allocator which pages and large objects are allocated
+     from. */
+  nghttp2_mem parent;
+  /* Linked list of pages allocated from |parent| */
+  nghttp2_slab_page *pages;
+  /* Freelist per size class */
+  nghttp2_slab_free_entry *freelist[NGHTTP2_SLAB_NCLASS];
+  nghttp2_slab_class_stat stat[NGHTTP2_SLAB_NCLASS];
+  /* The number of objects currently allocated from |parent| directly
+     because they do not fit in any size class. */
+  size_t nlarge;
+  /* The number of allocations forwarded to |parent| directly */
+  size_t nlarge_alloc;
+  /* Nonzero if owner released this slab.  The slab is destroyed when
+     the last outstanding object is freed. */
+  int released;
+} nghttp2_slab;
+
+/*
+ * Allocates new slab object, and assigns its pointer to |*slab_ptr|.
+ * Pages and large objects are allocated from |parent|, which is
+ * copied into the slab.
+ *
+ * This function returns 0 if it succeeds, or one of the following
+ * negative error codes:
+ *
+ * NGHTTP2_ERR_NOMEM
+ *   Out of memory
+ */
+int nghttp2_slab_new(nghttp2_slab **slab_ptr, nghttp2_mem *parent);
+
+/*
+ * Releases |slab|.  If no object allocated from |slab| is
+ * outstanding, |slab| and all its pages are freed immediately.
+ * Otherwise, they are freed when the last outstanding object is
+ * freed.  The latter happens when application retains nghttp2_rcbuf
+ * beyond the lifetime of session.
+ */
+void nghttp2_slab_release(nghttp2_slab *slab);
+
+/*
+ * Returns the allocator functions which allocate memory from |slab|.
+ */
+nghttp2_mem *nghttp2_slab_get_mem(nghttp2_slab *slab);
+
+/*
+ * Returns the number of objects currently allocated through |slab|,
+ * including the ones forwarded to parent allocator.
+ */
+size_t nghttp2_slab_get_num_outstanding(nghttp2_slab *slab);
+
+#endif /* NGHTTP2_SLAB_H */
@@ -90,7 +90,10 @@ typedef enum {
   NGHTTP2_STREAM_FLAG_DEFERRED_USER = 0x08,
   /* bitwise OR of NGHTTP2_STREAM_FLAG_DEFERRED_FLOW_CONTROL and
      NGHTTP2_STREAM_FLAG_DEFERRED_USER. */
-  NGHTTP2_STREAM_FLAG_DEFERRED_ALL = 0x0c
+  NGHTTP2_STREAM_FLAG_DEFERRED_ALL = 0x0c,
+  /* Indicates that this stream is not part of dependency tree, and
+     scheduled by the flat scheduler in nghttp2_session. */
+  NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES = 0x10
 
 } nghttp2_stream_flag;
 
@@ -169,6 +172,10 @@ struct nghttp2_stream {
      closed_next points to the next stream object if it is the element
      of the list. */
   nghttp2_stream *closed_prev, *closed_next;
+  /* If NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES is set, and this
+     stream is queued, it is linked in the doubly linked list of its
+     urgency in nghttp2_session sched. */
+  nghttp2_stream *sched_prev, *sched_next;
   /* The arbitrary data provided by user for this stream. */
   void *stream_user_data;
   /* Item to send */
@@ -211,14 +218,19 @@ struct nghttp2_stream {
   /* Bitwise OR of zero or more nghttp2_shut_flag values */
   uint8_t shut_flags;
   /* Nonzero if this stream has been queued to stream pointed by
-     dep_prev.  We maintain the invariant that if a stream is queued,
-     then its ancestors, except for root, are also queued.  This
-     invariant may break in fatal error condition. */
+     dep_prev, or to the flat scheduler if
+     NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES is set.  We maintain
+     the invariant that if a stream is queued, then its ancestors,
+     except for root, are also queued.  This invariant may break in
+     fatal error condition. */
   uint8_t queued;
   /* This flag is used to reduce excessive queuing of WINDOW_UPDATE to
      this stream.  The nonzero does not necessarily mean WINDOW_UPDATE
      is not queued. */
   uint8_t window_update_queued;
+  /* Extensible priority (RFC 9218) encoded by
+     nghttp2_extpri_to_uint8() */
+  uint8_t extpri;
 };
 
 void nghttp2_stream_init(nghttp2_stream *stream, int32_t stream_id,
@@ -348,7 +360,10 @@ void nghttp2_stream_dep_add(nghttp2_stream *dep_stream, nghttp2_stream *stream);
 int nghttp2_stream_dep_remove(nghttp2_stream *stream);
 
 /*
- * Attaches |item| to |stream|.
+ * Attaches |item| to |stream|.  If
+ * NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES is set, |stream| is not
+ * queued to the dependency tree, and the caller is responsible to
+ * schedule it.
  *
  * This function returns 0 if it succeeds, or one of the following
  * negative error codes:
@@ -2,36 +2,86 @@
 # -*- coding: utf-8 -*-
 
 # This scripts reads static table entries [1] and generates
-# nghttp2_hd_static_entry table.  This table is used in
+# nghttp2_hd_static_entry table, and the perfect hash table which maps
+# name/value pair to static table index.  These tables are used in
 # lib/nghttp2_hd.c.
 #
 # [1] http://http2.github.io/http2-spec/compression.html
 
-from __future__ import unicode_literals
+from __future__ import unicode_literals, print_function
 import re, sys
 
+# The number of bits of the index into static_nv_hash_table
+NV_HASH_BITS = 5
+
+def rotl32(x, n):
+    return ((x << n) | (x >> (32 - n))) & 0xffffffff
+
 def hd_map_hash(name):
-  h = 2166136261
+  name = bytearray(name.encode('ascii'))
+  h = len(name)
+
+  # Same as name_hash() in lib/nghttp2_hd.c.  Name is processed 4
+  # bytes at a time, taken in little endian.
+  for i in range(0, len(name), 4):
+    w = 0
+    for j, c in enumerate(name[i:i + 4]):
+      w |= c << (8 * j)
+    h = ((rotl32(h, 5) ^ w) * 0x27220a95) & 0xffffffff
 
-  # FNV hash variant: http://isthe.com/chongo/tech/comp/fnv/
-  for c in name:
-    h ^= ord(c)
-    h *= 16777619
-    h &= 0xffffffff
+  h ^= h >> 16
+  h = (h * 0x85ebca6b) & 0xffffffff
+  h ^= h >> 13
 
   return h
 
+def nv_hash_key(token, value):
+  value = bytearray(value.encode('ascii'))
+  return ((token << 24) ^ (len(value) << 16) ^ (value[0] << 8) ^ value[-1]) & \
+    0xffffffff
+
+def nv_hash(key, mul):
+  return ((key * mul) & 0xffffffff) >> (32 - NV_HASH_BITS)
+
+def find_nv_hash_mul(keys):
+  # Deterministic search for the multiplier which maps all keys to
+  # distinct slots.
+  mul = 0x9e3779b1
+  while True:
+    if len(set(nv_hash(k, mul) for k in keys)) == len(keys):
+      return mul
+    mul = (mul * 1103515245 + 12345) & 0xffffffff | 1
+
 entries = []
 for line in sys.stdin:
     m = re.match(r'(\d+)\s+(\S+)\s+(\S.*)?', line)
     val = m.group(3).strip() if m.group(3) else ''
     entries.append((int(m.group(1)), m.group(2), val))
 
-print 'static nghttp2_hd_entry static_table[] = {'
+print('static nghttp2_hd_static_entry static_table[] = {')
 idx = 0
+tokens = []
 for i, ent in enumerate(entries):
     if entries[idx][1] != ent[1]:
         idx = i
-    print 'MAKE_STATIC_ENT("{}", "{}", {}, {}u),'\
-        .format(ent[1], ent[2], entries[idx][0] - 1, hd_map_hash(ent[1]))
-print '};'
+    tokens.append(entries[idx][0] - 1)
+    print('MAKE_STATIC_ENT("{}", "{}", {}, {}u),'\
+        .format(ent[1], ent[2], entries[idx][0] - 1, hd_map_hash(ent[1])))
+print('};')
+
+# Entries with empty value are the only ones for their names, so
+# they are found by token alone.
+valued = [(tokens[i], ent) for i, ent in enumerate(entries) if ent[2]]
+mul = find_nv_hash_mul([nv_hash_key(t, ent[2]) for t, ent in valued])
+
+slots = [0] * (1 << NV_HASH_BITS)
+for t, ent in valued:
+    slots[nv_hash(nv_hash_key(t, ent[2]), mul)] = ent[0]
+
+print()
+print('#define STATIC_NV_HASH_BITS {}'.format(NV_HASH_BITS))
+print('#define STATIC_NV_HASH_MUL {}u'.format(mul))
+print()
+print('static const uint8_t static_nv_hash_table[] = {')
+print(', '.join(str(s) for s in slots))
+print('};')
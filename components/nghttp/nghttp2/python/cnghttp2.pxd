@@ -33,6 +33,7 @@ cdef extern from 'nghttp2/nghttp2.h':
         pass
 
     ctypedef enum nghttp2_error:
+        NGHTTP2_ERR_NOMEM
         NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE
         NGHTTP2_ERR_DEFERRED
 
@@ -302,7 +303,7 @@ cdef extern from 'nghttp2/nghttp2.h':
 
     ssize_t nghttp2_hd_deflate_hd(nghttp2_hd_deflater *deflater,
                                   uint8_t *buf, size_t buflen,
-                                  const nghttp2_nv *nva, size_t nvlen)
+                                  const nghttp2_nv *nva, size_t nvlen) nogil
 
     size_t nghttp2_hd_deflate_bound(nghttp2_hd_deflater *deflater,
                                     const nghttp2_nv *nva, size_t nvlen)
@@ -317,9 +318,9 @@ cdef extern from 'nghttp2/nghttp2.h':
     ssize_t nghttp2_hd_inflate_hd2(nghttp2_hd_inflater *inflater,
                                    nghttp2_nv *nv_out, int *inflate_flags,
                                    const uint8_t *input, size_t inlen,
-                                   int in_final)
+                                   int in_final) nogil
 
-    int nghttp2_hd_inflate_end_headers(nghttp2_hd_inflater *inflater)
+    int nghttp2_hd_inflate_end_headers(nghttp2_hd_inflater *inflater) nogil
 
     ctypedef enum nghttp2_hd_inflate_flag:
         NGHTTP2_HD_INFLATE_EMIT
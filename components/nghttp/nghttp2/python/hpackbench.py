@@ -0,0 +1,89 @@
+#!/usr/bin/env python
+#
+# This script takes directories or files which contain the
+# hpack-test-case json files, and measures the throughput of header
+# compression and decompression of the python bindings with the given
+# numbers of threads.  Each thread processes all stories with its own
+# HDDeflater and HDInflater objects.
+#
+# In "batch" mode, each story is processed by one deflate_many() and
+# one inflate_many() call, which release the GIL, so the throughput
+# should scale with the number of threads.  In "single" mode, deflate()
+# and inflate() are called per header set, holding the GIL, for
+# comparison.
+#
+# For hpack-test-case, see https://github.com/Jxck/hpack-test-case
+#
+import sys, json, os, argparse, threading, time
+import nghttp2
+
+def load_stories(paths):
+    files = []
+    for p in paths:
+        if os.path.isdir(p):
+            files += [os.path.join(p, fn) for fn in sorted(os.listdir(p)) \
+                      if fn.endswith('.json')]
+        else:
+            files.append(p)
+
+    stories = []
+    for fn in files:
+        with open(fn) as f:
+            jsdata = json.loads(f.read())
+        stories.append([[(list(x.keys())[0].encode('utf-8'),
+                          list(x.values())[0].encode('utf-8')) \
+                         for x in item['headers']] \
+                        for item in jsdata['cases']])
+    return stories
+
+def run_batch(stories, iterations):
+    for _ in range(iterations):
+        for story in stories:
+            deflater = nghttp2.HDDeflater()
+            inflater = nghttp2.HDInflater()
+            inflater.inflate_many(deflater.deflate_many(story))
+
+def run_single(stories, iterations):
+    for _ in range(iterations):
+        for story in stories:
+            deflater = nghttp2.HDDeflater()
+            inflater = nghttp2.HDInflater()
+            for headers in story:
+                inflater.inflate(deflater.deflate(headers))
+
+def measure(func, stories, iterations, nthreads):
+    threads = [threading.Thread(target=func, args=(stories, iterations)) \
+               for _ in range(nthreads)]
+    start = time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return time.time() - start
+
+if __name__ == '__main__':
+    ap = argparse.ArgumentParser(description='HPACK python bindings benchmark')
+    ap.add_argument('-n', '--iterations', help='number of iterations per thread',
+                    type=int, default=10)
+    ap.add_argument('-t', '--threads',
+                    help='comma separated list of numbers of threads',
+                    default='1,2,4')
+    ap.add_argument('path', nargs='+',
+                    help='hpack-test-case directory or json file')
+    args = ap.parse_args()
+
+    stories = load_stories(args.path)
+    nheaders = sum([len(headers) for story in stories for headers in story])
+
+    sys.stdout.write('{:8} {:>8} {:>10} {:>14} {:>8}\n'.format(
+        'mode', 'threads', 'seconds', 'headers/sec', 'speedup'))
+
+    for name, func in [('single', run_single), ('batch', run_batch)]:
+        base = None
+        for nthreads in [int(x) for x in args.threads.split(',')]:
+            elapsed = measure(func, stories, args.iterations, nthreads)
+            rate = nheaders * args.iterations * nthreads / elapsed
+            if base is None:
+                base = rate
+            sys.stdout.write('{:8} {:8} {:10.3f} {:14.0f} {:8.2f}\n'.format(
+                name, nthreads, elapsed, rate, rate / base))
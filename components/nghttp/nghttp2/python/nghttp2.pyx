@@ -22,7 +22,7 @@
 # WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 cimport cnghttp2
 
-from libc.stdlib cimport malloc, free
+from libc.stdlib cimport malloc, realloc, free
 from libc.string cimport memcpy, memset
 from libc.stdint cimport uint8_t, uint16_t, uint32_t, int32_t
 import logging
@@ -47,6 +47,73 @@ class HDTableEntry:
 cdef _get_pybytes(uint8_t *b, uint16_t blen):
     return b[:blen]
 
+cdef struct _NVBuffer:
+    # Names and values of header fields, concatenated
+    uint8_t *data
+    size_t datalen
+    size_t datacap
+    # Lengths of names and values in data, alternately
+    size_t *lens
+    size_t nlens
+    size_t lenscap
+
+cdef int _nvbuf_add(_NVBuffer *nvbuf, const uint8_t *s, size_t slen) nogil:
+    cdef void *p
+    cdef size_t cap
+
+    if nvbuf.datalen + slen > nvbuf.datacap:
+        cap = nvbuf.datacap * 2
+        if cap < nvbuf.datalen + slen:
+            cap = nvbuf.datalen + slen + 256
+        p = realloc(nvbuf.data, cap)
+        if p == NULL:
+            return -1
+        nvbuf.data = <uint8_t*>p
+        nvbuf.datacap = cap
+
+    if nvbuf.nlens == nvbuf.lenscap:
+        cap = nvbuf.lenscap * 2 + 64
+        p = realloc(nvbuf.lens, cap * sizeof(size_t))
+        if p == NULL:
+            return -1
+        nvbuf.lens = <size_t*>p
+        nvbuf.lenscap = cap
+
+    memcpy(nvbuf.data + nvbuf.datalen, s, slen)
+    nvbuf.datalen += slen
+    nvbuf.lens[nvbuf.nlens] = slen
+    nvbuf.nlens += 1
+
+    return 0
+
+cdef ssize_t _inflate_block(cnghttp2.nghttp2_hd_inflater *inflater,
+                            _NVBuffer *nvbuf, const uint8_t *buf,
+                            size_t buflen) nogil:
+    cdef cnghttp2.nghttp2_nv nv
+    cdef int inflate_flags
+    cdef ssize_t rv
+    cdef ssize_t nfields = 0
+
+    while True:
+        inflate_flags = 0
+        rv = cnghttp2.nghttp2_hd_inflate_hd2(inflater, &nv, &inflate_flags,
+                                             buf, buflen, 1)
+        if rv < 0:
+            return rv
+        buf += rv
+        buflen -= rv
+        if inflate_flags & cnghttp2.NGHTTP2_HD_INFLATE_EMIT:
+            if _nvbuf_add(nvbuf, nv.name, nv.namelen) != 0 or \
+               _nvbuf_add(nvbuf, nv.value, nv.valuelen) != 0:
+                return cnghttp2.NGHTTP2_ERR_NOMEM
+            nfields += 1
+        if inflate_flags & cnghttp2.NGHTTP2_HD_INFLATE_FINAL:
+            break
+
+    cnghttp2.nghttp2_hd_inflate_end_headers(inflater)
+
+    return nfields
+
 cdef class HDDeflater:
     '''Performs header compression. The constructor takes
     |hd_table_bufsize_max| parameter, which limits the usage of header
@@ -71,6 +138,8 @@ cdef class HDDeflater:
     '''
 
     cdef cnghttp2.nghttp2_hd_deflater *_deflater
+    # True while deflate_many() runs without the GIL
+    cdef bint _busy
 
     def __cinit__(self, hd_table_bufsize_max = DEFLATE_MAX_HEADER_TABLE_SIZE):
         rv = cnghttp2.nghttp2_hd_deflate_new(&self._deflater,
@@ -90,6 +159,9 @@ cdef class HDDeflater:
         An exception will be raised on error.
 
         '''
+        if self._busy:
+            raise Exception('HDDeflater is used by another thread')
+
         cdef cnghttp2.nghttp2_nv *nva = <cnghttp2.nghttp2_nv*>\
                                         malloc(sizeof(cnghttp2.nghttp2_nv)*\
                                         len(headers))
@@ -131,12 +203,110 @@ cdef class HDDeflater:
 
         return res
 
+    def deflate_many(self, header_lists):
+        '''Compresses each header list in |header_lists| in order, as if
+        deflate() is called for each of them, and returns the list of
+        encoded header blocks.
+
+        The GIL is released while the header lists are compressed, so
+        that the other threads can run, including the ones which use
+        the other HDDeflater objects.  This object must not be used by
+        the other threads until this function returns.
+
+        An exception will be raised on error.
+
+        '''
+        # The references to names and values are kept here, so that
+        # they are alive while the GIL is released.
+        cdef list keep = []
+        cdef list lists = [list(headers) for headers in header_lists]
+        cdef size_t nlists = len(lists)
+        cdef size_t nvtotal = sum([len(headers) for headers in lists])
+        cdef cnghttp2.nghttp2_nv *nva = NULL
+        cdef cnghttp2.nghttp2_nv *nvap
+        cdef size_t *nvlens = NULL
+        cdef ssize_t *blocklens = NULL
+        cdef uint8_t *out = NULL
+        cdef uint8_t *outp
+        cdef size_t outlen = 0
+        cdef size_t i
+        cdef ssize_t rv = 0
+
+        try:
+            nva = <cnghttp2.nghttp2_nv*>malloc(
+                sizeof(cnghttp2.nghttp2_nv) * (nvtotal + 1))
+            nvlens = <size_t*>malloc(sizeof(size_t) * (nlists + 1))
+            blocklens = <ssize_t*>malloc(sizeof(ssize_t) * (nlists + 1))
+            if nva == NULL or nvlens == NULL or blocklens == NULL:
+                raise MemoryError()
+
+            nvap = nva
+            for i in range(nlists):
+                for k, v in lists[i]:
+                    keep.append(k)
+                    keep.append(v)
+                    nvap[0].name = k
+                    nvap[0].namelen = len(k)
+                    nvap[0].value = v
+                    nvap[0].valuelen = len(v)
+                    nvap[0].flags = cnghttp2.NGHTTP2_NV_FLAG_NONE
+                    nvap += 1
+                nvlens[i] = len(lists[i])
+                outlen += cnghttp2.nghttp2_hd_deflate_bound(
+                    self._deflater, nvap - nvlens[i], nvlens[i])
+
+            out = <uint8_t*>malloc(outlen + 1)
+            if out == NULL:
+                raise MemoryError()
+
+            # Checked here, since iterating the input above may run
+            # the other threads.
+            if self._busy:
+                raise Exception('HDDeflater is used by another thread')
+
+            self._busy = True
+
+            with nogil:
+                nvap = nva
+                outp = out
+                for i in range(nlists):
+                    rv = cnghttp2.nghttp2_hd_deflate_hd(self._deflater,
+                                                        outp, outlen,
+                                                        nvap, nvlens[i])
+                    if rv < 0:
+                        break
+                    blocklens[i] = rv
+                    nvap += nvlens[i]
+                    outp += rv
+                    outlen -= rv
+
+            self._busy = False
+
+            if rv < 0:
+                raise Exception(_strerror(rv))
+
+            res = []
+            outp = out
+            for i in range(nlists):
+                res.append(outp[:blocklens[i]])
+                outp += blocklens[i]
+
+            return res
+        finally:
+            free(out)
+            free(blocklens)
+            free(nvlens)
+            free(nva)
+
     def change_table_size(self, hd_table_bufsize_max):
         '''Changes header table size to |hd_table_bufsize_max| byte.
 
         An exception will be raised on error.
 
         '''
+        if self._busy:
+            raise Exception('HDDeflater is used by another thread')
+
         cdef int rv
         rv = cnghttp2.nghttp2_hd_deflate_change_table_size(self._deflater,
                                                            hd_table_bufsize_max)
@@ -169,6 +339,8 @@ cdef class HDInflater:
     '''
 
     cdef cnghttp2.nghttp2_hd_inflater *_inflater
+    # True while inflate_many() runs without the GIL
+    cdef bint _busy
 
     def __cinit__(self):
         rv = cnghttp2.nghttp2_hd_inflate_new(&self._inflater)
@@ -183,6 +355,9 @@ cdef class HDInflater:
         byte string (not unicode string).
 
         '''
+        if self._busy:
+            raise Exception('HDInflater is used by another thread')
+
         cdef cnghttp2.nghttp2_nv nv
         cdef int inflate_flags
         cdef ssize_t rv
@@ -207,12 +382,95 @@ cdef class HDInflater:
         cnghttp2.nghttp2_hd_inflate_end_headers(self._inflater)
         return res
 
+    def inflate_many(self, blocks):
+        '''Decompresses each header block in |blocks| in order, as if
+        inflate() is called for each of them, and returns the list of
+        decompressed header lists.
+
+        The GIL is released while the header blocks are decompressed,
+        so that the other threads can run, including the ones which
+        use the other HDInflater objects.  This object must not be used
+        by the other threads until this function returns.
+
+        An exception will be raised on error.
+
+        '''
+        # The references to header blocks are kept here, so that they
+        # are alive while the GIL is released.
+        cdef list keep = list(blocks)
+        cdef size_t nblocks = len(keep)
+        cdef const uint8_t **bufs = NULL
+        cdef size_t *buflens = NULL
+        cdef ssize_t *nfields = NULL
+        cdef _NVBuffer nvbuf
+        cdef const uint8_t *p
+        cdef size_t i, j, k
+        cdef ssize_t rv = 0
+
+        memset(&nvbuf, 0, sizeof(nvbuf))
+
+        try:
+            bufs = <const uint8_t**>malloc(sizeof(uint8_t*) * (nblocks + 1))
+            buflens = <size_t*>malloc(sizeof(size_t) * (nblocks + 1))
+            nfields = <ssize_t*>malloc(sizeof(ssize_t) * (nblocks + 1))
+            if bufs == NULL or buflens == NULL or nfields == NULL:
+                raise MemoryError()
+
+            for i in range(nblocks):
+                bufs[i] = <bytes?>keep[i]
+                buflens[i] = len(keep[i])
+
+            # Checked here, since iterating the input above may run
+            # the other threads.
+            if self._busy:
+                raise Exception('HDInflater is used by another thread')
+
+            self._busy = True
+
+            with nogil:
+                for i in range(nblocks):
+                    rv = _inflate_block(self._inflater, &nvbuf, bufs[i],
+                                        buflens[i])
+                    if rv < 0:
+                        break
+                    nfields[i] = rv
+
+            self._busy = False
+
+            if rv < 0:
+                raise Exception(_strerror(rv))
+
+            res = []
+            p = nvbuf.data
+            k = 0
+            for i in range(nblocks):
+                headers = []
+                for j in range(nfields[i]):
+                    name = p[:nvbuf.lens[k]]
+                    p += nvbuf.lens[k]
+                    value = p[:nvbuf.lens[k + 1]]
+                    p += nvbuf.lens[k + 1]
+                    k += 2
+                    headers.append((name, value))
+                res.append(headers)
+
+            return res
+        finally:
+            free(nvbuf.lens)
+            free(nvbuf.data)
+            free(nfields)
+            free(buflens)
+            free(bufs)
+
     def change_table_size(self, hd_table_bufsize_max):
         '''Changes header table size to |hd_table_bufsize_max| byte.
 
         An exception will be raised on error.
 
         '''
+        if self._busy:
+            raise Exception('HDInflater is used by another thread')
+
         cdef int rv
         rv = cnghttp2.nghttp2_hd_inflate_change_table_size(self._inflater,
                                                            hd_table_bufsize_max)
@@ -0,0 +1,355 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shrpx_config.h"
+#include "shrpx_downstream.h"
+#include "shrpx_log.h"
+#include "shrpx_worker.h"
+#include "template.h"
+#include "util.h"
+
+// Microbenchmark of access log formatting in shrpx_log.cc.  The
+// reference implementation below is the interpreter which walked
+// std::vector<LogFragment> per request with a switch per fragment,
+// and which compile_log_format() replaced.  It is kept here for
+// comparison.  The escaping of the reference implementation checks
+// the same characters per byte as ESCAPE_TBL did.
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+namespace {
+std::pair<char *, char *> ref_copy(const char *src, size_t srclen, char *p,
+                                   char *last) {
+  auto n = std::min(static_cast<size_t>(last - p), srclen);
+  return std::make_pair(std::copy_n(src, n, p), last);
+}
+} // namespace
+
+namespace {
+std::pair<char *, char *> ref_copy(const StringRef &src, char *p,
+                                   char *last) {
+  return ref_copy(src.c_str(), src.size(), p, last);
+}
+} // namespace
+
+namespace {
+std::pair<char *, char *> ref_copy(char c, char *p, char *last) {
+  if (p == last) {
+    return std::make_pair(last, last);
+  }
+  *p++ = c;
+  return std::make_pair(p, last);
+}
+} // namespace
+
+namespace {
+template <typename T>
+std::pair<char *, char *> ref_copy(T n, char *p, char *last) {
+  if (static_cast<size_t>(last - p) < NGHTTP2_MAX_UINT64_DIGITS) {
+    return std::make_pair(last, last);
+  }
+  return std::make_pair(util::utos(p, n), last);
+}
+} // namespace
+
+namespace {
+constexpr char LOWER_XDIGITS[] = "0123456789abcdef";
+} // namespace
+
+namespace {
+std::pair<char *, char *> ref_copy_escape(const StringRef &src, char *p,
+                                          char *last) {
+  for (auto c : src) {
+    auto u = static_cast<unsigned char>(c);
+    if (u >= 0x20 && u < 0x7f && u != '"' && u != '\\') {
+      if (p == last) {
+        break;
+      }
+      *p++ = c;
+      continue;
+    }
+    if (last - p < 4) {
+      break;
+    }
+    *p++ = '\\';
+    *p++ = 'x';
+    *p++ = LOWER_XDIGITS[u >> 4];
+    *p++ = LOWER_XDIGITS[u & 0xf];
+  }
+  return std::make_pair(p, last);
+}
+} // namespace
+
+namespace {
+// The request target of CONNECT, and the absolute URI logged by
+// HTTP/2 proxy are not handled, because they are not used here.
+char *ref_format_accesslog(char *p, char *last,
+                           const std::vector<LogFragment> &lfv,
+                           const LogSpec &lgsp) {
+  auto downstream = lgsp.downstream;
+
+  const auto &req = downstream->request();
+  const auto &resp = downstream->response();
+  const auto &tstamp = req.tstamp;
+
+  auto downstream_addr = downstream->get_addr();
+  auto method = http2::to_method_string(req.method);
+  auto path = req.path.empty() ? req.method == HTTP_OPTIONS
+                                     ? StringRef::from_lit("*")
+                                     : StringRef::from_lit("-")
+                               : req.path;
+
+  for (auto &lf : lfv) {
+    switch (lf.type) {
+    case SHRPX_LOGF_LITERAL:
+      std::tie(p, last) = ref_copy(lf.value, p, last);
+      break;
+    case SHRPX_LOGF_REMOTE_ADDR:
+      std::tie(p, last) = ref_copy(lgsp.remote_addr, p, last);
+      break;
+    case SHRPX_LOGF_TIME_LOCAL:
+      std::tie(p, last) = ref_copy(tstamp->time_local, p, last);
+      break;
+    case SHRPX_LOGF_TIME_ISO8601:
+      std::tie(p, last) = ref_copy(tstamp->time_iso8601, p, last);
+      break;
+    case SHRPX_LOGF_REQUEST:
+      std::tie(p, last) = ref_copy(method, p, last);
+      std::tie(p, last) = ref_copy(' ', p, last);
+      std::tie(p, last) = ref_copy_escape(path, p, last);
+      std::tie(p, last) = ref_copy(StringRef::from_lit(" HTTP/"), p, last);
+      std::tie(p, last) = ref_copy(req.http_major, p, last);
+      if (req.http_major < 2) {
+        std::tie(p, last) = ref_copy('.', p, last);
+        std::tie(p, last) = ref_copy(req.http_minor, p, last);
+      }
+      break;
+    case SHRPX_LOGF_STATUS:
+      std::tie(p, last) = ref_copy(resp.http_status, p, last);
+      break;
+    case SHRPX_LOGF_BODY_BYTES_SENT:
+      std::tie(p, last) =
+          ref_copy(downstream->response_sent_body_length, p, last);
+      break;
+    case SHRPX_LOGF_HTTP: {
+      auto hd = req.fs.header(lf.value);
+      if (hd) {
+        std::tie(p, last) = ref_copy_escape((*hd).value, p, last);
+        break;
+      }
+
+      std::tie(p, last) = ref_copy('-', p, last);
+
+      break;
+    }
+    case SHRPX_LOGF_AUTHORITY:
+      if (!req.authority.empty()) {
+        std::tie(p, last) = ref_copy(req.authority, p, last);
+        break;
+      }
+
+      std::tie(p, last) = ref_copy('-', p, last);
+
+      break;
+    case SHRPX_LOGF_REMOTE_PORT:
+      std::tie(p, last) = ref_copy(lgsp.remote_port, p, last);
+      break;
+    case SHRPX_LOGF_SERVER_PORT:
+      std::tie(p, last) = ref_copy(lgsp.server_port, p, last);
+      break;
+    case SHRPX_LOGF_PID:
+      std::tie(p, last) = ref_copy(lgsp.pid, p, last);
+      break;
+    case SHRPX_LOGF_ALPN:
+      std::tie(p, last) = ref_copy_escape(lgsp.alpn, p, last);
+      break;
+    case SHRPX_LOGF_TLS_SNI:
+      if (lgsp.sni.empty()) {
+        std::tie(p, last) = ref_copy('-', p, last);
+        break;
+      }
+      std::tie(p, last) = ref_copy_escape(lgsp.sni, p, last);
+      break;
+    case SHRPX_LOGF_BACKEND_HOST:
+      if (!downstream_addr) {
+        std::tie(p, last) = ref_copy('-', p, last);
+        break;
+      }
+      std::tie(p, last) = ref_copy(downstream_addr->host, p, last);
+      break;
+    case SHRPX_LOGF_BACKEND_PORT:
+      if (!downstream_addr) {
+        std::tie(p, last) = ref_copy('-', p, last);
+        break;
+      }
+      std::tie(p, last) = ref_copy(downstream_addr->port, p, last);
+      break;
+    default:
+      break;
+    }
+  }
+
+  return p;
+}
+} // namespace
+
+namespace {
+void prepare_downstream(Downstream &d) {
+  const char *nv[][2] = {
+      {"accept", "*/*"},
+      {"accept-encoding", "gzip, deflate, br"},
+      {"accept-language", "en-US,en;q=0.5"},
+      {"user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:55.0) "
+                     "Gecko/20100101 Firefox/55.0"},
+      {"referer", "https://www.example.org/"},
+      {"cookie", "sid=31d4d96e407aad42; lang=en-US"},
+      {"cache-control", "no-cache"},
+      {"x-requested-with", "XMLHttpRequest"},
+      {"dnt", "1"},
+  };
+
+  auto &req = d.request();
+  req.method = HTTP_GET;
+  req.authority = StringRef::from_lit("www.example.org");
+  req.path = StringRef::from_lit("/assets/application-4f3c2a1b.js?v=2");
+  req.http_major = 2;
+  req.http_minor = 0;
+
+  for (auto &p : nv) {
+    auto name = StringRef{p[0]};
+    req.fs.add_header_token(name, StringRef{p[1]}, false,
+                            http2::lookup_token(name));
+  }
+
+  auto lgconf = log_config();
+  lgconf->update_tstamp(std::chrono::system_clock::now());
+  req.tstamp = lgconf->tstamp;
+
+  d.response().http_status = 200;
+  d.response_sent_body_length = 183742;
+}
+} // namespace
+
+namespace {
+template <typename F> void run(const char *name, size_t niter, F f) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < niter; ++i) {
+    f();
+  }
+
+  auto elapsed = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  printf("%-24s %10.1f ns/op\n", name, elapsed / niter);
+}
+} // namespace
+
+namespace {
+constexpr auto LOG_FORMAT = StringRef::from_lit(
+    R"($remote_addr - - [$time_local] )"
+    R"("$request" $status $body_bytes_sent )"
+    R"("$http_referer" "$http_user_agent" $http_host $alpn )"
+    R"($tls_sni $backend_host:$backend_port)");
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t niter = 1000000;
+
+  if (argc > 1) {
+    niter = strtoul(argv[1], nullptr, 10);
+    if (niter == 0) {
+      std::cerr << "Usage: accesslogbench [ITERATIONS [FORMAT]]" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  create_config();
+
+  BlockAllocator balloc(4096, 4096);
+  Downstream d(nullptr, nullptr, 0);
+
+  prepare_downstream(d);
+
+  auto lfv =
+      parse_log_format(balloc, argc > 2 ? StringRef{argv[2]} : LOG_FORMAT);
+  auto text_emv = compile_log_format(lfv, false);
+  auto binary_emv = compile_log_format(lfv, true);
+
+  auto lgsp = LogSpec{
+      &d,
+      StringRef::from_lit("192.0.2.1"),
+      StringRef::from_lit("h2"),
+      StringRef::from_lit("www.example.org"),
+      nullptr,
+      std::chrono::high_resolution_clock::now(),
+      StringRef::from_lit("52416"),
+      443,
+      getpid(),
+  };
+
+  std::array<char, 4_k> buf, ref_buf;
+
+  // Both implementations must produce the same output.
+  auto p = format_accesslog(std::begin(buf), std::end(buf), text_emv, false,
+                            lgsp);
+  auto ref_p =
+      ref_format_accesslog(std::begin(ref_buf), std::end(ref_buf), lfv, lgsp);
+
+  if (StringRef(std::begin(buf), p) != StringRef(std::begin(ref_buf), ref_p)) {
+    std::cerr << "Output does not match reference implementation"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  run("format_accesslog/ref", niter, [&]() {
+    ref_p =
+        ref_format_accesslog(std::begin(ref_buf), std::end(ref_buf), lfv, lgsp);
+  });
+  run("format_accesslog", niter, [&]() {
+    p = format_accesslog(std::begin(buf), std::end(buf), text_emv, false,
+                         lgsp);
+  });
+  run("format_accesslog/binary", niter, [&]() {
+    p = format_accesslog(std::begin(buf), std::end(buf), binary_emv, true,
+                         lgsp);
+  });
+
+  return 0;
+}
+
+} // namespace shrpx
+
+int main(int argc, char **argv) { return shrpx::main(argc, argv); }
@@ -0,0 +1,463 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif // HAVE_CONFIG_H
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif // HAVE_UNISTD_H
+#include <getopt.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cinttypes>
+#include <vector>
+#include <string>
+#include <array>
+#include <chrono>
+#include <iostream>
+
+#include <jansson.h>
+
+#include <nghttp2/nghttp2.h>
+
+#include "template.h"
+
+namespace nghttp2 {
+
+namespace {
+struct Config {
+  std::vector<size_t> table_sizes;
+  size_t iterations;
+};
+} // namespace
+
+namespace {
+Config config;
+} // namespace
+
+namespace {
+// A header set, which is encoded into one header block.
+struct HeaderSet {
+  // Storage of names and values of nva.
+  std::vector<std::string> strs;
+  std::vector<nghttp2_nv> nva;
+};
+} // namespace
+
+namespace {
+// A sequence of header sets which share one compression context.
+struct Story {
+  std::string path;
+  std::vector<HeaderSet> sets;
+};
+} // namespace
+
+namespace {
+// The measurement of one phase of the benchmark for one table size.
+struct Result {
+  std::chrono::steady_clock::duration elapsed;
+  // The counters accumulated over the stories for one iteration.
+  nghttp2_hd_stats stats;
+  size_t headers;
+};
+} // namespace
+
+namespace {
+void add_stats(nghttp2_hd_stats &dest, const nghttp2_hd_stats *src) {
+  dest.indexed += src->indexed;
+  dest.indexed_name += src->indexed_name;
+  dest.literal += src->literal;
+  dest.nvlen += src->nvlen;
+  dest.blocklen += src->blocklen;
+  dest.strings += src->strings;
+  dest.huffman += src->huffman;
+  dest.evicted += src->evicted;
+}
+} // namespace
+
+namespace {
+int load_story(Story &story, const char *path) {
+  json_error_t error;
+
+  auto json = json_load_file(path, 0, &error);
+  if (json == nullptr) {
+    std::cerr << path << ":" << error.line << ": " << error.text << std::endl;
+    return -1;
+  }
+
+  auto cases = json_object_get(json, "cases");
+  if (cases == nullptr || !json_is_array(cases)) {
+    std::cerr << path << ": 'cases' must be JSON array" << std::endl;
+    json_decref(json);
+    return -1;
+  }
+
+  story.path = path;
+
+  auto len = json_array_size(cases);
+
+  for (size_t i = 0; i < len; ++i) {
+    auto headers = json_object_get(json_array_get(cases, i), "headers");
+    if (headers == nullptr || !json_is_array(headers)) {
+      std::cerr << path << ": 'headers' must be JSON array at " << i
+                << std::endl;
+      json_decref(json);
+      return -1;
+    }
+
+    story.sets.emplace_back();
+    auto &set = story.sets.back();
+    auto nvlen = json_array_size(headers);
+
+    set.strs.reserve(nvlen * 2);
+
+    for (size_t j = 0; j < nvlen; ++j) {
+      auto nv_pair = json_array_get(headers, j);
+      const char *name;
+      json_t *value;
+
+      if (!json_is_object(nv_pair) || json_object_size(nv_pair) != 1) {
+        std::cerr << path << ": bad formatted name/value pair object at " << i
+                  << std::endl;
+        json_decref(json);
+        return -1;
+      }
+
+      json_object_foreach(nv_pair, name, value) {
+        if (!json_is_string(value)) {
+          std::cerr << path << ": value is not string at " << i << std::endl;
+          json_decref(json);
+          return -1;
+        }
+
+        set.strs.emplace_back(name);
+        set.strs.emplace_back(json_string_value(value));
+      }
+    }
+
+    for (size_t j = 0; j < set.strs.size(); j += 2) {
+      auto &name = set.strs[j];
+      auto &value = set.strs[j + 1];
+
+      set.nva.push_back({(uint8_t *)name.c_str(), (uint8_t *)value.c_str(),
+                         name.size(), value.size(), NGHTTP2_NV_FLAG_NONE});
+    }
+  }
+
+  json_decref(json);
+
+  return 0;
+}
+} // namespace
+
+namespace {
+// Deflates all stories config.iterations times with the dynamic table
+// size |table_size|.  The header blocks of the first iteration are
+// stored in |blocks| for the inflate phase.
+Result deflate_stories(std::vector<std::vector<std::string>> &blocks,
+                       const std::vector<Story> &stories, size_t table_size) {
+  Result res{};
+  std::array<uint8_t, 64_k> buf;
+
+  blocks.clear();
+  blocks.resize(stories.size());
+
+  for (size_t n = 0; n < config.iterations; ++n) {
+    for (size_t i = 0; i < stories.size(); ++i) {
+      auto &story = stories[i];
+      nghttp2_hd_deflater *deflater;
+
+      if (nghttp2_hd_deflate_new(&deflater, table_size) != 0) {
+        std::cerr << "nghttp2_hd_deflate_new() failed" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+
+      nghttp2_hd_deflate_change_table_size(deflater, table_size);
+
+      auto start = std::chrono::steady_clock::now();
+
+      for (auto &set : story.sets) {
+        auto rv = nghttp2_hd_deflate_hd(deflater, buf.data(), buf.size(),
+                                        set.nva.data(), set.nva.size());
+        if (rv < 0) {
+          std::cerr << story.path << ": deflate failed with error code " << rv
+                    << std::endl;
+          exit(EXIT_FAILURE);
+        }
+
+        if (n == 0) {
+          blocks[i].emplace_back(buf.begin(), buf.begin() + rv);
+        }
+      }
+
+      res.elapsed += std::chrono::steady_clock::now() - start;
+
+      if (n == 0) {
+        add_stats(res.stats, nghttp2_hd_deflate_get_stats(deflater));
+
+        for (auto &set : story.sets) {
+          res.headers += set.nva.size();
+        }
+      }
+
+      nghttp2_hd_deflate_del(deflater);
+    }
+  }
+
+  return res;
+}
+} // namespace
+
+namespace {
+// Inflates |blocks| produced by deflate_stories() config.iterations
+// times with the dynamic table size |table_size|.
+Result inflate_stories(const std::vector<std::vector<std::string>> &blocks,
+                       const std::vector<Story> &stories, size_t table_size) {
+  Result res{};
+
+  for (size_t n = 0; n < config.iterations; ++n) {
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      nghttp2_hd_inflater *inflater;
+      size_t headers = 0;
+
+      if (nghttp2_hd_inflate_new(&inflater) != 0) {
+        std::cerr << "nghttp2_hd_inflate_new() failed" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+
+      nghttp2_hd_inflate_change_table_size(inflater, table_size);
+
+      auto start = std::chrono::steady_clock::now();
+
+      for (auto &block : blocks[i]) {
+        auto p = reinterpret_cast<const uint8_t *>(block.data());
+        auto len = block.size();
+
+        for (;;) {
+          nghttp2_nv nv;
+          int inflate_flags = 0;
+
+          auto rv =
+              nghttp2_hd_inflate_hd2(inflater, &nv, &inflate_flags, p, len, 1);
+          if (rv < 0) {
+            std::cerr << stories[i].path << ": inflate failed with error code "
+                      << rv << std::endl;
+            exit(EXIT_FAILURE);
+          }
+
+          p += rv;
+          len -= rv;
+
+          if (inflate_flags & NGHTTP2_HD_INFLATE_EMIT) {
+            ++headers;
+          }
+
+          if (inflate_flags & NGHTTP2_HD_INFLATE_FINAL) {
+            break;
+          }
+        }
+
+        nghttp2_hd_inflate_end_headers(inflater);
+      }
+
+      res.elapsed += std::chrono::steady_clock::now() - start;
+
+      if (n == 0) {
+        add_stats(res.stats, nghttp2_hd_inflate_get_stats(inflater));
+        res.headers += headers;
+      }
+
+      nghttp2_hd_inflate_del(inflater);
+    }
+  }
+
+  return res;
+}
+} // namespace
+
+namespace {
+void print_result(size_t table_size, const char *phase, const Result &res) {
+  auto ns = std::chrono::duration<double, std::nano>(res.elapsed).count();
+  auto &stats = res.stats;
+  auto headers = res.headers == 0 ? 1.0 : static_cast<double>(res.headers);
+
+  printf("%10zu %-8s %10zu %10.1f %12.2f %7.2f%% %10" PRIu64 " %7.2f%%\n",
+         table_size, phase, res.headers,
+         ns / static_cast<double>(config.iterations) / headers,
+         static_cast<double>(stats.blocklen) / headers,
+         stats.nvlen == 0 ? 0.0 : static_cast<double>(stats.blocklen) /
+                                      static_cast<double>(stats.nvlen) * 100,
+         stats.evicted,
+         stats.strings == 0 ? 0.0 : static_cast<double>(stats.huffman) /
+                                        static_cast<double>(stats.strings) *
+                                        100);
+}
+} // namespace
+
+namespace {
+int parse_table_sizes(std::vector<size_t> &table_sizes, const char *s) {
+  table_sizes.clear();
+
+  for (;;) {
+    char *end;
+
+    errno = 0;
+    auto n = strtoul(s, &end, 10);
+    if (errno == ERANGE || end == s || (*end != '\0' && *end != ',')) {
+      return -1;
+    }
+
+    table_sizes.push_back(n);
+
+    if (*end == '\0') {
+      return 0;
+    }
+
+    s = end + 1;
+  }
+}
+} // namespace
+
+namespace {
+void print_help(void) {
+  std::cout << R"(HPACK HTTP/2 header compression benchmark
+Usage: hpackbench [OPTIONS] <STORY>...
+
+Deflates the header sets in STORY files, and inflates the resulting
+header blocks, repeatedly,  and reports the performance of each phase
+per dynamic table size.  Each STORY file  is a JSON file in the format
+deflatehd  takes as input,  such as the  stories in hpack-test-case.
+The header  sets in one STORY  share the same compression context.
+
+For each  phase and table size, the  following values are reported:
+
+    headers           The number of header fields per iteration.
+    ns/header         The time spent per header field.
+    bytes/header      The number of bytes of header blocks per header
+                      field.
+    ratio             The size  of header blocks relative  to the sum
+                      of lengths of header names and values.
+    evicted           The number of entries evicted from the dynamic
+                      table per iteration.
+    huffman           The  share of  string  literals which  are Huffman
+                      encoded.
+
+OPTIONS:
+    -n, --iterations=<N>
+                      Process the stories N times.
+                      Default: 100
+    -s, --table-size=<N>[,<N>...]
+                      Set   dynamic   table   size.   In   the   HPACK
+                      specification,   this   value  is   denoted   by
+                      SETTINGS_HEADER_TABLE_SIZE.  Multiple sizes can be
+                      given separated by comma.
+                      Default: 4096)"
+            << std::endl;
+}
+} // namespace
+
+constexpr static struct option long_options[] = {
+    {"iterations", required_argument, nullptr, 'n'},
+    {"table-size", required_argument, nullptr, 's'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}};
+
+int main(int argc, char **argv) {
+  char *end;
+
+  config.table_sizes = {4_k};
+  config.iterations = 100;
+  while (1) {
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "hn:s:", long_options, &option_index);
+    if (c == -1) {
+      break;
+    }
+    switch (c) {
+    case 'h':
+      print_help();
+      exit(EXIT_SUCCESS);
+    case 'n':
+      // --iterations
+      errno = 0;
+      config.iterations = strtoul(optarg, &end, 10);
+      if (errno == ERANGE || *end != '\0' || config.iterations == 0) {
+        fprintf(stderr, "-n: Bad option value\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 's':
+      // --table-size
+      if (parse_table_sizes(config.table_sizes, optarg) != 0) {
+        fprintf(stderr, "-s: Bad option value\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case '?':
+      exit(EXIT_FAILURE);
+    default:
+      break;
+    }
+  }
+
+  if (optind == argc) {
+    fprintf(stderr, "No story file given\n");
+    exit(EXIT_FAILURE);
+  }
+
+  std::vector<Story> stories(argc - optind);
+
+  for (int i = optind; i < argc; ++i) {
+    if (load_story(stories[i - optind], argv[i]) != 0) {
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  printf("%10s %-8s %10s %10s %12s %8s %10s %8s\n", "table", "phase",
+         "headers", "ns/header", "bytes/header", "ratio", "evicted",
+         "huffman");
+
+  std::vector<std::vector<std::string>> blocks;
+
+  for (auto table_size : config.table_sizes) {
+    auto res = deflate_stories(blocks, stories, table_size);
+    print_result(table_size, "deflate", res);
+
+    res = inflate_stories(blocks, stories, table_size);
+    print_result(table_size, "inflate", res);
+  }
+
+  return 0;
+}
+
+} // namespace nghttp2
+
+int main(int argc, char **argv) {
+  return nghttp2::run_app(nghttp2::main, argc, argv);
+}
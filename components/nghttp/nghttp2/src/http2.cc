@@ -357,90 +357,145 @@ nghttp2_nv make_nv_nocopy(const StringRef &name, const StringRef &value,
 }
 
 namespace {
-void copy_headers_to_nva_internal(std::vector<nghttp2_nv> &nva,
-                                  const HeaderRefs &headers, uint8_t nv_flags,
-                                  uint32_t flags) {
-  auto it_forwarded = std::end(headers);
-  auto it_xff = std::end(headers);
-  auto it_xfp = std::end(headers);
-  auto it_via = std::end(headers);
-
-  for (auto it = std::begin(headers); it != std::end(headers); ++it) {
-    auto kv = &(*it);
-    if (kv->name.empty() || kv->name[0] == ':') {
+// The bit flags of header field tokens, which tell how header fields
+// are treated when they are forwarded.
+enum {
+  // Header field is not forwarded to HTTP/2 peer.
+  HDF_DROP_HTTP2 = 1,
+  // Header field is not forwarded to HTTP/1 peer.
+  HDF_DROP_HTTP1 = 1 << 1,
+  // All but the last header fields are forwarded unless the
+  // HeaderBuildOp flag given by token_build_op is set.
+  HDF_BUILD_OP = 1 << 2,
+};
+} // namespace
+
+namespace {
+// The flags of each header field token, indexed by token.
+constexpr uint8_t token_flags[] = {
+    0,                                 // HD__AUTHORITY
+    0,                                 // HD__HOST
+    0,                                 // HD__METHOD
+    0,                                 // HD__PATH
+    0,                                 // HD__SCHEME
+    0,                                 // HD__STATUS
+    0,                                 // HD_ACCEPT_ENCODING
+    0,                                 // HD_ACCEPT_LANGUAGE
+    0,                                 // HD_ALT_SVC
+    0,                                 // HD_CACHE_CONTROL
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_CONNECTION
+    0,                                 // HD_CONTENT_LENGTH
+    0,                                 // HD_CONTENT_TYPE
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_COOKIE
+    0,                                 // HD_DATE
+    0,                                 // HD_EXPECT
+    HDF_BUILD_OP,                      // HD_FORWARDED
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_HOST
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_HTTP2_SETTINGS
+    0,                                 // HD_IF_MODIFIED_SINCE
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_KEEP_ALIVE
+    0,                                 // HD_LINK
+    0,                                 // HD_LOCATION
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_PROXY_CONNECTION
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_SERVER
+    HDF_DROP_HTTP2,                    // HD_TE
+    0,                                 // HD_TRAILER
+    HDF_DROP_HTTP2,                    // HD_TRANSFER_ENCODING
+    HDF_DROP_HTTP2 | HDF_DROP_HTTP1,   // HD_UPGRADE
+    0,                                 // HD_USER_AGENT
+    HDF_BUILD_OP,                      // HD_VIA
+    HDF_BUILD_OP,                      // HD_X_FORWARDED_FOR
+    HDF_BUILD_OP,                      // HD_X_FORWARDED_PROTO
+};
+} // namespace
+
+static_assert(sizeof(token_flags) == HD_MAXIDX, "token_flags is out of date");
+
+namespace {
+// Returns the index of HeaderBuildOp flag for a header field |token|
+// which has HDF_BUILD_OP.  The flag is 1 << the returned value.
+constexpr size_t token_build_op(int32_t token) {
+  return token == HD_FORWARDED
+             ? 0
+             : token == HD_X_FORWARDED_FOR
+                   ? 1
+                   : token == HD_X_FORWARDED_PROTO ? 2 : 3 /* HD_VIA */;
+}
+} // namespace
+
+static_assert((1 << token_build_op(HD_FORWARDED)) == HDOP_STRIP_FORWARDED &&
+                  (1 << token_build_op(HD_X_FORWARDED_FOR)) ==
+                      HDOP_STRIP_X_FORWARDED_FOR &&
+                  (1 << token_build_op(HD_X_FORWARDED_PROTO)) ==
+                      HDOP_STRIP_X_FORWARDED_PROTO &&
+                  (1 << token_build_op(HD_VIA)) == HDOP_STRIP_VIA,
+              "token_build_op does not match HeaderBuildOp");
+
+namespace {
+// Calls |f| for each header field in |headers| which is forwarded to
+// the peer, in a single pass.  Header fields whose token has |drop|
+// in token_flags are not forwarded.  |flags| is one or more of
+// HeaderBuildOp flags.
+template <typename F>
+void for_each_forwarded_header(const HeaderRefs &headers, uint8_t drop,
+                               uint32_t flags, F f) {
+  // The last header field seen for each HeaderBuildOp, which is held
+  // until the next one is seen.
+  std::array<const HeaderRef *, 4> last{};
+
+  for (auto &kv : headers) {
+    if (kv.name.empty() || kv.name[0] == ':') {
       continue;
     }
-    switch (kv->token) {
-    case HD_COOKIE:
-    case HD_CONNECTION:
-    case HD_HOST:
-    case HD_HTTP2_SETTINGS:
-    case HD_KEEP_ALIVE:
-    case HD_PROXY_CONNECTION:
-    case HD_SERVER:
-    case HD_TE:
-    case HD_TRANSFER_ENCODING:
-    case HD_UPGRADE:
+
+    if (kv.token == -1) {
+      f(kv);
       continue;
-    case HD_FORWARDED:
-      if (flags & HDOP_STRIP_FORWARDED) {
-        continue;
-      }
+    }
 
-      if (it_forwarded == std::end(headers)) {
-        it_forwarded = it;
-        continue;
-      }
+    auto tf = token_flags[kv.token];
 
-      kv = &(*it_forwarded);
-      it_forwarded = it;
-      break;
-    case HD_X_FORWARDED_FOR:
-      if (flags & HDOP_STRIP_X_FORWARDED_FOR) {
-        continue;
-      }
+    if (tf & drop) {
+      continue;
+    }
 
-      if (it_xff == std::end(headers)) {
-        it_xff = it;
-        continue;
-      }
+    if (tf & HDF_BUILD_OP) {
+      auto op = token_build_op(kv.token);
 
-      kv = &(*it_xff);
-      it_xff = it;
-      break;
-    case HD_X_FORWARDED_PROTO:
-      if (flags & HDOP_STRIP_X_FORWARDED_PROTO) {
+      if (flags & (1 << op)) {
         continue;
       }
 
-      if (it_xfp == std::end(headers)) {
-        it_xfp = it;
-        continue;
-      }
-
-      kv = &(*it_xfp);
-      it_xfp = it;
-      break;
-    case HD_VIA:
-      if (flags & HDOP_STRIP_VIA) {
-        continue;
-      }
+      auto prev = last[op];
+      last[op] = &kv;
 
-      if (it_via == std::end(headers)) {
-        it_via = it;
+      if (!prev) {
         continue;
       }
 
-      kv = &(*it_via);
-      it_via = it;
-      break;
+      f(*prev);
+      continue;
     }
-    nva.push_back(
-        make_nv_internal(kv->name, kv->value, kv->no_index, nv_flags));
+
+    f(kv);
   }
 }
 } // namespace
 
+namespace {
+void copy_headers_to_nva_internal(std::vector<nghttp2_nv> &nva,
+                                  const HeaderRefs &headers, uint8_t nv_flags,
+                                  uint32_t flags) {
+  nva.reserve(nva.size() + headers.size());
+
+  for_each_forwarded_header(headers, HDF_DROP_HTTP2, flags,
+                            [&nva, nv_flags](const HeaderRef &kv) {
+                              nva.push_back(make_nv_internal(
+                                  kv.name, kv.value, kv.no_index, nv_flags));
+                            });
+}
+} // namespace
+
 void copy_headers_to_nva(std::vector<nghttp2_nv> &nva,
                          const HeaderRefs &headers, uint32_t flags) {
   copy_headers_to_nva_internal(nva, headers, NGHTTP2_NV_FLAG_NONE, flags);
@@ -453,87 +508,56 @@ void copy_headers_to_nva_nocopy(std::vector<nghttp2_nv> &nva,
       NGHTTP2_NV_FLAG_NO_COPY_NAME | NGHTTP2_NV_FLAG_NO_COPY_VALUE, flags);
 }
 
+namespace {
+// Writes capitalized |s| to |dest|, and returns the one beyond the
+// last position written.
+uint8_t *capitalize(uint8_t *dest, const StringRef &s) {
+  *dest++ = util::upcase(s[0]);
+  for (size_t i = 1; i < s.size(); ++i) {
+    if (s[i - 1] == '-') {
+      *dest++ = util::upcase(s[i]);
+    } else {
+      *dest++ = s[i];
+    }
+  }
+  return dest;
+}
+} // namespace
+
 void build_http1_headers_from_headers(DefaultMemchunks *buf,
                                       const HeaderRefs &headers,
                                       uint32_t flags) {
-  auto it_forwarded = std::end(headers);
-  auto it_xff = std::end(headers);
-  auto it_xfp = std::end(headers);
-  auto it_via = std::end(headers);
-
-  for (auto it = std::begin(headers); it != std::end(headers); ++it) {
-    auto kv = &(*it);
-    if (kv->name.empty() || kv->name[0] == ':') {
-      continue;
-    }
-    switch (kv->token) {
-    case HD_CONNECTION:
-    case HD_COOKIE:
-    case HD_HOST:
-    case HD_HTTP2_SETTINGS:
-    case HD_KEEP_ALIVE:
-    case HD_PROXY_CONNECTION:
-    case HD_SERVER:
-    case HD_UPGRADE:
-      continue;
-    case HD_FORWARDED:
-      if (flags & HDOP_STRIP_FORWARDED) {
-        continue;
-      }
-
-      if (it_forwarded == std::end(headers)) {
-        it_forwarded = it;
-        continue;
-      }
-
-      kv = &(*it_forwarded);
-      it_forwarded = it;
-      break;
-    case HD_X_FORWARDED_FOR:
-      if (flags & HDOP_STRIP_X_FORWARDED_FOR) {
-        continue;
-      }
-
-      if (it_xff == std::end(headers)) {
-        it_xff = it;
-        continue;
-      }
-
-      kv = &(*it_xff);
-      it_xff = it;
-      break;
-    case HD_X_FORWARDED_PROTO:
-      if (flags & HDOP_STRIP_X_FORWARDED_PROTO) {
-        continue;
-      }
-
-      if (it_xfp == std::end(headers)) {
-        it_xfp = it;
-        continue;
-      }
-
-      kv = &(*it_xfp);
-      it_xfp = it;
-      break;
-    case HD_VIA:
-      if (flags & HDOP_STRIP_VIA) {
-        continue;
-      }
+  // Header lines are built in this buffer, and appended to |buf| when
+  // it gets full, rather than byte by byte.
+  std::array<uint8_t, 4_k> block;
+  auto p = block.data();
+
+  for_each_forwarded_header(
+      headers, HDF_DROP_HTTP1, flags, [buf, &block, &p](const HeaderRef &kv) {
+        auto linelen = kv.name.size() + kv.value.size() + 4;
+
+        if (static_cast<size_t>(std::end(block) - p) < linelen) {
+          buf->append(block.data(), p - block.data());
+          p = block.data();
+
+          if (block.size() < linelen) {
+            capitalize(buf, kv.name);
+            buf->append(": ");
+            buf->append(kv.value);
+            buf->append("\r\n");
+            return;
+          }
+        }
 
-      if (it_via == std::end(headers)) {
-        it_via = it;
-        continue;
-      }
+        p = capitalize(p, kv.name);
+        *p++ = ':';
+        *p++ = ' ';
+        p = std::copy(std::begin(kv.value), std::end(kv.value), p);
+        *p++ = '\r';
+        *p++ = '\n';
+      });
 
-      kv = &(*it_via);
-      it_via = it;
-      break;
-    }
-    capitalize(buf, kv->name);
-    buf->append(": ");
-    buf->append(kv->value);
-    buf->append("\r\n");
-  }
+  buf->append(block.data(), p - block.data());
 }
 
 int32_t determine_window_update_transmission(nghttp2_session *session,
@@ -248,6 +248,26 @@ void test_http2_build_http1_headers_from_headers(void) {
   http2::build_http1_headers_from_headers(&buf, headers2,
                                           http2::HDOP_STRIP_ALL);
   CU_ASSERT(0 == buf.rleft());
+
+  buf.reset();
+
+  // Header lines which do not fit in the internal buffer together, or
+  // alone.
+  auto v1 = std::string(3000, 'a');
+  auto v2 = std::string(3000, 'b');
+  auto v3 = std::string(5000, 'c');
+  auto headers3 = HeaderRefs{
+      {StringRef::from_lit("alpha"), StringRef{v1}},
+      {StringRef::from_lit("bravo-charlie"), StringRef{v2}},
+      {StringRef::from_lit("delta"), StringRef{v3}},
+      {StringRef::from_lit("echo"), StringRef::from_lit("4")},
+  };
+
+  http2::build_http1_headers_from_headers(&buf, headers3, http2::HDOP_NONE);
+  hdrs = std::string(buf.head->pos, buf.head->last);
+  CU_ASSERT("Alpha: " + v1 + "\r\nBravo-Charlie: " + v2 + "\r\nDelta: " + v3 +
+                "\r\nEcho: 4\r\n" ==
+            hdrs);
 }
 
 void test_http2_lws(void) {
@@ -0,0 +1,332 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "http2.h"
+#include "memchunk.h"
+#include "template.h"
+
+// Microbenchmark of header field conversion between HTTP/1 and HTTP/2
+// in http2.cc.  The reference implementations below are the
+// per-header-switch versions which the table driven, single pass
+// conversion replaced, and are kept here for comparison.
+
+namespace nghttp2 {
+
+namespace {
+void ref_copy_headers_to_nva(std::vector<nghttp2_nv> &nva,
+                             const HeaderRefs &headers, uint32_t flags) {
+  auto it_forwarded = std::end(headers);
+  auto it_xff = std::end(headers);
+  auto it_xfp = std::end(headers);
+  auto it_via = std::end(headers);
+
+  for (auto it = std::begin(headers); it != std::end(headers); ++it) {
+    auto kv = &(*it);
+    if (kv->name.empty() || kv->name[0] == ':') {
+      continue;
+    }
+    switch (kv->token) {
+    case http2::HD_COOKIE:
+    case http2::HD_CONNECTION:
+    case http2::HD_HOST:
+    case http2::HD_HTTP2_SETTINGS:
+    case http2::HD_KEEP_ALIVE:
+    case http2::HD_PROXY_CONNECTION:
+    case http2::HD_SERVER:
+    case http2::HD_TE:
+    case http2::HD_TRANSFER_ENCODING:
+    case http2::HD_UPGRADE:
+      continue;
+    case http2::HD_FORWARDED:
+      if (flags & http2::HDOP_STRIP_FORWARDED) {
+        continue;
+      }
+      if (it_forwarded == std::end(headers)) {
+        it_forwarded = it;
+        continue;
+      }
+      kv = &(*it_forwarded);
+      it_forwarded = it;
+      break;
+    case http2::HD_X_FORWARDED_FOR:
+      if (flags & http2::HDOP_STRIP_X_FORWARDED_FOR) {
+        continue;
+      }
+      if (it_xff == std::end(headers)) {
+        it_xff = it;
+        continue;
+      }
+      kv = &(*it_xff);
+      it_xff = it;
+      break;
+    case http2::HD_X_FORWARDED_PROTO:
+      if (flags & http2::HDOP_STRIP_X_FORWARDED_PROTO) {
+        continue;
+      }
+      if (it_xfp == std::end(headers)) {
+        it_xfp = it;
+        continue;
+      }
+      kv = &(*it_xfp);
+      it_xfp = it;
+      break;
+    case http2::HD_VIA:
+      if (flags & http2::HDOP_STRIP_VIA) {
+        continue;
+      }
+      if (it_via == std::end(headers)) {
+        it_via = it;
+        continue;
+      }
+      kv = &(*it_via);
+      it_via = it;
+      break;
+    }
+    nva.push_back(http2::make_nv_nocopy(kv->name, kv->value, kv->no_index));
+  }
+}
+} // namespace
+
+namespace {
+void ref_build_http1_headers_from_headers(DefaultMemchunks *buf,
+                                          const HeaderRefs &headers,
+                                          uint32_t flags) {
+  auto it_forwarded = std::end(headers);
+  auto it_xff = std::end(headers);
+  auto it_xfp = std::end(headers);
+  auto it_via = std::end(headers);
+
+  for (auto it = std::begin(headers); it != std::end(headers); ++it) {
+    auto kv = &(*it);
+    if (kv->name.empty() || kv->name[0] == ':') {
+      continue;
+    }
+    switch (kv->token) {
+    case http2::HD_CONNECTION:
+    case http2::HD_COOKIE:
+    case http2::HD_HOST:
+    case http2::HD_HTTP2_SETTINGS:
+    case http2::HD_KEEP_ALIVE:
+    case http2::HD_PROXY_CONNECTION:
+    case http2::HD_SERVER:
+    case http2::HD_UPGRADE:
+      continue;
+    case http2::HD_FORWARDED:
+      if (flags & http2::HDOP_STRIP_FORWARDED) {
+        continue;
+      }
+      if (it_forwarded == std::end(headers)) {
+        it_forwarded = it;
+        continue;
+      }
+      kv = &(*it_forwarded);
+      it_forwarded = it;
+      break;
+    case http2::HD_X_FORWARDED_FOR:
+      if (flags & http2::HDOP_STRIP_X_FORWARDED_FOR) {
+        continue;
+      }
+      if (it_xff == std::end(headers)) {
+        it_xff = it;
+        continue;
+      }
+      kv = &(*it_xff);
+      it_xff = it;
+      break;
+    case http2::HD_X_FORWARDED_PROTO:
+      if (flags & http2::HDOP_STRIP_X_FORWARDED_PROTO) {
+        continue;
+      }
+      if (it_xfp == std::end(headers)) {
+        it_xfp = it;
+        continue;
+      }
+      kv = &(*it_xfp);
+      it_xfp = it;
+      break;
+    case http2::HD_VIA:
+      if (flags & http2::HDOP_STRIP_VIA) {
+        continue;
+      }
+      if (it_via == std::end(headers)) {
+        it_via = it;
+        continue;
+      }
+      kv = &(*it_via);
+      it_via = it;
+      break;
+    }
+    http2::capitalize(buf, kv->name);
+    buf->append(": ");
+    buf->append(kv->value);
+    buf->append("\r\n");
+  }
+}
+} // namespace
+
+namespace {
+// Header fields of a typical browser request received by nghttpx.
+HeaderRefs make_request_headers() {
+  const char *nv[][2] = {
+      {":method", "GET"},
+      {":scheme", "https"},
+      {":authority", "www.example.org"},
+      {":path", "/assets/application-4f3c2a1b.js"},
+      {"accept", "*/*"},
+      {"accept-encoding", "gzip, deflate, br"},
+      {"accept-language", "en-US,en;q=0.5"},
+      {"user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:55.0) "
+                     "Gecko/20100101 Firefox/55.0"},
+      {"referer", "https://www.example.org/"},
+      {"cookie", "sid=31d4d96e407aad42; lang=en-US"},
+      {"cache-control", "no-cache"},
+      {"if-modified-since", "Tue, 15 Nov 1994 12:45:26 GMT"},
+      {"x-requested-with", "XMLHttpRequest"},
+      {"te", "trailers"},
+      {"x-forwarded-for", "192.0.2.1"},
+      {"x-forwarded-for", "198.51.100.7"},
+      {"via", "1.1 proxy.example.net"},
+      {"via", "2 nghttpx"},
+      {"dnt", "1"},
+  };
+
+  HeaderRefs headers;
+  for (auto &p : nv) {
+    auto name = StringRef{p[0]};
+    headers.emplace_back(name, StringRef{p[1]}, false,
+                         http2::lookup_token(name));
+  }
+
+  return headers;
+}
+} // namespace
+
+namespace {
+template <typename F>
+void run(const char *name, size_t niter, size_t nheaders, F f) {
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < niter; ++i) {
+    f();
+  }
+
+  auto elapsed = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  printf("%-24s %10.1f ns/op %8.1f ns/header\n", name, elapsed / niter,
+         elapsed / niter / nheaders);
+}
+} // namespace
+
+namespace {
+bool nva_equal(const std::vector<nghttp2_nv> &a,
+               const std::vector<nghttp2_nv> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].namelen != b[i].namelen || a[i].valuelen != b[i].valuelen ||
+        a[i].flags != b[i].flags ||
+        memcmp(a[i].name, b[i].name, a[i].namelen) != 0 ||
+        memcmp(a[i].value, b[i].value, a[i].valuelen) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+namespace {
+std::string memchunks_to_string(DefaultMemchunks &buf) {
+  std::string s;
+  for (auto m = buf.head; m; m = m->next) {
+    s.append(m->pos, m->last);
+  }
+  return s;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t niter = 1000000;
+
+  if (argc > 1) {
+    niter = strtoul(argv[1], nullptr, 10);
+    if (niter == 0) {
+      std::cerr << "Usage: http2bench [ITERATIONS]" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  auto headers = make_request_headers();
+  auto flags = static_cast<uint32_t>(http2::HDOP_STRIP_X_FORWARDED_PROTO);
+
+  std::vector<nghttp2_nv> nva, ref_nva;
+  MemchunkPool pool;
+  DefaultMemchunks buf(&pool), ref_buf(&pool);
+
+  // Both implementations must produce the same output.
+  http2::copy_headers_to_nva_nocopy(nva, headers, flags);
+  ref_copy_headers_to_nva(ref_nva, headers, flags);
+  http2::build_http1_headers_from_headers(&buf, headers, flags);
+  ref_build_http1_headers_from_headers(&ref_buf, headers, flags);
+
+  if (!nva_equal(nva, ref_nva) ||
+      memchunks_to_string(buf) != memchunks_to_string(ref_buf)) {
+    std::cerr << "Output does not match reference implementation"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  run("copy_headers_to_nva/ref", niter, headers.size(), [&]() {
+    ref_nva.clear();
+    ref_copy_headers_to_nva(ref_nva, headers, flags);
+  });
+  run("copy_headers_to_nva", niter, headers.size(), [&]() {
+    nva.clear();
+    http2::copy_headers_to_nva_nocopy(nva, headers, flags);
+  });
+  run("build_http1_headers/ref", niter, headers.size(), [&]() {
+    ref_buf.reset();
+    ref_build_http1_headers_from_headers(&ref_buf, headers, flags);
+  });
+  run("build_http1_headers", niter, headers.size(), [&]() {
+    buf.reset();
+    http2::build_http1_headers_from_headers(&buf, headers, flags);
+  });
+
+  return 0;
+}
+
+} // namespace nghttp2
+
+int main(int argc, char **argv) { return nghttp2::main(argc, argv); }
@@ -0,0 +1,177 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 nghttp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include "nghttp2_config.h"
+
+#include <atomic>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <type_traits>
+
+namespace nghttp2 {
+
+// Bounded, lock-free queue which many threads can push to, and one
+// thread pops from.  Each slot has a sequence number which tells
+// whether it is free for the push of the given position, or filled
+// for the pop of it.  This is the bounded MPMC queue by Dmitry
+// Vyukov, with the consumer side simplified for a single consumer.
+// N must be a power of 2.
+template <typename T, size_t N> class MPSCQueue {
+public:
+  static_assert(N > 1 && (N & (N - 1)) == 0, "N must be a power of 2");
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+
+  MPSCQueue() : tail_(0), head_(0) {
+    for (size_t i = 0; i < N; ++i) {
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Appends |v|.  Returns false if the queue is full.  This function
+  // can be called from any thread.
+  bool push(const T &v) {
+    auto pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      auto &slot = slots_[pos & (N - 1)];
+      auto seq = slot.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          slot.value = v;
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+        // pos was updated by compare_exchange_weak.
+      } else if (diff < 0) {
+        // The consumer has not popped the slot of the previous round.
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Removes the first element, and assigns it to |v|.  Returns false
+  // if the queue is empty.  Only one thread can call this function.
+  bool pop(T &v) {
+    auto &slot = slots_[head_ & (N - 1)];
+    if (slot.seq.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+    }
+    v = slot.value;
+    slot.seq.store(head_ + N, std::memory_order_release);
+    ++head_;
+    return true;
+  }
+
+  // Returns true if no push has been started since the last pop.
+  // Only the thread which pops can call this function.
+  bool empty() const { return tail_.load(std::memory_order_acquire) == head_; }
+
+  static constexpr size_t capacity() { return N; }
+
+private:
+  struct Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  // The producers and the consumer touch the different ends.  slots_
+  // sits between them so that they do not share a cache line.
+  std::atomic<size_t> tail_;
+  std::array<Slot, N> slots_;
+  size_t head_;
+};
+
+// Unbounded queue which many threads can push to, and one thread
+// pops from.  The items go to MPSCQueue of N slots, and when it is
+// full, to the list protected by mutex instead.  The items keep going
+// to the list until the consumer takes it, so that the order of the
+// items from a thread is kept.
+template <typename T, size_t N> class MPSCOverflowQueue {
+public:
+  MPSCOverflowQueue() : overflow_(false) {}
+
+  // Appends |v|.  This function can be called from any thread.
+  void push(const T &v) {
+    if (overflow_.load(std::memory_order_acquire) || !q_.push(v)) {
+      std::lock_guard<std::mutex> g(m_);
+
+      overflow_q_.push_back(v);
+      overflow_.store(true, std::memory_order_release);
+    }
+  }
+
+  // Appends all items to |dest| in order.  If a push is still in
+  // progress, the items after it may be left in the queue, and this
+  // function must be called again after that push returns.  Only one
+  // thread can call this function.
+  void pop_all(std::deque<T> &dest) {
+    drain(dest);
+
+    if (!overflow_.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> g(m_);
+
+    // The producers may have filled q_ again after the drain above,
+    // and overflowed into overflow_q_.  The items in q_ precede them.
+    drain(dest);
+
+    if (!q_.empty()) {
+      return;
+    }
+
+    dest.insert(std::end(dest), std::begin(overflow_q_),
+                std::end(overflow_q_));
+    overflow_q_.clear();
+    overflow_.store(false, std::memory_order_release);
+  }
+
+private:
+  void drain(std::deque<T> &dest) {
+    T v;
+    while (q_.pop(v)) {
+      dest.push_back(v);
+    }
+  }
+
+  MPSCQueue<T, N> q_;
+  // Protects overflow_q_.
+  std::mutex m_;
+  std::deque<T> overflow_q_;
+  // true if overflow_q_ may not be empty.
+  std::atomic<bool> overflow_;
+};
+
+} // namespace nghttp2
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,200 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 nghttp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "mpsc_queue_test.h"
+
+#include <vector>
+#include <deque>
+#ifndef NOTHREADS
+#include <thread>
+#endif // !NOTHREADS
+
+#include <CUnit/CUnit.h>
+
+#include "mpsc_queue.h"
+
+namespace nghttp2 {
+
+void test_mpsc_queue_push_pop(void) {
+  MPSCQueue<int, 4> q;
+  int v;
+
+  CU_ASSERT(!q.pop(v));
+
+  // Go around the ring several times.
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      CU_ASSERT(q.push(round * 4 + i));
+    }
+
+    CU_ASSERT(!q.push(1000000007));
+
+    for (int i = 0; i < 4; ++i) {
+      CU_ASSERT(q.pop(v));
+      CU_ASSERT(round * 4 + i == v);
+    }
+
+    CU_ASSERT(!q.pop(v));
+  }
+
+  // A freed slot can be reused immediately.
+  CU_ASSERT(q.push(1));
+  CU_ASSERT(q.push(2));
+  CU_ASSERT(q.pop(v));
+  CU_ASSERT(1 == v);
+  CU_ASSERT(q.push(3));
+  CU_ASSERT(q.pop(v));
+  CU_ASSERT(2 == v);
+  CU_ASSERT(q.pop(v));
+  CU_ASSERT(3 == v);
+}
+
+void test_mpsc_queue_multi_producer(void) {
+#ifndef NOTHREADS
+  constexpr size_t nproducers = 4;
+  constexpr uint32_t nitems = 100000;
+
+  MPSCQueue<uint64_t, 64> q;
+  std::vector<std::thread> producers;
+
+  for (size_t i = 0; i < nproducers; ++i) {
+    producers.emplace_back([&q, i]() {
+      for (uint32_t j = 0; j < nitems; ++j) {
+        // Encode producer ID and sequence number.
+        auto v = (static_cast<uint64_t>(i) << 32) | j;
+        while (!q.push(v)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  // The items from each producer must arrive in order, and none of
+  // them must be lost.
+  std::vector<uint32_t> next(nproducers);
+  size_t nerrors = 0;
+
+  for (size_t n = 0; n < nproducers * nitems;) {
+    uint64_t v;
+    if (!q.pop(v)) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    auto id = v >> 32;
+    if (id >= nproducers || next[id] != (v & 0xffffffffu)) {
+      ++nerrors;
+    } else {
+      ++next[id];
+    }
+    ++n;
+  }
+
+  for (auto &t : producers) {
+    t.join();
+  }
+
+  CU_ASSERT(0 == nerrors);
+
+  for (auto n : next) {
+    CU_ASSERT(nitems == n);
+  }
+
+  uint64_t v;
+  CU_ASSERT(!q.pop(v));
+#endif // !NOTHREADS
+}
+
+void test_mpsc_queue_overflow(void) {
+  MPSCOverflowQueue<int, 4> q;
+  std::deque<int> dest;
+
+  q.pop_all(dest);
+
+  CU_ASSERT(dest.empty());
+
+  // Overflow the ring, and then fill it again after the items in the
+  // ring are taken.
+  for (int i = 0; i < 10; ++i) {
+    q.push(i);
+  }
+
+  q.pop_all(dest);
+
+  for (int i = 10; i < 20; ++i) {
+    q.push(i);
+  }
+
+  q.pop_all(dest);
+
+  CU_ASSERT(20 == dest.size());
+
+  for (int i = 0; i < 20; ++i) {
+    CU_ASSERT(i == dest[i]);
+  }
+
+  dest.clear();
+  q.pop_all(dest);
+
+  CU_ASSERT(dest.empty());
+}
+
+void test_mpsc_queue_overflow_order(void) {
+#ifndef NOTHREADS
+  constexpr int nitems = 1000000;
+
+  // The ring is small so that it overflows while the consumer is
+  // taking the items.
+  MPSCOverflowQueue<int, 4> q;
+
+  std::thread producer([&q]() {
+    for (int i = 0; i < nitems; ++i) {
+      q.push(i);
+    }
+  });
+
+  std::deque<int> dest;
+  int next = 0;
+  size_t nerrors = 0;
+
+  while (next < nitems) {
+    q.pop_all(dest);
+
+    for (auto v : dest) {
+      if (v != next) {
+        ++nerrors;
+      }
+      next = v + 1;
+    }
+
+    dest.clear();
+  }
+
+  producer.join();
+
+  CU_ASSERT(0 == nerrors);
+#endif // !NOTHREADS
+}
+
+} // namespace nghttp2
@@ -0,0 +1,203 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "shrpx_router.h"
+#include "shrpx_rule_router.h"
+#include "template.h"
+
+// Microbenchmark of Router::match(host, path) in shrpx_router.cc with
+// many patterns, which looks like the configuration of the proxy
+// serving many virtual hosts.  There are NHOSTS hosts with random
+// names, and each of them has NPATHS paths.  The queries are the mix
+// of the exact match, the prefix match, the match without trailing
+// slash, and the miss with known and unknown hosts.  The same patterns
+// are also given to RuleRouter as routing rules for comparison.
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+namespace {
+struct Query {
+  std::string host;
+  std::string path;
+  ssize_t idx;
+};
+} // namespace
+
+namespace {
+template <typename F>
+void run(const char *name, size_t npatterns,
+         const std::vector<std::pair<StringRef, StringRef>> &qv, size_t niter,
+         F f) {
+  size_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < niter; ++i) {
+    auto &q = qv[i % qv.size()];
+    sum += f(q.first, q.second);
+  }
+
+  auto elapsed = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  printf("%-10s %zu patterns, %zu queries: %.1f ns/op (%zu)\n", name,
+         npatterns, qv.size(), elapsed / niter, sum);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  size_t nhosts = 1000;
+  size_t npaths = 10;
+  size_t niter = 1000000;
+
+  if (argc > 1) {
+    nhosts = strtoul(argv[1], nullptr, 10);
+  }
+  if (argc > 2) {
+    npaths = strtoul(argv[2], nullptr, 10);
+  }
+  if (argc > 3) {
+    niter = strtoul(argv[3], nullptr, 10);
+  }
+  if (nhosts == 0 || npaths == 0 || niter == 0) {
+    std::cerr << "Usage: routerbench [NHOSTS [NPATHS [ITERATIONS]]]"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<> dis('a', 'z');
+
+  std::vector<std::string> hosts, paths;
+  for (size_t i = 0; i < nhosts; ++i) {
+    std::string host;
+    for (size_t j = 0; j < 8; ++j) {
+      host += static_cast<char>(dis(gen));
+    }
+    hosts.push_back(host + ".example.com");
+  }
+  for (size_t i = 0; i < npaths; ++i) {
+    paths.push_back("/app" + std::to_string(i) + "-api/");
+  }
+
+  Router router;
+  size_t idx = 0;
+
+  for (auto &host : hosts) {
+    router.add_route(StringRef{host + '/'}, idx++);
+    for (auto &path : paths) {
+      router.add_route(StringRef{host + path}, idx++);
+    }
+  }
+
+  std::vector<Query> queries;
+  idx = 0;
+
+  for (auto &host : hosts) {
+    auto base = idx++;
+    for (auto &path : paths) {
+      auto i = idx++;
+      queries.push_back({host, path, static_cast<ssize_t>(i)});
+      queries.push_back({host, path + "users/12345/profile",
+                         static_cast<ssize_t>(i)});
+      queries.push_back({host, path.substr(0, path.size() - 1),
+                         static_cast<ssize_t>(i)});
+    }
+    queries.push_back({host, "/index.html", static_cast<ssize_t>(base)});
+    queries.push_back({"unknown." + host, "/app0-api/", -1});
+  }
+
+  std::shuffle(std::begin(queries), std::end(queries), gen);
+
+  for (auto &q : queries) {
+    if (router.match(StringRef{q.host}, StringRef{q.path}) != q.idx) {
+      std::cerr << "Unexpected result for " << q.host << q.path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  std::vector<std::pair<StringRef, StringRef>> qv;
+  for (auto &q : queries) {
+    qv.emplace_back(StringRef{q.host}, StringRef{q.path});
+  }
+
+  run("Router", idx, qv, niter, [&router](const StringRef &host,
+                                          const StringRef &path) {
+    return router.match(host, path);
+  });
+
+  // The same patterns as routing rules.  The rules for paths come
+  // before the one for host alone, since the first rule which
+  // matches wins.
+  RuleRouter rule_router;
+  idx = 0;
+
+  for (auto &host : hosts) {
+    auto base = idx++;
+    for (auto &path : paths) {
+      auto rule = "host=" + host + "&path=" + path.substr(0, path.size() - 1) +
+                  "(/.*)?";
+      rule_router.add_rule(StringRef{rule}, idx++);
+    }
+    rule_router.add_rule(StringRef{"host=" + host + "&path=/.*"}, base);
+  }
+
+  if (rule_router.compile() != 0) {
+    std::cerr << "RuleRouter: too many patterns" << std::endl;
+    return 0;
+  }
+
+  auto method = StringRef::from_lit("GET");
+
+  for (auto &q : queries) {
+    if (rule_router.match(method, StringRef{q.host}, StringRef{q.path},
+                          nullptr) != q.idx) {
+      std::cerr << "RuleRouter: unexpected result for " << q.host << q.path
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  run("RuleRouter", idx, qv, niter,
+      [&rule_router, &method](const StringRef &host, const StringRef &path) {
+        return rule_router.match(method, host, path, nullptr);
+      });
+
+  return 0;
+}
+
+} // namespace shrpx
+
+int main(int argc, char **argv) { return shrpx::main(argc, argv); }
@@ -34,17 +34,24 @@
 #include "shrpx_downstream_test.h"
 #include "shrpx_config_test.h"
 #include "shrpx_worker_test.h"
+#include "shrpx_connection_handler_test.h"
+#include "shrpx_accesslog_writer_test.h"
+#include "shrpx_log_test.h"
 #include "http2_test.h"
 #include "util_test.h"
 #include "nghttp2_gzip_test.h"
 #include "buffer_test.h"
 #include "memchunk_test.h"
 #include "template_test.h"
+#include "mpsc_queue_test.h"
 #include "shrpx_http_test.h"
 #include "base64_test.h"
 #include "shrpx_config.h"
 #include "tls.h"
 #include "shrpx_router_test.h"
+#include "shrpx_rule_router_test.h"
+#include "shrpx_response_cache_test.h"
+#include "shrpx_cache_downstream_connection_test.h"
 #include "shrpx_log.h"
 
 static int init_suite1(void) { return 0; }
@@ -123,8 +130,26 @@ int main(int argc, char *argv[]) {
                    shrpx::test_shrpx_config_read_tls_ticket_key_file) ||
       !CU_add_test(pSuite, "config_read_tls_ticket_key_file_aes_256",
                    shrpx::test_shrpx_config_read_tls_ticket_key_file_aes_256) ||
+      !CU_add_test(pSuite, "config_compute_affinity_table",
+                   shrpx::test_shrpx_config_compute_affinity_table) ||
       !CU_add_test(pSuite, "worker_match_downstream_addr_group",
                    shrpx::test_shrpx_worker_match_downstream_addr_group) ||
+      !CU_add_test(pSuite, "worker_match_downstream_addr_group_rule",
+                   shrpx::test_shrpx_worker_match_downstream_addr_group_rule) ||
+      !CU_add_test(pSuite, "worker_select_downstream_addr",
+                   shrpx::test_shrpx_worker_select_downstream_addr) ||
+      !CU_add_test(pSuite, "worker_select_affinity_downstream_addr",
+                   shrpx::test_shrpx_worker_select_affinity_downstream_addr) ||
+      !CU_add_test(pSuite, "connection_handler_select_worker_index",
+                   shrpx::test_shrpx_connection_handler_select_worker_index) ||
+      !CU_add_test(pSuite, "accesslog_writer_flush",
+                   shrpx::test_shrpx_accesslog_writer_flush) ||
+      !CU_add_test(pSuite, "accesslog_writer_drop",
+                   shrpx::test_shrpx_accesslog_writer_drop) ||
+      !CU_add_test(pSuite, "log_format_accesslog",
+                   shrpx::test_shrpx_log_format_accesslog) ||
+      !CU_add_test(pSuite, "log_format_accesslog_binary",
+                   shrpx::test_shrpx_log_format_accesslog_binary) ||
       !CU_add_test(pSuite, "http_create_forwarded",
                    shrpx::test_shrpx_http_create_forwarded) ||
       !CU_add_test(pSuite, "http_create_via_header_value",
@@ -134,6 +159,31 @@ int main(int argc, char *argv[]) {
                    shrpx::test_shrpx_router_match_wildcard) ||
       !CU_add_test(pSuite, "router_match_prefix",
                    shrpx::test_shrpx_router_match_prefix) ||
+      !CU_add_test(pSuite, "router_match_many",
+                   shrpx::test_shrpx_router_match_many) ||
+      !CU_add_test(pSuite, "rule_router_match",
+                   shrpx::test_shrpx_rule_router_match) ||
+      !CU_add_test(pSuite, "rule_router_regex",
+                   shrpx::test_shrpx_rule_router_regex) ||
+      !CU_add_test(pSuite, "rule_router_add_rule",
+                   shrpx::test_shrpx_rule_router_add_rule) ||
+      !CU_add_test(pSuite, "response_cache_parse_cache_control",
+                   shrpx::test_shrpx_response_cache_parse_cache_control) ||
+      !CU_add_test(pSuite, "response_cache_cacheable_request",
+                   shrpx::test_shrpx_response_cache_cacheable_request) ||
+      !CU_add_test(pSuite, "response_cache_arena",
+                   shrpx::test_shrpx_response_cache_arena) ||
+      !CU_add_test(pSuite, "response_cache_lookup",
+                   shrpx::test_shrpx_response_cache_lookup) ||
+      !CU_add_test(pSuite, "response_cache_max_slots",
+                   shrpx::test_shrpx_response_cache_max_slots) ||
+      !CU_add_test(pSuite, "cache_downstream_connection_wake",
+                   shrpx::test_shrpx_cache_downstream_connection_wake) ||
+      !CU_add_test(pSuite, "cache_downstream_connection_wake_delete",
+                   shrpx::test_shrpx_cache_downstream_connection_wake_delete) ||
+      !CU_add_test(
+          pSuite, "cache_downstream_connection_lock_timeout",
+          shrpx::test_shrpx_cache_downstream_connection_lock_timeout) ||
       !CU_add_test(pSuite, "util_streq", shrpx::test_util_streq) ||
       !CU_add_test(pSuite, "util_strieq", shrpx::test_util_strieq) ||
       !CU_add_test(pSuite, "util_inp_strlower",
@@ -210,6 +260,14 @@ int main(int argc, char *argv[]) {
                    nghttp2::test_template_immutable_string) ||
       !CU_add_test(pSuite, "template_string_ref",
                    nghttp2::test_template_string_ref) ||
+      !CU_add_test(pSuite, "mpsc_queue_push_pop",
+                   nghttp2::test_mpsc_queue_push_pop) ||
+      !CU_add_test(pSuite, "mpsc_queue_multi_producer",
+                   nghttp2::test_mpsc_queue_multi_producer) ||
+      !CU_add_test(pSuite, "mpsc_queue_overflow",
+                   nghttp2::test_mpsc_queue_overflow) ||
+      !CU_add_test(pSuite, "mpsc_queue_overflow_order",
+                   nghttp2::test_mpsc_queue_overflow_order) ||
       !CU_add_test(pSuite, "base64_encode", nghttp2::test_base64_encode) ||
       !CU_add_test(pSuite, "base64_decode", nghttp2::test_base64_decode)) {
     CU_cleanup_registry();
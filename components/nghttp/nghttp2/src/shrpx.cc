@@ -785,6 +785,20 @@ int create_tcp_server_socket(UpstreamAddr &faddr,
       continue;
     }
 
+#ifdef SO_REUSEPORT
+    // Worker threads bind their own listening sockets to the same
+    // address.
+    if (listenerconf.reuseport &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val,
+                   static_cast<socklen_t>(sizeof(val))) == -1) {
+      auto error = errno;
+      LOG(WARN) << "Failed to set SO_REUSEPORT option to listener socket: "
+                << xsi_strerror(error, errbuf.data(), errbuf.size());
+      close(fd);
+      continue;
+    }
+#endif // SO_REUSEPORT
+
 #ifdef IPV6_V6ONLY
     if (faddr.family == AF_INET6) {
       if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &val,
@@ -1546,6 +1560,8 @@ void fill_default_config(Config *config) {
     auto &accessconf = loggingconf.access;
     accessconf.format =
         parse_log_format(config->balloc, DEFAULT_ACCESSLOG_FORMAT);
+    accessconf.buffer_size = 1_m;
+    accessconf.flush_interval = 100_ms;
 
     auto &errorconf = loggingconf.error;
     errorconf.file = StringRef::from_lit("/dev/stderr");
@@ -1611,6 +1627,10 @@ void fill_default_config(Config *config) {
     timeoutconf.lookup = 5_s;
   }
   dnsconf.max_try = 2;
+
+  auto &cacheconf = config->cache;
+  cacheconf.max_object_size = 1_m;
+  cacheconf.lock_timeout = 5_s;
 }
 
 } // namespace
@@ -1704,6 +1724,27 @@ Connections:
               pattern,  which  matches  all request  paths  (catch-all
               pattern).  The catch-all backend must be given.
 
+              If  <PATTERN>  starts  with  "~",  the  rest  of it is a
+              routing rule, which is a list of predicates delimited by
+              "&".   All of them must be satisfied.   The predicate is
+              one  of  "host=<GLOB>", "path=<REGEX>", "method=<REGEX>"
+              and "header.<NAME>=<REGEX>".  In <GLOB>, "*" matches any
+              sequence  of  characters,  and  "?"  matches  any single
+              character.    <REGEX>  must  match  the whole value, and
+              supports  alternation  "|",  grouping  with parentheses,
+              "*", "+", "?", "{m,n}", ".", "[...]" and escapes such as
+              "\d"  and  "\xHH".    The  header  predicate  is matched
+              against  the  value of the first header field <NAME>, or
+              empty  string if it is not present.   ":" and ";" cannot
+              be  written  in  a  rule, use "\x3a" and "\x3b" instead.
+              The  rules  take precedence over the other patterns, and
+              the  first rule given which matches is used.   All rules
+              are  compiled  into a single automaton at startup.   For
+              example,
+              -b'127.0.0.1,8080;~path=/v[0-9]+/.*&header.x-canary=1'
+              routes the  requests with versioned  path and "x-canary:
+              1" header field to the backend.
+
               When doing  a match, nghttpx made  some normalization to
               pattern, request host and path.  For host part, they are
               converted to lower case.  For path part, percent-encoded
@@ -1726,15 +1767,17 @@ Connections:
               together forming  load balancing  group.
 
               Several parameters <PARAM> are accepted after <PATTERN>.
-              The  parameters are  delimited  by  ";".  The  available
-              parameters       are:      "proto=<PROTO>",       "tls",
+              The  parameters  are  delimited  by ";".   The available
+              parameters       are:       "proto=<PROTO>",      "tls",
               "sni=<SNI_HOST>",         "fall=<N>",        "rise=<N>",
-              "affinity=<METHOD>",  "dns", and  "redirect-if-not-tls".
-              The  parameter  consists   of  keyword,  and  optionally
-              followed by  "=" and value.  For  example, the parameter
-              "proto=h2"  consists of  the keyword  "proto" and  value
-              "h2".  The parameter "tls" consists of the keyword "tls"
-              without value.  Each parameter is described as follows.
+              "affinity=<METHOD>",              "affinity-key=<NAME>",
+              "balance=<POLICY>",     "weight=<N>",     "dns",     and
+              "redirect-if-not-tls".      The  parameter  consists  of
+              keyword, and optionally followed by "=" and value.   For
+              example,   the  parameter  "proto=h2"  consists  of  the
+              keyword  "proto"  and  value "h2".   The parameter "tls"
+              consists  of  the  keyword  "tls"  without value.   Each
+              parameter is described as follows.
 
               The backend application protocol  can be specified using
               optional  "proto"   parameter,  and   in  the   form  of
@@ -1769,19 +1812,56 @@ Connections:
               backend  is permanently  offline, once  it goes  in that
               state, and this is the default behaviour.
 
-              The     session     affinity    is     enabled     using
-              "affinity=<METHOD>"  parameter.   If  "ip" is  given  in
-              <METHOD>, client  IP based session affinity  is enabled.
-              If  "none" is  given  in <METHOD>,  session affinity  is
-              disabled, and this is the default.  The session affinity
-              is enabled per  <PATTERN>.  If at least  one backend has
-              "affinity" parameter,  and its  <METHOD> is  not "none",
-              session  affinity is  enabled  for  all backend  servers
-              sharing  the  same  <PATTERN>.   It is  advised  to  set
-              "affinity"  parameter  to   all  backend  explicitly  if
-              session affinity  is desired.  The session  affinity may
-              break if one of the backend gets unreachable, or backend
-              settings are reloaded or replaced by API.
+              The     session     affinity     is     enabled    using
+              "affinity=<METHOD>"  parameter.    If  "ip"  is given in
+              <METHOD>,  client  IP based session affinity is enabled.
+              If  "cookie"  is  given  in  <METHOD>,  the value of the
+              request  cookie named by "affinity-key=<NAME>" parameter
+              is used as the key of session affinity.   If "header" is
+              given in <METHOD>, the value of the request header field
+              named   by   "affinity-key=<NAME>"   parameter  is  used
+              instead.    "affinity-key"  is required for "cookie" and
+              "header".    If  the request does not have the cookie or
+              header field, client IP is used.   If "none" is given in
+              <METHOD>,  session affinity is disabled, and this is the
+              default.  The session affinity is enabled per <PATTERN>.
+              If  at  least  one backend has "affinity" parameter, and
+              its  <METHOD> is not "none", session affinity is enabled
+              for all backend servers sharing the same <PATTERN>.   It
+              is  advised  to  set "affinity" parameter to all backend
+              explicitly  if session affinity is desired.   The key is
+              mapped  to a backend server using consistent hashing, so
+              that  most of the keys stay with the same backend server
+              when  backend  servers  are  added  or removed.   If the
+              backend  server is unreachable, or it has more than 1.25
+              times  its  share  of  the requests in flight across all
+              worker  threads, the request is sent to the next backend
+              server for the key.
+
+              The    load    balancing    policy   is   chosen   using
+              "balance=<POLICY>" parameter.  If "round-robin" is given
+              in  <POLICY>,  backend  servers  are chosen in turn, and
+              this  is the default.   If "least-request" is given, the
+              backend  server  which has the fewest requests in flight
+              relative to its weight is chosen.  If "ewma" is given, 2
+              backend  servers are picked at random, and the one which
+              has  the  lower exponentially weighted moving average of
+              response  time  multiplied  by the number of requests in
+              flight, relative to its weight, is chosen.  The requests
+              in  flight  and  response  time  are  counted across all
+              worker threads.   Like "affinity", the policy is set per
+              <PATTERN>,  and  the  last  one other than "round-robin"
+              wins.  If session affinity is enabled, this parameter is
+              ignored.      The  statistics  of  backend  servers  are
+              available via /api/v1beta1/backendstats API endpoint.
+
+              The  weight  of  backend  server  can be specified using
+              "weight=<N>" parameter.   <N> must be an integer between
+              1 and 256, inclusive.   The larger weight means that the
+              more  requests  are  sent  to this backend server.   The
+              weight  is used by session affinity, and "least-request"
+              and   "ewma"   balance   policies,  and  it  is  ignored
+              otherwise.  The default weight is 1.
 
               By default, name resolution of backend host name is done
               at  start  up,  or reloading  configuration.   If  "dns"
@@ -1882,6 +1962,33 @@ Performance:
               experience,  or  for  the platforms  which  lack  thread
               support.   If  threading  is disabled,  this  option  is
               always enabled.
+  --reuseport
+              Make each worker thread accept TCP connections by itself
+              on  its  own listening socket with SO_REUSEPORT, and let
+              the  kernel  distribute incoming connections among them.
+              Without this option, one thread accepts all connections,
+              and  dispatches  them  to  worker threads.   UNIX domain
+              socket  and  API  frontends  are  still  accepted in one
+              thread.  This option has no effect if --single-thread is
+              used.
+  --worker-cpu-affinity=(auto|<CPU>[,<CPU>]*)
+              Pin worker threads to CPUs.   If comma separated list of
+              CPU  numbers  is given, the i-th worker thread is pinned
+              to  the  (i  mod  N)-th  CPU in the list, where N is the
+              number  of  CPUs  in the list.   If "auto" is given, the
+              i-th  worker  thread  is  pinned  to  the i-th CPU.   By
+              default, worker threads are not pinned.
+  --worker-dispatch=(round-robin|least-conn|p2c)
+              Set  the  policy  to  choose  a  worker thread for a new
+              connection.    "round-robin"  chooses  worker threads in
+              turn.    "least-conn"  chooses  the  worker thread which
+              serves the fewest connections, and breaks a tie with the
+              number  of  streams  in  flight.    "p2c" picks 2 worker
+              threads  at  random, and chooses the one which has fewer
+              connections  and streams.   This option has no effect on
+              the  TCP frontends accepted by worker threads themselves
+              with --reuseport.
+              Default: round-robin
   --read-rate=<SIZE>
               Set maximum  average read  rate on  frontend connection.
               Setting 0 to this option means read rate is unlimited.
@@ -2501,6 +2608,42 @@ Logging:
               Write  access  log  when   response  header  fields  are
               received   from  backend   rather   than  when   request
               transaction finishes.
+  --accesslog-async
+              Write  access  log  to  file  in  the  dedicated thread.
+              Worker  threads append access log lines to their buffer,
+              and  the  thread writes them to the file at once.   With
+              this option, slow access log file does not delay request
+              processing.   The buffered lines are written on graceful
+              shutdown,  but they may be lost if nghttpx is terminated
+              immediately.        This    option    is    ignored   if
+              --accesslog-syslog is used.
+  --accesslog-buffer-size=<SIZE>
+              Set the size of buffer per worker thread in which access
+              log  lines  wait to be written when --accesslog-async is
+              used.  <SIZE> must be at least 4K.
+              Default: )"
+      << util::utos_unit(config->logging.access.buffer_size) << R"(
+  --accesslog-flush-interval=<DURATION>
+              Set  the interval at which buffered access log lines are
+              written  when --accesslog-async is used.   They are also
+              written when the buffer of a worker thread is half full.
+              Default: )"
+      << util::duration_str(config->logging.access.flush_interval) << R"(
+  --accesslog-overflow=(block|drop)
+              Specify what to do when the buffer of a worker thread is
+              full  when  --accesslog-async  is  used.   If "block" is
+              given, the worker thread waits for the room.   If "drop"
+              is given, the access log line is discarded.   The number
+              of discarded lines is logged in error log.
+              Default: block
+  --accesslog-binary
+              Write access log in binary format instead of text.  Each
+              access  log  entry is written as a record which contains
+              the  values  of  variables in --accesslog-format without
+              escaping,  and  the  literal  strings are omitted.   Use
+              contrib/nghttpx-accesslog-decode.py   to   convert   the
+              records into text or JSON lines.  This option is ignored
+              if --accesslog-syslog is used.
   --errorlog-file=<PATH>
               Set path to write error  log.  To reopen file, send USR1
               signal  to nghttpx.   stderr will  be redirected  to the
@@ -2673,6 +2816,41 @@ DNS:
               and it  may allow additional few  requests.  The default
               value is unlimited.
 
+Cache:
+  --cache-size=<SIZE>
+              Set  the size of memory for cached responses.   If it is
+              greater  than  0,  nghttpx  caches  the responses to GET
+              requests from backend, and serves them to later requests
+              for  the  same  authority  and  path.    The  memory  is
+              allocated  at startup, and shared by all worker threads.
+              A response is cached only if it has an explicit lifetime
+              given  by s-maxage or max-age directive of cache-control
+              header  field,  or  expires  header field, and it has no
+              set-cookie header field.  Requests with authorization or
+              range  header field, or cache-control no-cache directive
+              are not served from cache.  While a response is fetched,
+              the  other  requests for it wait for it instead of going
+              to backend.   If the response has stale-while-revalidate
+              directive,  it  is served after it expires for the given
+              period  while  one  request  fetches  it  again.     The
+              statistics  of cache are available from the API endpoint
+              /api/v1beta1/cachestats.  Response cache is disabled if
+              --mruby-file  is given,  because  the  response  phase
+              hook  of mruby  script  cannot  run  for  the  responses
+              served from cache.  0 disables response cache.
+              Default: )"
+      << util::utos_unit(config->cache.size) << R"(
+  --cache-max-object-size=<SIZE>
+              Set the maximum size of a response to be cached.
+              Default: )"
+      << util::utos_unit(config->cache.max_object_size) << R"(
+  --cache-lock-timeout=<DURATION>
+              Set  the  maximum  time that a request waits for another
+              request  to  fetch  the same response.   After that, the
+              request is sent to backend without using cache.
+              Default: )"
+      << util::duration_str(config->cache.lock_timeout) << R"(
+
 Debug:
   --frontend-http2-dump-request-header=<PATH>
               Dumps request headers received by HTTP/2 frontend to the
@@ -2774,6 +2952,14 @@ int process_options(Config *config,
 
   auto &loggingconf = config->logging;
 
+  if (loggingconf.access.binary && loggingconf.access.syslog) {
+    LOG(WARN) << "accesslog-binary: ignored because accesslog-syslog is used";
+    loggingconf.access.binary = false;
+  }
+
+  loggingconf.access.emitters =
+      compile_log_format(loggingconf.access.format, loggingconf.access.binary);
+
   if (loggingconf.access.syslog || loggingconf.error.syslog) {
     openlog("nghttpx", LOG_NDELAY | LOG_NOWAIT | LOG_PID,
             loggingconf.syslog_facility);
@@ -3382,6 +3568,21 @@ int main(int argc, char **argv) {
         {SHRPX_OPT_NO_STRIP_INCOMING_X_FORWARDED_PROTO.c_str(), no_argument,
          &flag, 158},
         {SHRPX_OPT_SINGLE_PROCESS.c_str(), no_argument, &flag, 159},
+        {SHRPX_OPT_REUSEPORT.c_str(), no_argument, &flag, 160},
+        {SHRPX_OPT_WORKER_CPU_AFFINITY.c_str(), required_argument, &flag,
+         161},
+        {SHRPX_OPT_WORKER_DISPATCH.c_str(), required_argument, &flag, 162},
+        {SHRPX_OPT_ACCESSLOG_ASYNC.c_str(), no_argument, &flag, 163},
+        {SHRPX_OPT_ACCESSLOG_BUFFER_SIZE.c_str(), required_argument, &flag,
+         164},
+        {SHRPX_OPT_ACCESSLOG_FLUSH_INTERVAL.c_str(), required_argument, &flag,
+         165},
+        {SHRPX_OPT_ACCESSLOG_OVERFLOW.c_str(), required_argument, &flag, 166},
+        {SHRPX_OPT_ACCESSLOG_BINARY.c_str(), no_argument, &flag, 167},
+        {SHRPX_OPT_CACHE_SIZE.c_str(), required_argument, &flag, 168},
+        {SHRPX_OPT_CACHE_MAX_OBJECT_SIZE.c_str(), required_argument, &flag,
+         169},
+        {SHRPX_OPT_CACHE_LOCK_TIMEOUT.c_str(), required_argument, &flag, 170},
         {nullptr, 0, nullptr, 0}};
 
     int option_index = 0;
@@ -4143,6 +4344,55 @@ int main(int argc, char **argv) {
         cmdcfgs.emplace_back(SHRPX_OPT_SINGLE_PROCESS,
                              StringRef::from_lit("yes"));
         break;
+      case 160:
+        // --reuseport
+        cmdcfgs.emplace_back(SHRPX_OPT_REUSEPORT, StringRef::from_lit("yes"));
+        break;
+      case 161:
+        // --worker-cpu-affinity
+        cmdcfgs.emplace_back(SHRPX_OPT_WORKER_CPU_AFFINITY, StringRef{optarg});
+        break;
+      case 162:
+        // --worker-dispatch
+        cmdcfgs.emplace_back(SHRPX_OPT_WORKER_DISPATCH, StringRef{optarg});
+        break;
+      case 163:
+        // --accesslog-async
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_ASYNC,
+                             StringRef::from_lit("yes"));
+        break;
+      case 164:
+        // --accesslog-buffer-size
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_BUFFER_SIZE,
+                             StringRef{optarg});
+        break;
+      case 165:
+        // --accesslog-flush-interval
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_FLUSH_INTERVAL,
+                             StringRef{optarg});
+        break;
+      case 166:
+        // --accesslog-overflow
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_OVERFLOW, StringRef{optarg});
+        break;
+      case 167:
+        // --accesslog-binary
+        cmdcfgs.emplace_back(SHRPX_OPT_ACCESSLOG_BINARY,
+                             StringRef::from_lit("yes"));
+        break;
+      case 168:
+        // --cache-size
+        cmdcfgs.emplace_back(SHRPX_OPT_CACHE_SIZE, StringRef{optarg});
+        break;
+      case 169:
+        // --cache-max-object-size
+        cmdcfgs.emplace_back(SHRPX_OPT_CACHE_MAX_OBJECT_SIZE,
+                             StringRef{optarg});
+        break;
+      case 170:
+        // --cache-lock-timeout
+        cmdcfgs.emplace_back(SHRPX_OPT_CACHE_LOCK_TIMEOUT, StringRef{optarg});
+        break;
       default:
         break;
       }
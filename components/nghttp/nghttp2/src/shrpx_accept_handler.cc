@@ -31,6 +31,7 @@
 #include <cerrno>
 
 #include "shrpx_connection_handler.h"
+#include "shrpx_worker.h"
 #include "shrpx_config.h"
 #include "shrpx_log.h"
 #include "util.h"
@@ -47,26 +48,40 @@ void acceptcb(struct ev_loop *loop, ev_io *w, int revent) {
 } // namespace
 
 AcceptHandler::AcceptHandler(const UpstreamAddr *faddr, ConnectionHandler *h)
-    : conn_hnr_(h), faddr_(faddr) {
-  ev_io_init(&wev_, acceptcb, faddr_->fd, EV_READ);
+    : loop_(h->get_loop()),
+      conn_hnr_(h),
+      worker_(nullptr),
+      faddr_(faddr),
+      fd_(faddr->fd) {
+  ev_io_init(&wev_, acceptcb, fd_, EV_READ);
   wev_.data = this;
-  ev_io_start(conn_hnr_->get_loop(), &wev_);
+  ev_io_start(loop_, &wev_);
+}
+
+AcceptHandler::AcceptHandler(const UpstreamAddr *faddr, int fd, Worker *worker)
+    : loop_(worker->get_loop()),
+      conn_hnr_(nullptr),
+      worker_(worker),
+      faddr_(faddr),
+      fd_(fd) {
+  ev_io_init(&wev_, acceptcb, fd_, EV_READ);
+  wev_.data = this;
+  ev_io_start(loop_, &wev_);
 }
 
 AcceptHandler::~AcceptHandler() {
-  ev_io_stop(conn_hnr_->get_loop(), &wev_);
-  close(faddr_->fd);
+  ev_io_stop(loop_, &wev_);
+  close(fd_);
 }
 
-void AcceptHandler::accept_connection() {
+int AcceptHandler::accept_connection() {
   sockaddr_union sockaddr;
   socklen_t addrlen = sizeof(sockaddr);
 
 #ifdef HAVE_ACCEPT4
-  auto cfd =
-      accept4(faddr_->fd, &sockaddr.sa, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  auto cfd = accept4(fd_, &sockaddr.sa, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
 #else  // !HAVE_ACCEPT4
-  auto cfd = accept(faddr_->fd, &sockaddr.sa, &addrlen);
+  auto cfd = accept(fd_, &sockaddr.sa, &addrlen);
 #endif // !HAVE_ACCEPT4
 
   if (cfd == -1) {
@@ -82,15 +97,21 @@ void AcceptHandler::accept_connection() {
     case EHOSTUNREACH:
     case EOPNOTSUPP:
     case ENETUNREACH:
-      return;
+      return -1;
     case EMFILE:
-    case ENFILE:
+    case ENFILE: {
       LOG(WARN) << "acceptor: running out file descriptor; disable acceptor "
                    "temporarily";
-      conn_hnr_->sleep_acceptor(get_config()->conn.listener.timeout.sleep);
-      return;
+      auto t = get_config()->conn.listener.timeout.sleep;
+      if (worker_) {
+        worker_->sleep_acceptor(t);
+      } else {
+        conn_hnr_->sleep_acceptor(t);
+      }
+      return -1;
+    }
     default:
-      return;
+      return -1;
     }
   }
 
@@ -101,13 +122,19 @@ void AcceptHandler::accept_connection() {
 
   util::make_socket_nodelay(cfd);
 
-  conn_hnr_->handle_connection(cfd, &sockaddr.sa, addrlen, faddr_);
+  if (worker_) {
+    worker_->handle_connection(cfd, &sockaddr.sa, addrlen, faddr_);
+  } else {
+    conn_hnr_->handle_connection(cfd, &sockaddr.sa, addrlen, faddr_);
+  }
+
+  return 0;
 }
 
-void AcceptHandler::enable() { ev_io_start(conn_hnr_->get_loop(), &wev_); }
+void AcceptHandler::enable() { ev_io_start(loop_, &wev_); }
 
-void AcceptHandler::disable() { ev_io_stop(conn_hnr_->get_loop(), &wev_); }
+void AcceptHandler::disable() { ev_io_stop(loop_, &wev_); }
 
-int AcceptHandler::get_fd() const { return faddr_->fd; }
+int AcceptHandler::get_fd() const { return fd_; }
 
 } // namespace shrpx
@@ -32,21 +32,33 @@
 namespace shrpx {
 
 class ConnectionHandler;
+class Worker;
 struct UpstreamAddr;
 
 class AcceptHandler {
 public:
+  // Accepts connections on |faddr|->fd, and dispatches them to worker
+  // through |h|.
   AcceptHandler(const UpstreamAddr *faddr, ConnectionHandler *h);
+  // Accepts connections on |fd|, which is bound to the same address
+  // as |faddr|, and handles them in |worker| directly.  This is used
+  // when SO_REUSEPORT is enabled.  |fd| is closed on destruction.
+  AcceptHandler(const UpstreamAddr *faddr, int fd, Worker *worker);
   ~AcceptHandler();
-  void accept_connection();
+  // Accepts one connection.  Returns 0 if a connection has been
+  // accepted, or -1.
+  int accept_connection();
   void enable();
   void disable();
   int get_fd() const;
 
 private:
   ev_io wev_;
+  struct ev_loop *loop_;
   ConnectionHandler *conn_hnr_;
+  Worker *worker_;
   const UpstreamAddr *faddr_;
+  int fd_;
 };
 
 } // namespace shrpx
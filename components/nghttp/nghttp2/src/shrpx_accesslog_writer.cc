@@ -0,0 +1,302 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_accesslog_writer.h"
+
+#include <cassert>
+#include <climits>
+#include <chrono>
+
+#include "shrpx_log.h"
+#include "shrpx_log_config.h"
+#include "util.h"
+
+namespace shrpx {
+
+namespace {
+size_t round_up_pow2(size_t n) {
+  size_t res = 1;
+  for (; res < n; res <<= 1)
+    ;
+  return res;
+}
+} // namespace
+
+AccessLogBuffer::AccessLogBuffer(AccessLogWriter *writer, size_t size,
+                                 shrpx_accesslog_overflow overflow)
+    : writer_(writer),
+      size_(round_up_pow2(size)),
+      head_(0),
+      tail_(0),
+      num_dropped_(0),
+      overflow_(overflow) {
+  buf_ = make_unique<char[]>(size_);
+}
+
+int AccessLogBuffer::write(const char *data, size_t len) {
+  assert(len <= size_);
+
+  auto tail = tail_.load(std::memory_order_relaxed);
+
+  for (;;) {
+    auto used = tail - head_.load(std::memory_order_acquire);
+
+    if (size_ - used >= len) {
+      auto pos = tail & (size_ - 1);
+      auto n = std::min(len, size_ - pos);
+
+      std::copy_n(data, n, buf_.get() + pos);
+      std::copy_n(data + n, len - n, buf_.get());
+
+      tail_.store(tail + len, std::memory_order_release);
+
+      // Do not wait for flush interval if the buffer gets half full.
+      if (used < size_ / 2 && used + len >= size_ / 2) {
+        writer_->wakeup();
+      }
+
+      return 0;
+    }
+
+    if (overflow_ == ACCESSLOG_OVERFLOW_DROP) {
+      num_dropped_.fetch_add(1, std::memory_order_relaxed);
+
+      return -1;
+    }
+
+    writer_->wait_for_room();
+  }
+}
+
+size_t AccessLogBuffer::peek(struct iovec *iov, size_t &len) const {
+  auto head = head_.load(std::memory_order_relaxed);
+  auto tail = tail_.load(std::memory_order_acquire);
+
+  len = tail - head;
+
+  if (len == 0) {
+    return 0;
+  }
+
+  auto pos = head & (size_ - 1);
+  auto n = std::min(len, size_ - pos);
+
+  iov[0].iov_base = buf_.get() + pos;
+  iov[0].iov_len = n;
+
+  if (n == len) {
+    return 1;
+  }
+
+  iov[1].iov_base = buf_.get();
+  iov[1].iov_len = len - n;
+
+  return 2;
+}
+
+void AccessLogBuffer::consume(size_t len) {
+  head_.store(head_.load(std::memory_order_relaxed) + len,
+              std::memory_order_release);
+}
+
+uint64_t AccessLogBuffer::get_num_dropped() const {
+  return num_dropped_.load(std::memory_order_relaxed);
+}
+
+AccessLogWriter::AccessLogWriter(ev_tstamp flush_interval)
+    : flush_interval_(flush_interval),
+      num_dropped_reported_(0),
+      running_(false),
+      stop_(false),
+      reopen_(false),
+      wakeup_(false) {}
+
+AccessLogWriter::~AccessLogWriter() { stop(); }
+
+AccessLogBuffer *
+AccessLogWriter::add_buffer(size_t size, shrpx_accesslog_overflow overflow) {
+  assert(!running_);
+
+  buffers_.push_back(make_unique<AccessLogBuffer>(this, size, overflow));
+
+  return buffers_.back().get();
+}
+
+void AccessLogWriter::run() {
+#ifndef NOTHREADS
+  running_ = true;
+
+  fut_ = std::async(std::launch::async, [this] {
+    (void)reopen_log_files(get_config()->logging);
+
+    auto lgconf = log_config();
+    auto interval = std::chrono::duration<double>(flush_interval_);
+
+    std::unique_lock<std::mutex> lk(mu_);
+
+    for (;;) {
+      cv_.wait_for(lk, interval,
+                   [this] { return stop_ || reopen_ || wakeup_; });
+
+      auto stop = stop_;
+      auto reopen = reopen_;
+
+      reopen_ = false;
+      wakeup_ = false;
+
+      lk.unlock();
+
+      flush(lgconf->accesslog_fd);
+      report_dropped();
+
+      if (reopen) {
+        (void)reopen_log_files(get_config()->logging);
+      }
+
+      if (stop) {
+        break;
+      }
+
+      lk.lock();
+    }
+
+    delete_log_config();
+  });
+#endif // !NOTHREADS
+}
+
+void AccessLogWriter::stop() {
+  if (!running_) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+
+#ifndef NOTHREADS
+  fut_.get();
+#endif // !NOTHREADS
+
+  running_ = false;
+}
+
+void AccessLogWriter::reopen() {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    reopen_ = true;
+  }
+  cv_.notify_one();
+}
+
+void AccessLogWriter::wakeup() {
+  {
+    std::lock_guard<std::mutex> g(mu_);
+    wakeup_ = true;
+  }
+  cv_.notify_one();
+}
+
+void AccessLogWriter::wait_for_room() {
+  std::unique_lock<std::mutex> lk(mu_);
+
+  wakeup_ = true;
+  cv_.notify_one();
+
+  // The writer thread does not hold mu_ when it signals room_cv_, so
+  // do not wait forever in case we miss it.
+  room_cv_.wait_for(lk, std::chrono::milliseconds(10));
+}
+
+void AccessLogWriter::flush(int fd) {
+  iov_.resize(buffers_.size() * 2);
+  lens_.resize(buffers_.size());
+
+  size_t iovcnt = 0;
+  size_t total = 0;
+
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    iovcnt += buffers_[i]->peek(iov_.data() + iovcnt, lens_[i]);
+    total += lens_[i];
+  }
+
+  if (total == 0) {
+    return;
+  }
+
+  if (fd != -1) {
+    auto p = iov_.data();
+    auto end = p + iovcnt;
+
+    while (p != end) {
+      ssize_t nwrite;
+      while ((nwrite = writev(fd, p, std::min<ssize_t>(end - p, IOV_MAX))) ==
+                 -1 &&
+             errno == EINTR)
+        ;
+
+      if (nwrite == -1) {
+        // Like synchronous access log, we have nothing to do.
+        break;
+      }
+
+      for (; p != end && static_cast<size_t>(nwrite) >= p->iov_len; ++p) {
+        nwrite -= p->iov_len;
+      }
+
+      if (nwrite > 0) {
+        p->iov_base = static_cast<char *>(p->iov_base) + nwrite;
+        p->iov_len -= nwrite;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    buffers_[i]->consume(lens_[i]);
+  }
+
+  room_cv_.notify_all();
+}
+
+void AccessLogWriter::report_dropped() {
+  uint64_t num_dropped = 0;
+
+  for (auto &buf : buffers_) {
+    num_dropped += buf->get_num_dropped();
+  }
+
+  if (num_dropped == num_dropped_reported_) {
+    return;
+  }
+
+  LOG(WARN) << num_dropped - num_dropped_reported_
+            << " access log line(s) were dropped because access log buffer "
+               "was full";
+
+  num_dropped_reported_ = num_dropped;
+}
+
+} // namespace shrpx
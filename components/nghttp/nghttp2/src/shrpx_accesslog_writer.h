@@ -0,0 +1,139 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_ACCESSLOG_WRITER_H
+#define SHRPX_ACCESSLOG_WRITER_H
+
+#include "shrpx.h"
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifndef NOTHREADS
+#include <future>
+#endif // !NOTHREADS
+
+#include <ev.h>
+
+#include "shrpx_config.h"
+
+namespace shrpx {
+
+class AccessLogWriter;
+
+// Ring buffer of access log lines.  One worker thread appends lines
+// to it, and AccessLogWriter takes them.  A line is visible to
+// AccessLogWriter only after it is completely written.
+class AccessLogBuffer {
+public:
+  // |size| is rounded up to the power of 2.
+  AccessLogBuffer(AccessLogWriter *writer, size_t size,
+                  shrpx_accesslog_overflow overflow);
+
+  // Appends a line |data| of length |len|, which must include the
+  // terminating new line.  If the buffer is full, this function waits
+  // for the room, or discards the line according to the overflow
+  // policy.  This function returns 0 if it succeeds, or -1 if the
+  // line is discarded.
+  int write(const char *data, size_t len);
+  // Stores the buffered data in at most 2 elements of |iov|, and
+  // returns the number of elements used.  The number of bytes stored
+  // is assigned to |len|.
+  size_t peek(struct iovec *iov, size_t &len) const;
+  // Removes first |len| bytes from the buffer.
+  void consume(size_t len);
+  // Returns the number of lines discarded so far.
+  uint64_t get_num_dropped() const;
+
+private:
+  std::unique_ptr<char[]> buf_;
+  AccessLogWriter *writer_;
+  size_t size_;
+  // The position where AccessLogWriter reads next.  This only
+  // increases, and is taken modulo size_ to get the index into buf_.
+  std::atomic<size_t> head_;
+  // The position where the next line is written.
+  std::atomic<size_t> tail_;
+  std::atomic<uint64_t> num_dropped_;
+  shrpx_accesslog_overflow overflow_;
+};
+
+// AccessLogWriter writes access log lines, which worker threads
+// append to their AccessLogBuffer, to the access log file in the
+// dedicated thread.  The lines in all buffers are written in one
+// writev call.  This is done every flush interval, or earlier if a
+// buffer gets half full.
+class AccessLogWriter {
+public:
+  AccessLogWriter(ev_tstamp flush_interval);
+  ~AccessLogWriter();
+
+  // Creates new AccessLogBuffer.  The returned object is owned by
+  // this object.  This function must not be called after run().
+  AccessLogBuffer *add_buffer(size_t size, shrpx_accesslog_overflow overflow);
+  // Starts the writer thread.
+  void run();
+  // Writes the remaining lines, and stops the writer thread.
+  void stop();
+  // Makes the writer thread reopen the access log file after writing
+  // the buffered lines.
+  void reopen();
+  // Makes the writer thread write the buffered lines now.
+  void wakeup();
+  // Wakes up the writer thread, and waits until it writes the
+  // buffered lines, or for a short period of time.
+  void wait_for_room();
+  // Writes all buffered lines to |fd|.  If |fd| is -1, they are just
+  // discarded.
+  void flush(int fd);
+
+private:
+  void report_dropped();
+
+  std::vector<std::unique_ptr<AccessLogBuffer>> buffers_;
+  std::vector<struct iovec> iov_;
+  std::vector<size_t> lens_;
+  std::mutex mu_;
+  // Signaled to wake up the writer thread.
+  std::condition_variable cv_;
+  // Signaled when the writer thread made room in buffers.
+  std::condition_variable room_cv_;
+#ifndef NOTHREADS
+  std::future<void> fut_;
+#endif // !NOTHREADS
+  ev_tstamp flush_interval_;
+  uint64_t num_dropped_reported_;
+  bool running_;
+  bool stop_;
+  bool reopen_;
+  bool wakeup_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_ACCESSLOG_WRITER_H
@@ -0,0 +1,122 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_accesslog_writer_test.h"
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif // HAVE_UNISTD_H
+
+#include <string>
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_accesslog_writer.h"
+#include "shrpx_log.h"
+
+namespace shrpx {
+
+namespace {
+std::string read_all(int fd) {
+  std::string res;
+  std::array<char, 4096> buf;
+
+  for (;;) {
+    auto nread = read(fd, buf.data(), buf.size());
+    if (nread <= 0) {
+      break;
+    }
+    res.append(buf.data(), nread);
+  }
+
+  return res;
+}
+} // namespace
+
+void test_shrpx_accesslog_writer_flush(void) {
+  AccessLogWriter writer(1.);
+  auto buf1 = writer.add_buffer(4096, ACCESSLOG_OVERFLOW_DROP);
+  auto buf2 = writer.add_buffer(4096, ACCESSLOG_OVERFLOW_DROP);
+  int fds[2];
+
+  CU_ASSERT(0 == pipe(fds));
+
+  auto a = std::string(3000, 'a') + '\n';
+  auto b = std::string(100, 'b') + '\n';
+
+  CU_ASSERT(0 == buf1->write(a.c_str(), a.size()));
+  CU_ASSERT(0 == buf2->write(b.c_str(), b.size()));
+
+  writer.flush(fds[1]);
+
+  // Lines in all buffers are written in one go.
+  close(fds[1]);
+
+  CU_ASSERT(a + b == read_all(fds[0]));
+
+  close(fds[0]);
+
+  CU_ASSERT(0 == pipe(fds));
+
+  // This line wraps around the end of buffer.
+  auto c = std::string(2000, 'c') + '\n';
+
+  CU_ASSERT(0 == buf1->write(c.c_str(), c.size()));
+
+  struct iovec iov[2];
+  size_t len;
+
+  CU_ASSERT(2 == buf1->peek(iov, len));
+  CU_ASSERT(c.size() == len);
+
+  writer.flush(fds[1]);
+
+  close(fds[1]);
+
+  CU_ASSERT(c == read_all(fds[0]));
+
+  close(fds[0]);
+
+  CU_ASSERT(0 == buf1->peek(iov, len));
+  CU_ASSERT(0 == len);
+}
+
+void test_shrpx_accesslog_writer_drop(void) {
+  AccessLogWriter writer(1.);
+  auto buf = writer.add_buffer(4096, ACCESSLOG_OVERFLOW_DROP);
+
+  auto a = std::string(3000, 'a') + '\n';
+
+  CU_ASSERT(0 == buf->write(a.c_str(), a.size()));
+  CU_ASSERT(-1 == buf->write(a.c_str(), a.size()));
+  CU_ASSERT(1 == buf->get_num_dropped());
+
+  // Lines are discarded if there is no file.
+  writer.flush(-1);
+
+  CU_ASSERT(0 == buf->write(a.c_str(), a.size()));
+  CU_ASSERT(1 == buf->get_num_dropped());
+}
+
+} // namespace shrpx
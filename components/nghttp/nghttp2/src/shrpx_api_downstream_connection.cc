@@ -30,13 +30,14 @@
 #include "shrpx_worker.h"
 #include "shrpx_connection_handler.h"
 #include "shrpx_log.h"
+#include "shrpx_response_cache.h"
 
 namespace shrpx {
 
 namespace {
 // List of API endpoints
-const std::array<APIEndpoint, 2> &apis() {
-  static const auto apis = new std::array<APIEndpoint, 2>{{
+const std::array<APIEndpoint, 4> &apis() {
+  static const auto apis = new std::array<APIEndpoint, 4>{{
       APIEndpoint{
           StringRef::from_lit("/api/v1beta1/backendconfig"), true,
           (1 << API_METHOD_POST) | (1 << API_METHOD_PUT),
@@ -47,6 +48,16 @@ const std::array<APIEndpoint, 2> &apis() {
           (1 << API_METHOD_GET),
           &APIDownstreamConnection::handle_configrevision,
       },
+      APIEndpoint{
+          StringRef::from_lit("/api/v1beta1/backendstats"), true,
+          (1 << API_METHOD_GET),
+          &APIDownstreamConnection::handle_backendstats,
+      },
+      APIEndpoint{
+          StringRef::from_lit("/api/v1beta1/cachestats"), true,
+          (1 << API_METHOD_GET),
+          &APIDownstreamConnection::handle_cachestats,
+      },
   }};
 
   return *apis;
@@ -161,6 +172,24 @@ int APIDownstreamConnection::send_reply(unsigned int http_status,
 namespace {
 const APIEndpoint *lookup_api(const StringRef &path) {
   switch (path.size()) {
+  case 23:
+    switch (path[22]) {
+    case 's':
+      if (util::streq_l("/api/v1beta1/cachestat", std::begin(path), 22)) {
+        return &apis()[3];
+      }
+      break;
+    }
+    break;
+  case 25:
+    switch (path[24]) {
+    case 's':
+      if (util::streq_l("/api/v1beta1/backendstat", std::begin(path), 24)) {
+        return &apis()[2];
+      }
+      break;
+    }
+    break;
   case 26:
     switch (path[25]) {
     case 'g':
@@ -416,6 +445,167 @@ int APIDownstreamConnection::handle_configrevision() {
   return 0;
 }
 
+namespace {
+// Appends |s| to |dest| as JSON string.
+void append_json_string(std::string &dest, const StringRef &s) {
+  dest += '"';
+  for (auto c : s) {
+    switch (c) {
+    case '"':
+    case '\\':
+      dest += '\\';
+      dest += c;
+      break;
+    default:
+      if (static_cast<uint8_t>(c) < 0x20) {
+        dest += "\\u00";
+        dest += util::format_hex(reinterpret_cast<const uint8_t *>(&c), 1);
+      } else {
+        dest += c;
+      }
+    }
+  }
+  dest += '"';
+}
+} // namespace
+
+namespace {
+StringRef strbalance(shrpx_balance balance) {
+  switch (balance) {
+  case BALANCE_ROUND_ROBIN:
+    return StringRef::from_lit("round-robin");
+  case BALANCE_LEAST_REQUEST:
+    return StringRef::from_lit("least-request");
+  case BALANCE_EWMA:
+    return StringRef::from_lit("ewma");
+  default:
+    assert(0);
+    abort();
+  }
+}
+} // namespace
+
+int APIDownstreamConnection::handle_backendstats() {
+  auto &downstreamconf = *worker_->get_downstream_config();
+  auto &balloc = downstream_->get_block_allocator();
+
+  // Construct the following string:
+  //   ,
+  //   "data":{
+  //     "backends":[
+  //       {
+  //         "pattern": "...",
+  //         "host": "...",
+  //         "port": N,
+  //         "proto": "...",
+  //         "balance": "...",
+  //         "weight": N,
+  //         "outstanding": N,
+  //         "requests": N,
+  //         "failures": N,
+  //         "ewmaResponseTime": N
+  //       }, ...
+  //     ]
+  //   }
+  std::string data = R"(,"data":{"backends":[)";
+
+  auto first = true;
+  for (auto &g : downstreamconf.addr_groups) {
+    for (auto &addr : g.addrs) {
+      if (!first) {
+        data += ',';
+      }
+      first = false;
+
+      auto &stat = *addr.stat;
+
+      data += R"({"pattern":)";
+      append_json_string(data, g.pattern);
+      data += R"(,"host":)";
+      append_json_string(data, addr.host);
+      data += R"(,"port":)";
+      data += util::utos(addr.port);
+      data += R"(,"proto":")";
+      data += strproto(addr.proto).str();
+      data += R"(","balance":")";
+      data += strbalance(g.balance).str();
+      data += R"(","weight":)";
+      data += util::utos(addr.weight);
+      data += R"(,"outstanding":)";
+      data += util::utos(stat.num_outstanding.load());
+      data += R"(,"requests":)";
+      data += util::utos(stat.num_requests.load());
+      data += R"(,"failures":)";
+      data += util::utos(stat.num_failures.load());
+      data += R"(,"ewmaResponseTime":)";
+      data += util::utos(stat.ewma_rtt.load());
+      data += '}';
+    }
+  }
+
+  data += "]}";
+
+  send_reply(200, API_SUCCESS, make_string_ref(balloc, StringRef{data}));
+
+  return 0;
+}
+
+int APIDownstreamConnection::handle_cachestats() {
+  auto config = get_config();
+  auto cache = worker_->get_response_cache();
+  auto &balloc = downstream_->get_block_allocator();
+
+  if (!cache) {
+    send_reply(200, API_SUCCESS,
+               StringRef::from_lit(R"(,"data":{"enabled":false})"));
+
+    return 0;
+  }
+
+  auto &stat = cache->get_stat();
+
+  // Construct the following string:
+  //   ,
+  //   "data":{
+  //     "enabled":true,
+  //     "size":N,
+  //     "used":N,
+  //     "entries":N,
+  //     "hits":N,
+  //     "staleHits":N,
+  //     "misses":N,
+  //     "coalesced":N,
+  //     "bypasses":N,
+  //     "stores":N,
+  //     "evictions":N
+  //   }
+  std::string data = R"(,"data":{"enabled":true,"size":)";
+  data += util::utos(config->cache.size);
+  data += R"(,"used":)";
+  data += util::utos(cache->get_used());
+  data += R"(,"entries":)";
+  data += util::utos(stat.num_entries.load());
+  data += R"(,"hits":)";
+  data += util::utos(stat.hits.load());
+  data += R"(,"staleHits":)";
+  data += util::utos(stat.stale_hits.load());
+  data += R"(,"misses":)";
+  data += util::utos(stat.misses.load());
+  data += R"(,"coalesced":)";
+  data += util::utos(stat.coalesced.load());
+  data += R"(,"bypasses":)";
+  data += util::utos(stat.bypasses.load());
+  data += R"(,"stores":)";
+  data += util::utos(stat.stores.load());
+  data += R"(,"evictions":)";
+  data += util::utos(stat.evictions.load());
+  data += '}';
+
+  send_reply(200, API_SUCCESS, make_string_ref(balloc, StringRef{data}));
+
+  return 0;
+}
+
 void APIDownstreamConnection::pause_read(IOCtrlReason reason) {}
 
 int APIDownstreamConnection::resume_read(IOCtrlReason reason, size_t consumed) {
@@ -91,6 +91,10 @@ public:
   int handle_backendconfig();
   // Handles configrevision API request.
   int handle_configrevision();
+  // Handles backendstats API request.
+  int handle_backendstats();
+  // Handles cachestats API request.
+  int handle_cachestats();
 
 private:
   Worker *worker_;
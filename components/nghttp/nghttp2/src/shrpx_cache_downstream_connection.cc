@@ -0,0 +1,275 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_cache_downstream_connection.h"
+
+#include <chrono>
+
+#include "shrpx_client_handler.h"
+#include "shrpx_upstream.h"
+#include "shrpx_downstream.h"
+#include "shrpx_response_cache.h"
+#include "shrpx_worker.h"
+#include "shrpx_config.h"
+#include "shrpx_log.h"
+#include "util.h"
+
+namespace shrpx {
+
+namespace {
+void locktimeoutcb(struct ev_loop *loop, ev_timer *w, int revents) {
+  auto dconn = static_cast<CacheDownstreamConnection *>(w->data);
+
+  dconn->on_lock_timeout();
+}
+} // namespace
+
+CacheDownstreamConnection::CacheDownstreamConnection(
+    Worker *worker, std::shared_ptr<CacheEntry> entry, uint64_t hash)
+    : entry_(std::move(entry)), worker_(worker), hash_(hash), waiting_(false) {
+  ev_timer_init(&locktimer_, locktimeoutcb, 0.,
+                get_config()->cache.lock_timeout);
+  locktimer_.data = this;
+}
+
+CacheDownstreamConnection::~CacheDownstreamConnection() { stop_waiting(); }
+
+int CacheDownstreamConnection::attach_downstream(Downstream *downstream) {
+  if (LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Attaching to DOWNSTREAM:" << downstream;
+  }
+
+  downstream_ = downstream;
+
+  if (!entry_) {
+    waiting_ = true;
+    worker_->add_cache_waiter(hash_, this);
+    ev_timer_again(worker_->get_loop(), &locktimer_);
+  }
+
+  return 0;
+}
+
+void CacheDownstreamConnection::detach_downstream(Downstream *downstream) {
+  if (LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Detaching from DOWNSTREAM:" << downstream;
+  }
+
+  stop_waiting();
+
+  downstream_ = nullptr;
+}
+
+void CacheDownstreamConnection::stop_waiting() {
+  if (!waiting_) {
+    return;
+  }
+
+  waiting_ = false;
+  worker_->remove_cache_waiter(hash_, this);
+  ev_timer_stop(worker_->get_loop(), &locktimer_);
+}
+
+int CacheDownstreamConnection::push_request_headers() {
+  // The request may have been completely received, for example, if
+  // it was dispatched again after waiting.
+  if (entry_ &&
+      downstream_->get_request_state() == Downstream::MSG_COMPLETE) {
+    return send_reply();
+  }
+
+  return 0;
+}
+
+int CacheDownstreamConnection::push_upload_data_chunk(const uint8_t *data,
+                                                      size_t datalen) {
+  return 0;
+}
+
+int CacheDownstreamConnection::end_upload_data() {
+  if (entry_ &&
+      downstream_->get_response_state() != Downstream::MSG_COMPLETE) {
+    return send_reply();
+  }
+
+  return 0;
+}
+
+namespace {
+StringRef opaque_tag(const StringRef &etag) {
+  if (util::starts_with(etag, StringRef::from_lit("W/"))) {
+    return StringRef{etag.c_str() + 2, etag.size() - 2};
+  }
+  return etag;
+}
+} // namespace
+
+namespace {
+// Returns true if if-none-match header field value |inm| matches
+// |etag| using weak comparison.
+bool etag_match(const StringRef &inm, const StringRef &etag) {
+  auto tag = opaque_tag(etag);
+
+  for (auto first = std::begin(inm), last = std::end(inm);;) {
+    auto end = std::find(first, last, ',');
+    for (; first != end && (*first == ' ' || *first == '\t'); ++first)
+      ;
+    auto p = end;
+    for (; p != first && (*(p - 1) == ' ' || *(p - 1) == '\t'); --p)
+      ;
+    auto s = StringRef{first, p};
+
+    if (s == StringRef::from_lit("*") || opaque_tag(s) == tag) {
+      return true;
+    }
+
+    if (end == last) {
+      return false;
+    }
+
+    first = end + 1;
+  }
+}
+} // namespace
+
+namespace {
+// Returns true if the header field |name| is sent in 304 response.
+bool not_modified_header(const StringRef &name) {
+  return util::streq_l("cache-control", name) ||
+         util::streq_l("content-location", name) ||
+         util::streq_l("date", name) || util::streq_l("etag", name) ||
+         util::streq_l("expires", name) || util::streq_l("vary", name);
+}
+} // namespace
+
+int CacheDownstreamConnection::send_reply() {
+  auto upstream = downstream_->get_upstream();
+  const auto &req = downstream_->request();
+  auto &resp = downstream_->response();
+  auto &balloc = downstream_->get_block_allocator();
+  auto &entry = *entry_;
+
+  auto inm = req.fs.header(StringRef::from_lit("if-none-match"));
+  auto not_modified =
+      inm && !entry.etag.empty() && etag_match(inm->value, entry.etag);
+
+  resp.http_status = not_modified ? 304 : entry.http_status;
+
+  for (auto &kv : entry.headers) {
+    if (not_modified && !not_modified_header(kv.name)) {
+      continue;
+    }
+    resp.fs.add_header_token(make_string_ref(balloc, kv.name),
+                             make_string_ref(balloc, kv.value), kv.no_index,
+                             kv.token);
+  }
+
+  auto age = entry.initial_age +
+             std::chrono::duration_cast<std::chrono::seconds>(
+                 std::chrono::steady_clock::now() - entry.stored)
+                 .count();
+
+  resp.fs.add_header_token(StringRef::from_lit("age"),
+                           util::make_string_ref_uint(balloc, age), false, -1);
+
+  const uint8_t *body = nullptr;
+  size_t bodylen = 0;
+
+  if (!not_modified) {
+    resp.fs.add_header_token(
+        StringRef::from_lit("content-length"),
+        util::make_string_ref_uint(balloc, entry.body.size()), false,
+        http2::HD_CONTENT_LENGTH);
+
+    if (req.method != HTTP_HEAD) {
+      body = entry.body.byte();
+      bodylen = entry.body.size();
+    }
+  }
+
+  // send_reply copies the body.
+  auto rv = upstream->send_reply(downstream_, body, bodylen);
+
+  entry_.reset();
+
+  if (rv != 0) {
+    return -1;
+  }
+
+  upstream->get_client_handler()->signal_write();
+
+  return 0;
+}
+
+void CacheDownstreamConnection::on_cache_filled() {
+  stop_waiting();
+
+  // This object is deleted in on_downstream_reset().
+  auto downstream = downstream_;
+  auto upstream = downstream->get_upstream();
+  auto handler = upstream->get_client_handler();
+
+  if (upstream->on_downstream_reset(downstream, false) != 0) {
+    delete handler;
+  }
+}
+
+void CacheDownstreamConnection::on_lock_timeout() {
+  if (LOG_ENABLED(INFO)) {
+    DCLOG(INFO, this) << "Waited too long for cache to be filled";
+  }
+
+  ++worker_->get_response_cache()->get_stat().bypasses;
+
+  downstream_->set_cache_bypass(true);
+
+  on_cache_filled();
+}
+
+void CacheDownstreamConnection::pause_read(IOCtrlReason reason) {}
+
+int CacheDownstreamConnection::resume_read(IOCtrlReason reason,
+                                           size_t consumed) {
+  return 0;
+}
+
+void CacheDownstreamConnection::force_resume_read() {}
+
+int CacheDownstreamConnection::on_read() { return 0; }
+
+int CacheDownstreamConnection::on_write() { return 0; }
+
+void CacheDownstreamConnection::on_upstream_change(Upstream *uptream) {}
+
+bool CacheDownstreamConnection::poolable() const { return false; }
+
+const std::shared_ptr<DownstreamAddrGroup> &
+CacheDownstreamConnection::get_downstream_addr_group() const {
+  static std::shared_ptr<DownstreamAddrGroup> s;
+  return s;
+}
+
+DownstreamAddr *CacheDownstreamConnection::get_addr() const { return nullptr; }
+
+} // namespace shrpx
@@ -0,0 +1,92 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_CACHE_DOWNSTREAM_CONNECTION_H
+#define SHRPX_CACHE_DOWNSTREAM_CONNECTION_H
+
+#include "shrpx_downstream_connection.h"
+
+#include <memory>
+
+#include <ev.h>
+
+namespace shrpx {
+
+class Worker;
+struct CacheEntry;
+
+// CacheDownstreamConnection serves the response from ResponseCache.
+// If it has no entry, the request waits for another request to fetch
+// the response, and then it is dispatched again.
+class CacheDownstreamConnection : public DownstreamConnection {
+public:
+  // If |entry| is nullptr, the request waits for the response for
+  // cache key |hash| being stored.
+  CacheDownstreamConnection(Worker *worker, std::shared_ptr<CacheEntry> entry,
+                            uint64_t hash);
+  virtual ~CacheDownstreamConnection();
+  virtual int attach_downstream(Downstream *downstream);
+  virtual void detach_downstream(Downstream *downstream);
+
+  virtual int push_request_headers();
+  virtual int push_upload_data_chunk(const uint8_t *data, size_t datalen);
+  virtual int end_upload_data();
+
+  virtual void pause_read(IOCtrlReason reason);
+  virtual int resume_read(IOCtrlReason reason, size_t consumed);
+  virtual void force_resume_read();
+
+  virtual int on_read();
+  virtual int on_write();
+
+  virtual void on_upstream_change(Upstream *uptream);
+
+  // true if this object is poolable.
+  virtual bool poolable() const;
+
+  virtual const std::shared_ptr<DownstreamAddrGroup> &
+  get_downstream_addr_group() const;
+  virtual DownstreamAddr *get_addr() const;
+
+  // Dispatches the request again.  This is called when the response
+  // the request waits for is stored, or the fetch is abandoned.
+  void on_cache_filled();
+  // Called when the request waits for too long.  The request is sent
+  // to backend without using cache.
+  void on_lock_timeout();
+
+private:
+  int send_reply();
+  void stop_waiting();
+
+  std::shared_ptr<CacheEntry> entry_;
+  ev_timer locktimer_;
+  Worker *worker_;
+  uint64_t hash_;
+  bool waiting_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_CACHE_DOWNSTREAM_CONNECTION_H
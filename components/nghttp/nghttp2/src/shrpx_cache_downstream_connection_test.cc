@@ -0,0 +1,273 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 nghttp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_cache_downstream_connection_test.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_cache_downstream_connection.h"
+#include "shrpx_response_cache.h"
+#include "shrpx_upstream.h"
+#include "shrpx_downstream.h"
+#include "shrpx_worker.h"
+#include "shrpx_config.h"
+#include "shrpx_log.h"
+
+namespace shrpx {
+
+namespace {
+// Upstream which only records the requests dispatched again.
+class MockUpstream : public Upstream {
+public:
+  virtual int on_read() { return 0; }
+  virtual int on_write() { return 0; }
+  virtual int on_downstream_abort_request(Downstream *downstream,
+                                          unsigned int status_code) {
+    return 0;
+  }
+  virtual int
+  on_downstream_abort_request_with_https_redirect(Downstream *downstream) {
+    return 0;
+  }
+  virtual int downstream_read(DownstreamConnection *dconn) { return 0; }
+  virtual int downstream_write(DownstreamConnection *dconn) { return 0; }
+  virtual int downstream_eof(DownstreamConnection *dconn) { return 0; }
+  virtual int downstream_error(DownstreamConnection *dconn, int events) {
+    return 0;
+  }
+  virtual ClientHandler *get_client_handler() const { return nullptr; }
+  virtual int on_downstream_header_complete(Downstream *downstream) {
+    return 0;
+  }
+  virtual int on_downstream_body(Downstream *downstream, const uint8_t *data,
+                                 size_t len, bool flush) {
+    return 0;
+  }
+  virtual int on_downstream_body_complete(Downstream *downstream) {
+    return 0;
+  }
+  virtual void on_handler_delete() {}
+  virtual int on_downstream_reset(Downstream *downstream, bool no_retry) {
+    reset.push_back(downstream);
+    if (on_reset) {
+      on_reset(downstream);
+    }
+    return 0;
+  }
+  virtual void pause_read(IOCtrlReason reason) {}
+  virtual int resume_read(IOCtrlReason reason, Downstream *downstream,
+                          size_t consumed) {
+    return 0;
+  }
+  virtual int send_reply(Downstream *downstream, const uint8_t *body,
+                         size_t bodylen) {
+    return 0;
+  }
+  virtual int initiate_push(Downstream *downstream, const StringRef &uri) {
+    return 0;
+  }
+  virtual int response_riovec(struct iovec *iov, int iovcnt) const {
+    return 0;
+  }
+  virtual void response_drain(size_t n) {}
+  virtual bool response_empty() const { return true; }
+  virtual Downstream *
+  on_downstream_push_promise(Downstream *downstream,
+                             int32_t promised_stream_id) {
+    return nullptr;
+  }
+  virtual int
+  on_downstream_push_promise_complete(Downstream *downstream,
+                                      Downstream *promised_downstream) {
+    return 0;
+  }
+  virtual bool push_enabled() const { return false; }
+  virtual void cancel_premature_downstream(Downstream *promised_downstream) {}
+
+  // The requests passed to on_downstream_reset(), in the order of the
+  // calls.
+  std::vector<Downstream *> reset;
+  // Called from on_downstream_reset() in place of the real upstream
+  // which deletes the connection.
+  std::function<void(Downstream *)> on_reset;
+};
+} // namespace
+
+namespace {
+// The requests waiting for cache, and the worker which they belong
+// to.
+struct CacheWaitFixture {
+  CacheWaitFixture(size_t n)
+      : loop(ev_loop_new(0), ev_loop_destroy),
+        cache(64 * 1024, 1024),
+        worker(loop.get(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+               std::make_shared<DownstreamConfig>()) {
+    worker.set_response_cache(&cache);
+
+    for (size_t i = 0; i < n; ++i) {
+      downstreams.push_back(make_unique<Downstream>(nullptr, nullptr, 0));
+      downstreams.back()->reset_upstream(&upstream);
+      dconns.push_back(make_unique<CacheDownstreamConnection>(
+          &worker, nullptr, cache_key_hash(key)));
+    }
+  }
+  ~CacheWaitFixture() {
+    dconns.clear();
+    for (auto &d : downstreams) {
+      // Downstream destructor refers to the client handler of
+      // upstream.
+      d->reset_upstream(nullptr);
+    }
+    downstreams.clear();
+  }
+
+  // Makes the requests wait for the response for |key| fetched by
+  // another request.
+  void wait() {
+    auto hash = cache_key_hash(key);
+    std::shared_ptr<CacheEntry> entry;
+
+    CU_ASSERT(CACHE_MISS == cache.lookup(entry, hash, key,
+                                         downstreams[0]->request(), nullptr,
+                                         true));
+
+    for (size_t i = 0; i < dconns.size(); ++i) {
+      CU_ASSERT(CACHE_WAIT == cache.lookup(entry, hash, key,
+                                           downstreams[i]->request(), &worker,
+                                           true));
+      CU_ASSERT(0 == dconns[i]->attach_downstream(downstreams[i].get()));
+    }
+  }
+
+  // Abandons the fetch, and processes CACHE_FILLED event sent to the
+  // worker.
+  void fill() {
+    cache.finish_fill(cache_key_hash(key), key, nullptr, false);
+    worker.process_events();
+  }
+
+  // Sends CACHE_FILLED event for |key| to the worker, and processes
+  // it.
+  void notify() {
+    WorkerEvent wev{};
+    wev.type = CACHE_FILLED;
+    wev.cache_hash = cache_key_hash(key);
+
+    worker.send(wev);
+    worker.process_events();
+  }
+
+  // Makes upstream delete the connection of the request dispatched
+  // again.
+  void delete_on_reset() {
+    upstream.on_reset = [this](Downstream *downstream) {
+      for (size_t i = 0; i < downstreams.size(); ++i) {
+        if (downstreams[i].get() == downstream) {
+          dconns[i].reset();
+        }
+      }
+    };
+  }
+
+  StringRef key = StringRef::from_lit("0 nghttp2.org/");
+  std::unique_ptr<struct ev_loop, void (*)(struct ev_loop *)> loop;
+  ResponseCache cache;
+  Worker worker;
+  MockUpstream upstream;
+  std::vector<std::unique_ptr<Downstream>> downstreams;
+  std::vector<std::unique_ptr<CacheDownstreamConnection>> dconns;
+};
+} // namespace
+
+void test_shrpx_cache_downstream_connection_wake(void) {
+  CacheWaitFixture f(3);
+  f.wait();
+
+  // The connection for the other key is not woken.
+  Downstream other(nullptr, nullptr, 0);
+  CacheDownstreamConnection other_dconn(&f.worker, nullptr,
+                                        cache_key_hash(StringRef::from_lit(
+                                            "0 nghttp2.org/other")));
+  CU_ASSERT(0 == other_dconn.attach_downstream(&other));
+
+  f.delete_on_reset();
+  f.fill();
+
+  // Every request is dispatched again exactly once.
+  CU_ASSERT(3 == f.upstream.reset.size());
+  for (auto &d : f.downstreams) {
+    CU_ASSERT(1 == std::count(std::begin(f.upstream.reset),
+                              std::end(f.upstream.reset), d.get()));
+  }
+
+  // The connections are no longer registered, and the event does
+  // nothing.
+  f.notify();
+
+  CU_ASSERT(3 == f.upstream.reset.size());
+}
+
+void test_shrpx_cache_downstream_connection_wake_delete(void) {
+  CacheWaitFixture f(3);
+  f.wait();
+
+  // The first request notified deletes all connections, as the
+  // client handler does when it is deleted.  The others, which are
+  // still waiting to be notified, must not be touched.
+  f.upstream.on_reset = [&f](Downstream *downstream) { f.dconns.clear(); };
+
+  f.fill();
+
+  CU_ASSERT(1 == f.upstream.reset.size());
+  CU_ASSERT(f.dconns.empty());
+}
+
+void test_shrpx_cache_downstream_connection_lock_timeout(void) {
+  CacheWaitFixture f(2);
+  f.wait();
+
+  f.delete_on_reset();
+
+  auto &d = f.downstreams[0];
+
+  f.dconns[0]->on_lock_timeout();
+
+  // The request waited too long is sent to backend without cache.
+  CU_ASSERT(1 == f.upstream.reset.size());
+  CU_ASSERT(d.get() == f.upstream.reset[0]);
+  CU_ASSERT(d->get_cache_bypass());
+  CU_ASSERT(!f.downstreams[1]->get_cache_bypass());
+  CU_ASSERT(1 == f.cache.get_stat().bypasses);
+
+  // Only the other request is woken.
+  f.fill();
+
+  CU_ASSERT(2 == f.upstream.reset.size());
+  CU_ASSERT(f.downstreams[1].get() == f.upstream.reset[1]);
+}
+
+} // namespace shrpx
@@ -50,6 +50,8 @@
 #include "shrpx_connect_blocker.h"
 #include "shrpx_api_downstream_connection.h"
 #include "shrpx_health_monitor_downstream_connection.h"
+#include "shrpx_cache_downstream_connection.h"
+#include "shrpx_response_cache.h"
 #include "shrpx_log.h"
 #ifdef HAVE_SPDYLAY
 #include "shrpx_spdy_upstream.h"
@@ -692,7 +694,7 @@ void ClientHandler::pool_downstream_connection(
 
   auto &shared_addr = group->shared_addr;
 
-  if (shared_addr->affinity == AFFINITY_NONE) {
+  if (!shared_addr->per_addr_pool()) {
     auto &dconn_pool = group->shared_addr->dconn_pool;
     dconn_pool.add_downstream_connection(std::move(dconn));
 
@@ -715,16 +717,17 @@ void ClientHandler::remove_downstream_connection(DownstreamConnection *dconn) {
 }
 
 namespace {
-// Computes 32bits hash for session affinity for IP address |ip|.
-uint32_t compute_affinity_from_ip(const StringRef &ip) {
+// Computes 32bits hash for session affinity for |s|, which is IP
+// address, or the value of cookie or header field.
+uint32_t compute_affinity_hash(const StringRef &s) {
   int rv;
   std::array<uint8_t, 32> buf;
 
-  rv = util::sha256(buf.data(), ip);
+  rv = util::sha256(buf.data(), s);
   if (rv != 0) {
     // Not sure when sha256 failed.  Just fall back to another
     // function.
-    return util::hash32(ip);
+    return util::hash32(s);
   }
 
   return (static_cast<uint32_t>(buf[0]) << 24) |
@@ -733,6 +736,40 @@ uint32_t compute_affinity_from_ip(const StringRef &ip) {
 }
 } // namespace
 
+namespace {
+// Returns the value of cookie |name| in request |req|.  If there is
+// no such cookie, returns empty string.
+StringRef find_request_cookie(const Request &req, const StringRef &name) {
+  for (auto &kv : req.fs.headers()) {
+    if (kv.token != http2::HD_COOKIE) {
+      continue;
+    }
+
+    auto last = std::end(kv.value);
+
+    for (auto first = std::begin(kv.value); first != last;) {
+      auto end = std::find(first, last, ';');
+      auto eq = std::find(first, end, '=');
+      // Skip white spaces before cookie-pair.
+      auto key_first =
+          std::find_if(first, eq, [](char c) { return c != ' ' && c != '\t'; });
+
+      if (eq != end && StringRef{key_first, eq} == name) {
+        return StringRef{eq + 1, end};
+      }
+
+      if (end == last) {
+        break;
+      }
+
+      first = end + 1;
+    }
+  }
+
+  return StringRef{};
+}
+} // namespace
+
 Http2Session *ClientHandler::select_http2_session_with_affinity(
     const std::shared_ptr<DownstreamAddrGroup> &group, DownstreamAddr *addr) {
   auto &shared_addr = group->shared_addr;
@@ -956,6 +993,79 @@ uint32_t next_cycle(const WeightedPri &pri) {
 }
 } // namespace
 
+StringRef ClientHandler::get_request_authority(const Request &req) const {
+  if (faddr_->sni_fwd) {
+    return sni_;
+  }
+
+  if (!req.authority.empty()) {
+    return req.authority;
+  }
+
+  auto h = req.fs.header(http2::HD_HOST);
+  if (h) {
+    return h->value;
+  }
+
+  return StringRef{};
+}
+
+std::unique_ptr<DownstreamConnection>
+ClientHandler::get_cache_downstream_connection(Downstream *downstream,
+                                               size_t group_idx) {
+  auto cache = worker_->get_response_cache();
+  const auto &req = downstream->request();
+  auto &balloc = downstream->get_block_allocator();
+
+  if (!cacheable_request(req)) {
+    ++cache->get_stat().bypasses;
+    return nullptr;
+  }
+
+  // The key is "<pattern> <authority><path>", where <pattern> is the
+  // pattern of the group.  Different groups may serve different
+  // content for the same authority and path.  Unlike the index of
+  // group, the pattern stays the same when the configuration is
+  // replaced, and the other groups are added or removed.
+  auto authority = get_request_authority(req);
+  auto pattern =
+      StringRef{worker_->get_downstream_addr_groups()[group_idx]->pattern};
+  auto iov = make_byte_ref(balloc, pattern.size() + 1 + authority.size() +
+                                       req.path.size() + 1);
+  auto p = std::copy(std::begin(pattern), std::end(pattern), iov.base);
+  *p++ = ' ';
+  auto q = p;
+  p = std::copy(std::begin(authority), std::end(authority), p);
+  util::inp_strlower(q, p);
+  p = std::copy(std::begin(req.path), std::end(req.path), p);
+  *p = '\0';
+
+  auto key = StringRef{iov.base, p};
+  auto hash = cache_key_hash(key);
+
+  std::shared_ptr<CacheEntry> entry;
+
+  switch (cache->lookup(entry, hash, key, req, worker_,
+                        req.method == HTTP_GET)) {
+  case CACHE_HIT:
+    if (LOG_ENABLED(INFO)) {
+      CLOG(INFO, this) << "Cache hit: " << key;
+    }
+    return make_unique<CacheDownstreamConnection>(worker_, std::move(entry),
+                                                  hash);
+  case CACHE_WAIT:
+    if (LOG_ENABLED(INFO)) {
+      CLOG(INFO, this) << "Waiting for cache to be filled: " << key;
+    }
+    return make_unique<CacheDownstreamConnection>(worker_, nullptr, hash);
+  case CACHE_MISS:
+    downstream->set_cache_writer(make_unique<CacheWriter>(cache, hash, key));
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
 std::unique_ptr<DownstreamConnection>
 ClientHandler::get_downstream_connection(int &err, Downstream *downstream) {
   size_t group_idx;
@@ -982,17 +1092,7 @@ ClientHandler::get_downstream_connection(int &err, Downstream *downstream) {
   if (groups.size() == 1) {
     group_idx = 0;
   } else {
-    StringRef authority;
-    if (faddr_->sni_fwd) {
-      authority = sni_;
-    } else if (!req.authority.empty()) {
-      authority = req.authority;
-    } else {
-      auto h = req.fs.header(http2::HD_HOST);
-      if (h) {
-        authority = h->value;
-      }
-    }
+    auto authority = get_request_authority(req);
 
     StringRef path;
     // CONNECT method does not have path.  But we requires path in
@@ -1002,7 +1102,7 @@ ClientHandler::get_downstream_connection(int &err, Downstream *downstream) {
     }
 
     group_idx = match_downstream_addr_group(routerconf, authority, path, groups,
-                                            catch_all, balloc);
+                                            catch_all, balloc, &req);
   }
 
   if (LOG_ENABLED(INFO)) {
@@ -1018,26 +1118,66 @@ ClientHandler::get_downstream_connection(int &err, Downstream *downstream) {
     return nullptr;
   }
 
+  if (worker_->get_response_cache() && !downstream->get_cache_writer() &&
+      !downstream->get_cache_bypass()) {
+    auto dconn = get_cache_downstream_connection(downstream, group_idx);
+    if (dconn) {
+      return dconn;
+    }
+  }
+
   auto &group = groups[group_idx];
   auto &shared_addr = group->shared_addr;
 
-  if (shared_addr->affinity == AFFINITY_IP) {
-    if (!affinity_hash_computed_) {
-      affinity_hash_ = compute_affinity_from_ip(ipaddr_);
-      affinity_hash_computed_ = true;
-    }
+  if (shared_addr->per_addr_pool()) {
+    ssize_t rv;
 
-    const auto &affinity_hash = shared_addr->affinity_hash;
+    if (shared_addr->affinity != AFFINITY_NONE) {
+      StringRef key;
 
-    auto it = std::lower_bound(
-        std::begin(affinity_hash), std::end(affinity_hash), affinity_hash_,
-        [](const AffinityHash &lhs, uint32_t rhs) { return lhs.hash < rhs; });
+      switch (shared_addr->affinity) {
+      case AFFINITY_COOKIE:
+        key = find_request_cookie(req, shared_addr->affinity_key);
+        break;
+      case AFFINITY_HEADER: {
+        auto kv = req.fs.header(shared_addr->affinity_key);
+        if (kv) {
+          key = kv->value;
+        }
+        break;
+      }
+      default:
+        break;
+      }
+
+      uint32_t hash;
+
+      if (!key.empty()) {
+        hash = compute_affinity_hash(key);
+      } else {
+        // Fall back to client IP if request does not have the key.
+        if (!affinity_hash_computed_) {
+          affinity_hash_ = compute_affinity_hash(ipaddr_);
+          affinity_hash_computed_ = true;
+        }
+        hash = affinity_hash_;
+      }
 
-    if (it == std::end(affinity_hash)) {
-      it = std::begin(affinity_hash);
+      rv = select_affinity_downstream_addr(*shared_addr, hash);
+    } else {
+      rv = select_downstream_addr(*shared_addr, worker_->get_randgen());
+    }
+
+    if (rv == -1) {
+      if (LOG_ENABLED(INFO)) {
+        CLOG(INFO, this) << "No working downstream address found";
+      }
+
+      err = -1;
+      return nullptr;
     }
 
-    auto idx = (*it).idx;
+    auto idx = static_cast<size_t>(rv);
 
     auto &addr = shared_addr->addrs[idx];
     if (addr.proto == PROTO_HTTP2) {
@@ -1215,7 +1355,7 @@ void ClientHandler::write_accesslog(Downstream *downstream) {
   }
 
   upstream_accesslog(
-      config->logging.access.format,
+      config->logging.access.emitters,
       LogSpec{
           downstream, ipaddr_, alpn_, sni_,
           nghttp2::tls::get_tls_session_info(&tls_info, conn_.tls.ssl),
@@ -53,6 +53,7 @@ class Downstream;
 struct WorkerStat;
 struct DownstreamAddrGroup;
 struct DownstreamAddr;
+struct Request;
 
 class ClientHandler {
 public:
@@ -166,6 +167,15 @@ public:
   BlockAllocator &get_block_allocator();
 
 private:
+  // Returns the authority of |req| which is used to select backend.
+  StringRef get_request_authority(const Request &req) const;
+  // Looks up the response to the request in cache.  Returns
+  // DownstreamConnection which serves the response, or makes the
+  // request wait for it.  Returns nullptr if the request should be
+  // sent to backend in group |group_idx|.
+  std::unique_ptr<DownstreamConnection>
+  get_cache_downstream_connection(Downstream *downstream, size_t group_idx);
+
   // Allocator to allocate memory for connection-wide objects.  Make
   // sure that the allocations must be bounded, and not proportional
   // to the number of requests.
@@ -42,11 +42,16 @@
 #include <unistd.h>
 #endif // HAVE_UNISTD_H
 #include <dirent.h>
+#if !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
+#include <sched.h>
+#endif // !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
 
 #include <cstring>
 #include <cerrno>
 #include <limits>
+#include <map>
 #include <fstream>
+#include <thread>
 
 #include <nghttp2/nghttp2.h>
 
@@ -368,6 +373,42 @@ int parse_int(T *dest, const StringRef &opt, const char *optarg) {
   return 0;
 }
 
+#if !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
+namespace {
+// Parses |optarg| as the list of CPUs for worker threads, and stores
+// them in |dest|.  |optarg| is either "auto" or comma separated list
+// of CPU numbers.  "auto" pins the i-th worker thread to the i-th CPU
+// available.
+int parse_worker_cpus(std::vector<uint32_t> &dest, const StringRef &opt,
+                      const StringRef &optarg) {
+  dest.clear();
+
+  if (util::strieq_l("auto", optarg)) {
+    auto ncpu = std::thread::hardware_concurrency();
+    if (ncpu == 0) {
+      LOG(ERROR) << opt << ": could not get the number of CPUs";
+      return -1;
+    }
+    for (uint32_t i = 0; i < ncpu; ++i) {
+      dest.push_back(i);
+    }
+    return 0;
+  }
+
+  for (auto &s : util::split_str(optarg, ',')) {
+    auto n = util::parse_uint(s);
+    if (n == -1 || n >= CPU_SETSIZE) {
+      LOG(ERROR) << opt << ": bad CPU number: '" << s << "'";
+      return -1;
+    }
+    dest.push_back(n);
+  }
+
+  return 0;
+}
+} // namespace
+#endif // !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
+
 namespace {
 // generated by gennghttpxfun.py
 LogFragmentType log_var_lookup_token(const char *name, size_t namelen) {
@@ -762,10 +803,13 @@ int parse_upstream_params(UpstreamParams &out, const StringRef &src_params) {
 
 struct DownstreamParams {
   StringRef sni;
+  StringRef affinity_key;
   size_t fall;
   size_t rise;
+  uint32_t weight;
   shrpx_proto proto;
   shrpx_session_affinity affinity;
+  shrpx_balance balance;
   bool tls;
   bool dns;
   bool redirect_if_not_tls;
@@ -838,10 +882,48 @@ int parse_downstream_params(DownstreamParams &out,
         out.affinity = AFFINITY_NONE;
       } else if (util::strieq_l("ip", valstr)) {
         out.affinity = AFFINITY_IP;
+      } else if (util::strieq_l("cookie", valstr)) {
+        out.affinity = AFFINITY_COOKIE;
+      } else if (util::strieq_l("header", valstr)) {
+        out.affinity = AFFINITY_HEADER;
       } else {
-        LOG(ERROR) << "backend: affinity: value must be either none or ip";
+        LOG(ERROR) << "backend: affinity: value must be one of none, ip, "
+                      "cookie, and header";
+        return -1;
+      }
+    } else if (util::istarts_with_l(param, "affinity-key=")) {
+      out.affinity_key = StringRef{first + str_size("affinity-key="), end};
+      if (out.affinity_key.empty()) {
+        LOG(ERROR) << "backend: affinity-key: non-empty string is expected";
         return -1;
       }
+    } else if (util::istarts_with_l(param, "balance=")) {
+      auto valstr = StringRef{first + str_size("balance="), end};
+      if (util::strieq_l("round-robin", valstr)) {
+        out.balance = BALANCE_ROUND_ROBIN;
+      } else if (util::strieq_l("least-request", valstr)) {
+        out.balance = BALANCE_LEAST_REQUEST;
+      } else if (util::strieq_l("ewma", valstr)) {
+        out.balance = BALANCE_EWMA;
+      } else {
+        LOG(ERROR) << "backend: balance: value must be one of round-robin, "
+                      "least-request, and ewma";
+        return -1;
+      }
+    } else if (util::istarts_with_l(param, "weight=")) {
+      auto valstr = StringRef{first + str_size("weight="), end};
+      if (valstr.empty()) {
+        LOG(ERROR) << "backend: weight: integer [1, 256] is expected";
+        return -1;
+      }
+
+      auto n = util::parse_uint(valstr);
+      if (n < 1 || n > 256) {
+        LOG(ERROR) << "backend: weight: integer [1, 256] is expected";
+        return -1;
+      }
+
+      out.weight = n;
     } else if (util::strieq_l("dns", param)) {
       out.dns = true;
     } else if (util::strieq_l("redirect-if-not-tls", param)) {
@@ -881,6 +963,7 @@ int parse_mapping(Config *config, DownstreamAddrConfig &addr,
 
   DownstreamParams params{};
   params.proto = PROTO_HTTP1;
+  params.weight = 1;
 
   if (parse_downstream_params(params, src_params) != 0) {
     return -1;
@@ -893,11 +976,37 @@ int parse_mapping(Config *config, DownstreamAddrConfig &addr,
 
   addr.fall = params.fall;
   addr.rise = params.rise;
+  addr.weight = params.weight;
   addr.proto = params.proto;
   addr.tls = params.tls;
   addr.sni = make_string_ref(downstreamconf.balloc, params.sni);
   addr.dns = params.dns;
 
+  StringRef affinity_key;
+  switch (params.affinity) {
+  case AFFINITY_COOKIE:
+  case AFFINITY_HEADER: {
+    if (params.affinity_key.empty()) {
+      LOG(ERROR) << "backend: affinity-key: required if affinity is cookie or "
+                    "header";
+      return -1;
+    }
+    auto iov =
+        make_byte_ref(downstreamconf.balloc, params.affinity_key.size() + 1);
+    auto p = std::copy(std::begin(params.affinity_key),
+                       std::end(params.affinity_key), iov.base);
+    // Header field name is case insensitive, but cookie name is not.
+    if (params.affinity == AFFINITY_HEADER) {
+      util::inp_strlower(iov.base, p);
+    }
+    *p = '\0';
+    affinity_key = StringRef{iov.base, p};
+    break;
+  }
+  default:
+    break;
+  }
+
   auto &routerconf = downstreamconf.router;
   auto &router = routerconf.router;
   auto &rw_router = routerconf.rev_wildcard_router;
@@ -907,7 +1016,10 @@ int parse_mapping(Config *config, DownstreamAddrConfig &addr,
     auto done = false;
     StringRef pattern;
     auto slash = std::find(std::begin(raw_pattern), std::end(raw_pattern), '/');
-    if (slash == std::end(raw_pattern)) {
+    if (!raw_pattern.empty() && raw_pattern[0] == '~') {
+      // Routing rule is used as is, and RuleRouter normalizes it.
+      pattern = make_string_ref(downstreamconf.balloc, raw_pattern);
+    } else if (slash == std::end(raw_pattern)) {
       // This effectively makes empty pattern to "/".  2 for '/' and
       // terminal NULL character.
       auto iov = make_byte_ref(downstreamconf.balloc, raw_pattern.size() + 2);
@@ -937,6 +1049,11 @@ int parse_mapping(Config *config, DownstreamAddrConfig &addr,
         // value under one group.
         if (params.affinity != AFFINITY_NONE) {
           g.affinity = params.affinity;
+          g.affinity_key = affinity_key;
+        }
+        // Same for balance.
+        if (params.balance != BALANCE_ROUND_ROBIN) {
+          g.balance = params.balance;
         }
         // If at least one backend requires frontend TLS connection,
         // enable it for all backends sharing the same pattern.
@@ -957,8 +1074,20 @@ int parse_mapping(Config *config, DownstreamAddrConfig &addr,
     auto &g = addr_groups.back();
     g.addrs.push_back(addr);
     g.affinity = params.affinity;
+    g.affinity_key = affinity_key;
+    g.balance = params.balance;
     g.redirect_if_not_tls = params.redirect_if_not_tls;
 
+    if (pattern[0] == '~') {
+      if (routerconf.rule_router.add_rule(
+              StringRef{std::begin(pattern) + 1, std::end(pattern)}, idx) !=
+          0) {
+        return -1;
+      }
+
+      continue;
+    }
+
     if (pattern[0] == '*') {
       // wildcard pattern
       auto path_first =
@@ -1511,11 +1640,19 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_LOG_LEVEL;
       }
       break;
+    case 't':
+      if (util::strieq_l("reusepor", name, 8)) {
+        return SHRPX_OPTID_REUSEPORT;
+      }
+      break;
     }
     break;
   case 10:
     switch (name[9]) {
     case 'e':
+      if (util::strieq_l("cache-siz", name, 9)) {
+        return SHRPX_OPTID_CACHE_SIZE;
+      }
       if (util::strieq_l("error-pag", name, 9)) {
         return SHRPX_OPTID_ERROR_PAGE;
       }
@@ -1676,6 +1813,11 @@ int option_lookup_token(const char *name, size_t namelen) {
     break;
   case 15:
     switch (name[14]) {
+    case 'c':
+      if (util::strieq_l("accesslog-asyn", name, 14)) {
+        return SHRPX_OPTID_ACCESSLOG_ASYNC;
+      }
+      break;
     case 'e':
       if (util::strieq_l("no-host-rewrit", name, 14)) {
         return SHRPX_OPTID_NO_HOST_REWRITE;
@@ -1686,6 +1828,11 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_ERRORLOG_SYSLOG;
       }
       break;
+    case 'h':
+      if (util::strieq_l("worker-dispatc", name, 14)) {
+        return SHRPX_OPTID_WORKER_DISPATCH;
+      }
+      break;
     case 's':
       if (util::strieq_l("frontend-no-tl", name, 14)) {
         return SHRPX_OPTID_FRONTEND_NO_TLS;
@@ -1724,6 +1871,11 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_ACCESSLOG_FORMAT;
       }
       break;
+    case 'y':
+      if (util::strieq_l("accesslog-binar", name, 15)) {
+        return SHRPX_OPTID_ACCESSLOG_BINARY;
+      }
+      break;
     }
     break;
   case 17:
@@ -1767,6 +1919,9 @@ int option_lookup_token(const char *name, size_t namelen) {
       }
       break;
     case 't':
+      if (util::strieq_l("cache-lock-timeou", name, 17)) {
+        return SHRPX_OPTID_CACHE_LOCK_TIMEOUT;
+      }
       if (util::strieq_l("dns-lookup-timeou", name, 17)) {
         return SHRPX_OPTID_DNS_LOOKUP_TIMEOUT;
       }
@@ -1774,6 +1929,11 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_WORKER_WRITE_BURST;
       }
       break;
+    case 'w':
+      if (util::strieq_l("accesslog-overflo", name, 17)) {
+        return SHRPX_OPTID_ACCESSLOG_OVERFLOW;
+      }
+      break;
     }
     break;
   case 19:
@@ -1810,6 +1970,11 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_STREAM_READ_TIMEOUT;
       }
       break;
+    case 'y':
+      if (util::strieq_l("worker-cpu-affinit", name, 18)) {
+        return SHRPX_OPTID_WORKER_CPU_AFFINITY;
+      }
+      break;
     }
     break;
   case 20:
@@ -1849,6 +2014,14 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_BACKEND_TLS_SNI_FIELD;
       }
       break;
+    case 'e':
+      if (util::strieq_l("accesslog-buffer-siz", name, 20)) {
+        return SHRPX_OPTID_ACCESSLOG_BUFFER_SIZE;
+      }
+      if (util::strieq_l("cache-max-object-siz", name, 20)) {
+        return SHRPX_OPTID_CACHE_MAX_OBJECT_SIZE;
+      }
+      break;
     case 'l':
       if (util::strieq_l("accept-proxy-protoco", name, 20)) {
         return SHRPX_OPTID_ACCEPT_PROXY_PROTOCOL;
@@ -1948,6 +2121,11 @@ int option_lookup_token(const char *name, size_t namelen) {
         return SHRPX_OPTID_FETCH_OCSP_RESPONSE_FILE;
       }
       break;
+    case 'l':
+      if (util::strieq_l("accesslog-flush-interva", name, 23)) {
+        return SHRPX_OPTID_ACCESSLOG_FLUSH_INTERVAL;
+      }
+      break;
     case 'o':
       if (util::strieq_l("no-add-x-forwarded-prot", name, 23)) {
         return SHRPX_OPTID_NO_ADD_X_FORWARDED_PROTO;
@@ -3439,6 +3617,84 @@ int parse_config(Config *config, int optid, const StringRef &opt,
     config->tls.ocsp.no_verify = util::strieq_l("yes", optarg);
 
     return 0;
+  case SHRPX_OPTID_REUSEPORT:
+#ifdef SO_REUSEPORT
+    config->conn.listener.reuseport = util::strieq_l("yes", optarg);
+#else  // !SO_REUSEPORT
+    LOG(WARN) << opt << ": SO_REUSEPORT is not supported on this platform";
+#endif // !SO_REUSEPORT
+
+    return 0;
+  case SHRPX_OPTID_WORKER_CPU_AFFINITY:
+#if defined(NOTHREADS) || !HAVE_DECL_PTHREAD_SETAFFINITY_NP
+    LOG(WARN) << opt << ": CPU affinity is not supported on this platform";
+
+    return 0;
+#else  // !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
+    return parse_worker_cpus(config->worker_cpus, opt, optarg);
+#endif // !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
+  case SHRPX_OPTID_WORKER_DISPATCH:
+    if (util::strieq_l("round-robin", optarg)) {
+      config->worker_dispatch = WORKER_DISPATCH_ROUND_ROBIN;
+    } else if (util::strieq_l("least-conn", optarg)) {
+      config->worker_dispatch = WORKER_DISPATCH_LEAST_CONN;
+    } else if (util::strieq_l("p2c", optarg)) {
+      config->worker_dispatch = WORKER_DISPATCH_P2C;
+    } else {
+      LOG(ERROR) << opt
+                 << ": value must be one of round-robin, least-conn, and p2c";
+      return -1;
+    }
+
+    return 0;
+  case SHRPX_OPTID_ACCESSLOG_ASYNC:
+#ifdef NOTHREADS
+    LOG(WARN) << opt << ": not supported without thread support";
+#else  // !NOTHREADS
+    config->logging.access.async = util::strieq_l("yes", optarg);
+#endif // !NOTHREADS
+
+    return 0;
+  case SHRPX_OPTID_ACCESSLOG_BUFFER_SIZE: {
+    size_t n;
+    if (parse_uint_with_unit(&n, opt, optarg) != 0) {
+      return -1;
+    }
+
+    // One access log line is at most 4KiB.
+    if (n < 4_k) {
+      LOG(ERROR) << opt << ": specify an integer at least 4K";
+
+      return -1;
+    }
+
+    config->logging.access.buffer_size = n;
+
+    return 0;
+  }
+  case SHRPX_OPTID_ACCESSLOG_FLUSH_INTERVAL:
+    return parse_duration(&config->logging.access.flush_interval, opt, optarg);
+  case SHRPX_OPTID_ACCESSLOG_OVERFLOW:
+    if (util::strieq_l("block", optarg)) {
+      config->logging.access.overflow = ACCESSLOG_OVERFLOW_BLOCK;
+    } else if (util::strieq_l("drop", optarg)) {
+      config->logging.access.overflow = ACCESSLOG_OVERFLOW_DROP;
+    } else {
+      LOG(ERROR) << opt << ": value must be either block or drop";
+      return -1;
+    }
+
+    return 0;
+  case SHRPX_OPTID_ACCESSLOG_BINARY:
+    config->logging.access.binary = util::strieq_l("yes", optarg);
+
+    return 0;
+  case SHRPX_OPTID_CACHE_SIZE:
+    return parse_uint_with_unit(&config->cache.size, opt, optarg);
+  case SHRPX_OPTID_CACHE_MAX_OBJECT_SIZE:
+    return parse_uint_with_unit(&config->cache.max_object_size, opt, optarg);
+  case SHRPX_OPTID_CACHE_LOCK_TIMEOUT:
+    return parse_duration(&config->cache.lock_timeout, opt, optarg);
   case SHRPX_OPTID_CONF:
     LOG(WARN) << "conf: ignored";
 
@@ -3635,41 +3891,88 @@ StringRef strproto(shrpx_proto proto) {
 }
 
 namespace {
-// Consistent hashing method described in
-// https://github.com/RJ/ketama.  Generate 160 32-bit hashes per |s|,
-// which is usually backend address.  The each hash is associated to
-// index of backend address.  When all hashes for every backend
-// address are calculated, sort it in ascending order of hash.  To
-// choose the index, compute 32-bit hash based on client IP address,
-// and do lower bound search in the array. The returned index is the
-// backend to use.
-int compute_affinity_hash(std::vector<AffinityHash> &res, size_t idx,
-                          const StringRef &s) {
+// The candidates of the size of affinity table.  They are prime
+// numbers, so that any skip value visits all elements.
+constexpr uint32_t AFFINITY_TABLE_SIZES[] = {251,  509,   1021,  2039, 4093,
+                                             8191, 16381, 32749, 65521};
+// The number of table elements we want per unit of weight.  The
+// larger value makes the share of each address closer to its weight.
+constexpr uint32_t AFFINITY_TABLE_ELEMENTS_PER_WEIGHT = 100;
+} // namespace
+
+namespace {
+uint32_t get_uint32(const uint8_t *p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+} // namespace
+
+// Maglev hashing described in "Maglev: A Fast and Reliable Software
+// Network Load Balancer".  Each address visits the elements of table
+// in its own order, which is determined by the hash of its key.  The
+// addresses take turns to claim the next unclaimed element in their
+// order.  An address with weight N claims N elements in a turn.  To
+// choose the address, compute 32-bit hash of client (e.g., IP
+// address), and use it as an index into the table.
+int compute_affinity_table(std::vector<uint32_t> &table,
+                           const std::vector<StringRef> &keys,
+                           const std::vector<uint32_t> &weights) {
   int rv;
-  std::array<uint8_t, 32> buf;
 
-  for (auto i = 0; i < 20; ++i) {
-    auto t = s.str();
-    t += i;
+  assert(!keys.empty());
+  assert(keys.size() == weights.size());
+
+  uint64_t total_weight = 0;
+  for (auto w : weights) {
+    total_weight += w;
+  }
+
+  auto size = AFFINITY_TABLE_SIZES[array_size(AFFINITY_TABLE_SIZES) - 1];
+  for (auto n : AFFINITY_TABLE_SIZES) {
+    if (n >= total_weight * AFFINITY_TABLE_ELEMENTS_PER_WEIGHT) {
+      size = n;
+      break;
+    }
+  }
+
+  // The next element to visit, and the distance to the next one.
+  std::vector<std::pair<uint32_t, uint32_t>> cursors;
+  cursors.reserve(keys.size());
 
-    rv = util::sha256(buf.data(), StringRef{t});
+  std::array<uint8_t, 32> buf;
+
+  for (auto &key : keys) {
+    rv = util::sha256(buf.data(), key);
     if (rv != 0) {
       return -1;
     }
 
-    for (int i = 0; i < 8; ++i) {
-      auto h = (static_cast<uint32_t>(buf[4 * i]) << 24) |
-               (static_cast<uint32_t>(buf[4 * i + 1]) << 16) |
-               (static_cast<uint32_t>(buf[4 * i + 2]) << 8) |
-               static_cast<uint32_t>(buf[4 * i + 3]);
+    cursors.emplace_back(get_uint32(buf.data()) % size,
+                         get_uint32(buf.data() + 4) % (size - 1) + 1);
+  }
+
+  constexpr auto EMPTY = std::numeric_limits<uint32_t>::max();
+
+  table.assign(size, EMPTY);
+
+  for (size_t filled = 0;;) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+      auto &c = cursors[i];
+      for (uint32_t j = 0; j < weights[i]; ++j) {
+        while (table[c.first] != EMPTY) {
+          c.first = (c.first + c.second) % size;
+        }
+
+        table[c.first] = i;
 
-      res.emplace_back(idx, h);
+        if (++filled == size) {
+          return 0;
+        }
+      }
     }
   }
-
-  return 0;
 }
-} // namespace
 
 // Configures the following member in |config|:
 // conn.downstream_router, conn.downstream.addr_groups,
@@ -3689,6 +3992,7 @@ int configure_downstream_group(Config *config, bool http2_proxy,
     addr.host = StringRef::from_lit(DEFAULT_DOWNSTREAM_HOST);
     addr.port = DEFAULT_DOWNSTREAM_PORT;
     addr.proto = PROTO_HTTP1;
+    addr.weight = 1;
 
     DownstreamAddrGroupConfig g(StringRef::from_lit("/"));
     g.addrs.push_back(std::move(addr));
@@ -3736,14 +4040,28 @@ int configure_downstream_group(Config *config, bool http2_proxy,
 
   downstreamconf.addr_group_catch_all = catch_all_group;
 
+  if (routerconf.rule_router.compile() != 0) {
+    return -1;
+  }
+
   if (LOG_ENABLED(INFO)) {
     LOG(INFO) << "Catch-all pattern is group " << catch_all_group;
   }
 
   auto resolve_flags = numeric_addr_only ? AI_NUMERICHOST | AI_NUMERICSERV : 0;
 
+  // The statistics are per backend server, and the addresses with the
+  // same host and port in the different groups share them.
+  std::map<std::pair<StringRef, uint16_t>, std::shared_ptr<DownstreamAddrStat>>
+      stats;
+
   for (auto &g : addr_groups) {
     for (auto &addr : g.addrs) {
+      auto &stat = stats[std::make_pair(addr.host, addr.port)];
+      if (!stat) {
+        stat = std::make_shared<DownstreamAddrStat>();
+      }
+      addr.stat = stat;
 
       if (addr.host_unix) {
         // for AF_UNIX socket, we use "localhost" as host for backend
@@ -3796,8 +4114,9 @@ int configure_downstream_group(Config *config, bool http2_proxy,
       }
     }
 
-    if (g.affinity == AFFINITY_IP) {
-      size_t idx = 0;
+    if (g.affinity != AFFINITY_NONE) {
+      std::vector<StringRef> keys;
+      std::vector<uint32_t> weights;
       for (auto &addr : g.addrs) {
         StringRef key;
         if (addr.dns) {
@@ -3810,18 +4129,16 @@ int configure_downstream_group(Config *config, bool http2_proxy,
           auto p = reinterpret_cast<uint8_t *>(&addr.addr.su);
           key = StringRef{p, addr.addr.len};
         }
-        rv = compute_affinity_hash(g.affinity_hash, idx, key);
-        if (rv != 0) {
-          return -1;
-        }
-
-        ++idx;
+        keys.push_back(key);
+        weights.push_back(addr.weight);
       }
 
-      std::sort(std::begin(g.affinity_hash), std::end(g.affinity_hash),
-                [](const AffinityHash &lhs, const AffinityHash &rhs) {
-                  return lhs.hash < rhs.hash;
-                });
+      g.affinity_table = std::make_shared<std::vector<uint32_t>>();
+
+      rv = compute_affinity_table(*g.affinity_table, keys, weights);
+      if (rv != 0) {
+        return -1;
+      }
     }
   }
 
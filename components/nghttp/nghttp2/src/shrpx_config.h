@@ -43,6 +43,7 @@
 #include <vector>
 #include <memory>
 #include <set>
+#include <atomic>
 
 #include <openssl/ssl.h>
 
@@ -51,6 +52,7 @@
 #include <nghttp2/nghttp2.h>
 
 #include "shrpx_router.h"
+#include "shrpx_rule_router.h"
 #include "template.h"
 #include "http2.h"
 #include "network.h"
@@ -61,6 +63,7 @@ using namespace nghttp2;
 namespace shrpx {
 
 struct LogFragment;
+struct LogEmitter;
 class ConnectBlocker;
 class Http2Session;
 
@@ -343,6 +346,26 @@ constexpr auto SHRPX_OPT_NO_STRIP_INCOMING_X_FORWARDED_PROTO =
     StringRef::from_lit("no-strip-incoming-x-forwarded-proto");
 constexpr auto SHRPX_OPT_OCSP_STARTUP = StringRef::from_lit("ocsp-startup");
 constexpr auto SHRPX_OPT_NO_VERIFY_OCSP = StringRef::from_lit("no-verify-ocsp");
+constexpr auto SHRPX_OPT_REUSEPORT = StringRef::from_lit("reuseport");
+constexpr auto SHRPX_OPT_WORKER_CPU_AFFINITY =
+    StringRef::from_lit("worker-cpu-affinity");
+constexpr auto SHRPX_OPT_WORKER_DISPATCH =
+    StringRef::from_lit("worker-dispatch");
+constexpr auto SHRPX_OPT_ACCESSLOG_ASYNC =
+    StringRef::from_lit("accesslog-async");
+constexpr auto SHRPX_OPT_ACCESSLOG_BUFFER_SIZE =
+    StringRef::from_lit("accesslog-buffer-size");
+constexpr auto SHRPX_OPT_ACCESSLOG_FLUSH_INTERVAL =
+    StringRef::from_lit("accesslog-flush-interval");
+constexpr auto SHRPX_OPT_ACCESSLOG_OVERFLOW =
+    StringRef::from_lit("accesslog-overflow");
+constexpr auto SHRPX_OPT_ACCESSLOG_BINARY =
+    StringRef::from_lit("accesslog-binary");
+constexpr auto SHRPX_OPT_CACHE_SIZE = StringRef::from_lit("cache-size");
+constexpr auto SHRPX_OPT_CACHE_MAX_OBJECT_SIZE =
+    StringRef::from_lit("cache-max-object-size");
+constexpr auto SHRPX_OPT_CACHE_LOCK_TIMEOUT =
+    StringRef::from_lit("cache-lock-timeout");
 
 constexpr size_t SHRPX_OBFUSCATED_NODE_LENGTH = 8;
 
@@ -356,6 +379,34 @@ enum shrpx_session_affinity {
   AFFINITY_NONE,
   // Client IP affinity
   AFFINITY_IP,
+  // Affinity based on the value of request cookie
+  AFFINITY_COOKIE,
+  // Affinity based on the value of request header field
+  AFFINITY_HEADER,
+};
+
+// The policy to choose a backend address in a group for a request.
+enum shrpx_balance {
+  // Choose backend addresses in turn
+  BALANCE_ROUND_ROBIN,
+  // Choose the backend address which has the fewest requests in
+  // flight relative to its weight
+  BALANCE_LEAST_REQUEST,
+  // Choose 2 backend addresses at random, and take the one which has
+  // lower EWMA of response time multiplied by the requests in flight,
+  // relative to its weight
+  BALANCE_EWMA,
+};
+
+// The policy to choose a worker thread for a new connection.
+enum shrpx_worker_dispatch {
+  // Choose worker threads in turn
+  WORKER_DISPATCH_ROUND_ROBIN,
+  // Choose the worker thread which has the fewest connections
+  WORKER_DISPATCH_LEAST_CONN,
+  // Choose 2 worker threads at random, and take the one which has
+  // fewer connections and streams ("power of two choices")
+  WORKER_DISPATCH_P2C,
 };
 
 enum shrpx_forwarded_param {
@@ -414,6 +465,22 @@ struct UpstreamAddr {
   int fd;
 };
 
+// Statistics of a backend address.  This is shared by all worker
+// threads, and the backend addresses with the same host and port in
+// the different groups.
+struct DownstreamAddrStat {
+  // The number of requests in flight
+  std::atomic<size_t> num_outstanding;
+  // The number of requests which have finished
+  std::atomic<uint64_t> num_requests;
+  // The number of requests which have finished without complete
+  // response
+  std::atomic<uint64_t> num_failures;
+  // EWMA of response time in microseconds.  0 if no response has
+  // been received.
+  std::atomic<uint64_t> ewma_rtt;
+};
+
 struct DownstreamAddrConfig {
   // Resolved address if |dns| is false
   Address addr;
@@ -425,8 +492,11 @@ struct DownstreamAddrConfig {
   StringRef hostport;
   // hostname sent as SNI field
   StringRef sni;
+  std::shared_ptr<DownstreamAddrStat> stat;
   size_t fall;
   size_t rise;
+  // Weight of this address for load balancing
+  uint32_t weight;
   // Application protocol used in this group
   shrpx_proto proto;
   // backend port.  0 if |host_unix| is true.
@@ -438,26 +508,26 @@ struct DownstreamAddrConfig {
   bool dns;
 };
 
-// Mapping hash to idx which is an index into
-// DownstreamAddrGroupConfig::addrs.
-struct AffinityHash {
-  AffinityHash(size_t idx, uint32_t hash) : idx(idx), hash(hash) {}
-
-  size_t idx;
-  uint32_t hash;
-};
-
 struct DownstreamAddrGroupConfig {
   DownstreamAddrGroupConfig(const StringRef &pattern)
-      : pattern(pattern), affinity(AFFINITY_NONE), redirect_if_not_tls(false) {}
+      : pattern(pattern),
+        affinity(AFFINITY_NONE),
+        balance(BALANCE_ROUND_ROBIN),
+        redirect_if_not_tls(false) {}
 
   StringRef pattern;
   std::vector<DownstreamAddrConfig> addrs;
-  // Bunch of session affinity hash.  Only used if affinity ==
-  // AFFINITY_IP.
-  std::vector<AffinityHash> affinity_hash;
+  // Lookup table for session affinity.  Each element is an index
+  // into addrs.  It is immutable once built, and shared by all
+  // workers.  Only used if affinity != AFFINITY_NONE.
+  std::shared_ptr<std::vector<uint32_t>> affinity_table;
   // Session affinity
   shrpx_session_affinity affinity;
+  // The name of cookie if affinity == AFFINITY_COOKIE, or the
+  // lowercased name of header field if affinity == AFFINITY_HEADER.
+  StringRef affinity_key;
+  // Load balancing policy.  This is not used if affinity is enabled.
+  shrpx_balance balance;
   // true if this group requires that client connection must be TLS,
   // and the request must be redirected to https URI.
   bool redirect_if_not_tls;
@@ -718,15 +788,39 @@ struct Http2Config {
   bool no_server_push;
 };
 
+// What to do when the access log buffer of the asynchronous access
+// log writer is full.
+enum shrpx_accesslog_overflow {
+  // Wait for the writer thread to make room.
+  ACCESSLOG_OVERFLOW_BLOCK,
+  // Discard the access log line.
+  ACCESSLOG_OVERFLOW_DROP,
+};
+
 struct LoggingConfig {
   struct {
     std::vector<LogFragment> format;
+    // format compiled by compile_log_format().
+    std::vector<LogEmitter> emitters;
     StringRef file;
     // Send accesslog to syslog, ignoring accesslog_file.
     bool syslog;
+    // Size of the buffer per worker thread in which access log lines
+    // wait for the access log writer thread.
+    size_t buffer_size;
+    // Interval at which the access log writer thread writes buffered
+    // access log lines.
+    ev_tstamp flush_interval;
+    // What to do when the buffer is full.
+    shrpx_accesslog_overflow overflow;
     // Write accesslog when response headers are received from
     // backend, rather than response body is received and sent.
     bool write_early;
+    // Write accesslog to file in the dedicated thread, instead of
+    // worker threads.
+    bool async;
+    // Write accesslog in binary format instead of text.
+    bool binary;
   } access;
   struct {
     StringRef file;
@@ -763,6 +857,9 @@ struct RouterConfig {
   // The index stored in this router is index of wildcard_patterns.
   Router rev_wildcard_router;
   std::vector<WildcardPattern> wildcard_patterns;
+  // Routing rules given by the patterns which start with "~".  They
+  // take precedence over the other patterns.
+  RuleRouter rule_router;
 };
 
 struct DownstreamConfig {
@@ -821,6 +918,10 @@ struct ConnectionConfig {
     // TCP fastopen.  If this is positive, it is passed to
     // setsockopt() along with TCP_FASTOPEN.
     int fastopen;
+    // true if each worker thread accepts TCP connections by itself
+    // on its own listening socket with SO_REUSEPORT, instead of
+    // getting them dispatched from the acceptor thread.
+    bool reuseport;
   } listener;
 
   struct {
@@ -859,6 +960,17 @@ struct DNSConfig {
   size_t max_try;
 };
 
+struct CacheConfig {
+  // The size of memory for cached responses.  0 disables response
+  // cache.
+  size_t size;
+  // The response larger than this is not cached.
+  size_t max_object_size;
+  // The maximum time the request waits for another request to fetch
+  // the response.
+  ev_tstamp lock_timeout;
+};
+
 struct Config {
   Config()
       : balloc(4096, 4096),
@@ -870,8 +982,10 @@ struct Config {
         conn{},
         api{},
         dns{},
+        cache{},
         config_revision{0},
         num_worker{0},
+        worker_dispatch{WORKER_DISPATCH_ROUND_ROBIN},
         padding{0},
         rlimit_nofile{0},
         uid{0},
@@ -902,6 +1016,7 @@ struct Config {
   ConnectionConfig conn;
   APIConfig api;
   DNSConfig dns;
+  CacheConfig cache;
   StringRef pid_file;
   StringRef conf_path;
   StringRef user;
@@ -914,6 +1029,11 @@ struct Config {
   // completed or not.
   uint64_t config_revision;
   size_t num_worker;
+  // CPUs which worker threads are pinned to.  The i-th worker thread
+  // is pinned to worker_cpus[i % worker_cpus.size()].  If this is
+  // empty, worker threads are not pinned.
+  std::vector<uint32_t> worker_cpus;
+  shrpx_worker_dispatch worker_dispatch;
   size_t padding;
   size_t rlimit_nofile;
   uid_t uid;
@@ -940,8 +1060,13 @@ void create_config();
 // generated by gennghttpxfun.py
 enum {
   SHRPX_OPTID_ACCEPT_PROXY_PROTOCOL,
+  SHRPX_OPTID_ACCESSLOG_ASYNC,
+  SHRPX_OPTID_ACCESSLOG_BINARY,
+  SHRPX_OPTID_ACCESSLOG_BUFFER_SIZE,
   SHRPX_OPTID_ACCESSLOG_FILE,
+  SHRPX_OPTID_ACCESSLOG_FLUSH_INTERVAL,
   SHRPX_OPTID_ACCESSLOG_FORMAT,
+  SHRPX_OPTID_ACCESSLOG_OVERFLOW,
   SHRPX_OPTID_ACCESSLOG_SYSLOG,
   SHRPX_OPTID_ACCESSLOG_WRITE_EARLY,
   SHRPX_OPTID_ADD_FORWARDED,
@@ -981,6 +1106,9 @@ enum {
   SHRPX_OPTID_BACKEND_WRITE_TIMEOUT,
   SHRPX_OPTID_BACKLOG,
   SHRPX_OPTID_CACERT,
+  SHRPX_OPTID_CACHE_LOCK_TIMEOUT,
+  SHRPX_OPTID_CACHE_MAX_OBJECT_SIZE,
+  SHRPX_OPTID_CACHE_SIZE,
   SHRPX_OPTID_CERTIFICATE_FILE,
   SHRPX_OPTID_CIPHERS,
   SHRPX_OPTID_CLIENT,
@@ -1062,6 +1190,7 @@ enum {
   SHRPX_OPTID_REDIRECT_HTTPS_PORT,
   SHRPX_OPTID_REQUEST_HEADER_FIELD_BUFFER,
   SHRPX_OPTID_RESPONSE_HEADER_FIELD_BUFFER,
+  SHRPX_OPTID_REUSEPORT,
   SHRPX_OPTID_RLIMIT_NOFILE,
   SHRPX_OPTID_SERVER_NAME,
   SHRPX_OPTID_SINGLE_PROCESS,
@@ -1096,6 +1225,8 @@ enum {
   SHRPX_OPTID_USER,
   SHRPX_OPTID_VERIFY_CLIENT,
   SHRPX_OPTID_VERIFY_CLIENT_CACERT,
+  SHRPX_OPTID_WORKER_CPU_AFFINITY,
+  SHRPX_OPTID_WORKER_DISPATCH,
   SHRPX_OPTID_WORKER_FRONTEND_CONNECTIONS,
   SHRPX_OPTID_WORKER_READ_BURST,
   SHRPX_OPTID_WORKER_READ_RATE,
@@ -1158,6 +1289,16 @@ read_tls_ticket_key_file(const std::vector<StringRef> &files,
 // Returns string representation of |proto|.
 StringRef strproto(shrpx_proto proto);
 
+// Builds the lookup table for session affinity into |table| with
+// Maglev hashing.  |keys| identifies each backend address, and
+// |weights| is the weight of each address.  The element of |table|
+// is an index into |keys|.  An address keeps the most of its
+// elements when the other addresses are added or removed.  This
+// function returns 0 if it succeeds, or -1.
+int compute_affinity_table(std::vector<uint32_t> &table,
+                           const std::vector<StringRef> &keys,
+                           const std::vector<uint32_t> &weights);
+
 int configure_downstream_group(Config *config, bool http2_proxy,
                                bool numeric_addr_only,
                                const TLSConfig &tlsconf);
@@ -246,4 +246,62 @@ void test_shrpx_config_read_tls_ticket_key_file_aes_256(void) {
                        "a..............................b"));
 }
 
+void test_shrpx_config_compute_affinity_table(void) {
+  std::vector<uint32_t> table;
+  std::vector<StringRef> keys{
+      StringRef::from_lit("192.168.0.1:80"),
+      StringRef::from_lit("192.168.0.2:80"),
+      StringRef::from_lit("192.168.0.3:80"),
+      StringRef::from_lit("192.168.0.4:80"),
+  };
+  std::vector<uint32_t> weights{1, 1, 1, 1};
+
+  CU_ASSERT(0 == compute_affinity_table(table, keys, weights));
+  CU_ASSERT(509 == table.size());
+
+  // Each address takes an element in turn, so the share differs by
+  // at most 1.
+  std::vector<size_t> counts(keys.size());
+  for (auto idx : table) {
+    CU_ASSERT(idx < keys.size());
+    ++counts[idx];
+  }
+  for (auto n : counts) {
+    CU_ASSERT(127 <= n && n <= 128);
+  }
+
+  // Remove the last address.  The elements which belonged to the
+  // other addresses should mostly stay.
+  auto old_table = table;
+
+  keys.pop_back();
+  weights.pop_back();
+
+  CU_ASSERT(0 == compute_affinity_table(table, keys, weights));
+  CU_ASSERT(509 == table.size());
+
+  size_t moved = 0;
+  for (size_t i = 0; i < table.size(); ++i) {
+    CU_ASSERT(table[i] < keys.size());
+    if (old_table[i] != 3 && old_table[i] != table[i]) {
+      ++moved;
+    }
+  }
+  CU_ASSERT(moved < table.size() / 10);
+
+  // An address with weight 2 takes twice as many elements.
+  weights[2] = 2;
+
+  CU_ASSERT(0 == compute_affinity_table(table, keys, weights));
+
+  counts.assign(keys.size(), 0);
+  for (auto idx : table) {
+    ++counts[idx];
+  }
+
+  CU_ASSERT(128 == counts[0]);
+  CU_ASSERT(127 == counts[1]);
+  CU_ASSERT(254 == counts[2]);
+}
+
 } // namespace shrpx
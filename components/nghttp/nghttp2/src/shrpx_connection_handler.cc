@@ -29,6 +29,10 @@
 #endif // HAVE_UNISTD_H
 #include <sys/types.h>
 #include <sys/wait.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif // HAVE_NETINET_IN_H
+#include <netinet/tcp.h>
 
 #include <cerrno>
 #include <thread>
@@ -45,8 +49,12 @@
 #include "shrpx_memcached_dispatcher.h"
 #include "shrpx_signal.h"
 #include "shrpx_log.h"
+#include "shrpx_log_config.h"
+#include "shrpx_accesslog_writer.h"
+#include "shrpx_response_cache.h"
 #include "util.h"
 #include "template.h"
+#include "xsi_strerror.h"
 
 using namespace nghttp2;
 
@@ -119,7 +127,8 @@ ConnectionHandler::ConnectionHandler(struct ev_loop *loop, std::mt19937 &gen)
       tls_ticket_key_memcached_fail_count_(0),
       worker_round_robin_cnt_(get_config()->api.enabled ? 1 : 0),
       graceful_shutdown_(false),
-      enable_acceptor_on_ocsp_completion_(false) {
+      enable_acceptor_on_ocsp_completion_(false),
+      worker_acceptor_(false) {
   ev_timer_init(&disable_acceptor_timer_, acceptor_disable_cb, 0., 0.);
   disable_acceptor_timer_.data = this;
 
@@ -163,11 +172,21 @@ ConnectionHandler::~ConnectionHandler() {
   }
 
   // Free workers before destroying ev_loop
+  worker_stats_.clear();
   workers_.clear();
 
   for (auto loop : worker_loops_) {
     ev_loop_destroy(loop);
   }
+
+  if (accesslog_writer_) {
+    // The single worker writes access log to the buffer through
+    // log_config() of this thread.  Free the worker first, and do not
+    // leave the pointer to the buffer freed with the writer.
+    single_worker_.reset();
+    log_config()->accesslog_buffer = nullptr;
+    accesslog_writer_.reset();
+  }
 }
 
 void ConnectionHandler::set_ticket_keys_to_worker(
@@ -185,17 +204,16 @@ void ConnectionHandler::worker_reopen_log_files() {
   for (auto &worker : workers_) {
     worker->send(wev);
   }
+
+  if (accesslog_writer_) {
+    accesslog_writer_->reopen();
+  }
 }
 
 void ConnectionHandler::worker_replace_downstream(
     std::shared_ptr<DownstreamConfig> downstreamconf) {
-  WorkerEvent wev{};
-
-  wev.type = REPLACE_DOWNSTREAM;
-  wev.downstreamconf = std::move(downstreamconf);
-
   for (auto &worker : workers_) {
-    worker->send(wev);
+    worker->send_replace_downstream(downstreamconf);
   }
 }
 
@@ -244,9 +262,128 @@ int ConnectionHandler::create_single_worker() {
   }
 #endif // HAVE_MRUBY
 
+  if (create_accesslog_writer()) {
+    auto &accessconf = config->logging.access;
+
+    // The worker runs in this thread.
+    log_config()->accesslog_buffer = accesslog_writer_->add_buffer(
+        accessconf.buffer_size, accessconf.overflow);
+
+    accesslog_writer_->run();
+  }
+
+  if (create_response_cache() != 0) {
+    return -1;
+  }
+
+  single_worker_->set_response_cache(response_cache_.get());
+
   return 0;
 }
 
+namespace {
+// Creates a listening socket which is bound to the same address as
+// |faddr|.fd with SO_REUSEPORT.  Returns the file descriptor if it
+// succeeds, or -1.
+int create_reuseport_socket(const UpstreamAddr &faddr) {
+#ifdef SO_REUSEPORT
+  std::array<char, STRERROR_BUFSIZE> errbuf;
+  auto &listenerconf = get_config()->conn.listener;
+
+  sockaddr_union su;
+  socklen_t salen = sizeof(su);
+
+  if (getsockname(faddr.fd, &su.sa, &salen) == -1) {
+    auto error = errno;
+    LOG(WARN) << "getsockname() syscall failed: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    return -1;
+  }
+
+  auto fd = util::create_nonblock_socket(su.storage.ss_family);
+  if (fd == -1) {
+    auto error = errno;
+    LOG(WARN) << "socket() syscall failed: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    return -1;
+  }
+
+  int val = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    auto error = errno;
+    LOG(WARN) << "Failed to set SO_REUSEPORT option to listener socket: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    close(fd);
+    return -1;
+  }
+
+#ifdef IPV6_V6ONLY
+  if (su.storage.ss_family == AF_INET6 &&
+      setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    auto error = errno;
+    LOG(WARN) << "Failed to set IPV6_V6ONLY option to listener socket: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    close(fd);
+    return -1;
+  }
+#endif // IPV6_V6ONLY
+
+#ifdef TCP_DEFER_ACCEPT
+  val = 3;
+  if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &val,
+                 static_cast<socklen_t>(sizeof(val))) == -1) {
+    auto error = errno;
+    LOG(WARN) << "Failed to set TCP_DEFER_ACCEPT option to listener socket: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+  }
+#endif // TCP_DEFER_ACCEPT
+
+  if (bind(fd, &su.sa, salen) == -1) {
+    auto error = errno;
+    LOG(WARN) << "bind() syscall failed: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    close(fd);
+    return -1;
+  }
+
+#ifdef TCP_FASTOPEN
+  if (listenerconf.fastopen > 0) {
+    val = listenerconf.fastopen;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &val,
+                   static_cast<socklen_t>(sizeof(val))) == -1) {
+      auto error = errno;
+      LOG(WARN) << "Failed to set TCP_FASTOPEN option to listener socket: "
+                << xsi_strerror(error, errbuf.data(), errbuf.size());
+    }
+  }
+#endif // TCP_FASTOPEN
+
+  if (listen(fd, listenerconf.backlog) == -1) {
+    auto error = errno;
+    LOG(WARN) << "listen() syscall failed: "
+              << xsi_strerror(error, errbuf.data(), errbuf.size());
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+#else  // !SO_REUSEPORT
+  return -1;
+#endif // !SO_REUSEPORT
+}
+} // namespace
+
+bool accept_in_worker(const UpstreamAddr &faddr) {
+  auto config = get_config();
+
+  return config->conn.listener.reuseport && !config->single_thread &&
+         !faddr.host_unix && faddr.alt_mode != ALTMODE_API;
+}
+
 int ConnectionHandler::create_worker_thread(size_t num) {
 #ifndef NOTHREADS
   assert(workers_.size() == 0);
@@ -305,13 +442,80 @@ int ConnectionHandler::create_worker_thread(size_t num) {
     }
 #endif // HAVE_MRUBY
 
+    worker_stats_.push_back(worker->get_worker_stat());
     workers_.push_back(std::move(worker));
     worker_loops_.push_back(loop);
 
     LLOG(NOTICE, this) << "Created worker thread #" << workers_.size() - 1;
   }
 
+  if (!config->worker_cpus.empty()) {
+    auto &cpus = config->worker_cpus;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i]->set_cpu_affinity(cpus[i % cpus.size()]);
+    }
+  }
+
+  // The API worker does not accept the connections of the other
+  // frontends.
+  size_t first_worker = apiconf.enabled ? 1 : 0;
+
+  for (auto &addr : config->conn.listener.addrs) {
+    if (!accept_in_worker(addr)) {
+      continue;
+    }
+
+    for (size_t i = first_worker; i < workers_.size(); ++i) {
+      auto worker = workers_[i].get();
+      int fd;
+
+      if (i == first_worker) {
+        // The socket created by the master process belongs to the same
+        // SO_REUSEPORT group.  The kernel assigns connections to it as
+        // well, so one of the workers must accept on it.
+        fd = addr.fd;
+      } else {
+        fd = create_reuseport_socket(addr);
+        if (fd == -1) {
+          LLOG(WARN, this) << "Worker thread #" << i
+                           << " does not accept connections on "
+                           << addr.hostport;
+          continue;
+        }
+      }
+
+      worker->add_acceptor(make_unique<AcceptHandler>(&addr, fd, worker));
+    }
+
+    if (enable_acceptor_on_ocsp_completion_) {
+      // The worker acceptors are enabled by enable_acceptor() when
+      // the initial OCSP update finishes.  Disable them before the
+      // workers start, so that no connection is accepted in between.
+      for (size_t i = first_worker; i < workers_.size(); ++i) {
+        workers_[i]->disable_acceptor();
+      }
+    }
+
+    worker_acceptor_ = true;
+  }
+
+  if (create_accesslog_writer()) {
+    auto &accessconf = config->logging.access;
+
+    for (auto &worker : workers_) {
+      worker->set_accesslog_buffer(accesslog_writer_->add_buffer(
+          accessconf.buffer_size, accessconf.overflow));
+    }
+
+    accesslog_writer_->run();
+  }
+
+  if (create_response_cache() != 0) {
+    return -1;
+  }
+
   for (auto &worker : workers_) {
+    worker->set_response_cache(response_cache_.get());
     worker->run_async();
   }
 
@@ -320,6 +524,45 @@ int ConnectionHandler::create_worker_thread(size_t num) {
   return 0;
 }
 
+bool ConnectionHandler::create_accesslog_writer() {
+#ifndef NOTHREADS
+  auto &accessconf = get_config()->logging.access;
+
+  if (!accessconf.async || accessconf.syslog || accessconf.file.empty()) {
+    return false;
+  }
+
+  accesslog_writer_ = make_unique<AccessLogWriter>(accessconf.flush_interval);
+
+  return true;
+#else  // NOTHREADS
+  return false;
+#endif // NOTHREADS
+}
+
+int ConnectionHandler::create_response_cache() {
+  auto config = get_config();
+  auto &cacheconf = config->cache;
+
+  if (cacheconf.size == 0) {
+    return 0;
+  }
+
+  // The response phase hook of mruby script runs when the response
+  // header fields arrive from backend.  The cached response would
+  // store the header fields before the hook modifies them, and the
+  // hook would not run for the requests served from cache.
+  if (!config->mruby_file.empty()) {
+    LOG(WARN) << "Response cache is disabled because --mruby-file is given";
+    return 0;
+  }
+
+  response_cache_ =
+      make_unique<ResponseCache>(cacheconf.size, cacheconf.max_object_size);
+
+  return response_cache_->init();
+}
+
 void ConnectionHandler::join_worker() {
 #ifndef NOTHREADS
   int n = 0;
@@ -411,23 +654,11 @@ int ConnectionHandler::handle_connection(int fd, sockaddr *addr, int addrlen,
       LOG(INFO) << "Dispatch connection to API worker #0";
     }
   } else {
-    worker = workers_[worker_round_robin_cnt_].get();
-
-    if (LOG_ENABLED(INFO)) {
-      LOG(INFO) << "Dispatch connection to worker #" << worker_round_robin_cnt_;
-    }
-
-    if (++worker_round_robin_cnt_ == workers_.size()) {
-      auto &apiconf = config->api;
-
-      if (apiconf.enabled) {
-        worker_round_robin_cnt_ = 1;
-      } else {
-        worker_round_robin_cnt_ = 0;
-      }
-    }
+    worker = select_worker();
   }
 
+  ++worker->get_worker_stat()->num_incoming;
+
   WorkerEvent wev{};
   wev.type = NEW_CONNECTION;
   wev.client_fd = fd;
@@ -440,6 +671,80 @@ int ConnectionHandler::handle_connection(int fd, sockaddr *addr, int addrlen,
   return 0;
 }
 
+namespace {
+// Returns the number of connections the worker of |stat| serves,
+// including the ones which are queued to it.
+size_t worker_load(const WorkerStat *stat) {
+  return stat->num_connections + stat->num_incoming;
+}
+} // namespace
+
+size_t select_worker_index(const std::vector<WorkerStat *> &stats,
+                           size_t first, size_t rr_idx,
+                           shrpx_worker_dispatch policy, std::mt19937 &gen) {
+  size_t n = stats.size() - first;
+
+  switch (policy) {
+  case WORKER_DISPATCH_LEAST_CONN: {
+    // Start from the round robin position so that the ties are
+    // broken in turn.
+    auto idx = rr_idx;
+    auto min_load = worker_load(stats[idx]);
+    auto min_streams = stats[idx]->num_streams.load();
+    for (size_t i = 1; i < n; ++i) {
+      auto j = first + (rr_idx - first + i) % n;
+      auto load = worker_load(stats[j]);
+      if (load > min_load) {
+        continue;
+      }
+      auto streams = stats[j]->num_streams.load();
+      if (load == min_load && streams >= min_streams) {
+        continue;
+      }
+      idx = j;
+      min_load = load;
+      min_streams = streams;
+    }
+    return idx;
+  }
+  case WORKER_DISPATCH_P2C: {
+    if (n == 1) {
+      return first;
+    }
+    // Choose 2 distinct workers at random.
+    std::uniform_int_distribution<size_t> dist(0, n - 1);
+    std::uniform_int_distribution<size_t> offset_dist(1, n - 1);
+    auto a = first + dist(gen);
+    auto b = first + (a - first + offset_dist(gen)) % n;
+    return worker_load(stats[a]) + stats[a]->num_streams <=
+                   worker_load(stats[b]) + stats[b]->num_streams
+               ? a
+               : b;
+  }
+  default:
+    return rr_idx;
+  }
+}
+
+Worker *ConnectionHandler::select_worker() {
+  auto config = get_config();
+  // The first worker is dedicated to API request if API is enabled.
+  size_t first = config->api.enabled ? 1 : 0;
+
+  auto idx = select_worker_index(worker_stats_, first, worker_round_robin_cnt_,
+                                 config->worker_dispatch, gen_);
+
+  if (++worker_round_robin_cnt_ == workers_.size()) {
+    worker_round_robin_cnt_ = first;
+  }
+
+  if (LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Dispatch connection to worker #" << idx;
+  }
+
+  return workers_[idx].get();
+}
+
 struct ev_loop *ConnectionHandler::get_loop() const {
   return loop_;
 }
@@ -456,12 +761,30 @@ void ConnectionHandler::enable_acceptor() {
   for (auto &a : acceptors_) {
     a->enable();
   }
+
+  if (worker_acceptor_) {
+    WorkerEvent wev{};
+    wev.type = ENABLE_ACCEPTOR;
+
+    for (auto &worker : workers_) {
+      worker->send(wev);
+    }
+  }
 }
 
 void ConnectionHandler::disable_acceptor() {
   for (auto &a : acceptors_) {
     a->disable();
   }
+
+  if (worker_acceptor_) {
+    WorkerEvent wev{};
+    wev.type = DISABLE_ACCEPTOR;
+
+    for (auto &worker : workers_) {
+      worker->send(wev);
+    }
+  }
 }
 
 void ConnectionHandler::sleep_acceptor(ev_tstamp t) {
@@ -62,6 +62,8 @@ struct WorkerStat;
 struct TicketKeys;
 class MemcachedDispatcher;
 struct UpstreamAddr;
+class AccessLogWriter;
+class ResponseCache;
 
 namespace tls {
 
@@ -104,6 +106,10 @@ public:
   ~ConnectionHandler();
   int handle_connection(int fd, sockaddr *addr, int addrlen,
                         const UpstreamAddr *faddr);
+  // Chooses the worker to which a new connection is dispatched
+  // according to worker-dispatch policy.  The API worker is never
+  // chosen.
+  Worker *select_worker();
   // Creates Worker object for single threaded configuration.
   int create_single_worker();
   // Creates |num| Worker objects for multi threaded configuration.
@@ -177,6 +183,13 @@ public:
   void set_enable_acceptor_on_ocsp_completion(bool f);
 
 private:
+  // Creates AccessLogWriter if --accesslog-async is enabled.  Returns
+  // true if it is created.
+  bool create_accesslog_writer();
+  // Creates ResponseCache if --cache-size is greater than 0.
+  // Returns 0 if it succeeds, or -1.
+  int create_response_cache();
+
   // Stores all SSL_CTX objects.
   std::vector<SSL_CTX *> all_ssl_ctx_;
   // Stores all SSL_CTX objects in a way that its index is stored in
@@ -189,10 +202,18 @@ private:
   std::mt19937 &gen_;
   // ev_loop for each worker
   std::vector<struct ev_loop *> worker_loops_;
+  // Writes access log on behalf of workers if --accesslog-async is
+  // enabled.  This must outlive workers.
+  std::unique_ptr<AccessLogWriter> accesslog_writer_;
+  // Response cache shared by workers, or nullptr if it is disabled.
+  // This must outlive workers.
+  std::unique_ptr<ResponseCache> response_cache_;
   // Worker instances when multi threaded mode (-nN, N >= 2) is used.
   // If at least one frontend enables API request, we allocate 1
   // additional worker dedicated to API request .
   std::vector<std::unique_ptr<Worker>> workers_;
+  // The counters of workers_, in the same order.
+  std::vector<WorkerStat *> worker_stats_;
   // mutex for serial event resive buffer handling
   std::mutex serial_event_mu_;
   // SerialEvent receive buffer
@@ -225,8 +246,25 @@ private:
   // true if acceptors should be enabled after the initial ocsp update
   // has finished.
   bool enable_acceptor_on_ocsp_completion_;
+  // true if worker threads have their own acceptors.
+  bool worker_acceptor_;
 };
 
+// Returns true if worker threads accept connections on |faddr| by
+// themselves through their own SO_REUSEPORT sockets, rather than
+// having them dispatched by ConnectionHandler.
+bool accept_in_worker(const UpstreamAddr &faddr);
+
+// Selects the worker to which a new connection is dispatched from
+// the workers whose counters are |stats|[first], |stats|[first + 1],
+// ..., according to |policy|.  |rr_idx| is the round robin position,
+// which is selected by WORKER_DISPATCH_ROUND_ROBIN, and breaks the
+// ties of WORKER_DISPATCH_LEAST_CONN.  This function returns the
+// index of the selected worker.
+size_t select_worker_index(const std::vector<WorkerStat *> &stats,
+                           size_t first, size_t rr_idx,
+                           shrpx_worker_dispatch policy, std::mt19937 &gen);
+
 } // namespace shrpx
 
 #endif // SHRPX_CONNECTION_HANDLER_H
@@ -0,0 +1,96 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2026 nghttp2 contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_connection_handler_test.h"
+
+#include <array>
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_connection_handler.h"
+#include "shrpx_worker.h"
+#include "shrpx_log.h"
+
+namespace shrpx {
+
+void test_shrpx_connection_handler_select_worker_index(void) {
+  std::mt19937 gen(1);
+  std::array<WorkerStat, 4> wstats{};
+  std::vector<WorkerStat *> stats;
+
+  for (auto &s : wstats) {
+    stats.push_back(&s);
+  }
+
+  // Ties are broken by the round robin position.
+  for (size_t i = 0; i < stats.size(); ++i) {
+    CU_ASSERT(i == select_worker_index(stats, 0, i,
+                                       WORKER_DISPATCH_LEAST_CONN, gen));
+    CU_ASSERT(i == select_worker_index(stats, 0, i,
+                                       WORKER_DISPATCH_ROUND_ROBIN, gen));
+  }
+
+  wstats[0].num_connections = 10;
+  wstats[1].num_connections = 1;
+  wstats[1].num_incoming = 1;
+  wstats[1].num_streams = 5;
+  wstats[2].num_connections = 7;
+  wstats[3].num_connections = 2;
+  wstats[3].num_streams = 1;
+
+  // Workers 1 and 3 have the fewest connections, including the
+  // queued one, and worker 3 has fewer streams.
+  for (size_t i = 0; i < stats.size(); ++i) {
+    CU_ASSERT(3 == select_worker_index(stats, 0, i,
+                                       WORKER_DISPATCH_LEAST_CONN, gen));
+  }
+
+  // Round robin ignores the load.
+  CU_ASSERT(0 == select_worker_index(stats, 0, 0, WORKER_DISPATCH_ROUND_ROBIN,
+                                     gen));
+
+  // Of the 2 workers picked at random, the less loaded one wins.  The
+  // busiest worker is never chosen.
+  for (size_t i = 0; i < 16; ++i) {
+    CU_ASSERT(0 != select_worker_index(stats, 0, 0, WORKER_DISPATCH_P2C, gen));
+  }
+
+  // Worker 0 is reserved for API request, and is never chosen even if
+  // it is idle.
+  wstats[0].num_connections = 0;
+
+  CU_ASSERT(3 == select_worker_index(stats, 1, 1, WORKER_DISPATCH_LEAST_CONN,
+                                     gen));
+
+  for (size_t i = 0; i < 16; ++i) {
+    CU_ASSERT(0 != select_worker_index(stats, 1, 1, WORKER_DISPATCH_P2C, gen));
+  }
+
+  // Only 1 worker is left besides API worker.
+  stats.resize(2);
+
+  CU_ASSERT(1 == select_worker_index(stats, 1, 1, WORKER_DISPATCH_P2C, gen));
+}
+
+} // namespace shrpx
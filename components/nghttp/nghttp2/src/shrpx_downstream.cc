@@ -37,6 +37,7 @@
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
 #include "shrpx_log.h"
+#include "shrpx_response_cache.h"
 #ifdef HAVE_MRUBY
 #include "shrpx_mruby.h"
 #endif // HAVE_MRUBY
@@ -140,7 +141,8 @@ Downstream::Downstream(Upstream *upstream, MemchunkPool *mcpool,
       expect_final_response_(false),
       request_pending_(false),
       request_header_sent_(false),
-      accesslog_written_(false) {
+      accesslog_written_(false),
+      cache_bypass_(false) {
 
   auto &timeoutconf = get_config()->http2.timeout;
 
@@ -159,6 +161,12 @@ Downstream::Downstream(Upstream *upstream, MemchunkPool *mcpool,
   downstream_wtimer_.data = this;
 
   rcbufs_.reserve(32);
+
+  // check nullptr for unittest
+  if (upstream_) {
+    ++upstream_->get_client_handler()->get_worker()->get_worker_stat()
+          ->num_streams;
+  }
 }
 
 Downstream::~Downstream() {
@@ -166,6 +174,8 @@ Downstream::~Downstream() {
     DLOG(INFO, this) << "Deleting";
   }
 
+  finish_backend_request(false);
+
   // check nullptr for unittest
   if (upstream_) {
     auto loop = upstream_->get_client_handler()->get_loop();
@@ -175,6 +185,9 @@ Downstream::~Downstream() {
     ev_timer_stop(loop, &downstream_rtimer_);
     ev_timer_stop(loop, &downstream_wtimer_);
 
+    --upstream_->get_client_handler()->get_worker()->get_worker_stat()
+          ->num_streams;
+
 #ifdef HAVE_MRUBY
     auto handler = upstream_->get_client_handler();
     auto worker = handler->get_worker();
@@ -991,6 +1004,67 @@ void Downstream::set_addr(const DownstreamAddr *addr) { addr_ = addr; }
 
 const DownstreamAddr *Downstream::get_addr() const { return addr_; }
 
+void Downstream::start_backend_request(const DownstreamAddr *addr) {
+  finish_backend_request(false);
+
+  if (!addr->stat) {
+    return;
+  }
+
+  backend_stat_ = addr->stat;
+  ++backend_stat_->num_outstanding;
+  backend_request_start_time_ = std::chrono::high_resolution_clock::now();
+}
+
+void Downstream::finish_backend_request(bool success) {
+  if (!backend_stat_) {
+    return;
+  }
+
+  auto stat = std::move(backend_stat_);
+
+  --stat->num_outstanding;
+  ++stat->num_requests;
+
+  if (!success) {
+    // Tunneled connection never completes.  It is not a failure.
+    if (!upgraded_) {
+      ++stat->num_failures;
+    }
+    return;
+  }
+
+  uint64_t rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::high_resolution_clock::now() -
+                     backend_request_start_time_)
+                     .count();
+  // 0 means that there is no sample yet.
+  rtt = std::max(rtt, static_cast<uint64_t>(1));
+
+  // Other worker threads may update ewma_rtt concurrently.  The
+  // weight of new sample is 1/8, which is the same as smoothed RTT of
+  // TCP.
+  auto ewma = stat->ewma_rtt.load(std::memory_order_relaxed);
+  uint64_t next;
+  do {
+    next = ewma == 0 ? rtt : ewma - ewma / 8 + rtt / 8;
+    next = std::max(next, static_cast<uint64_t>(1));
+  } while (!stat->ewma_rtt.compare_exchange_weak(ewma, next,
+                                                 std::memory_order_relaxed));
+}
+
 void Downstream::set_accesslog_written(bool f) { accesslog_written_ = f; }
 
+void Downstream::set_cache_writer(std::unique_ptr<CacheWriter> writer) {
+  cache_writer_ = std::move(writer);
+}
+
+CacheWriter *Downstream::get_cache_writer() const {
+  return cache_writer_.get();
+}
+
+void Downstream::set_cache_bypass(bool f) { cache_bypass_ = f; }
+
+bool Downstream::get_cache_bypass() const { return cache_bypass_; }
+
 } // namespace shrpx
@@ -52,6 +52,8 @@ class DownstreamConnection;
 struct BlockedLink;
 struct DownstreamAddrGroup;
 struct DownstreamAddr;
+struct DownstreamAddrStat;
+class CacheWriter;
 
 class FieldStore {
 public:
@@ -407,8 +409,26 @@ public:
 
   const DownstreamAddr *get_addr() const;
 
+  // Records that the request has been sent to the backend |addr| in
+  // its statistics for load balancing.  If the previous request to
+  // backend has not finished, it is counted as failure.
+  void start_backend_request(const DownstreamAddr *addr);
+  // Records that the request started by start_backend_request() has
+  // finished.  |success| is true if the complete response has been
+  // received, and then the response time is also recorded.  This
+  // function does nothing if no request is in flight.
+  void finish_backend_request(bool success);
+
   void set_accesslog_written(bool f);
 
+  // Makes |writer| store the response to this request in cache.
+  void set_cache_writer(std::unique_ptr<CacheWriter> writer);
+  // Returns CacheWriter, or nullptr if the response is not stored.
+  CacheWriter *get_cache_writer() const;
+
+  void set_cache_bypass(bool f);
+  bool get_cache_bypass() const;
+
   enum {
     EVENT_ERROR = 0x1,
     EVENT_TIMEOUT = 0x2,
@@ -436,6 +456,8 @@ private:
   Response resp_;
 
   std::chrono::high_resolution_clock::time_point request_start_time_;
+  // The time when the request has been sent to backend.
+  std::chrono::high_resolution_clock::time_point backend_request_start_time_;
 
   // host we requested to downstream.  This is used to rewrite
   // location header field to decide the location should be rewritten
@@ -460,6 +482,11 @@ private:
   // logging purpose.
   std::shared_ptr<DownstreamAddrGroup> group_;
   const DownstreamAddr *addr_;
+  // The statistics of the backend address which the request is in
+  // flight to.
+  std::shared_ptr<DownstreamAddrStat> backend_stat_;
+  // Stores the response in cache if it is not nullptr.
+  std::unique_ptr<CacheWriter> cache_writer_;
   // How many times we tried in backend connection
   size_t num_retry_;
   // The stream ID in frontend connection
@@ -494,6 +521,9 @@ private:
   bool request_header_sent_;
   // true if access.log has been written.
   bool accesslog_written_;
+  // true if the request is sent to backend without using cache,
+  // because it waited for the response too long.
+  bool cache_bypass_;
 };
 
 } // namespace shrpx
@@ -240,6 +240,7 @@ int Http2DownstreamConnection::push_request_headers() {
   }
 
   downstream_->set_request_pending(false);
+  downstream_->start_backend_request(http2session_->get_addr());
 
   const auto &req = downstream_->request();
 
@@ -849,6 +849,7 @@ int on_stream_close_callback(nghttp2_session *session, int32_t stream_id,
         // MSG_COMPLETE here. Upstream will take care of that.
         downstream->get_upstream()->on_downstream_body_complete(downstream);
         downstream->set_response_state(Downstream::MSG_COMPLETE);
+        downstream->finish_backend_request(true);
       } else if (error_code == NGHTTP2_NO_ERROR) {
         switch (downstream->get_response_state()) {
         case Downstream::MSG_COMPLETE:
@@ -1236,6 +1237,8 @@ int on_frame_recv_callback(nghttp2_session *session, const nghttp2_frame *frame,
 
         downstream->set_response_state(Downstream::MSG_COMPLETE);
 
+        downstream->finish_backend_request(true);
+
         rv = upstream->on_downstream_body_complete(downstream);
 
         if (rv != 0) {
@@ -1277,6 +1280,7 @@ int on_frame_recv_callback(nghttp2_session *session, const nghttp2_frame *frame,
 
       if (downstream->get_response_state() == Downstream::HEADER_COMPLETE) {
         downstream->set_response_state(Downstream::MSG_COMPLETE);
+        downstream->finish_backend_request(true);
 
         auto upstream = downstream->get_upstream();
 
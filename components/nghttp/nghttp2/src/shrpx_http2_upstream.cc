@@ -38,6 +38,7 @@
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
 #include "shrpx_log.h"
+#include "shrpx_response_cache.h"
 #ifdef HAVE_MRUBY
 #include "shrpx_mruby.h"
 #endif // HAVE_MRUBY
@@ -1602,6 +1603,11 @@ int Http2Upstream::on_downstream_header_complete(Downstream *downstream) {
     }
   }
 
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer && !downstream->get_non_final_response()) {
+    cache_writer->on_header(*downstream);
+  }
+
   auto config = get_config();
   auto &httpconf = config->http;
 
@@ -1776,6 +1782,11 @@ int Http2Upstream::on_downstream_header_complete(Downstream *downstream) {
 int Http2Upstream::on_downstream_body(Downstream *downstream,
                                       const uint8_t *data, size_t len,
                                       bool flush) {
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_body(data, len);
+  }
+
   auto body = downstream->get_response_buf();
   body->append(data, len);
 
@@ -1795,6 +1806,11 @@ int Http2Upstream::on_downstream_body_complete(Downstream *downstream) {
     DLOG(INFO, downstream) << "HTTP response completed";
   }
 
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_complete(*downstream);
+  }
+
   auto &resp = downstream->response();
 
   if (!downstream->validate_response_recv_body_length()) {
@@ -265,12 +265,12 @@ int HttpDownstreamConnection::initiate_connection() {
     auto &shared_addr = group_->shared_addr;
     auto &addrs = shared_addr->addrs;
 
-    // If session affinity is enabled, we always start with address at
-    // initial_addr_idx_.
+    // If session affinity or balance policy other than round-robin
+    // is enabled, we always start with address at initial_addr_idx_.
     size_t temp_idx = initial_addr_idx_;
 
     auto &next_downstream =
-        shared_addr->affinity == AFFINITY_NONE ? shared_addr->next : temp_idx;
+        shared_addr->per_addr_pool() ? temp_idx : shared_addr->next;
     auto end = next_downstream;
     for (;;) {
       auto check_dns_result = dns_query_.get() != nullptr;
@@ -498,6 +498,7 @@ int HttpDownstreamConnection::push_request_headers() {
   // Set request_sent to true because we write request into buffer
   // here.
   downstream_->set_request_header_sent(true);
+  downstream_->start_backend_request(addr_);
 
   // For HTTP/1.0 request, there is no authority in request.  In that
   // case, we use backend server's host nonetheless.
@@ -757,7 +758,7 @@ void remove_from_pool(HttpDownstreamConnection *dconn) {
   auto &group = dconn->get_downstream_addr_group();
   auto &shared_addr = group->shared_addr;
 
-  if (shared_addr->affinity == AFFINITY_NONE) {
+  if (!shared_addr->per_addr_pool()) {
     auto &dconn_pool =
         dconn->get_downstream_addr_group()->shared_addr->dconn_pool;
     dconn_pool.remove_downstream_connection(dconn);
@@ -1104,6 +1105,8 @@ int htp_msg_completecb(http_parser *htp) {
   }
 
   downstream->set_response_state(Downstream::MSG_COMPLETE);
+
+  downstream->finish_backend_request(true);
   // Block reading another response message from (broken?)
   // server. This callback is not called if the connection is
   // tunneled.
@@ -38,6 +38,7 @@
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
 #include "shrpx_log.h"
+#include "shrpx_response_cache.h"
 #ifdef HAVE_MRUBY
 #include "shrpx_mruby.h"
 #endif // HAVE_MRUBY
@@ -1022,6 +1023,11 @@ int HttpsUpstream::on_downstream_header_complete(Downstream *downstream) {
   auto &resp = downstream->response();
   auto &balloc = downstream->get_block_allocator();
 
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer && !downstream->get_non_final_response()) {
+    cache_writer->on_header(*downstream);
+  }
+
 #ifdef HAVE_MRUBY
   if (!downstream->get_non_final_response()) {
     auto worker = handler_->get_worker();
@@ -1183,6 +1189,12 @@ int HttpsUpstream::on_downstream_body(Downstream *downstream,
   if (len == 0) {
     return 0;
   }
+
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_body(data, len);
+  }
+
   auto output = downstream->get_response_buf();
   if (downstream->get_chunked_response()) {
     output->append(util::utox(len));
@@ -1202,6 +1214,11 @@ int HttpsUpstream::on_downstream_body_complete(Downstream *downstream) {
   const auto &req = downstream->request();
   auto &resp = downstream->response();
 
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_complete(*downstream);
+  }
+
   if (downstream->get_chunked_response()) {
     auto output = downstream->get_response_buf();
     const auto &trailers = resp.fs.trailers();
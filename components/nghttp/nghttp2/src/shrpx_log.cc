@@ -50,6 +50,7 @@
 #include "shrpx_config.h"
 #include "shrpx_downstream.h"
 #include "shrpx_worker.h"
+#include "shrpx_accesslog_writer.h"
 #include "util.h"
 #include "template.h"
 
@@ -299,34 +300,63 @@ constexpr uint8_t ESCAPE_TBL[] = {
 };
 } // namespace
 
+namespace {
+// Returns the pointer to the first character in [first, last) which
+// must be escaped, or last if there is no such character.  8 bytes
+// are examined at once until the word which contains such character
+// is found.
+const char *find_escape(const char *first, const char *last) {
+  constexpr uint64_t ONES = 0x0101010101010101ULL;
+  constexpr uint64_t HIGHS = 0x8080808080808080ULL;
+
+  for (; last - first >= 8; first += 8) {
+    uint64_t x;
+    memcpy(&x, first, sizeof(x));
+
+    auto dquote = x ^ (ONES * '"');
+    auto bslash = x ^ (ONES * '\\');
+    auto del = x ^ (ONES * 0x7f);
+
+    // Some byte is a control character, double quote, backslash, or
+    // has the highest bit set.
+    if ((((x - ONES * 0x20) & ~x) | ((dquote - ONES) & ~dquote) |
+         ((bslash - ONES) & ~bslash) | ((del - ONES) & ~del) | x) &
+        HIGHS) {
+      break;
+    }
+  }
+
+  for (; first != last && !ESCAPE_TBL[static_cast<uint8_t>(*first)]; ++first)
+    ;
+
+  return first;
+}
+} // namespace
+
 namespace {
 template <typename OutputIterator>
 std::pair<OutputIterator, OutputIterator>
 copy_escape(const char *src, size_t srclen, OutputIterator d_first,
             OutputIterator d_last) {
-  auto safe_first = src;
-  for (auto p = src; p != src + srclen && d_first != d_last; ++p) {
-    unsigned char c = *p;
-    if (!ESCAPE_TBL[c]) {
-      continue;
-    }
+  auto end = src + srclen;
+
+  for (;;) {
+    auto p = find_escape(src, end);
 
-    auto n =
-        std::min(std::distance(d_first, d_last), std::distance(safe_first, p));
-    d_first = std::copy_n(safe_first, n, d_first);
-    if (std::distance(d_first, d_last) < 4) {
+    auto n = std::min(std::distance(d_first, d_last), std::distance(src, p));
+    d_first = std::copy_n(src, n, d_first);
+
+    if (p == end || std::distance(d_first, d_last) < 4) {
       return std::make_pair(d_first, d_last);
     }
+
+    unsigned char c = *p;
     *d_first++ = '\\';
     *d_first++ = 'x';
     *d_first++ = LOWER_XDIGITS[c >> 4];
     *d_first++ = LOWER_XDIGITS[c & 0xf];
-    safe_first = p + 1;
+    src = p + 1;
   }
-
-  auto n = std::min(std::distance(d_first, d_last),
-                    std::distance(safe_first, src + srclen));
-  return std::make_pair(std::copy_n(safe_first, n, d_first), d_last);
 }
 } // namespace
 
@@ -377,186 +407,594 @@ StringRef construct_absolute_request_uri(BlockAllocator &balloc,
 }
 } // namespace
 
-void upstream_accesslog(const std::vector<LogFragment> &lfv,
+namespace {
+// Returns request target logged in $request.
+StringRef get_request_target(const LogSpec &lgsp) {
+  auto downstream = lgsp.downstream;
+  const auto &req = downstream->request();
+
+  if (req.method == HTTP_CONNECT) {
+    return req.authority;
+  }
+  if (get_config()->http2_proxy) {
+    return construct_absolute_request_uri(downstream->get_block_allocator(),
+                                          req);
+  }
+  if (req.path.empty()) {
+    return req.method == HTTP_OPTIONS ? StringRef::from_lit("*")
+                                      : StringRef::from_lit("-");
+  }
+  return req.path;
+}
+} // namespace
+
+namespace {
+StringRef get_remote_addr(const LogSpec &lgsp) { return lgsp.remote_addr; }
+} // namespace
+
+namespace {
+StringRef get_time_local(const LogSpec &lgsp) {
+  return lgsp.downstream->request().tstamp->time_local;
+}
+} // namespace
+
+namespace {
+StringRef get_time_iso8601(const LogSpec &lgsp) {
+  return lgsp.downstream->request().tstamp->time_iso8601;
+}
+} // namespace
+
+namespace {
+StringRef get_authority(const LogSpec &lgsp) {
+  const auto &req = lgsp.downstream->request();
+  if (req.authority.empty()) {
+    return StringRef::from_lit("-");
+  }
+  return req.authority;
+}
+} // namespace
+
+namespace {
+StringRef get_remote_port(const LogSpec &lgsp) { return lgsp.remote_port; }
+} // namespace
+
+namespace {
+StringRef get_alpn(const LogSpec &lgsp) { return lgsp.alpn; }
+} // namespace
+
+namespace {
+StringRef get_tls_cipher(const LogSpec &lgsp) {
+  if (!lgsp.tls_info) {
+    return StringRef::from_lit("-");
+  }
+  return StringRef{lgsp.tls_info->cipher};
+}
+} // namespace
+
+namespace {
+StringRef get_tls_protocol(const LogSpec &lgsp) {
+  if (!lgsp.tls_info) {
+    return StringRef::from_lit("-");
+  }
+  return StringRef{lgsp.tls_info->protocol};
+}
+} // namespace
+
+namespace {
+StringRef get_tls_session_reused(const LogSpec &lgsp) {
+  if (!lgsp.tls_info) {
+    return StringRef::from_lit("-");
+  }
+  return lgsp.tls_info->session_reused ? StringRef::from_lit("r")
+                                       : StringRef::from_lit(".");
+}
+} // namespace
+
+namespace {
+StringRef get_tls_sni(const LogSpec &lgsp) {
+  if (lgsp.sni.empty()) {
+    return StringRef::from_lit("-");
+  }
+  return lgsp.sni;
+}
+} // namespace
+
+namespace {
+StringRef get_backend_host(const LogSpec &lgsp) {
+  auto addr = lgsp.downstream->get_addr();
+  if (!addr) {
+    return StringRef::from_lit("-");
+  }
+  return addr->host;
+}
+} // namespace
+
+namespace {
+StringRef get_http(const LogEmitter &em, const LogSpec &lgsp) {
+  const auto &req = lgsp.downstream->request();
+  auto hd = em.token == -1 ? req.fs.header(em.value) : req.fs.header(em.token);
+  if (!hd) {
+    return StringRef::from_lit("-");
+  }
+  return (*hd).value;
+}
+} // namespace
+
+namespace {
+// Returns the time between the start and the end of request in
+// milliseconds.
+int64_t get_request_time(const LogSpec &lgsp) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             lgsp.request_end_time -
+             lgsp.downstream->get_request_start_time())
+      .count();
+}
+} // namespace
+
+namespace {
+char *emit_literal(char *p, char *last, const LogEmitter &em,
+                   const LogSpec &lgsp) {
+  return copy(em.value, p, last).first;
+}
+} // namespace
+
+namespace {
+template <StringRef (*get)(const LogSpec &)>
+char *emit_text(char *p, char *last, const LogEmitter &em,
+                const LogSpec &lgsp) {
+  return copy(get(lgsp), p, last).first;
+}
+} // namespace
+
+namespace {
+template <StringRef (*get)(const LogSpec &)>
+char *emit_text_escape(char *p, char *last, const LogEmitter &em,
+                       const LogSpec &lgsp) {
+  return copy_escape(get(lgsp), p, last).first;
+}
+} // namespace
+
+namespace {
+char *emit_text_request(char *p, char *last, const LogEmitter &em,
                         const LogSpec &lgsp) {
-  auto config = get_config();
-  auto lgconf = log_config();
-  auto &accessconf = get_config()->logging.access;
+  const auto &req = lgsp.downstream->request();
+
+  std::tie(p, last) = copy(http2::to_method_string(req.method), p, last);
+  std::tie(p, last) = copy(' ', p, last);
+  std::tie(p, last) = copy_escape(get_request_target(lgsp), p, last);
+  std::tie(p, last) = copy_l(" HTTP/", p, last);
+  std::tie(p, last) = copy(req.http_major, p, last);
+  if (req.http_major < 2) {
+    std::tie(p, last) = copy('.', p, last);
+    std::tie(p, last) = copy(req.http_minor, p, last);
+  }
+  return p;
+}
+} // namespace
 
-  if (lgconf->accesslog_fd == -1 && !accessconf.syslog) {
-    return;
+namespace {
+char *emit_text_status(char *p, char *last, const LogEmitter &em,
+                       const LogSpec &lgsp) {
+  return copy(lgsp.downstream->response().http_status, p, last).first;
+}
+} // namespace
+
+namespace {
+char *emit_text_body_bytes_sent(char *p, char *last, const LogEmitter &em,
+                                const LogSpec &lgsp) {
+  return copy(lgsp.downstream->response_sent_body_length, p, last).first;
+}
+} // namespace
+
+namespace {
+char *emit_text_http(char *p, char *last, const LogEmitter &em,
+                     const LogSpec &lgsp) {
+  return copy_escape(get_http(em, lgsp), p, last).first;
+}
+} // namespace
+
+namespace {
+char *emit_text_server_port(char *p, char *last, const LogEmitter &em,
+                            const LogSpec &lgsp) {
+  return copy(lgsp.server_port, p, last).first;
+}
+} // namespace
+
+namespace {
+char *emit_text_request_time(char *p, char *last, const LogEmitter &em,
+                             const LogSpec &lgsp) {
+  auto t = get_request_time(lgsp);
+
+  std::tie(p, last) = copy(t / 1000, p, last);
+  std::tie(p, last) = copy('.', p, last);
+  auto frac = t % 1000;
+  if (frac < 100) {
+    auto n = frac < 10 ? 2 : 1;
+    std::tie(p, last) = copy("000", n, p, last);
   }
+  std::tie(p, last) = copy(frac, p, last);
+  return p;
+}
+} // namespace
 
-  std::array<char, 4_k> buf;
+namespace {
+char *emit_text_pid(char *p, char *last, const LogEmitter &em,
+                    const LogSpec &lgsp) {
+  return copy(lgsp.pid, p, last).first;
+}
+} // namespace
 
-  auto downstream = lgsp.downstream;
+namespace {
+char *emit_text_tls_session_id(char *p, char *last, const LogEmitter &em,
+                               const LogSpec &lgsp) {
+  if (!lgsp.tls_info || lgsp.tls_info->session_id_length == 0) {
+    return copy('-', p, last).first;
+  }
+  return copy_hex_low(lgsp.tls_info->session_id,
+                      lgsp.tls_info->session_id_length, p, last)
+      .first;
+}
+} // namespace
 
-  const auto &req = downstream->request();
-  const auto &resp = downstream->response();
-  const auto &tstamp = req.tstamp;
-  auto &balloc = downstream->get_block_allocator();
-
-  auto downstream_addr = downstream->get_addr();
-  auto method = http2::to_method_string(req.method);
-  auto path = req.method == HTTP_CONNECT
-                  ? req.authority
-                  : config->http2_proxy
-                        ? construct_absolute_request_uri(balloc, req)
-                        : req.path.empty()
-                              ? req.method == HTTP_OPTIONS
-                                    ? StringRef::from_lit("*")
-                                    : StringRef::from_lit("-")
-                              : req.path;
-
-  auto p = std::begin(buf);
-  auto last = std::end(buf) - 2;
+namespace {
+char *emit_text_backend_port(char *p, char *last, const LogEmitter &em,
+                             const LogSpec &lgsp) {
+  auto addr = lgsp.downstream->get_addr();
+  if (!addr) {
+    return copy('-', p, last).first;
+  }
+  return copy(addr->port, p, last).first;
+}
+} // namespace
 
-  for (auto &lf : lfv) {
-    switch (lf.type) {
-    case SHRPX_LOGF_LITERAL:
-      std::tie(p, last) = copy(lf.value, p, last);
-      break;
-    case SHRPX_LOGF_REMOTE_ADDR:
-      std::tie(p, last) = copy(lgsp.remote_addr, p, last);
-      break;
-    case SHRPX_LOGF_TIME_LOCAL:
-      std::tie(p, last) = copy(tstamp->time_local, p, last);
-      break;
-    case SHRPX_LOGF_TIME_ISO8601:
-      std::tie(p, last) = copy(tstamp->time_iso8601, p, last);
-      break;
-    case SHRPX_LOGF_REQUEST:
-      std::tie(p, last) = copy(method, p, last);
-      std::tie(p, last) = copy(' ', p, last);
-      std::tie(p, last) = copy_escape(path, p, last);
-      std::tie(p, last) = copy_l(" HTTP/", p, last);
-      std::tie(p, last) = copy(req.http_major, p, last);
-      if (req.http_major < 2) {
-        std::tie(p, last) = copy('.', p, last);
-        std::tie(p, last) = copy(req.http_minor, p, last);
-      }
-      break;
-    case SHRPX_LOGF_STATUS:
-      std::tie(p, last) = copy(resp.http_status, p, last);
-      break;
-    case SHRPX_LOGF_BODY_BYTES_SENT:
-      std::tie(p, last) = copy(downstream->response_sent_body_length, p, last);
-      break;
-    case SHRPX_LOGF_HTTP: {
-      auto hd = req.fs.header(lf.value);
-      if (hd) {
-        std::tie(p, last) = copy_escape((*hd).value, p, last);
-        break;
-      }
+namespace {
+constexpr size_t BINARY_FIELD_HDLEN = 3;
+} // namespace
 
-      std::tie(p, last) = copy('-', p, last);
+namespace {
+// Writes binary access log field of type |type| to [p, last).  |f|
+// writes the value to the given buffer, and returns the one beyond
+// the last byte written.
+template <typename F>
+char *emit_binary_field(LogFragmentType type, char *p, char *last, F f) {
+  if (static_cast<size_t>(last - p) < BINARY_FIELD_HDLEN) {
+    return p;
+  }
 
-      break;
-    }
-    case SHRPX_LOGF_AUTHORITY:
-      if (!req.authority.empty()) {
-        std::tie(p, last) = copy(req.authority, p, last);
-        break;
-      }
+  auto first = p + BINARY_FIELD_HDLEN;
+  auto end = f(first, first + std::min(last - first,
+                                       static_cast<ptrdiff_t>(0xffff)));
+  auto len = end - first;
 
-      std::tie(p, last) = copy('-', p, last);
+  *p++ = type;
+  *p++ = (len >> 8) & 0xff;
+  *p++ = len & 0xff;
 
-      break;
-    case SHRPX_LOGF_REMOTE_PORT:
-      std::tie(p, last) = copy(lgsp.remote_port, p, last);
-      break;
-    case SHRPX_LOGF_SERVER_PORT:
-      std::tie(p, last) = copy(lgsp.server_port, p, last);
-      break;
-    case SHRPX_LOGF_REQUEST_TIME: {
-      auto t = std::chrono::duration_cast<std::chrono::milliseconds>(
-                   lgsp.request_end_time - downstream->get_request_start_time())
-                   .count();
-      std::tie(p, last) = copy(t / 1000, p, last);
+  return end;
+}
+} // namespace
+
+namespace {
+// Writes |n| in network byte order using the minimum number of
+// bytes, which is at least 1.  If [p, last) is not large enough,
+// nothing is written.
+char *copy_uint_be(uint64_t n, char *p, char *last) {
+  size_t nbytes = 1;
+  for (auto m = n >> 8; m; m >>= 8) {
+    ++nbytes;
+  }
+  if (static_cast<size_t>(last - p) < nbytes) {
+    return p;
+  }
+  for (; nbytes; --nbytes) {
+    *p++ = (n >> ((nbytes - 1) * 8)) & 0xff;
+  }
+  return p;
+}
+} // namespace
+
+namespace {
+template <StringRef (*get)(const LogSpec &)>
+char *emit_binary(char *p, char *last, const LogEmitter &em,
+                  const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    return copy(get(lgsp), p, last).first;
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_request(char *p, char *last, const LogEmitter &em,
+                          const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    const auto &req = lgsp.downstream->request();
+
+    std::tie(p, last) = copy(http2::to_method_string(req.method), p, last);
+    std::tie(p, last) = copy(' ', p, last);
+    std::tie(p, last) = copy(get_request_target(lgsp), p, last);
+    std::tie(p, last) = copy_l(" HTTP/", p, last);
+    std::tie(p, last) = copy(static_cast<char>('0' + req.http_major), p, last);
+    if (req.http_major < 2) {
       std::tie(p, last) = copy('.', p, last);
-      auto frac = t % 1000;
-      if (frac < 100) {
-        auto n = frac < 10 ? 2 : 1;
-        std::tie(p, last) = copy("000", n, p, last);
-      }
-      std::tie(p, last) = copy(frac, p, last);
-      break;
-    }
-    case SHRPX_LOGF_PID:
-      std::tie(p, last) = copy(lgsp.pid, p, last);
-      break;
-    case SHRPX_LOGF_ALPN:
-      std::tie(p, last) = copy_escape(lgsp.alpn, p, last);
-      break;
-    case SHRPX_LOGF_TLS_CIPHER:
-      if (!lgsp.tls_info) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
-      std::tie(p, last) = copy(lgsp.tls_info->cipher, p, last);
-      break;
-    case SHRPX_LOGF_TLS_PROTOCOL:
-      if (!lgsp.tls_info) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
-      std::tie(p, last) = copy(lgsp.tls_info->protocol, p, last);
-      break;
-    case SHRPX_LOGF_TLS_SESSION_ID:
-      if (!lgsp.tls_info || lgsp.tls_info->session_id_length == 0) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
-      std::tie(p, last) = copy_hex_low(
-          lgsp.tls_info->session_id, lgsp.tls_info->session_id_length, p, last);
-      break;
-    case SHRPX_LOGF_TLS_SESSION_REUSED:
-      if (!lgsp.tls_info) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
       std::tie(p, last) =
-          copy(lgsp.tls_info->session_reused ? 'r' : '.', p, last);
-      break;
-    case SHRPX_LOGF_TLS_SNI:
-      if (lgsp.sni.empty()) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
-      std::tie(p, last) = copy_escape(lgsp.sni, p, last);
-      break;
-    case SHRPX_LOGF_BACKEND_HOST:
-      if (!downstream_addr) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
-      std::tie(p, last) = copy(downstream_addr->host, p, last);
-      break;
-    case SHRPX_LOGF_BACKEND_PORT:
-      if (!downstream_addr) {
-        std::tie(p, last) = copy('-', p, last);
-        break;
-      }
-      std::tie(p, last) = copy(downstream_addr->port, p, last);
-      break;
-    case SHRPX_LOGF_NONE:
-      break;
-    default:
-      break;
+          copy(static_cast<char>('0' + req.http_minor), p, last);
     }
+    return p;
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_status(char *p, char *last, const LogEmitter &em,
+                         const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    return copy_uint_be(lgsp.downstream->response().http_status, p, last);
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_body_bytes_sent(char *p, char *last, const LogEmitter &em,
+                                  const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    return copy_uint_be(lgsp.downstream->response_sent_body_length, p, last);
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_http(char *p, char *last, const LogEmitter &em,
+                       const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last,
+                           [&em, &lgsp](char *p, char *last) {
+                             return copy(get_http(em, lgsp), p, last).first;
+                           });
+}
+} // namespace
+
+namespace {
+char *emit_binary_server_port(char *p, char *last, const LogEmitter &em,
+                              const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    return copy_uint_be(lgsp.server_port, p, last);
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_request_time(char *p, char *last, const LogEmitter &em,
+                               const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    return copy_uint_be(get_request_time(lgsp), p, last);
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_pid(char *p, char *last, const LogEmitter &em,
+                      const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    return copy_uint_be(lgsp.pid, p, last);
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_tls_session_id(char *p, char *last, const LogEmitter &em,
+                                 const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    if (!lgsp.tls_info) {
+      return p;
+    }
+    return copy(reinterpret_cast<const char *>(lgsp.tls_info->session_id),
+                lgsp.tls_info->session_id_length, p, last)
+        .first;
+  });
+}
+} // namespace
+
+namespace {
+char *emit_binary_backend_port(char *p, char *last, const LogEmitter &em,
+                               const LogSpec &lgsp) {
+  return emit_binary_field(em.type, p, last, [&lgsp](char *p, char *last) {
+    auto addr = lgsp.downstream->get_addr();
+    if (!addr) {
+      return p;
+    }
+    return copy_uint_be(addr->port, p, last);
+  });
+}
+} // namespace
+
+namespace {
+LogEmitFunc get_text_emitter(LogFragmentType type) {
+  switch (type) {
+  case SHRPX_LOGF_LITERAL:
+    return emit_literal;
+  case SHRPX_LOGF_REMOTE_ADDR:
+    return emit_text<get_remote_addr>;
+  case SHRPX_LOGF_TIME_LOCAL:
+    return emit_text<get_time_local>;
+  case SHRPX_LOGF_TIME_ISO8601:
+    return emit_text<get_time_iso8601>;
+  case SHRPX_LOGF_REQUEST:
+    return emit_text_request;
+  case SHRPX_LOGF_STATUS:
+    return emit_text_status;
+  case SHRPX_LOGF_BODY_BYTES_SENT:
+    return emit_text_body_bytes_sent;
+  case SHRPX_LOGF_HTTP:
+    return emit_text_http;
+  case SHRPX_LOGF_AUTHORITY:
+    return emit_text<get_authority>;
+  case SHRPX_LOGF_REMOTE_PORT:
+    return emit_text<get_remote_port>;
+  case SHRPX_LOGF_SERVER_PORT:
+    return emit_text_server_port;
+  case SHRPX_LOGF_REQUEST_TIME:
+    return emit_text_request_time;
+  case SHRPX_LOGF_PID:
+    return emit_text_pid;
+  case SHRPX_LOGF_ALPN:
+    return emit_text_escape<get_alpn>;
+  case SHRPX_LOGF_TLS_CIPHER:
+    return emit_text<get_tls_cipher>;
+  case SHRPX_LOGF_TLS_PROTOCOL:
+    return emit_text<get_tls_protocol>;
+  case SHRPX_LOGF_TLS_SESSION_ID:
+    return emit_text_tls_session_id;
+  case SHRPX_LOGF_TLS_SESSION_REUSED:
+    return emit_text<get_tls_session_reused>;
+  case SHRPX_LOGF_TLS_SNI:
+    return emit_text_escape<get_tls_sni>;
+  case SHRPX_LOGF_BACKEND_HOST:
+    return emit_text<get_backend_host>;
+  case SHRPX_LOGF_BACKEND_PORT:
+    return emit_text_backend_port;
+  default:
+    return nullptr;
   }
+}
+} // namespace
 
-  *p = '\0';
+namespace {
+LogEmitFunc get_binary_emitter(LogFragmentType type) {
+  switch (type) {
+  case SHRPX_LOGF_REMOTE_ADDR:
+    return emit_binary<get_remote_addr>;
+  case SHRPX_LOGF_TIME_LOCAL:
+    return emit_binary<get_time_local>;
+  case SHRPX_LOGF_TIME_ISO8601:
+    return emit_binary<get_time_iso8601>;
+  case SHRPX_LOGF_REQUEST:
+    return emit_binary_request;
+  case SHRPX_LOGF_STATUS:
+    return emit_binary_status;
+  case SHRPX_LOGF_BODY_BYTES_SENT:
+    return emit_binary_body_bytes_sent;
+  case SHRPX_LOGF_HTTP:
+    return emit_binary_http;
+  case SHRPX_LOGF_AUTHORITY:
+    return emit_binary<get_authority>;
+  case SHRPX_LOGF_REMOTE_PORT:
+    return emit_binary<get_remote_port>;
+  case SHRPX_LOGF_SERVER_PORT:
+    return emit_binary_server_port;
+  case SHRPX_LOGF_REQUEST_TIME:
+    return emit_binary_request_time;
+  case SHRPX_LOGF_PID:
+    return emit_binary_pid;
+  case SHRPX_LOGF_ALPN:
+    return emit_binary<get_alpn>;
+  case SHRPX_LOGF_TLS_CIPHER:
+    return emit_binary<get_tls_cipher>;
+  case SHRPX_LOGF_TLS_PROTOCOL:
+    return emit_binary<get_tls_protocol>;
+  case SHRPX_LOGF_TLS_SESSION_ID:
+    return emit_binary_tls_session_id;
+  case SHRPX_LOGF_TLS_SESSION_REUSED:
+    return emit_binary<get_tls_session_reused>;
+  case SHRPX_LOGF_TLS_SNI:
+    return emit_binary<get_tls_sni>;
+  case SHRPX_LOGF_BACKEND_HOST:
+    return emit_binary<get_backend_host>;
+  case SHRPX_LOGF_BACKEND_PORT:
+    return emit_binary_backend_port;
+  default:
+    // SHRPX_LOGF_LITERAL is not written in binary format.
+    return nullptr;
+  }
+}
+} // namespace
+
+std::vector<LogEmitter> compile_log_format(const std::vector<LogFragment> &lfv,
+                                           bool binary) {
+  std::vector<LogEmitter> res;
+
+  for (auto &lf : lfv) {
+    auto func =
+        binary ? get_binary_emitter(lf.type) : get_text_emitter(lf.type);
+    if (!func) {
+      continue;
+    }
+
+    auto token =
+        lf.type == SHRPX_LOGF_HTTP ? http2::lookup_token(lf.value) : -1;
 
-  if (accessconf.syslog) {
-    syslog(LOG_INFO, "%s", buf.data());
+    res.push_back(LogEmitter{func, lf.value, lf.type, token});
+  }
+
+  return res;
+}
+
+char *format_accesslog(char *first, char *last,
+                       const std::vector<LogEmitter> &emv, bool binary,
+                       const LogSpec &lgsp) {
+  if (!binary) {
+    auto p = first;
+    for (auto &em : emv) {
+      p = em.func(p, last, em, lgsp);
+    }
+    return p;
+  }
+
+  if (last - first < 4) {
+    return first;
+  }
 
+  auto p = first + 4;
+  for (auto &em : emv) {
+    p = em.func(p, last, em, lgsp);
+  }
+
+  auto len = p - first - 4;
+
+  *first++ = (len >> 24) & 0xff;
+  *first++ = (len >> 16) & 0xff;
+  *first++ = (len >> 8) & 0xff;
+  *first++ = len & 0xff;
+
+  return p;
+}
+
+void upstream_accesslog(const std::vector<LogEmitter> &emv,
+                        const LogSpec &lgsp) {
+  auto lgconf = log_config();
+  auto &accessconf = get_config()->logging.access;
+
+  if (lgconf->accesslog_fd == -1 && !accessconf.syslog) {
     return;
   }
 
-  *p++ = '\n';
+  std::array<char, 4_k> buf;
+
+  char *p;
+
+  if (accessconf.binary) {
+    p = format_accesslog(std::begin(buf), std::end(buf), emv, true, lgsp);
+  } else {
+    p = format_accesslog(std::begin(buf), std::end(buf) - 2, emv, false,
+                         lgsp);
+
+    *p = '\0';
+
+    if (accessconf.syslog) {
+      syslog(LOG_INFO, "%s", buf.data());
+
+      return;
+    }
+
+    *p++ = '\n';
+  }
 
   auto nwrite = std::distance(std::begin(buf), p);
+
+  if (lgconf->accesslog_buffer) {
+    lgconf->accesslog_buffer->write(buf.data(), nwrite);
+
+    return;
+  }
+
   while (write(lgconf->accesslog_fd, buf.data(), nwrite) == -1 &&
          errno == EINTR)
     ;
@@ -113,6 +113,7 @@ private:
 #define TTY_HTTP_HD (log_config()->errorlog_tty ? "\033[1;34m" : "")
 #define TTY_RST (log_config()->errorlog_tty ? "\033[0m" : "")
 
+// The values are written in binary access log.  Do not change them.
 enum LogFragmentType {
   SHRPX_LOGF_NONE,
   SHRPX_LOGF_LITERAL,
@@ -161,7 +162,47 @@ struct LogSpec {
   pid_t pid;
 };
 
-void upstream_accesslog(const std::vector<LogFragment> &lf,
+struct LogEmitter;
+
+// Appends the value of one fragment of access log format described
+// by |em| to the buffer [p, last), and returns the one beyond the
+// last byte written.
+using LogEmitFunc = char *(*)(char *p, char *last, const LogEmitter &em,
+                              const LogSpec &lgsp);
+
+// LogFragment compiled by compile_log_format().  The type of
+// fragment and the output format are resolved into |func| when
+// configuration is loaded, so that writing access log does not
+// branch on them per fragment.
+struct LogEmitter {
+  LogEmitFunc func;
+  StringRef value;
+  LogFragmentType type;
+  // Header field name token of SHRPX_LOGF_HTTP, or -1.
+  int32_t token;
+};
+
+// Compiles |lfv| into the list of functions which write each
+// fragment in order.  If |binary| is true, they write the binary
+// access log record fields, and SHRPX_LOGF_LITERAL is omitted.
+std::vector<LogEmitter> compile_log_format(const std::vector<LogFragment> &lfv,
+                                           bool binary);
+
+// Writes access log entry for |lgsp| using |emv| to the buffer
+// [first, last), and returns the one beyond the last byte written.
+// If |binary| is true, |emv| must be compiled for binary format, and
+// the entry is written as binary access log record: 4 bytes length
+// of the rest of the record in network byte order, followed by the
+// fields.  Each field consists of 1 byte LogFragmentType, 2 bytes
+// length of the value in network byte order, and the value which is
+// not escaped.  Integers are written in network byte order using the
+// minimum number of bytes.  Otherwise, the entry is a text line without line
+// terminator.
+char *format_accesslog(char *first, char *last,
+                       const std::vector<LogEmitter> &emv, bool binary,
+                       const LogSpec &lgsp);
+
+void upstream_accesslog(const std::vector<LogEmitter> &emv,
                         const LogSpec &lgsp);
 
 int reopen_log_files(const LoggingConfig &loggingconf);
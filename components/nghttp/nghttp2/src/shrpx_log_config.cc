@@ -44,6 +44,7 @@ Timestamp::Timestamp(const std::chrono::system_clock::time_point &tp) {
 LogConfig::LogConfig()
     : time_str_updated(std::chrono::system_clock::now()),
       tstamp(std::make_shared<Timestamp>(time_str_updated)),
+      accesslog_buffer(nullptr),
       pid(getpid()),
       accesslog_fd(-1),
       errorlog_fd(-1),
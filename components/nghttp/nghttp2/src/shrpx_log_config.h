@@ -37,6 +37,8 @@ using namespace nghttp2;
 
 namespace shrpx {
 
+class AccessLogBuffer;
+
 struct Timestamp {
   Timestamp(const std::chrono::system_clock::time_point &tp);
 
@@ -52,6 +54,9 @@ struct LogConfig {
   std::chrono::system_clock::time_point time_str_updated;
   std::shared_ptr<Timestamp> tstamp;
   std::string thread_id;
+  // If not nullptr, access log lines are appended to this buffer
+  // instead of being written to accesslog_fd.
+  AccessLogBuffer *accesslog_buffer;
   pid_t pid;
   int accesslog_fd;
   int errorlog_fd;
@@ -0,0 +1,169 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_log_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_log.h"
+#include "shrpx_downstream.h"
+
+namespace shrpx {
+
+namespace {
+void prepare_downstream(Downstream &d) {
+  auto &req = d.request();
+  req.method = HTTP_GET;
+  req.path = StringRef::from_lit("/alpha?q=\x01");
+  req.http_major = 1;
+  req.http_minor = 1;
+  req.fs.add_header_token(StringRef::from_lit("user-agent"),
+                          StringRef::from_lit("nghttp2\"/1"), false,
+                          http2::HD_USER_AGENT);
+  req.fs.add_header_token(StringRef::from_lit("x-bravo"),
+                          StringRef::from_lit("charlie"), false, -1);
+  req.fs.add_header_token(
+      StringRef::from_lit("x-delta"),
+      StringRef::from_lit("0123456789abcdef\x7f"
+                          "0123456\x80\\01234567890\t"),
+      false, -1);
+
+  auto &resp = d.response();
+  resp.http_status = 200;
+
+  d.response_sent_body_length = 1024;
+}
+} // namespace
+
+namespace {
+LogSpec make_log_spec(Downstream *d) {
+  return LogSpec{
+      d,
+      StringRef::from_lit("192.0.2.1"),
+      StringRef::from_lit("h2"),
+      StringRef{},
+      nullptr,
+      std::chrono::high_resolution_clock::now(),
+      StringRef::from_lit("443"),
+      3000,
+      7,
+  };
+}
+} // namespace
+
+namespace {
+constexpr auto LOG_FORMAT =
+    StringRef::from_lit(R"($remote_addr "$request" $status $body_bytes_sent )"
+                        R"("$http_user_agent" $http_x_alpha $http_x_bravo )"
+                        R"($server_port $pid $tls_cipher)");
+} // namespace
+
+void test_shrpx_log_format_accesslog(void) {
+  BlockAllocator balloc(4096, 4096);
+  Downstream d(nullptr, nullptr, 0);
+  std::array<char, 4_k> buf;
+
+  prepare_downstream(d);
+
+  auto emv = compile_log_format(parse_log_format(balloc, LOG_FORMAT), false);
+
+  CU_ASSERT(19 == emv.size());
+  CU_ASSERT(http2::HD_USER_AGENT == emv[8].token);
+  CU_ASSERT(-1 == emv[12].token);
+
+  auto lgsp = make_log_spec(&d);
+
+  auto p = format_accesslog(std::begin(buf), std::end(buf), emv, false, lgsp);
+
+  CU_ASSERT(R"(192.0.2.1 "GET /alpha?q=\x01 HTTP/1.1" 200 1024 )"
+            R"("nghttp2\x22/1" - charlie 3000 7 -)" ==
+            StringRef(std::begin(buf), p));
+
+  // Output is truncated at the end of buffer.
+  p = format_accesslog(std::begin(buf), std::begin(buf) + 16, emv, false,
+                       lgsp);
+
+  CU_ASSERT(R"(192.0.2.1 "GET /)" == StringRef(std::begin(buf), p));
+
+  emv = compile_log_format(
+      parse_log_format(balloc, StringRef::from_lit("$http_x_delta")), false);
+
+  p = format_accesslog(std::begin(buf), std::end(buf), emv, false, lgsp);
+
+  CU_ASSERT(R"(0123456789abcdef\x7f0123456\x80\x5c01234567890\x09)" ==
+            StringRef(std::begin(buf), p));
+}
+
+void test_shrpx_log_format_accesslog_binary(void) {
+  BlockAllocator balloc(4096, 4096);
+  Downstream d(nullptr, nullptr, 0);
+  std::array<char, 4_k> buf;
+
+  prepare_downstream(d);
+
+  auto emv = compile_log_format(parse_log_format(balloc, LOG_FORMAT), true);
+
+  // Literals are not written.
+  CU_ASSERT(10 == emv.size());
+
+  auto lgsp = make_log_spec(&d);
+
+  auto p = format_accesslog(std::begin(buf), std::end(buf), emv, true, lgsp);
+
+  auto ans = StringRef::from_lit("\x00\x00\x00\x57"
+                                 "\x02\x00\x09"
+                                 "192.0.2.1"
+                                 "\x05\x00\x17"
+                                 "GET /alpha?q=\x01 HTTP/1.1"
+                                 "\x06\x00\x01"
+                                 "\xc8"
+                                 "\x07\x00\x02"
+                                 "\x04\x00"
+                                 "\x08\x00\x0a"
+                                 "nghttp2\"/1"
+                                 "\x08\x00\x01"
+                                 "-"
+                                 "\x08\x00\x07"
+                                 "charlie"
+                                 "\x0b\x00\x02"
+                                 "\x0b\xb8"
+                                 "\x0d\x00\x01"
+                                 "\x07"
+                                 "\x0f\x00\x01"
+                                 "-");
+
+  CU_ASSERT(ans == StringRef(std::begin(buf), p));
+
+  // Truncated field keeps the record well formed.
+  p = format_accesslog(std::begin(buf), std::begin(buf) + 20, emv, true,
+                       lgsp);
+
+  CU_ASSERT(StringRef::from_lit("\x00\x00\x00\x10"
+                                "\x02\x00\x09"
+                                "192.0.2.1"
+                                "\x05\x00\x01"
+                                "G") == StringRef(std::begin(buf), p));
+}
+
+} // namespace shrpx
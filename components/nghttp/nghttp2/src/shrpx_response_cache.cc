@@ -0,0 +1,757 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_response_cache.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#include "shrpx_downstream.h"
+#include "shrpx_worker.h"
+#include "shrpx_log.h"
+#include "util.h"
+#include "xsi_strerror.h"
+
+namespace shrpx {
+
+namespace {
+// The period of time the requests bypass cache after the response
+// for the same key turned out to be uncacheable.
+constexpr auto PASS_DURATION = std::chrono::seconds(60);
+} // namespace
+
+namespace {
+StringRef trim_ows(const char *first, const char *last) {
+  for (; first != last && (*first == ' ' || *first == '\t'); ++first)
+    ;
+  for (; first != last && (*(last - 1) == ' ' || *(last - 1) == '\t');
+       --last)
+    ;
+  return StringRef{first, last};
+}
+} // namespace
+
+namespace {
+// Parses delta-seconds |s|, which may be quoted.  Returns -1 if it is
+// invalid.
+int64_t parse_delta_seconds(const StringRef &s) {
+  if (s.size() >= 2 && s[0] == '"' && s[s.size() - 1] == '"') {
+    return util::parse_uint(StringRef{s.c_str() + 1, s.size() - 2});
+  }
+  return util::parse_uint(s);
+}
+} // namespace
+
+void parse_cache_control(CacheControl &cc, const StringRef &value) {
+  auto first = std::begin(value);
+  auto last = std::end(value);
+
+  for (;;) {
+    auto end = std::find(first, last, ',');
+    auto eq = std::find(first, end, '=');
+    auto name = trim_ows(first, eq);
+    auto arg = eq == end ? StringRef{} : trim_ows(eq + 1, end);
+
+    if (util::strieq_l("max-age", name)) {
+      // Invalid max-age makes the response stale.
+      cc.max_age = std::max(parse_delta_seconds(arg), static_cast<int64_t>(0));
+    } else if (util::strieq_l("s-maxage", name)) {
+      cc.s_maxage = std::max(parse_delta_seconds(arg), static_cast<int64_t>(0));
+    } else if (util::strieq_l("stale-while-revalidate", name)) {
+      cc.stale_while_revalidate = parse_delta_seconds(arg);
+    } else if (util::strieq_l("no-store", name)) {
+      cc.no_store = true;
+    } else if (util::strieq_l("no-cache", name)) {
+      cc.no_cache = true;
+    } else if (util::strieq_l("private", name)) {
+      cc.is_private = true;
+    } else if (util::strieq_l("must-revalidate", name) ||
+               util::strieq_l("proxy-revalidate", name)) {
+      cc.must_revalidate = true;
+    }
+
+    if (end == last) {
+      return;
+    }
+
+    first = end + 1;
+  }
+}
+
+bool cacheable_request(const Request &req) {
+  if ((req.method != HTTP_GET && req.method != HTTP_HEAD) ||
+      req.upgrade_request) {
+    return false;
+  }
+
+  if (req.fs.header(StringRef::from_lit("authorization")) ||
+      req.fs.header(StringRef::from_lit("range"))) {
+    return false;
+  }
+
+  auto cc = req.fs.header(http2::HD_CACHE_CONTROL);
+  if (cc) {
+    CacheControl c;
+    parse_cache_control(c, cc->value);
+    if (c.no_store || c.no_cache || c.max_age == 0) {
+      return false;
+    }
+  }
+
+  auto pragma = req.fs.header(StringRef::from_lit("pragma"));
+  if (pragma && util::strieq_l("no-cache", pragma->value)) {
+    return false;
+  }
+
+  return true;
+}
+
+uint64_t cache_key_hash(const StringRef &key) {
+  // 64 bit FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+
+  for (auto c : key) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 1099511628211ULL;
+  }
+
+  return h;
+}
+
+namespace {
+size_t arena_align(size_t n) { return std::max((n + 7) & ~7, size_t{8}); }
+} // namespace
+
+CacheArena::CacheArena(size_t size) : used_(0) {
+  if (size) {
+    free_.emplace(0, size);
+    free_by_size_.emplace(size, 0);
+  }
+}
+
+ssize_t CacheArena::allocate(size_t n) {
+  n = arena_align(n);
+
+  auto it = free_by_size_.lower_bound(std::make_pair(n, size_t{0}));
+  if (it == std::end(free_by_size_)) {
+    return -1;
+  }
+
+  auto len = (*it).first;
+  auto offset = (*it).second;
+
+  free_by_size_.erase(it);
+  free_.erase(offset);
+
+  if (len > n) {
+    free_.emplace(offset + n, len - n);
+    free_by_size_.emplace(len - n, offset + n);
+  }
+
+  used_ += n;
+
+  return offset;
+}
+
+void CacheArena::release(size_t offset, size_t n) {
+  n = arena_align(n);
+
+  used_ -= n;
+
+  auto next = free_.lower_bound(offset);
+
+  if (next != std::begin(free_)) {
+    auto prev = std::prev(next);
+    if ((*prev).first + (*prev).second == offset) {
+      offset = (*prev).first;
+      n += (*prev).second;
+      free_by_size_.erase(std::make_pair((*prev).second, (*prev).first));
+      free_.erase(prev);
+    }
+  }
+
+  if (next != std::end(free_) && offset + n == (*next).first) {
+    n += (*next).second;
+    free_by_size_.erase(std::make_pair((*next).second, (*next).first));
+    free_.erase(next);
+  }
+
+  free_.emplace(offset, n);
+  free_by_size_.emplace(n, offset);
+}
+
+size_t CacheArena::get_used() const { return used_; }
+
+CacheEntry::CacheEntry(ResponseCache *cache, uint8_t *data, size_t offset,
+                       size_t len)
+    : initial_age(0),
+      http_status(0),
+      cache(cache),
+      data(data),
+      offset(offset),
+      len(len) {}
+
+CacheEntry::~CacheEntry() { cache->release(offset, len); }
+
+ResponseCache::ResponseCache(size_t size, size_t max_object_size)
+    : stat_{},
+      arena_(size),
+      base_(nullptr),
+      size_(size),
+      max_object_size_(max_object_size),
+      max_slots_(std::max(size / 1024, size_t{1024}) / shards_.size()),
+      next_evict_(0) {}
+
+ResponseCache::~ResponseCache() {
+  for (auto &shard : shards_) {
+    shard.slots.clear();
+  }
+
+  if (base_) {
+    munmap(base_, size_);
+  }
+}
+
+int ResponseCache::init() {
+  auto p = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    auto error = errno;
+    std::array<char, STRERROR_BUFSIZE> errbuf;
+    LOG(ERROR) << "Could not allocate response cache: mmap() failed: "
+               << xsi_strerror(error, errbuf.data(), errbuf.size());
+    return -1;
+  }
+
+  base_ = static_cast<uint8_t *>(p);
+
+  return 0;
+}
+
+CacheShard &ResponseCache::get_shard(uint64_t hash) {
+  // The lower bits are used by unordered_map.
+  return shards_[(hash >> 32) % shards_.size()];
+}
+
+namespace {
+bool vary_match(const CacheEntry &entry, const Request &req) {
+  for (auto &kv : entry.vary) {
+    auto f = req.fs.header(kv.name);
+    if ((f ? f->value : StringRef{}) != kv.value) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+CacheLookupResult ResponseCache::lookup(std::shared_ptr<CacheEntry> &entry,
+                                        uint64_t hash, const StringRef &key,
+                                        const Request &req, Worker *worker,
+                                        bool fill) {
+  auto &shard = get_shard(hash);
+  auto now = std::chrono::steady_clock::now();
+  // Entries must be released after the shard lock is released.
+  std::vector<std::shared_ptr<CacheEntry>> garbage;
+
+  std::lock_guard<std::mutex> g(shard.mu);
+
+  auto it = shard.slots.find(hash);
+  if (it == std::end(shard.slots)) {
+    if (!fill) {
+      ++stat_.bypasses;
+      return CACHE_PASS;
+    }
+
+    if (shard.slots.size() >= max_slots_ &&
+        !remove_lru_slot(shard, garbage)) {
+      // Every slot is being fetched.  Do not grow the shard beyond
+      // its limit.
+      ++stat_.bypasses;
+      return CACHE_PASS;
+    }
+
+    auto &slot = shard.slots[hash];
+    slot.key = key.str();
+    slot.filling = true;
+    slot.lru = shard.lru.insert(std::end(shard.lru), hash);
+
+    ++stat_.misses;
+    return CACHE_MISS;
+  }
+
+  auto &slot = (*it).second;
+
+  if (StringRef{slot.key} != key || slot.pass_until > now) {
+    ++stat_.bypasses;
+    return CACHE_PASS;
+  }
+
+  if (slot.entry && vary_match(*slot.entry, req)) {
+    if (now < slot.entry->fresh_until) {
+      shard.lru.splice(std::end(shard.lru), shard.lru, slot.lru);
+      entry = slot.entry;
+      ++stat_.hits;
+      return CACHE_HIT;
+    }
+
+    if (now < slot.entry->stale_until) {
+      if (slot.filling || !fill) {
+        shard.lru.splice(std::end(shard.lru), shard.lru, slot.lru);
+        entry = slot.entry;
+        ++stat_.hits;
+        ++stat_.stale_hits;
+        return CACHE_HIT;
+      }
+
+      // This request revalidates the entry, and others are served
+      // from the stale one meanwhile.
+      slot.filling = true;
+      ++stat_.misses;
+      return CACHE_MISS;
+    }
+  }
+
+  if (!fill) {
+    ++stat_.bypasses;
+    return CACHE_PASS;
+  }
+
+  if (slot.filling) {
+    if (worker && std::find(std::begin(slot.waiters), std::end(slot.waiters),
+                            worker) == std::end(slot.waiters)) {
+      slot.waiters.push_back(worker);
+    }
+    ++stat_.coalesced;
+    return CACHE_WAIT;
+  }
+
+  slot.filling = true;
+  ++stat_.misses;
+  return CACHE_MISS;
+}
+
+bool ResponseCache::remove_lru_slot(
+    CacheShard &shard, std::vector<std::shared_ptr<CacheEntry>> &garbage) {
+  for (auto it = std::begin(shard.lru); it != std::end(shard.lru); ++it) {
+    auto sit = shard.slots.find(*it);
+    auto &slot = (*sit).second;
+
+    if (slot.filling) {
+      continue;
+    }
+
+    if (slot.entry) {
+      garbage.push_back(std::move(slot.entry));
+      --stat_.num_entries;
+      ++stat_.evictions;
+    }
+
+    shard.lru.erase(it);
+    shard.slots.erase(sit);
+
+    return true;
+  }
+
+  return false;
+}
+
+bool ResponseCache::evict_one() {
+  for (size_t i = 0; i < shards_.size(); ++i) {
+    auto &shard = shards_[next_evict_++ % shards_.size()];
+    std::shared_ptr<CacheEntry> victim;
+
+    {
+      std::lock_guard<std::mutex> g(shard.mu);
+
+      for (auto it = std::begin(shard.lru); it != std::end(shard.lru); ++it) {
+        auto sit = shard.slots.find(*it);
+        auto &slot = (*sit).second;
+
+        if (!slot.entry) {
+          continue;
+        }
+
+        victim = std::move(slot.entry);
+
+        if (!slot.filling) {
+          shard.lru.erase(it);
+          shard.slots.erase(sit);
+        }
+
+        break;
+      }
+    }
+
+    if (victim) {
+      --stat_.num_entries;
+      ++stat_.evictions;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::shared_ptr<CacheEntry> ResponseCache::allocate_entry(size_t len) {
+  if (!base_ || len > size_) {
+    return nullptr;
+  }
+
+  for (;;) {
+    ssize_t offset;
+    {
+      std::lock_guard<std::mutex> g(arena_mu_);
+      offset = arena_.allocate(len);
+    }
+
+    if (offset != -1) {
+      return std::make_shared<CacheEntry>(this, base_ + offset, offset, len);
+    }
+
+    // The evicted entry might still be in use, and its range is not
+    // released yet.  In that case, we just evict another one.
+    if (!evict_one()) {
+      return nullptr;
+    }
+  }
+}
+
+void ResponseCache::finish_fill(uint64_t hash, const StringRef &key,
+                                std::shared_ptr<CacheEntry> entry,
+                                bool pass) {
+  auto &shard = get_shard(hash);
+  auto now = std::chrono::steady_clock::now();
+  std::shared_ptr<CacheEntry> old;
+  std::vector<Worker *> waiters;
+
+  {
+    std::lock_guard<std::mutex> g(shard.mu);
+
+    auto it = shard.slots.find(hash);
+    if (it == std::end(shard.slots) || StringRef{(*it).second.key} != key) {
+      return;
+    }
+
+    auto &slot = (*it).second;
+
+    slot.filling = false;
+    waiters = std::move(slot.waiters);
+    slot.waiters.clear();
+
+    if (entry) {
+      old = std::move(slot.entry);
+      slot.entry = std::move(entry);
+      shard.lru.splice(std::end(shard.lru), shard.lru, slot.lru);
+
+      ++stat_.stores;
+      if (!old) {
+        ++stat_.num_entries;
+      }
+    } else if (pass) {
+      old = std::move(slot.entry);
+      slot.pass_until = now + PASS_DURATION;
+
+      if (old) {
+        --stat_.num_entries;
+      }
+    }
+
+    if (!slot.entry && slot.pass_until <= now) {
+      shard.lru.erase(slot.lru);
+      shard.slots.erase(it);
+    }
+  }
+
+  for (auto worker : waiters) {
+    WorkerEvent wev{};
+    wev.type = CACHE_FILLED;
+    wev.cache_hash = hash;
+    worker->send(wev);
+  }
+}
+
+void ResponseCache::release(size_t offset, size_t len) {
+  std::lock_guard<std::mutex> g(arena_mu_);
+  arena_.release(offset, len);
+}
+
+size_t ResponseCache::get_max_object_size() const { return max_object_size_; }
+
+size_t ResponseCache::get_used() {
+  std::lock_guard<std::mutex> g(arena_mu_);
+  return arena_.get_used();
+}
+
+CacheStat &ResponseCache::get_stat() { return stat_; }
+
+namespace {
+bool cacheable_status(unsigned int status) {
+  switch (status) {
+  case 200:
+  case 203:
+  case 204:
+  case 300:
+  case 301:
+  case 404:
+  case 405:
+  case 410:
+  case 414:
+  case 501:
+    return true;
+  default:
+    return false;
+  }
+}
+} // namespace
+
+CacheWriter::CacheWriter(ResponseCache *cache, uint64_t hash,
+                         const StringRef &key)
+    : key_(key.str()),
+      cache_(cache),
+      hash_(hash),
+      initial_age_(0),
+      etag_idx_(-1),
+      http_status_(0),
+      header_received_(false),
+      done_(false) {}
+
+CacheWriter::~CacheWriter() {
+  if (!done_) {
+    cache_->finish_fill(hash_, StringRef{key_}, nullptr, false);
+  }
+}
+
+void CacheWriter::on_header(const Downstream &downstream) {
+  if (done_ || header_received_) {
+    return;
+  }
+
+  header_received_ = true;
+
+  const auto &req = downstream.request();
+  const auto &resp = downstream.response();
+
+  if (req.method != HTTP_GET || downstream.get_upgraded() ||
+      !cacheable_status(resp.http_status) ||
+      (resp.fs.content_length != -1 &&
+       static_cast<size_t>(resp.fs.content_length) >
+           cache_->get_max_object_size())) {
+    finish(nullptr, true);
+    return;
+  }
+
+  CacheControl cc;
+  StringRef expires, date;
+
+  for (auto &kv : resp.fs.headers()) {
+    if (kv.name.empty() || kv.name[0] == ':') {
+      continue;
+    }
+
+    switch (kv.token) {
+    case http2::HD_CONNECTION:
+    case http2::HD_CONTENT_LENGTH:
+    case http2::HD_KEEP_ALIVE:
+    case http2::HD_PROXY_CONNECTION:
+    case http2::HD_TE:
+    case http2::HD_TRANSFER_ENCODING:
+    case http2::HD_UPGRADE:
+    case http2::HD_VIA:
+      continue;
+    case http2::HD_CACHE_CONTROL:
+      parse_cache_control(cc, kv.value);
+      break;
+    case http2::HD_DATE:
+      date = kv.value;
+      break;
+    case -1:
+      if (util::streq_l("set-cookie", kv.name)) {
+        finish(nullptr, true);
+        return;
+      }
+      if (util::streq_l("age", kv.name)) {
+        initial_age_ = std::max(util::parse_uint(kv.value), int64_t{0});
+        continue;
+      }
+      if (util::streq_l("expires", kv.name)) {
+        expires = kv.value;
+      } else if (util::streq_l("etag", kv.name)) {
+        etag_idx_ = headers_.size();
+      } else if (util::streq_l("vary", kv.name)) {
+        for (auto first = std::begin(kv.value), last = std::end(kv.value);;) {
+          auto end = std::find(first, last, ',');
+          auto name = trim_ows(first, end);
+          if (name == StringRef::from_lit("*")) {
+            finish(nullptr, true);
+            return;
+          }
+          if (!name.empty()) {
+            auto pos = vary_buf_.size();
+            vary_buf_.append(std::begin(name), std::end(name));
+            util::inp_strlower(std::begin(vary_buf_) + pos,
+                               std::end(vary_buf_));
+            auto f = req.fs.header(
+                StringRef{vary_buf_.c_str() + pos, name.size()});
+            auto value = f ? f->value : StringRef{};
+            vary_buf_.append(std::begin(value), std::end(value));
+            vary_.push_back(Field{name.size(), value.size(), -1, false});
+          }
+          if (end == last) {
+            break;
+          }
+          first = end + 1;
+        }
+      }
+      break;
+    }
+
+    buf_.append(std::begin(kv.name), std::end(kv.name));
+    buf_.append(std::begin(kv.value), std::end(kv.value));
+    headers_.push_back(
+        Field{kv.name.size(), kv.value.size(), kv.token, kv.no_index});
+  }
+
+  if (cc.no_store || cc.no_cache || cc.is_private) {
+    finish(nullptr, true);
+    return;
+  }
+
+  int64_t lifetime;
+  if (cc.s_maxage != -1) {
+    lifetime = cc.s_maxage;
+  } else if (cc.max_age != -1) {
+    lifetime = cc.max_age;
+  } else if (!expires.empty()) {
+    auto t = util::parse_http_date(expires);
+    auto base = date.empty() ? time(nullptr) : util::parse_http_date(date);
+    lifetime = t == 0 || base == 0 ? 0 : t - base;
+  } else {
+    finish(nullptr, true);
+    return;
+  }
+
+  auto swr = cc.must_revalidate || cc.stale_while_revalidate == -1
+                 ? 0
+                 : cc.stale_while_revalidate;
+  auto fresh = std::max(lifetime - initial_age_, int64_t{0});
+
+  if (fresh == 0 && swr == 0) {
+    finish(nullptr, true);
+    return;
+  }
+
+  http_status_ = resp.http_status;
+  stored_ = std::chrono::steady_clock::now();
+  fresh_until_ = stored_ + std::chrono::seconds(fresh);
+  stale_until_ = fresh_until_ + std::chrono::seconds(swr);
+}
+
+void CacheWriter::on_body(const uint8_t *data, size_t len) {
+  if (done_ || !header_received_) {
+    return;
+  }
+
+  if (body_.size() + len > cache_->get_max_object_size()) {
+    finish(nullptr, true);
+    return;
+  }
+
+  body_.append(data, data + len);
+}
+
+void CacheWriter::on_complete(const Downstream &downstream) {
+  if (done_ || !header_received_) {
+    return;
+  }
+
+  const auto &resp = downstream.response();
+
+  if (resp.fs.content_length != -1 &&
+      static_cast<size_t>(resp.fs.content_length) != body_.size()) {
+    finish(nullptr, false);
+    return;
+  }
+
+  auto entry =
+      cache_->allocate_entry(buf_.size() + vary_buf_.size() + body_.size());
+  if (!entry) {
+    finish(nullptr, false);
+    return;
+  }
+
+  auto p = std::copy(std::begin(buf_), std::end(buf_), entry->data);
+  p = std::copy(std::begin(vary_buf_), std::end(vary_buf_), p);
+  std::copy(std::begin(body_), std::end(body_), p);
+
+  auto s = reinterpret_cast<const char *>(entry->data);
+
+  entry->headers.reserve(headers_.size());
+  for (auto &f : headers_) {
+    auto name = StringRef{s, f.namelen};
+    s += f.namelen;
+    auto value = StringRef{s, f.valuelen};
+    s += f.valuelen;
+    entry->headers.emplace_back(name, value, f.no_index, f.token);
+  }
+
+  entry->vary.reserve(vary_.size());
+  for (auto &f : vary_) {
+    auto name = StringRef{s, f.namelen};
+    s += f.namelen;
+    auto value = StringRef{s, f.valuelen};
+    s += f.valuelen;
+    entry->vary.emplace_back(name, value);
+  }
+
+  entry->body = StringRef{s, body_.size()};
+
+  if (etag_idx_ != -1) {
+    entry->etag = entry->headers[etag_idx_].value;
+  }
+
+  entry->stored = stored_;
+  entry->fresh_until = fresh_until_;
+  entry->stale_until = stale_until_;
+  entry->initial_age = initial_age_;
+  entry->http_status = http_status_;
+
+  finish(std::move(entry), false);
+}
+
+void CacheWriter::finish(std::shared_ptr<CacheEntry> entry, bool pass) {
+  done_ = true;
+
+  cache_->finish_fill(hash_, StringRef{key_}, std::move(entry), pass);
+
+  buf_ = std::string{};
+  vary_buf_ = std::string{};
+  body_ = std::string{};
+  headers_ = std::vector<Field>{};
+  vary_ = std::vector<Field>{};
+}
+
+} // namespace shrpx
@@ -0,0 +1,330 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_RESPONSE_CACHE_H
+#define SHRPX_RESPONSE_CACHE_H
+
+#include "shrpx.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "http2.h"
+#include "template.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+class Worker;
+class Downstream;
+struct Request;
+class ResponseCache;
+
+// The directives of cache-control header field which affect caching.
+struct CacheControl {
+  CacheControl()
+      : max_age(-1),
+        s_maxage(-1),
+        stale_while_revalidate(-1),
+        no_store(false),
+        no_cache(false),
+        is_private(false),
+        must_revalidate(false) {}
+
+  // The values of max-age, s-maxage, and stale-while-revalidate
+  // directives in seconds.  -1 if the directive is not present.
+  int64_t max_age;
+  int64_t s_maxage;
+  int64_t stale_while_revalidate;
+  bool no_store;
+  bool no_cache;
+  bool is_private;
+  // true if must-revalidate or proxy-revalidate is present.
+  bool must_revalidate;
+};
+
+// Parses the value of cache-control header field |value|, and
+// updates |cc|.  Unknown directives are ignored.
+void parse_cache_control(CacheControl &cc, const StringRef &value);
+
+// Returns true if the response to |req| may be served from cache,
+// or stored in it.
+bool cacheable_request(const Request &req);
+
+// Returns the hash of cache key |key|.
+uint64_t cache_key_hash(const StringRef &key);
+
+// CacheArena allocates ranges from the region of fixed size.  It
+// takes the smallest free range which is large enough, and merges
+// adjacent free ranges when a range is released.  This object does
+// not lock anything.
+class CacheArena {
+public:
+  CacheArena(size_t size);
+
+  // Allocates |n| bytes, and returns the offset of the range.  If no
+  // free range is large enough, returns -1.
+  ssize_t allocate(size_t n);
+  // Releases |n| bytes at |offset| returned from allocate().
+  void release(size_t offset, size_t n);
+  // Returns the number of bytes allocated.
+  size_t get_used() const;
+
+private:
+  // Free ranges, offset to length.
+  std::map<size_t, size_t> free_;
+  // Free ranges ordered by (length, offset).
+  std::set<std::pair<size_t, size_t>> free_by_size_;
+  size_t used_;
+};
+
+// CacheEntry is a stored response.  Its header fields and body are
+// placed in the region of ResponseCache, and all members point to
+// it.  The entry is never modified once it is stored, and it is
+// shared by the requests served from it.  The range is released
+// when the last reference goes away.
+struct CacheEntry {
+  CacheEntry(ResponseCache *cache, uint8_t *data, size_t offset, size_t len);
+  ~CacheEntry();
+
+  // Response header fields, except for hop-by-hop ones,
+  // content-length, and age.
+  HeaderRefs headers;
+  // The header fields nominated by vary header field, and their
+  // values in the request the response was stored for.
+  HeaderRefs vary;
+  StringRef body;
+  StringRef etag;
+  // The time when the response was received.
+  std::chrono::steady_clock::time_point stored;
+  // The response is fresh until this time.
+  std::chrono::steady_clock::time_point fresh_until;
+  // After fresh_until, the response may be served until this time
+  // while another request revalidates it.
+  std::chrono::steady_clock::time_point stale_until;
+  // The value of age header field in the response from backend.
+  int64_t initial_age;
+  unsigned int http_status;
+  ResponseCache *cache;
+  uint8_t *data;
+  // The range this entry occupies in the region.
+  size_t offset;
+  size_t len;
+};
+
+// CacheSlot is the index entry for one cache key.
+struct CacheSlot {
+  // The cache key.  Slots are indexed by the hash of key, and when
+  // keys collide, the one which came later is not cached.
+  std::string key;
+  std::shared_ptr<CacheEntry> entry;
+  // The workers which have requests waiting for the response being
+  // fetched.
+  std::vector<Worker *> waiters;
+  // The requests for this key bypass cache until this time, because
+  // the last response was not cacheable.
+  std::chrono::steady_clock::time_point pass_until;
+  // The position in CacheShard::lru.
+  std::list<uint64_t>::iterator lru;
+  // true if a request is fetching the response from backend to store
+  // it.
+  bool filling;
+};
+
+// CacheShard is a part of the index.  Each shard has its own lock.
+struct CacheShard {
+  std::mutex mu;
+  std::unordered_map<uint64_t, CacheSlot> slots;
+  // The hashes of slots, the least recently used first.
+  std::list<uint64_t> lru;
+};
+
+struct CacheStat {
+  // The number of requests served from cache, including stale_hits.
+  std::atomic<uint64_t> hits;
+  // The number of requests served from stale entries.
+  std::atomic<uint64_t> stale_hits;
+  // The number of requests sent to backend to store the response.
+  std::atomic<uint64_t> misses;
+  // The number of times requests waited for the response another
+  // request was fetching.
+  std::atomic<uint64_t> coalesced;
+  // The number of requests sent to backend without using cache.
+  std::atomic<uint64_t> bypasses;
+  // The number of responses stored.
+  std::atomic<uint64_t> stores;
+  // The number of entries evicted to make room.
+  std::atomic<uint64_t> evictions;
+  // The number of entries in cache.
+  std::atomic<uint64_t> num_entries;
+};
+
+enum CacheLookupResult {
+  // The response is served from the entry.
+  CACHE_HIT,
+  // The request is sent to backend, and its response is given to
+  // CacheWriter.
+  CACHE_MISS,
+  // Another request is fetching the response.  The request waits for
+  // CACHE_FILLED worker event.
+  CACHE_WAIT,
+  // The request is sent to backend, and its response is not stored.
+  CACHE_PASS,
+};
+
+// ResponseCache stores the responses from backends, and serves them
+// to later requests.  One object is shared by all worker threads.
+// The index is split into shards, and the lock of a shard is held
+// only while a slot is looked up or updated.  Entries are reference
+// counted, so that they are read without lock.  Entries are placed
+// in the anonymous memory mapping allocated at startup, so that the
+// cache does not grow beyond the configured size, and does not
+// fragment the heap of workers.
+class ResponseCache {
+public:
+  // |size| is the size of the region for entries.  The response
+  // larger than |max_object_size| is not stored.
+  ResponseCache(size_t size, size_t max_object_size);
+  ~ResponseCache();
+
+  // Maps the region.  Returns 0 if it succeeds, or -1.
+  int init();
+
+  // Looks up the response to |req| with cache key |key| whose hash is
+  // |hash|.  If CACHE_HIT is returned, the entry is assigned to
+  // |entry|.  If CACHE_MISS is returned, the caller must call
+  // finish_fill() later.  If CACHE_WAIT is returned, CACHE_FILLED
+  // event is sent to |worker| when the request which fetches the
+  // response finishes.  If |fill| is false, the request neither
+  // fetches nor waits for the response, and CACHE_PASS is returned
+  // instead.  CACHE_PASS is also returned if a new key does not fit
+  // because every slot of its shard is being fetched.
+  CacheLookupResult lookup(std::shared_ptr<CacheEntry> &entry, uint64_t hash,
+                           const StringRef &key, const Request &req,
+                           Worker *worker, bool fill);
+  // Allocates the entry of |len| bytes, evicting the least recently
+  // used entries if necessary.  Returns nullptr if |len| bytes cannot
+  // be allocated.
+  std::shared_ptr<CacheEntry> allocate_entry(size_t len);
+  // Finishes the fetch started by lookup() which returned CACHE_MISS.
+  // If |entry| is not nullptr, it is stored.  Otherwise, if |pass| is
+  // true, the response was not cacheable, and the requests for |key|
+  // bypass cache for a while.  Otherwise, the fetch is abandoned, and
+  // the next request fetches the response again.  The waiting
+  // workers are notified in all cases.
+  void finish_fill(uint64_t hash, const StringRef &key,
+                   std::shared_ptr<CacheEntry> entry, bool pass);
+  // Releases the range allocated for an entry.
+  void release(size_t offset, size_t len);
+
+  size_t get_max_object_size() const;
+  // Returns the number of bytes used by entries.
+  size_t get_used();
+  CacheStat &get_stat();
+
+private:
+  CacheShard &get_shard(uint64_t hash);
+  // Evicts the least recently used entry in one shard, and returns
+  // true if an entry is evicted.
+  bool evict_one();
+  // Removes the least recently used slot of |shard| which nobody is
+  // fetching.  Its entry is moved to |garbage| so that it is released
+  // after the lock is released.  Returns false if every slot is being
+  // fetched.
+  bool remove_lru_slot(CacheShard &shard,
+                       std::vector<std::shared_ptr<CacheEntry>> &garbage);
+
+  std::array<CacheShard, 16> shards_;
+  CacheStat stat_;
+  std::mutex arena_mu_;
+  CacheArena arena_;
+  uint8_t *base_;
+  size_t size_;
+  size_t max_object_size_;
+  // The maximum number of slots in a shard.
+  size_t max_slots_;
+  // The shard evict_one() looks at next.
+  std::atomic<size_t> next_evict_;
+};
+
+// CacheWriter collects the response from backend, and stores it to
+// ResponseCache.  It is created for the request which lookup()
+// returned CACHE_MISS for.  If it is destroyed before the response
+// is stored, the fetch is abandoned so that waiting requests go on.
+class CacheWriter {
+public:
+  CacheWriter(ResponseCache *cache, uint64_t hash, const StringRef &key);
+  ~CacheWriter();
+
+  // Called when the final response header fields are received.
+  void on_header(const Downstream &downstream);
+  // Called when response body |data| of length |len| is received.
+  void on_body(const uint8_t *data, size_t len);
+  // Called when the response is completely received.
+  void on_complete(const Downstream &downstream);
+
+private:
+  void finish(std::shared_ptr<CacheEntry> entry, bool pass);
+
+  // The names and values of header fields to store, concatenated.
+  std::string buf_;
+  // The names of header fields nominated by vary header field, and
+  // their values in the request, concatenated.
+  std::string vary_buf_;
+  struct Field {
+    size_t namelen;
+    size_t valuelen;
+    int32_t token;
+    bool no_index;
+  };
+  std::vector<Field> headers_;
+  std::vector<Field> vary_;
+  std::string body_;
+  std::string key_;
+  ResponseCache *cache_;
+  std::chrono::steady_clock::time_point stored_;
+  std::chrono::steady_clock::time_point fresh_until_;
+  std::chrono::steady_clock::time_point stale_until_;
+  uint64_t hash_;
+  int64_t initial_age_;
+  // The index of etag header field in headers_, or -1.
+  ssize_t etag_idx_;
+  unsigned int http_status_;
+  bool header_received_;
+  bool done_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_RESPONSE_CACHE_H
@@ -0,0 +1,335 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_response_cache_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_response_cache.h"
+#include "shrpx_downstream.h"
+#include "util.h"
+
+namespace shrpx {
+
+void test_shrpx_response_cache_parse_cache_control(void) {
+  {
+    CacheControl cc;
+    parse_cache_control(cc, StringRef::from_lit(""));
+
+    CU_ASSERT(-1 == cc.max_age);
+    CU_ASSERT(-1 == cc.s_maxage);
+    CU_ASSERT(-1 == cc.stale_while_revalidate);
+    CU_ASSERT(!cc.no_store);
+    CU_ASSERT(!cc.no_cache);
+    CU_ASSERT(!cc.is_private);
+    CU_ASSERT(!cc.must_revalidate);
+  }
+  {
+    CacheControl cc;
+    parse_cache_control(
+        cc, StringRef::from_lit(
+                "public, Max-Age=60 ,s-maxage=\"120\", "
+                "stale-while-revalidate=30,proxy-revalidate"));
+
+    CU_ASSERT(60 == cc.max_age);
+    CU_ASSERT(120 == cc.s_maxage);
+    CU_ASSERT(30 == cc.stale_while_revalidate);
+    CU_ASSERT(cc.must_revalidate);
+    CU_ASSERT(!cc.no_store);
+  }
+  {
+    CacheControl cc;
+    parse_cache_control(cc, StringRef::from_lit("no-store,private"));
+    parse_cache_control(cc, StringRef::from_lit("no-cache=\"set-cookie\""));
+
+    CU_ASSERT(cc.no_store);
+    CU_ASSERT(cc.is_private);
+    CU_ASSERT(cc.no_cache);
+  }
+  {
+    // Invalid max-age makes the response stale.
+    CacheControl cc;
+    parse_cache_control(cc, StringRef::from_lit("max-age=foo"));
+
+    CU_ASSERT(0 == cc.max_age);
+  }
+}
+
+void test_shrpx_response_cache_cacheable_request(void) {
+  {
+    Downstream d(nullptr, nullptr, 0);
+    auto &req = d.request();
+    req.method = HTTP_GET;
+
+    CU_ASSERT(cacheable_request(req));
+
+    req.method = HTTP_HEAD;
+
+    CU_ASSERT(cacheable_request(req));
+
+    req.method = HTTP_POST;
+
+    CU_ASSERT(!cacheable_request(req));
+  }
+  {
+    Downstream d(nullptr, nullptr, 0);
+    auto &req = d.request();
+    req.method = HTTP_GET;
+    req.fs.add_header_token(StringRef::from_lit("authorization"),
+                            StringRef::from_lit("Basic Zm9vOmJhcg=="), false,
+                            -1);
+
+    CU_ASSERT(!cacheable_request(req));
+  }
+  {
+    Downstream d(nullptr, nullptr, 0);
+    auto &req = d.request();
+    req.method = HTTP_GET;
+    req.fs.add_header_token(StringRef::from_lit("cache-control"),
+                            StringRef::from_lit("max-age=0"), false,
+                            http2::HD_CACHE_CONTROL);
+
+    CU_ASSERT(!cacheable_request(req));
+  }
+  {
+    Downstream d(nullptr, nullptr, 0);
+    auto &req = d.request();
+    req.method = HTTP_GET;
+    req.fs.add_header_token(StringRef::from_lit("pragma"),
+                            StringRef::from_lit("no-cache"), false, -1);
+
+    CU_ASSERT(!cacheable_request(req));
+  }
+}
+
+void test_shrpx_response_cache_arena(void) {
+  CacheArena arena(1024);
+
+  auto a = arena.allocate(100);
+  auto b = arena.allocate(200);
+  auto c = arena.allocate(300);
+
+  CU_ASSERT(0 == a);
+  CU_ASSERT(104 == b);
+  CU_ASSERT(304 == c);
+  CU_ASSERT(608 == arena.get_used());
+  CU_ASSERT(-1 == arena.allocate(1024));
+
+  arena.release(b, 200);
+
+  // The smallest free range which is large enough is taken.
+  CU_ASSERT(104 == arena.allocate(150));
+
+  arena.release(104, 150);
+  arena.release(a, 100);
+  arena.release(c, 300);
+
+  // All ranges are merged.
+  CU_ASSERT(0 == arena.get_used());
+  CU_ASSERT(0 == arena.allocate(1024));
+}
+
+namespace {
+void set_cacheable_response(Downstream &d, const StringRef &cache_control) {
+  auto &resp = d.response();
+  resp.http_status = 200;
+  resp.fs.add_header_token(StringRef::from_lit("cache-control"), cache_control,
+                           false, http2::HD_CACHE_CONTROL);
+  resp.fs.add_header_token(StringRef::from_lit("etag"),
+                           StringRef::from_lit("\"alpha\""), false, -1);
+  resp.fs.add_header_token(StringRef::from_lit("connection"),
+                           StringRef::from_lit("close"), false,
+                           http2::HD_CONNECTION);
+  resp.fs.add_header_token(StringRef::from_lit("vary"),
+                           StringRef::from_lit("Accept-Encoding"), false, -1);
+}
+} // namespace
+
+void test_shrpx_response_cache_lookup(void) {
+  ResponseCache cache(64 * 1024, 1024);
+
+  CU_ASSERT(0 == cache.init());
+
+  auto key = StringRef::from_lit("0 nghttp2.org/");
+  auto hash = cache_key_hash(key);
+  std::shared_ptr<CacheEntry> entry;
+
+  Downstream d(nullptr, nullptr, 0);
+  auto &req = d.request();
+  req.method = HTTP_GET;
+  req.fs.add_header_token(StringRef::from_lit("accept-encoding"),
+                          StringRef::from_lit("gzip"), false,
+                          http2::HD_ACCEPT_ENCODING);
+
+  CU_ASSERT(CACHE_MISS == cache.lookup(entry, hash, key, req, nullptr, true));
+  // The other requests wait for the response being fetched.
+  CU_ASSERT(CACHE_WAIT == cache.lookup(entry, hash, key, req, nullptr, true));
+  // HEAD request neither fetches nor waits.
+  CU_ASSERT(CACHE_PASS == cache.lookup(entry, hash, key, req, nullptr, false));
+
+  {
+    CacheWriter writer(&cache, hash, key);
+    set_cacheable_response(d, StringRef::from_lit("max-age=60"));
+
+    writer.on_header(d);
+    writer.on_body(reinterpret_cast<const uint8_t *>("hello"), 5);
+    writer.on_body(reinterpret_cast<const uint8_t *>(" world"), 6);
+    writer.on_complete(d);
+  }
+
+  CU_ASSERT(CACHE_HIT == cache.lookup(entry, hash, key, req, nullptr, true));
+  CU_ASSERT(nullptr != entry);
+  CU_ASSERT(200 == entry->http_status);
+  CU_ASSERT("hello world" == entry->body);
+  CU_ASSERT("\"alpha\"" == entry->etag);
+  // connection header field is not stored.
+  CU_ASSERT(3 == entry->headers.size());
+  CU_ASSERT(1 == entry->vary.size());
+  CU_ASSERT("accept-encoding" == entry->vary[0].name);
+  CU_ASSERT("gzip" == entry->vary[0].value);
+  CU_ASSERT(1 == cache.get_stat().num_entries);
+  CU_ASSERT(1 == cache.get_stat().stores);
+
+  entry.reset();
+
+  {
+    // The request with different accept-encoding does not match.
+    Downstream d2(nullptr, nullptr, 0);
+    auto &req2 = d2.request();
+    req2.method = HTTP_GET;
+
+    CU_ASSERT(CACHE_MISS ==
+              cache.lookup(entry, hash, key, req2, nullptr, true));
+
+    // Abandoned fetch keeps the existing entry.
+    cache.finish_fill(hash, key, nullptr, false);
+
+    CU_ASSERT(CACHE_HIT == cache.lookup(entry, hash, key, req, nullptr, true));
+    CU_ASSERT(nullptr != entry);
+
+    entry.reset();
+  }
+
+  {
+    // Uncacheable response makes the requests bypass cache.
+    auto key2 = StringRef::from_lit("0 nghttp2.org/private");
+    auto hash2 = cache_key_hash(key2);
+
+    CU_ASSERT(CACHE_MISS ==
+              cache.lookup(entry, hash2, key2, req, nullptr, true));
+
+    Downstream d2(nullptr, nullptr, 0);
+    d2.request().method = HTTP_GET;
+
+    {
+      CacheWriter writer(&cache, hash2, key2);
+      set_cacheable_response(d2, StringRef::from_lit("private, max-age=60"));
+
+      writer.on_header(d2);
+    }
+
+    CU_ASSERT(CACHE_PASS ==
+              cache.lookup(entry, hash2, key2, req, nullptr, true));
+  }
+
+  {
+    // The response larger than max object size is not stored.
+    auto key3 = StringRef::from_lit("0 nghttp2.org/large");
+    auto hash3 = cache_key_hash(key3);
+
+    CU_ASSERT(CACHE_MISS ==
+              cache.lookup(entry, hash3, key3, req, nullptr, true));
+
+    Downstream d3(nullptr, nullptr, 0);
+    d3.request().method = HTTP_GET;
+
+    CacheWriter writer(&cache, hash3, key3);
+    set_cacheable_response(d3, StringRef::from_lit("max-age=60"));
+
+    writer.on_header(d3);
+
+    std::string body(1025, 'a');
+    writer.on_body(reinterpret_cast<const uint8_t *>(body.c_str()),
+                   body.size());
+    writer.on_complete(d3);
+
+    CU_ASSERT(CACHE_PASS ==
+              cache.lookup(entry, hash3, key3, req, nullptr, true));
+    CU_ASSERT(1 == cache.get_stat().stores);
+  }
+}
+
+void test_shrpx_response_cache_max_slots(void) {
+  // 64 slots per shard.
+  ResponseCache cache(64 * 1024, 1024);
+
+  CU_ASSERT(0 == cache.init());
+
+  std::shared_ptr<CacheEntry> entry;
+
+  Downstream d(nullptr, nullptr, 0);
+  auto &req = d.request();
+  req.method = HTTP_GET;
+
+  // Collect the keys which fall into the same shard.
+  std::vector<std::string> keys;
+  uint64_t shard = 0;
+  for (size_t i = 0; keys.size() < 66; ++i) {
+    auto key = "0 nghttp2.org/" + util::utos(i);
+    auto hash = cache_key_hash(StringRef{key});
+    if (keys.empty()) {
+      shard = (hash >> 32) % 16;
+    } else if ((hash >> 32) % 16 != shard) {
+      continue;
+    }
+    keys.push_back(std::move(key));
+  }
+
+  for (size_t i = 0; i < 64; ++i) {
+    auto key = StringRef{keys[i]};
+    CU_ASSERT(CACHE_MISS == cache.lookup(entry, cache_key_hash(key), key, req,
+                                         nullptr, true));
+  }
+
+  // Every slot is being fetched, and the new key does not get a slot.
+  auto key = StringRef{keys[64]};
+  auto hash = cache_key_hash(key);
+
+  CU_ASSERT(CACHE_PASS == cache.lookup(entry, hash, key, req, nullptr, true));
+  CU_ASSERT(1 == cache.get_stat().bypasses);
+
+  // Once one fetch finishes, its slot is reused.
+  auto key0 = StringRef{keys[0]};
+  cache.finish_fill(cache_key_hash(key0), key0, nullptr, false);
+
+  CU_ASSERT(CACHE_MISS == cache.lookup(entry, hash, key, req, nullptr, true));
+
+  key = StringRef{keys[65]};
+
+  CU_ASSERT(CACHE_PASS == cache.lookup(entry, cache_key_hash(key), key, req,
+                                       nullptr, true));
+  CU_ASSERT(2 == cache.get_stat().bypasses);
+}
+
+} // namespace shrpx
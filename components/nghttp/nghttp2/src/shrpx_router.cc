@@ -26,141 +26,262 @@
 
 #include <algorithm>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
 #include "shrpx_config.h"
 #include "shrpx_log.h"
 
 namespace shrpx {
 
-RNode::RNode() : s(nullptr), len(0), index(-1), wildcard_index(-1) {}
+RNode::RNode()
+    : s(nullptr),
+      len(0),
+      next_first(0),
+      next_len(0),
+      next_cap(0),
+      index(-1),
+      wildcard_index(-1) {}
+
+RNode::RNode(const char *s, size_t len)
+    : s(s),
+      len(len),
+      next_first(0),
+      next_len(0),
+      next_cap(0),
+      index(-1),
+      wildcard_index(-1) {}
+
+Router::Router()
+    : balloc_(1024, 1024), nodes_(1), next_chars_(16), num_hosts_(0) {}
 
-RNode::RNode(const char *s, size_t len, ssize_t index, ssize_t wildcard_index)
-    : s(s), len(len), index(index), wildcard_index(wildcard_index) {}
+Router::~Router() {}
 
-Router::Router() : balloc_(1024, 1024), root_{} {}
+ssize_t Router::find_next(const RNode &node, char c) const {
+  auto chars = next_chars_.data() + node.next_first;
+  auto n = node.next_len;
 
-Router::~Router() {}
+#ifdef __SSE2__
+  // For a few children, the byte by byte comparison is faster.
+  if (n > 8) {
+    auto key = _mm_set1_epi8(c);
 
-namespace {
-RNode *find_next_node(const RNode *node, char c) {
-  auto itr = std::lower_bound(std::begin(node->next), std::end(node->next), c,
-                              [](const std::unique_ptr<RNode> &lhs,
-                                 const char c) { return lhs->s[0] < c; });
-  if (itr == std::end(node->next) || (*itr)->s[0] != c) {
-    return nullptr;
+    for (uint32_t i = 0; i < n; i += 16) {
+      auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(chars + i));
+      uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(x, key));
+      if (n - i < 16) {
+        mask &= (1u << (n - i)) - 1;
+      }
+      if (mask) {
+        return node.next_first + i + __builtin_ctz(mask);
+      }
+    }
+
+    return -1;
   }
+#endif // __SSE2__
 
-  return (*itr).get();
-}
-} // namespace
+  for (uint32_t i = 0; i < n; ++i) {
+    if (chars[i] == c) {
+      return node.next_first + i;
+    }
+  }
 
-namespace {
-void add_next_node(RNode *node, std::unique_ptr<RNode> new_node) {
-  auto itr = std::lower_bound(std::begin(node->next), std::end(node->next),
-                              new_node->s[0],
-                              [](const std::unique_ptr<RNode> &lhs,
-                                 const char c) { return lhs->s[0] < c; });
-  node->next.insert(itr, std::move(new_node));
+  return -1;
 }
-} // namespace
 
-void Router::add_node(RNode *node, const char *pattern, size_t patlen,
-                      ssize_t index, ssize_t wildcard_index) {
-  auto pat = make_string_ref(balloc_, StringRef{pattern, patlen});
-  auto new_node =
-      make_unique<RNode>(pat.c_str(), pat.size(), index, wildcard_index);
-  add_next_node(node, std::move(new_node));
+const RNode *Router::find_next_node(const RNode &node, char c) const {
+  auto pos = find_next(node, c);
+  if (pos == -1) {
+    return nullptr;
+  }
+
+  return &nodes_[next_nodes_[pos]];
 }
 
-size_t Router::add_route(const StringRef &pattern, size_t idx, bool wildcard) {
-  ssize_t index = -1, wildcard_index = -1;
-  if (wildcard) {
-    wildcard_index = idx;
-  } else {
-    index = idx;
+void Router::add_next_node(uint32_t node, uint32_t child) {
+  auto &nd = nodes_[node];
+
+  if (nd.next_len == nd.next_cap) {
+    // Move the children to the end, leaving the old space unused.
+    auto first = static_cast<uint32_t>(next_nodes_.size());
+    auto cap = std::max(nd.next_cap * 2, 2u);
+
+    next_chars_.resize(first + cap + 16);
+    next_nodes_.resize(first + cap);
+
+    std::copy_n(std::begin(next_chars_) + nd.next_first, nd.next_len,
+                std::begin(next_chars_) + first);
+    std::copy_n(std::begin(next_nodes_) + nd.next_first, nd.next_len,
+                std::begin(next_nodes_) + first);
+
+    nd.next_first = first;
+    nd.next_cap = cap;
   }
 
-  auto node = &root_;
+  next_chars_[nd.next_first + nd.next_len] = nodes_[child].s[0];
+  next_nodes_[nd.next_first + nd.next_len] = child;
+  ++nd.next_len;
+}
+
+uint32_t Router::add_node(const char *s, size_t len) {
+  nodes_.emplace_back(s, len);
+  return nodes_.size() - 1;
+}
+
+uint32_t Router::insert(const StringRef &pattern) {
+  uint32_t node = 0;
   size_t i = 0;
 
   for (;;) {
-    auto next_node = find_next_node(node, pattern[i]);
-    if (next_node == nullptr) {
-      add_node(node, pattern.c_str() + i, pattern.size() - i, index,
-               wildcard_index);
-      return idx;
+    if (i == pattern.size()) {
+      return node;
     }
 
-    node = next_node;
+    auto pos = find_next(nodes_[node], pattern[i]);
+    if (pos == -1) {
+      auto pat = make_string_ref(
+          balloc_, StringRef{pattern.c_str() + i, pattern.size() - i});
+      auto new_node = add_node(pat.c_str(), pat.size());
+      add_next_node(node, new_node);
+      return new_node;
+    }
+
+    auto next = next_nodes_[pos];
+    const auto &nd = nodes_[next];
 
-    auto slen = pattern.size() - i;
     auto s = pattern.c_str() + i;
-    auto n = std::min(node->len, slen);
+    auto n = std::min(static_cast<size_t>(nd.len), pattern.size() - i);
     size_t j;
-    for (j = 0; j < n && node->s[j] == s[j]; ++j)
+    for (j = 0; j < n && nd.s[j] == s[j]; ++j)
       ;
-    if (j == n) {
-      // The common prefix was matched
-      if (slen == node->len) {
-        // Complete match
-        if (index != -1) {
-          if (node->index != -1) {
-            // Return the existing index for duplicates.
-            return node->index;
-          }
-          node->index = index;
-          return idx;
-        }
 
-        assert(wildcard_index != -1);
+    if (j < nd.len) {
+      // next must be split into 2 nodes.  The new node for the first
+      // half takes the place of next, and next becomes its child.
+      auto prefix = add_node(nodes_[next].s, j);
 
-        if (node->wildcard_index != -1) {
-          return node->wildcard_index;
-        }
-        node->wildcard_index = wildcard_index;
-        return idx;
-      }
+      auto &suffix = nodes_[next];
+      suffix.s += j;
+      suffix.len -= j;
 
-      if (slen > node->len) {
-        // We still have pattern to add
-        i += j;
+      next_nodes_[pos] = prefix;
+      add_next_node(prefix, next);
 
-        continue;
-      }
+      next = prefix;
     }
 
-    if (node->len > j) {
-      // node must be split into 2 nodes.  new_node is now the child
-      // of node.
-      auto new_node = make_unique<RNode>(&node->s[j], node->len - j,
-                                         node->index, node->wildcard_index);
-      std::swap(node->next, new_node->next);
+    node = next;
+    i += j;
+  }
+}
 
-      node->len = j;
-      node->index = -1;
-      node->wildcard_index = -1;
+namespace {
+// Hashes |s| 8 bytes at a time.  Host names are usually short, and
+// this is faster than hashing byte by byte.
+uint32_t hash_host(const StringRef &s) {
+  uint64_t h = 0xcbf29ce484222325ull ^ s.size();
+  auto p = s.byte();
+  auto n = s.size();
+
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
+  }
 
-      add_next_node(node, std::move(new_node));
+  if (n) {
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ w) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
+  }
 
-      if (slen == j) {
-        node->index = index;
-        node->wildcard_index = wildcard_index;
-        return idx;
+  return h;
+}
+} // namespace
+
+size_t Router::find_host(const StringRef &host, uint32_t hash) const {
+  auto mask = hosts_.size() - 1;
+
+  for (auto i = hash & mask;; i = (i + 1) & mask) {
+    auto &ent = hosts_[i];
+    if (ent.host.empty() || (ent.hash == hash && ent.host == host)) {
+      return i;
+    }
+  }
+}
+
+void Router::add_host(const StringRef &host, uint32_t node) {
+  if ((num_hosts_ + 1) * 2 > hosts_.size()) {
+    auto hosts = std::vector<RHost>(std::max(hosts_.size() * 2, size_t{16}));
+    hosts.swap(hosts_);
+    for (auto &ent : hosts) {
+      if (!ent.host.empty()) {
+        hosts_[find_host(ent.host, ent.hash)] = ent;
       }
     }
+  }
 
-    i += j;
+  auto hash = hash_host(host);
+  auto &ent = hosts_[find_host(host, hash)];
+  if (!ent.host.empty()) {
+    return;
+  }
 
-    assert(pattern.size() > i);
-    add_node(node, pattern.c_str() + i, pattern.size() - i, index,
-             wildcard_index);
+  ent.host = make_string_ref(balloc_, host);
+  ent.hash = hash;
+  ent.node = node;
 
-    return idx;
+  ++num_hosts_;
+}
+
+const RNode *Router::match_host(const StringRef &host) const {
+  if (hosts_.empty()) {
+    return nullptr;
+  }
+
+  auto &ent = hosts_[find_host(host, hash_host(host))];
+  if (ent.host.empty()) {
+    return nullptr;
   }
+
+  return &nodes_[ent.node];
 }
 
-namespace {
-const RNode *match_complete(size_t *offset, const RNode *node,
-                            const char *first, const char *last) {
+size_t Router::add_route(const StringRef &pattern, size_t idx, bool wildcard) {
+  auto &node = nodes_[insert(pattern)];
+
+  if (wildcard) {
+    if (node.wildcard_index != -1) {
+      return node.wildcard_index;
+    }
+    node.wildcard_index = idx;
+  } else {
+    if (node.index != -1) {
+      // Return the existing index for duplicates.
+      return node.index;
+    }
+    node.index = idx;
+  }
+
+  auto host = StringRef{std::begin(pattern),
+                        std::find(std::begin(pattern), std::end(pattern), '/')};
+  if (!host.empty()) {
+    // This may split nodes, but does not change the node which ends
+    // at the end of pattern.
+    add_host(host, insert(host));
+  }
+
+  return idx;
+}
+
+const RNode *Router::match_complete(size_t *offset, const char *first,
+                                    const char *last) const {
+  auto node = &nodes_[0];
+
   *offset = 0;
 
   if (first == last) {
@@ -170,14 +291,15 @@ const RNode *match_complete(size_t *offset, const RNode *node,
   auto p = first;
 
   for (;;) {
-    auto next_node = find_next_node(node, *p);
+    auto next_node = find_next_node(*node, *p);
     if (next_node == nullptr) {
       return nullptr;
     }
 
     node = next_node;
 
-    auto n = std::min(node->len, static_cast<size_t>(last - p));
+    auto n = std::min(static_cast<size_t>(node->len),
+                      static_cast<size_t>(last - p));
     if (memcmp(node->s, p, n) != 0) {
       return nullptr;
     }
@@ -188,11 +310,10 @@ const RNode *match_complete(size_t *offset, const RNode *node,
     }
   }
 }
-} // namespace
 
-namespace {
-const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
-                           size_t offset, const char *first, const char *last) {
+const RNode *Router::match_partial(bool *pattern_is_wildcard,
+                                   const RNode *node, size_t offset,
+                                   const char *first, const char *last) const {
   *pattern_is_wildcard = false;
 
   if (first == last) {
@@ -207,7 +328,8 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
   const RNode *found_node = nullptr;
 
   if (offset > 0) {
-    auto n = std::min(node->len - offset, static_cast<size_t>(last - first));
+    auto n = std::min(static_cast<size_t>(node->len - offset),
+                      static_cast<size_t>(last - first));
     if (memcmp(node->s + offset, first, n) != 0) {
       return nullptr;
     }
@@ -243,14 +365,15 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
   }
 
   for (;;) {
-    auto next_node = find_next_node(node, *p);
+    auto next_node = find_next_node(*node, *p);
     if (next_node == nullptr) {
       return found_node;
     }
 
     node = next_node;
 
-    auto n = std::min(node->len, static_cast<size_t>(last - p));
+    auto n = std::min(static_cast<size_t>(node->len),
+                      static_cast<size_t>(last - p));
     if (memcmp(node->s, p, n) != 0) {
       return found_node;
     }
@@ -295,21 +418,34 @@ const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
     assert(node->len == n);
   }
 }
-} // namespace
 
 ssize_t Router::match(const StringRef &host, const StringRef &path) const {
   const RNode *node;
   size_t offset;
 
-  node = match_complete(&offset, &root_, std::begin(host), std::end(host));
-  if (node == nullptr) {
-    return -1;
+  if (host.empty()) {
+    node = &nodes_[0];
+    offset = 0;
+  } else {
+    node = match_host(host);
+    if (node) {
+      offset = node->len;
+    } else if (!path.empty() && path[0] == '/') {
+      // Since host part of pattern ends before the first '/', it must
+      // be found in hosts_ for the match.
+      return -1;
+    } else {
+      node = match_complete(&offset, std::begin(host), std::end(host));
+      if (node == nullptr) {
+        return -1;
+      }
+    }
   }
 
   bool pattern_is_wildcard;
   node = match_partial(&pattern_is_wildcard, node, offset, std::begin(path),
                        std::end(path));
-  if (node == nullptr || node == &root_) {
+  if (node == nullptr || node == &nodes_[0]) {
     return -1;
   }
 
@@ -320,7 +456,7 @@ ssize_t Router::match(const StringRef &s) const {
   const RNode *node;
   size_t offset;
 
-  node = match_complete(&offset, &root_, std::begin(s), std::end(s));
+  node = match_complete(&offset, std::begin(s), std::end(s));
   if (node == nullptr) {
     return -1;
   }
@@ -332,9 +468,8 @@ ssize_t Router::match(const StringRef &s) const {
   return node->index;
 }
 
-namespace {
-const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
-                          const char *last) {
+const RNode *Router::match_prefix(size_t *nread, const RNode *node,
+                                  const char *first, const char *last) const {
   if (first == last) {
     return nullptr;
   }
@@ -342,14 +477,15 @@ const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
   auto p = first;
 
   for (;;) {
-    auto next_node = find_next_node(node, *p);
+    auto next_node = find_next_node(*node, *p);
     if (next_node == nullptr) {
       return nullptr;
     }
 
     node = next_node;
 
-    auto n = std::min(node->len, static_cast<size_t>(last - p));
+    auto n = std::min(static_cast<size_t>(node->len),
+                      static_cast<size_t>(last - p));
     if (memcmp(node->s, p, n) != 0) {
       return nullptr;
     }
@@ -372,16 +508,14 @@ const RNode *match_prefix(size_t *nread, const RNode *node, const char *first,
     return nullptr;
   }
 }
-} // namespace
 
 ssize_t Router::match_prefix(size_t *nread, const RNode **last_node,
                              const StringRef &s) const {
   if (*last_node == nullptr) {
-    *last_node = &root_;
+    *last_node = &nodes_[0];
   }
 
-  auto node =
-      ::shrpx::match_prefix(nread, *last_node, std::begin(s), std::end(s));
+  auto node = match_prefix(nread, *last_node, std::begin(s), std::end(s));
   if (node == nullptr) {
     return -1;
   }
@@ -391,16 +525,14 @@ ssize_t Router::match_prefix(size_t *nread, const RNode **last_node,
   return node->index;
 }
 
-namespace {
-void dump_node(const RNode *node, int depth) {
-  fprintf(stderr, "%*ss='%.*s', len=%zu, index=%zd\n", depth, "",
-          (int)node->len, node->s, node->len, node->index);
-  for (auto &nd : node->next) {
-    dump_node(nd.get(), depth + 4);
+void Router::dump_node(const RNode &node, int depth) const {
+  fprintf(stderr, "%*ss='%.*s', len=%u, index=%zd\n", depth, "",
+          (int)node.len, node.s, node.len, node.index);
+  for (uint32_t i = 0; i < node.next_len; ++i) {
+    dump_node(nodes_[next_nodes_[node.next_first + i]], depth + 4);
   }
 }
-} // namespace
 
-void Router::dump() const { dump_node(&root_, 0); }
+void Router::dump() const { dump_node(nodes_[0], 0); }
 
 } // namespace shrpx
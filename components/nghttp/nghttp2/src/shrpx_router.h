@@ -31,6 +31,7 @@
 #include <memory>
 
 #include "allocator.h"
+#include "template.h"
 
 using namespace nghttp2;
 
@@ -38,19 +39,21 @@ namespace shrpx {
 
 struct RNode {
   RNode();
-  RNode(const char *s, size_t len, ssize_t index, ssize_t wildcard_index);
-  RNode(RNode &&) = default;
-  RNode(const RNode &) = delete;
-  RNode &operator=(RNode &&) = default;
-  RNode &operator=(const RNode &) = delete;
+  RNode(const char *s, size_t len);
 
-  // Next RNode, sorted by s[0].
-  std::vector<std::unique_ptr<RNode>> next;
   // Stores pointer to the string this node represents.  Not
   // NULL-terminated.
   const char *s;
   // Length of |s|
-  size_t len;
+  uint32_t len;
+  // Position of the first child in Router::next_chars_ and
+  // Router::next_nodes_.  The children of a node are stored
+  // contiguously there.
+  uint32_t next_first;
+  // The number of children.
+  uint32_t next_len;
+  // The number of children which can be stored from |next_first|.
+  uint32_t next_cap;
   // Index of pattern if match ends in this node.  Note that we don't
   // store duplicated pattern.
   ssize_t index;
@@ -60,6 +63,16 @@ struct RNode {
   ssize_t wildcard_index;
 };
 
+// The entry of the host index of Router.
+struct RHost {
+  // The host part of pattern.  It is empty if this entry is unused.
+  StringRef host;
+  // The hash value of |host|.
+  uint32_t hash;
+  // The node which ends with |host|.
+  uint32_t node;
+};
+
 class Router {
 public:
   Router();
@@ -93,16 +106,58 @@ public:
   ssize_t match_prefix(size_t *nread, const RNode **last_node,
                        const StringRef &s) const;
 
-  void add_node(RNode *node, const char *pattern, size_t patlen, ssize_t index,
-                ssize_t wildcard_index);
-
   void dump() const;
 
 private:
+  // Returns the position of the child of |node| whose string starts
+  // with |c| in next_chars_ and next_nodes_, or -1.
+  ssize_t find_next(const RNode &node, char c) const;
+  const RNode *find_next_node(const RNode &node, char c) const;
+  void add_next_node(uint32_t node, uint32_t child);
+  uint32_t add_node(const char *s, size_t len);
+  // Returns the node which ends at the end of |pattern|.  The nodes
+  // are added or split as needed.
+  uint32_t insert(const StringRef &pattern);
+  const RNode *match_complete(size_t *offset, const char *first,
+                              const char *last) const;
+  const RNode *match_partial(bool *pattern_is_wildcard, const RNode *node,
+                             size_t offset, const char *first,
+                             const char *last) const;
+  const RNode *match_prefix(size_t *nread, const RNode *node,
+                            const char *first, const char *last) const;
+  void dump_node(const RNode &node, int depth) const;
+  // Returns the position of |host| whose hash value is |hash| in
+  // hosts_, or the position of the unused entry if it is not found.
+  size_t find_host(const StringRef &host, uint32_t hash) const;
+  void add_host(const StringRef &host, uint32_t node);
+  // Returns the node which ends with |host| if |host| is the host
+  // part of any pattern, or nullptr.
+  const RNode *match_host(const StringRef &host) const;
+
   BlockAllocator balloc_;
-  // The root node of Patricia tree.  This is special node and its s
-  // field is nulptr, and len field is 0.
-  RNode root_;
+  // All nodes of Patricia tree.  The first node is the root node.
+  // This is special node and its s field is nullptr, and len field
+  // is 0.  A node is never moved to other position, and the string
+  // which a node represents always ends at the same position of
+  // pattern, even if the node is split, since the split makes the
+  // new node for the first half.
+  std::vector<RNode> nodes_;
+  // The first characters of the children.  The children of a node
+  // are looked up here with SIMD instructions if available.  16
+  // bytes are always appended at the end so that reading 16 bytes
+  // at once does not go beyond the end.
+  std::vector<char> next_chars_;
+  // The position of the children in nodes_, which correspond to
+  // next_chars_.
+  std::vector<uint32_t> next_nodes_;
+  // Hash table from the host part of pattern (the part before the
+  // first '/', or the whole pattern if it has no '/') to the node
+  // which ends with it.  match(const StringRef&, const StringRef&)
+  // starts matching path from there.  This is open addressing with
+  // linear probing, and its size is power of 2.
+  std::vector<RHost> hosts_;
+  // The number of used entries in hosts_.
+  size_t num_hosts_;
 };
 
 } // namespace shrpx
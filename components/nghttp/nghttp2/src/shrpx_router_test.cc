@@ -24,6 +24,8 @@
  */
 #include "shrpx_router_test.h"
 
+#include <string>
+
 #include <CUnit/CUnit.h>
 
 #include "shrpx_router.h"
@@ -180,4 +182,84 @@ void test_shrpx_router_match_prefix(void) {
   CU_ASSERT(6 == nread);
 }
 
+void test_shrpx_router_match_many(void) {
+  // Many nodes have more than 16 children, so that the lookup of the
+  // child spans several chunks.
+  auto chars = StringRef::from_lit(
+      "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ");
+  constexpr size_t nhosts = 200;
+
+  std::vector<std::string> hosts;
+  for (size_t i = 0; i < nhosts; ++i) {
+    hosts.push_back(chars[i % chars.size()] + std::to_string(i) +
+                    ".example.com");
+  }
+
+  Router router;
+  size_t idx = 0;
+
+  // For each host, pattern host + "/" + c + "/" gets index idx, and
+  // host + "/" + c + "/file" gets index idx + 1.
+  for (auto &host : hosts) {
+    for (auto c : chars) {
+      auto dir = host + '/' + c + '/';
+      CU_ASSERT(idx == router.add_route(StringRef{dir}, idx));
+      auto file = dir + "file";
+      CU_ASSERT(idx + 1 == router.add_route(StringRef{file}, idx + 1));
+      idx += 2;
+    }
+  }
+
+  // Patterns without host part
+  auto static_idx = idx;
+  for (auto c : chars) {
+    auto path = std::string{"/static/"} + c + '/';
+    CU_ASSERT(idx == router.add_route(StringRef{path}, idx));
+    ++idx;
+  }
+
+  // Duplicates return the existing index.
+  CU_ASSERT(0 == router.add_route(StringRef{hosts[0] + "/0/"}, idx));
+
+  idx = 0;
+  for (auto &host : hosts) {
+    auto h = StringRef{host};
+    for (auto c : chars) {
+      auto dir = std::string{"/"} + c + '/';
+      CU_ASSERT(static_cast<ssize_t>(idx) == router.match(h, StringRef{dir}));
+      CU_ASSERT(static_cast<ssize_t>(idx) ==
+                router.match(h, StringRef{dir.substr(0, 2)}));
+      CU_ASSERT(static_cast<ssize_t>(idx) ==
+                router.match(h, StringRef{dir + "other"}));
+      CU_ASSERT(static_cast<ssize_t>(idx + 1) ==
+                router.match(h, StringRef{dir + "file"}));
+      CU_ASSERT(static_cast<ssize_t>(idx) ==
+                router.match(h, StringRef{dir + "file/"}));
+      CU_ASSERT(static_cast<ssize_t>(idx) ==
+                router.match(h, StringRef{dir + "files"}));
+      idx += 2;
+    }
+
+    CU_ASSERT(-1 == router.match(h, StringRef::from_lit("/")));
+    CU_ASSERT(-1 == router.match(h, StringRef::from_lit("/!/")));
+    CU_ASSERT(-1 == router.match(h, StringRef::from_lit("/static/0/")));
+    CU_ASSERT(-1 == router.match(StringRef{host.substr(0, host.size() - 1)},
+                                 StringRef::from_lit("/0/")));
+    CU_ASSERT(-1 == router.match(StringRef{host + 'm'},
+                                 StringRef::from_lit("/0/")));
+  }
+
+  for (size_t i = 0; i < chars.size(); ++i) {
+    auto path = std::string{"/static/"} + chars[i] + "/a";
+    CU_ASSERT(static_cast<ssize_t>(static_idx + i) ==
+              router.match(StringRef{}, StringRef{path}));
+    CU_ASSERT(-1 == router.match(StringRef{hosts[i]}, StringRef{path}));
+  }
+
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("www.example.com"),
+                               StringRef::from_lit("/0/")));
+  CU_ASSERT(-1 ==
+            router.match(StringRef{}, StringRef::from_lit("/static/!/")));
+}
+
 } // namespace shrpx
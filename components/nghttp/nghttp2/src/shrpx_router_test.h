@@ -34,6 +34,7 @@ namespace shrpx {
 void test_shrpx_router_match(void);
 void test_shrpx_router_match_wildcard(void);
 void test_shrpx_router_match_prefix(void);
+void test_shrpx_router_match_many(void);
 
 } // namespace shrpx
 
@@ -0,0 +1,859 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_rule_router.h"
+
+#include <algorithm>
+#include <map>
+
+#include "shrpx_log.h"
+#include "util.h"
+
+namespace shrpx {
+
+namespace {
+// Builds the fragments of NFA in |nfa|.  The fragments are combined
+// by adding epsilon transitions from the last state of fragment.
+class NFABuilder {
+public:
+  NFABuilder(std::vector<RNState> &nfa) : nfa_(nfa) {}
+
+  uint32_t add_state() {
+    nfa_.emplace_back();
+    nfa_.back().next = 0;
+    return nfa_.size() - 1;
+  }
+
+  // Returns the fragment which matches empty string.
+  RFrag empty() {
+    auto s = add_state();
+    return {s, s};
+  }
+
+  // Returns the fragment which matches one symbol in |cs|.
+  RFrag chars(const RCharSet &cs) {
+    auto first = add_state();
+    auto last = add_state();
+    nfa_[first].chars = cs;
+    nfa_[first].next = last;
+    return {first, last};
+  }
+
+  RFrag concat(const RFrag &a, const RFrag &b) {
+    nfa_[a.last].eps.push_back(b.first);
+    return {a.first, b.last};
+  }
+
+  RFrag alt(const RFrag &a, const RFrag &b) {
+    auto first = add_state();
+    auto last = add_state();
+    nfa_[first].eps = {a.first, b.first};
+    nfa_[a.last].eps.push_back(last);
+    nfa_[b.last].eps.push_back(last);
+    return {first, last};
+  }
+
+  RFrag star(const RFrag &a) {
+    auto first = add_state();
+    auto last = add_state();
+    nfa_[first].eps = {a.first, last};
+    nfa_[a.last].eps = {a.first, last};
+    return {first, last};
+  }
+
+  RFrag plus(const RFrag &a) {
+    auto last = add_state();
+    nfa_[a.last].eps = {a.first, last};
+    return {a.first, last};
+  }
+
+  RFrag opt(const RFrag &a) {
+    auto first = add_state();
+    auto last = add_state();
+    nfa_[first].eps = {a.first, last};
+    nfa_[a.last].eps.push_back(last);
+    return {first, last};
+  }
+
+  size_t size() const { return nfa_.size(); }
+
+  // Returns true if NFA has more than RuleRouter::MAX_NFA_STATES
+  // states.
+  bool full() const { return nfa_.size() > RuleRouter::MAX_NFA_STATES; }
+
+private:
+  std::vector<RNState> &nfa_;
+};
+} // namespace
+
+namespace {
+// Returns the set of all bytes.  It does not include the separator.
+RCharSet any_byte() {
+  RCharSet cs;
+  cs.set();
+  cs.reset(RSEPARATOR);
+  return cs;
+}
+} // namespace
+
+namespace {
+// Parses the regular expression, and builds NFA fragment which
+// matches it.
+class RegexParser {
+public:
+  RegexParser(NFABuilder &builder, const char *first, const char *last)
+      : builder_(builder), p_(first), last_(last), error_(nullptr) {}
+
+  // Parses whole input.  "^" at the beginning and "$" at the end are
+  // allowed, but they have no effect since the match is always made
+  // against the whole value.  This function returns 0 if it
+  // succeeds, or -1.
+  int parse(RFrag &frag) {
+    if (p_ != last_ && *p_ == '^') {
+      ++p_;
+    }
+    if (last_ - p_ >= 1 && *(last_ - 1) == '$' &&
+        (last_ - p_ == 1 || *(last_ - 2) != '\\')) {
+      --last_;
+    }
+
+    if (parse_alt(frag) != 0) {
+      return -1;
+    }
+
+    if (p_ != last_) {
+      error_ = "unmatched ')'";
+      return -1;
+    }
+
+    return 0;
+  }
+
+  const char *error() const { return error_; }
+
+private:
+  int parse_alt(RFrag &frag) {
+    if (parse_concat(frag) != 0) {
+      return -1;
+    }
+
+    while (p_ != last_ && *p_ == '|') {
+      ++p_;
+
+      RFrag f;
+      if (parse_concat(f) != 0) {
+        return -1;
+      }
+
+      frag = builder_.alt(frag, f);
+    }
+
+    return 0;
+  }
+
+  int parse_concat(RFrag &frag) {
+    frag = builder_.empty();
+
+    while (p_ != last_ && *p_ != '|' && *p_ != ')') {
+      RFrag f;
+      if (parse_repeat(f) != 0) {
+        return -1;
+      }
+
+      frag = builder_.concat(frag, f);
+    }
+
+    return 0;
+  }
+
+  int parse_repeat(RFrag &frag) {
+    auto atom_first = p_;
+
+    if (parse_atom(frag) != 0) {
+      return -1;
+    }
+
+    auto atom_last = p_;
+
+    if (p_ == last_) {
+      return 0;
+    }
+
+    switch (*p_) {
+    case '*':
+      ++p_;
+      frag = builder_.star(frag);
+      break;
+    case '+':
+      ++p_;
+      frag = builder_.plus(frag);
+      break;
+    case '?':
+      ++p_;
+      frag = builder_.opt(frag);
+      break;
+    case '{': {
+      ++p_;
+
+      size_t min, max;
+      if (parse_bound(min, max) != 0) {
+        return -1;
+      }
+
+      // The atom is parsed again to get its copy.  It never fails
+      // because it succeeded once.
+      auto copy = [this, atom_first, atom_last]() {
+        RegexParser parser(builder_, atom_first, atom_last);
+        RFrag f;
+        parser.parse_atom(f);
+        return f;
+      };
+
+      auto f = builder_.empty();
+      for (size_t i = 0; i < min && !builder_.full(); ++i) {
+        f = builder_.concat(f, i == 0 ? frag : copy());
+      }
+      if (max == std::numeric_limits<size_t>::max()) {
+        f = builder_.concat(f, builder_.star(min == 0 ? frag : copy()));
+      } else {
+        for (size_t i = min; i < max && !builder_.full(); ++i) {
+          f = builder_.concat(f, builder_.opt(i == 0 ? frag : copy()));
+        }
+      }
+      // Stop here, or nested repetitions build exponentially many
+      // states.
+      if (builder_.full()) {
+        error_ = "too many NFA states";
+        return -1;
+      }
+      frag = f;
+      break;
+    }
+    default:
+      return 0;
+    }
+
+    if (p_ != last_ &&
+        (*p_ == '*' || *p_ == '+' || *p_ == '?' || *p_ == '{')) {
+      error_ = "multiple repetition operators; use group";
+      return -1;
+    }
+
+    return 0;
+  }
+
+  // Parses "m}", "m,}" or "m,n}".  If n is omitted, |max| is
+  // std::numeric_limits<size_t>::max().
+  int parse_bound(size_t &min, size_t &max) {
+    constexpr size_t MAX_REPEAT = 255;
+
+    auto parse_num = [this](size_t &n) {
+      auto first = p_;
+      n = 0;
+      for (; p_ != last_ && util::is_digit(*p_); ++p_) {
+        n = n * 10 + (*p_ - '0');
+        if (n > MAX_REPEAT) {
+          return -1;
+        }
+      }
+      return p_ == first ? -1 : 0;
+    };
+
+    if (parse_num(min) != 0) {
+      error_ = "bad repetition count";
+      return -1;
+    }
+
+    if (p_ != last_ && *p_ == ',') {
+      ++p_;
+      if (p_ != last_ && *p_ == '}') {
+        max = std::numeric_limits<size_t>::max();
+      } else if (parse_num(max) != 0 || max < min) {
+        error_ = "bad repetition count";
+        return -1;
+      }
+    } else {
+      max = min;
+    }
+
+    if (p_ == last_ || *p_ != '}') {
+      error_ = "missing '}'";
+      return -1;
+    }
+
+    ++p_;
+
+    return 0;
+  }
+
+  int parse_atom(RFrag &frag) {
+    RCharSet cs;
+
+    switch (*p_) {
+    case '(':
+      ++p_;
+      if (parse_alt(frag) != 0) {
+        return -1;
+      }
+      if (p_ == last_ || *p_ != ')') {
+        error_ = "missing ')'";
+        return -1;
+      }
+      ++p_;
+      return 0;
+    case '[':
+      ++p_;
+      if (parse_class(cs) != 0) {
+        return -1;
+      }
+      break;
+    case '.':
+      ++p_;
+      cs = any_byte();
+      break;
+    case '\\':
+      ++p_;
+      if (parse_escape(cs) != 0) {
+        return -1;
+      }
+      break;
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+      error_ = "nothing to repeat";
+      return -1;
+    case '^':
+    case '$':
+      error_ = "'^' and '$' are only allowed at the ends";
+      return -1;
+    default:
+      cs.set(static_cast<uint8_t>(*p_++));
+      break;
+    }
+
+    frag = builder_.chars(cs);
+
+    return 0;
+  }
+
+  // Parses escape sequence after "\".
+  int parse_escape(RCharSet &cs) {
+    if (p_ == last_) {
+      error_ = "trailing '\\'";
+      return -1;
+    }
+
+    auto c = *p_++;
+
+    switch (c) {
+    case 'd':
+      for (auto b = '0'; b <= '9'; ++b) {
+        cs.set(b);
+      }
+      return 0;
+    case 'w':
+      for (size_t b = 0; b < 256; ++b) {
+        if (util::is_alpha(b) || util::is_digit(b) || b == '_') {
+          cs.set(b);
+        }
+      }
+      return 0;
+    case 's':
+      cs.set(' ');
+      cs.set('\t');
+      return 0;
+    case 't':
+      cs.set('\t');
+      return 0;
+    case 'x':
+      if (last_ - p_ < 2 || !util::is_hex_digit(p_[0]) ||
+          !util::is_hex_digit(p_[1])) {
+        error_ = "bad '\\x' escape";
+        return -1;
+      }
+      cs.set((util::hex_to_uint(p_[0]) << 4) | util::hex_to_uint(p_[1]));
+      p_ += 2;
+      return 0;
+    }
+
+    if (util::is_alpha(c) || util::is_digit(c)) {
+      error_ = "unknown escape";
+      return -1;
+    }
+
+    cs.set(static_cast<uint8_t>(c));
+
+    return 0;
+  }
+
+  // Parses character class after "[".
+  int parse_class(RCharSet &cs) {
+    auto negate = false;
+    if (p_ != last_ && *p_ == '^') {
+      negate = true;
+      ++p_;
+    }
+
+    for (auto first = true;; first = false) {
+      if (p_ == last_) {
+        error_ = "missing ']'";
+        return -1;
+      }
+
+      if (*p_ == ']' && !first) {
+        ++p_;
+        break;
+      }
+
+      RCharSet elem;
+      if (*p_ == '\\') {
+        ++p_;
+        if (parse_escape(elem) != 0) {
+          return -1;
+        }
+      } else {
+        elem.set(static_cast<uint8_t>(*p_++));
+      }
+
+      if (last_ - p_ >= 2 && *p_ == '-' && *(p_ + 1) != ']') {
+        ++p_;
+
+        RCharSet hi;
+        if (*p_ == '\\') {
+          ++p_;
+          if (parse_escape(hi) != 0) {
+            return -1;
+          }
+        } else {
+          hi.set(static_cast<uint8_t>(*p_++));
+        }
+
+        if (elem.count() != 1 || hi.count() != 1) {
+          error_ = "bad range";
+          return -1;
+        }
+
+        size_t lo_byte = 0, hi_byte = 0;
+        for (; !elem[lo_byte]; ++lo_byte)
+          ;
+        for (; !hi[hi_byte]; ++hi_byte)
+          ;
+
+        if (lo_byte > hi_byte) {
+          error_ = "bad range";
+          return -1;
+        }
+
+        for (auto b = lo_byte; b <= hi_byte; ++b) {
+          elem.set(b);
+        }
+      }
+
+      cs |= elem;
+    }
+
+    if (negate) {
+      cs = ~cs & any_byte();
+    }
+
+    return 0;
+  }
+
+  NFABuilder &builder_;
+  const char *p_, *last_;
+  const char *error_;
+};
+} // namespace
+
+namespace {
+// Builds NFA fragment which matches host glob |glob|.
+RFrag glob_to_frag(NFABuilder &builder, const StringRef &glob) {
+  auto frag = builder.empty();
+
+  for (auto c : glob) {
+    RCharSet cs;
+    switch (c) {
+    case '*':
+      frag = builder.concat(frag, builder.star(builder.chars(any_byte())));
+      continue;
+    case '?':
+      cs = any_byte();
+      break;
+    default:
+      cs.set(static_cast<uint8_t>(util::lowcase(c)));
+      break;
+    }
+    frag = builder.concat(frag, builder.chars(cs));
+  }
+
+  return frag;
+}
+} // namespace
+
+RuleRouter::RuleRouter()
+    : balloc_(1024, 1024), classes_{}, sep_class_(0), nclasses_(0) {}
+
+int RuleRouter::add_rule(const StringRef &rule, size_t idx) {
+  auto nfa_size = nfa_.size();
+
+  if (parse_rule(rule, idx) != 0) {
+    // No other rule refers to the states of the failed rule.
+    nfa_.resize(nfa_size);
+    return -1;
+  }
+
+  return 0;
+}
+
+int RuleRouter::parse_rule(const StringRef &rule, size_t idx) {
+  if (rule.empty()) {
+    LOG(ERROR) << "backend: rule: empty rule";
+    return -1;
+  }
+
+  NFABuilder builder(nfa_);
+
+  RRule r{};
+  for (auto &f : r.fields) {
+    f.first = f.last = RNONE;
+  }
+  r.idx = idx;
+
+  for (auto first = std::begin(rule);;) {
+    // Look for "&" which is not escaped.
+    auto last = first;
+    for (; last != std::end(rule) && *last != '&'; ++last) {
+      if (*last == '\\' && last + 1 != std::end(rule)) {
+        ++last;
+      }
+    }
+
+    auto pred = StringRef{first, last};
+    auto eq = std::find(std::begin(pred), std::end(pred), '=');
+    if (eq == std::end(pred)) {
+      LOG(ERROR) << "backend: rule: predicate must be <NAME>=<VALUE>: "
+                 << pred;
+      return -1;
+    }
+
+    auto name = StringRef{std::begin(pred), eq};
+    auto value = StringRef{eq + 1, std::end(pred)};
+
+    RFrag *dest = nullptr;
+    auto glob = false;
+    auto dup = false;
+
+    if (name == StringRef::from_lit("method")) {
+      dest = &r.fields[0];
+      dup = dest->first != RNONE;
+    } else if (name == StringRef::from_lit("host")) {
+      dest = &r.fields[1];
+      dup = dest->first != RNONE;
+      glob = true;
+    } else if (name == StringRef::from_lit("path")) {
+      dest = &r.fields[2];
+      dup = dest->first != RNONE;
+    } else if (util::starts_with(name, StringRef::from_lit("header.")) &&
+               name.size() > str_size("header.")) {
+      auto iov = make_byte_ref(balloc_, name.size() - str_size("header.") + 1);
+      auto p = std::copy(std::begin(name) + str_size("header."),
+                         std::end(name), iov.base);
+      util::inp_strlower(iov.base, p);
+      *p = '\0';
+      auto hdname = StringRef{iov.base, p};
+
+      dup = std::find_if(std::begin(r.headers), std::end(r.headers),
+                         [&hdname](const std::pair<StringRef, RFrag> &kv) {
+                           return kv.first == hdname;
+                         }) != std::end(r.headers);
+
+      r.headers.emplace_back(hdname, RFrag{});
+      dest = &r.headers.back().second;
+    } else {
+      LOG(ERROR) << "backend: rule: unknown predicate: " << pred;
+      return -1;
+    }
+
+    if (dup) {
+      LOG(ERROR) << "backend: rule: duplicate predicate: " << pred;
+      return -1;
+    }
+
+    if (glob) {
+      *dest = glob_to_frag(builder, value);
+    } else {
+      RegexParser parser(builder, std::begin(value), std::end(value));
+      if (parser.parse(*dest) != 0) {
+        LOG(ERROR) << "backend: rule: " << parser.error() << ": " << pred;
+        return -1;
+      }
+    }
+
+    if (builder.full()) {
+      LOG(ERROR) << "backend: rule: rules are too complex, NFA has more "
+                    "than "
+                 << MAX_NFA_STATES << " states";
+      return -1;
+    }
+
+    if (last == std::end(rule)) {
+      break;
+    }
+
+    first = last + 1;
+  }
+
+  rules_.push_back(std::move(r));
+
+  return 0;
+}
+
+int RuleRouter::compile() {
+  if (rules_.empty()) {
+    return 0;
+  }
+
+  for (auto &r : rules_) {
+    for (auto &kv : r.headers) {
+      if (std::find(std::begin(header_names_), std::end(header_names_),
+                    kv.first) == std::end(header_names_)) {
+        header_names_.push_back(kv.first);
+      }
+    }
+  }
+
+  if (header_names_.size() > MAX_HEADER_NAMES) {
+    LOG(ERROR) << "backend: rule: rules refer to too many header fields, "
+                  "the maximum is "
+               << MAX_HEADER_NAMES;
+    return -1;
+  }
+
+  NFABuilder builder(nfa_);
+
+  RCharSet sep;
+  sep.set(RSEPARATOR);
+
+  // The initial state of NFA branches to the rules.  Each of them
+  // reads all fields in order, matching the field without predicate
+  // with any bytes.  The last state of each rule accepts it.
+  auto start = builder.add_state();
+  std::vector<std::pair<uint32_t, size_t>> accepts;
+
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    auto &r = rules_[i];
+    auto frag = builder.empty();
+
+    auto add_field = [&builder, &frag, &sep](const RFrag &f) {
+      frag = builder.concat(frag, f.first == RNONE
+                                      ? builder.star(builder.chars(any_byte()))
+                                      : f);
+      frag = builder.concat(frag, builder.chars(sep));
+    };
+
+    for (auto &f : r.fields) {
+      add_field(f);
+    }
+
+    for (auto &name : header_names_) {
+      auto it = std::find_if(std::begin(r.headers), std::end(r.headers),
+                             [&name](const std::pair<StringRef, RFrag> &kv) {
+                               return kv.first == name;
+                             });
+      add_field(it == std::end(r.headers) ? RFrag{RNONE, RNONE}
+                                           : (*it).second);
+    }
+
+    nfa_[start].eps.push_back(frag.first);
+    accepts.emplace_back(frag.last, i);
+  }
+
+  // The rule which appears first wins.
+  std::vector<ssize_t> nfa_accept(nfa_.size(), -1);
+  for (auto &p : accepts) {
+    nfa_accept[p.first] = p.second;
+  }
+
+  // Partition symbols into classes.  Two symbols are in the same
+  // class if every NFA state makes the same transition with them.
+  std::array<uint32_t, 257> cls{};
+  uint32_t ncls = 1;
+  for (auto &st : nfa_) {
+    if (st.chars.none()) {
+      continue;
+    }
+
+    std::vector<uint32_t> remap(ncls * 2, RNONE);
+    uint32_t n = 0;
+    for (size_t c = 0; c < cls.size(); ++c) {
+      auto &m = remap[cls[c] * 2 + st.chars[c]];
+      if (m == RNONE) {
+        m = n++;
+      }
+      cls[c] = m;
+    }
+    ncls = n;
+  }
+
+  std::copy_n(std::begin(cls), classes_.size(), std::begin(classes_));
+  sep_class_ = cls[RSEPARATOR];
+  nclasses_ = ncls;
+
+  // The symbol which represents each class.
+  std::vector<size_t> reps(nclasses_);
+  for (size_t c = cls.size(); c > 0; --c) {
+    reps[cls[c - 1]] = c - 1;
+  }
+
+  // Subset construction.  Each DFA state is the sorted list of NFA
+  // states which are reachable.
+  std::vector<uint32_t> mark(nfa_.size(), 0);
+  uint32_t gen = 0;
+  auto closure = [this, &mark, &gen](std::vector<uint32_t> &set) {
+    ++gen;
+    for (auto s : set) {
+      mark[s] = gen;
+    }
+    for (size_t i = 0; i < set.size(); ++i) {
+      for (auto t : nfa_[set[i]].eps) {
+        if (mark[t] != gen) {
+          mark[t] = gen;
+          set.push_back(t);
+        }
+      }
+    }
+    std::sort(std::begin(set), std::end(set));
+  };
+
+  auto accept_of = [this, &nfa_accept](const std::vector<uint32_t> &set) {
+    ssize_t best = -1;
+    for (auto s : set) {
+      auto a = nfa_accept[s];
+      if (a != -1 && (best == -1 || a < best)) {
+        best = a;
+      }
+    }
+    return best == -1 ? -1 : static_cast<ssize_t>(rules_[best].idx);
+  };
+
+  std::map<std::vector<uint32_t>, uint32_t> ids;
+  std::vector<std::vector<uint32_t>> dstates(2);
+
+  dstates[1].push_back(start);
+  closure(dstates[1]);
+  ids.emplace(dstates[1], 1);
+
+  trans_.assign(nclasses_ * 2, 0);
+  accept_ = {-1, accept_of(dstates[1])};
+
+  for (size_t s = 1; s < dstates.size(); ++s) {
+    for (uint32_t c = 0; c < nclasses_; ++c) {
+      auto sym = reps[c];
+
+      std::vector<uint32_t> next;
+      for (auto u : dstates[s]) {
+        if (nfa_[u].chars[sym]) {
+          next.push_back(nfa_[u].next);
+        }
+      }
+
+      if (next.empty()) {
+        continue;
+      }
+
+      closure(next);
+
+      uint32_t t;
+      auto it = ids.find(next);
+      if (it == std::end(ids)) {
+        if (dstates.size() == MAX_DFA_STATES) {
+          LOG(ERROR) << "backend: rule: rules are too complex, DFA has more "
+                        "than "
+                     << MAX_DFA_STATES << " states";
+          return -1;
+        }
+
+        t = dstates.size();
+        accept_.push_back(accept_of(next));
+        ids.emplace(next, t);
+        dstates.push_back(std::move(next));
+        trans_.resize(trans_.size() + nclasses_);
+      } else {
+        t = (*it).second;
+      }
+
+      trans_[s * nclasses_ + c] = t * nclasses_;
+    }
+  }
+
+  if (LOG_ENABLED(INFO)) {
+    LOG(INFO) << "Compiled " << rules_.size() << " routing rules into DFA with "
+              << dstates.size() << " states and " << nclasses_
+              << " symbol classes";
+  }
+
+  // NFA is no longer needed.
+  std::vector<RNState>().swap(nfa_);
+
+  return 0;
+}
+
+bool RuleRouter::empty() const { return rules_.empty(); }
+
+const std::vector<StringRef> &RuleRouter::header_names() const {
+  return header_names_;
+}
+
+uint32_t RuleRouter::feed(uint32_t state, const StringRef &s) const {
+  for (auto c : s) {
+    if (state == 0) {
+      return 0;
+    }
+    state = trans_[state + classes_[static_cast<uint8_t>(c)]];
+  }
+
+  return trans_[state + sep_class_];
+}
+
+ssize_t RuleRouter::match(const StringRef &method, const StringRef &host,
+                          const StringRef &path,
+                          const StringRef *header_values) const {
+  if (trans_.empty()) {
+    return -1;
+  }
+
+  uint32_t state = nclasses_;
+
+  state = feed(state, method);
+  state = feed(state, host);
+  state = feed(state, path);
+  for (size_t i = 0; i < header_names_.size(); ++i) {
+    state = feed(state, header_values[i]);
+  }
+
+  return accept_[state / nclasses_];
+}
+
+} // namespace shrpx
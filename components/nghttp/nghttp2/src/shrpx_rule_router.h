@@ -0,0 +1,170 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef SHRPX_RULE_ROUTER_H
+#define SHRPX_RULE_ROUTER_H
+
+#include "shrpx.h"
+
+#include <vector>
+#include <bitset>
+#include <array>
+#include <limits>
+
+#include "allocator.h"
+#include "template.h"
+
+using namespace nghttp2;
+
+namespace shrpx {
+
+// The symbols of NFA transition.  The first 256 are bytes, and the
+// last one is the separator between request fields.  The separator
+// is not a byte, so that no byte in a field can be taken as the end
+// of the field.
+using RCharSet = std::bitset<257>;
+
+constexpr size_t RSEPARATOR = 256;
+
+constexpr uint32_t RNONE = std::numeric_limits<uint32_t>::max();
+
+// The state of NFA which RuleRouter builds from rules.
+struct RNState {
+  // The symbols which make transition to |next|.  If this has no
+  // symbol, this state only has epsilon transitions.
+  RCharSet chars;
+  uint32_t next;
+  // The states reachable without consuming symbol.
+  std::vector<uint32_t> eps;
+};
+
+// The fragment of NFA.  |last| has no transition yet, and it is
+// connected to the next fragment.
+struct RFrag {
+  uint32_t first;
+  uint32_t last;
+};
+
+struct RRule {
+  // NFA fragments for request method, host and path in this order.
+  // The first field of fragment is RNONE if the rule has no
+  // predicate for it.
+  std::array<RFrag, 3> fields;
+  // The header field names, and NFA fragments for their values.
+  std::vector<std::pair<StringRef, RFrag>> headers;
+  // Index of group this rule selects.
+  size_t idx;
+};
+
+// RuleRouter selects a group with the rules which consist of the
+// predicates on request method, host, path and header fields.  The
+// rules are compiled into one DFA, which reads method, host, path and
+// the values of header fields which any rule refers to, each followed
+// by the separator, in a single pass.  It accepts the first rule
+// which matches.
+//
+// The rule is a list of predicates delimited by "&".  All of them
+// must be satisfied.  The predicate is one of the following:
+//
+// host=<GLOB>         "*" matches any sequence of characters, and "?"
+//                     matches any single character.  The match is
+//                     case-insensitive.
+// path=<REGEX>        The request path without query.
+// method=<REGEX>      The request method (e.g., GET).
+// header.<NAME>=<REGEX>
+//                     The value of the first header field <NAME>, or
+//                     empty string if it is not present.
+//
+// <REGEX> supports concatenation, "|", "(...)", "*", "+", "?",
+// "{m}", "{m,}", "{m,n}", ".", "[...]", "[^...]" and escapes "\d",
+// "\w", "\s", "\xHH" and "\" followed by punctuation.  It must match
+// the whole value.  "&" must be escaped.
+class RuleRouter {
+public:
+  RuleRouter();
+  RuleRouter(RuleRouter &&) = default;
+  RuleRouter(const RuleRouter &) = delete;
+  RuleRouter &operator=(RuleRouter &&) = default;
+  RuleRouter &operator=(const RuleRouter &) = delete;
+
+  // Parses |rule|, and adds it with the index |idx|.  This function
+  // returns 0 if it succeeds, or -1.
+  int add_rule(const StringRef &rule, size_t idx);
+  // Builds DFA from the rules added so far.  This function must be
+  // called once after all rules are added.  It returns 0 if it
+  // succeeds, or -1 if DFA gets too large.
+  int compile();
+  // Returns true if no rule has been added.
+  bool empty() const;
+  // Returns the header field names which the rules refer to, in the
+  // order match() expects their values.  The names are lower cased.
+  const std::vector<StringRef> &header_names() const;
+  // Returns the index of the first rule which matches the request
+  // with |method|, |host| and |path|, or -1.  |header_values| must
+  // point to the values of header_names(), and the value of absent
+  // header field is empty string.
+  ssize_t match(const StringRef &method, const StringRef &host,
+                const StringRef &path, const StringRef *header_values) const;
+
+  // The maximum number of header fields which rules can refer to.
+  static constexpr size_t MAX_HEADER_NAMES = 16;
+  // The maximum number of NFA states of all rules.  Repetition
+  // "{m,n}" copies the NFA states of the atom, and nested repetitions
+  // multiply them.
+  static constexpr size_t MAX_NFA_STATES = 65536;
+  // The maximum number of DFA states.
+  static constexpr size_t MAX_DFA_STATES = 65536;
+
+private:
+  // Parses |rule|, and adds its NFA states and the rule with the
+  // index |idx|.  This function returns 0 if it succeeds, or -1.
+  int parse_rule(const StringRef &rule, size_t idx);
+  // Makes transitions from |state| with |s| and the separator, and
+  // returns the new state.
+  uint32_t feed(uint32_t state, const StringRef &s) const;
+
+  BlockAllocator balloc_;
+  std::vector<RNState> nfa_;
+  std::vector<RRule> rules_;
+  std::vector<StringRef> header_names_;
+  // Mapping from byte to its equivalence class.  The bytes in the
+  // same class make the same transitions in DFA.
+  std::array<uint8_t, 256> classes_;
+  // The class of the separator.
+  uint32_t sep_class_;
+  // The number of classes.
+  uint32_t nclasses_;
+  // Transition table of DFA.  State s is represented by s *
+  // nclasses_, which is the offset of its row, and the next state of
+  // it with class c is trans_[s * nclasses_ + c].  State 0 is dead
+  // state, from which no rule can match, and state 1 is the initial
+  // state.
+  std::vector<uint32_t> trans_;
+  // The index of group which DFA state accepts, or -1.
+  std::vector<ssize_t> accept_;
+};
+
+} // namespace shrpx
+
+#endif // SHRPX_RULE_ROUTER_H
@@ -0,0 +1,218 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "shrpx_rule_router_test.h"
+
+#include <string>
+
+#include <CUnit/CUnit.h>
+
+#include "shrpx_rule_router.h"
+
+namespace shrpx {
+
+void test_shrpx_rule_router_match(void) {
+  RuleRouter router;
+
+  CU_ASSERT(router.empty());
+  CU_ASSERT(0 == router.compile());
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("GET"),
+                               StringRef::from_lit("nghttp2.org"),
+                               StringRef::from_lit("/"), nullptr));
+
+  CU_ASSERT(0 == router.add_rule(
+                     StringRef::from_lit("host=*.nghttp2.org&path=/api/v[0-9]+/"
+                                         ".*&method=GET|HEAD"),
+                     0));
+  CU_ASSERT(0 == router.add_rule(StringRef::from_lit("host=*.nghttp2.org&"
+                                                     "header.X-Canary=1"),
+                                 1));
+  CU_ASSERT(0 == router.add_rule(StringRef::from_lit("host=*.NGHTTP2.org"), 2));
+  CU_ASSERT(0 == router.add_rule(
+                     StringRef::from_lit("method=POST&header.content-type="
+                                         "application/json(;.*)?"),
+                     3));
+  CU_ASSERT(0 == router.add_rule(StringRef::from_lit("host=w?w.example.com&"
+                                                     "header.x-canary=1"),
+                                 4));
+  CU_ASSERT(0 == router.compile());
+
+  CU_ASSERT(!router.empty());
+
+  auto &names = router.header_names();
+
+  CU_ASSERT(2 == names.size());
+  CU_ASSERT("x-canary" == names[0]);
+  CU_ASSERT("content-type" == names[1]);
+
+  StringRef hd[2];
+
+  CU_ASSERT(0 == router.match(StringRef::from_lit("GET"),
+                              StringRef::from_lit("www.nghttp2.org"),
+                              StringRef::from_lit("/api/v12/users"), hd));
+  CU_ASSERT(0 == router.match(StringRef::from_lit("HEAD"),
+                              StringRef::from_lit("www.nghttp2.org"),
+                              StringRef::from_lit("/api/v1/"), hd));
+  // Method does not match
+  CU_ASSERT(2 == router.match(StringRef::from_lit("POST"),
+                              StringRef::from_lit("www.nghttp2.org"),
+                              StringRef::from_lit("/api/v1/"), hd));
+  // Path does not match
+  CU_ASSERT(2 == router.match(StringRef::from_lit("GET"),
+                              StringRef::from_lit("www.nghttp2.org"),
+                              StringRef::from_lit("/api/v/"), hd));
+  // "*" must match the whole prefix.
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("GET"),
+                               StringRef::from_lit("nghttp2.org"),
+                               StringRef::from_lit("/api/v1/"), hd));
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("GET"),
+                               StringRef::from_lit("www.nghttp2.org.com"),
+                               StringRef::from_lit("/api/v1/"), hd));
+
+  hd[0] = StringRef::from_lit("1");
+
+  CU_ASSERT(0 == router.match(StringRef::from_lit("GET"),
+                              StringRef::from_lit("www.nghttp2.org"),
+                              StringRef::from_lit("/api/v1/"), hd));
+  CU_ASSERT(1 == router.match(StringRef::from_lit("GET"),
+                              StringRef::from_lit("www.nghttp2.org"),
+                              StringRef::from_lit("/"), hd));
+  CU_ASSERT(4 == router.match(StringRef::from_lit("GET"),
+                              StringRef::from_lit("wxw.example.com"),
+                              StringRef::from_lit("/"), hd));
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("GET"),
+                               StringRef::from_lit("ww.example.com"),
+                               StringRef::from_lit("/"), hd));
+
+  hd[0] = StringRef::from_lit("10");
+
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("GET"),
+                               StringRef::from_lit("www.example.com"),
+                               StringRef::from_lit("/"), hd));
+
+  hd[0] = StringRef{};
+  hd[1] = StringRef::from_lit("application/json; charset=utf-8");
+
+  CU_ASSERT(3 == router.match(StringRef::from_lit("POST"),
+                              StringRef::from_lit("example.com"),
+                              StringRef::from_lit("/"), hd));
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("PUT"),
+                               StringRef::from_lit("example.com"),
+                               StringRef::from_lit("/"), hd));
+
+  hd[1] = StringRef::from_lit("application/jsonp");
+
+  CU_ASSERT(-1 == router.match(StringRef::from_lit("POST"),
+                               StringRef::from_lit("example.com"),
+                               StringRef::from_lit("/"), hd));
+}
+
+namespace {
+// Returns true if |re| matches |s|.
+bool regex_match(const char *re, const StringRef &s) {
+  RuleRouter router;
+
+  auto rule = std::string{"path="} + re;
+  if (router.add_rule(StringRef{rule}, 0) != 0 || router.compile() != 0) {
+    return false;
+  }
+
+  return router.match(StringRef{}, StringRef{}, s, nullptr) == 0;
+}
+} // namespace
+
+void test_shrpx_rule_router_regex(void) {
+  CU_ASSERT(regex_match("/foo", StringRef::from_lit("/foo")));
+  CU_ASSERT(!regex_match("/foo", StringRef::from_lit("/foobar")));
+  CU_ASSERT(regex_match("^/foo$", StringRef::from_lit("/foo")));
+  CU_ASSERT(regex_match("/foo\\$", StringRef::from_lit("/foo$")));
+  CU_ASSERT(regex_match("", StringRef::from_lit("")));
+  CU_ASSERT(!regex_match("", StringRef::from_lit("/")));
+
+  CU_ASSERT(regex_match("/(alpha|bravo)/", StringRef::from_lit("/bravo/")));
+  CU_ASSERT(!regex_match("/(alpha|bravo)/", StringRef::from_lit("/charlie/")));
+  CU_ASSERT(regex_match("/a(b|)c", StringRef::from_lit("/ac")));
+
+  CU_ASSERT(regex_match("/ab*c", StringRef::from_lit("/ac")));
+  CU_ASSERT(regex_match("/ab*c", StringRef::from_lit("/abbbc")));
+  CU_ASSERT(!regex_match("/ab+c", StringRef::from_lit("/ac")));
+  CU_ASSERT(regex_match("/ab?c", StringRef::from_lit("/ac")));
+  CU_ASSERT(!regex_match("/ab?c", StringRef::from_lit("/abbc")));
+
+  CU_ASSERT(regex_match("/a{3}", StringRef::from_lit("/aaa")));
+  CU_ASSERT(!regex_match("/a{3}", StringRef::from_lit("/aa")));
+  CU_ASSERT(regex_match("/(ab){2,}", StringRef::from_lit("/ababab")));
+  CU_ASSERT(!regex_match("/(ab){2,}", StringRef::from_lit("/ab")));
+  CU_ASSERT(regex_match("/[0-9]{0,2}x", StringRef::from_lit("/x")));
+  CU_ASSERT(regex_match("/[0-9]{0,2}x", StringRef::from_lit("/12x")));
+  CU_ASSERT(!regex_match("/[0-9]{0,2}x", StringRef::from_lit("/123x")));
+
+  CU_ASSERT(regex_match("/[a-c_]+", StringRef::from_lit("/cab_")));
+  CU_ASSERT(!regex_match("/[a-c_]+", StringRef::from_lit("/cabd")));
+  CU_ASSERT(regex_match("/[^/]+", StringRef::from_lit("/foo")));
+  CU_ASSERT(!regex_match("/[^/]+", StringRef::from_lit("/foo/")));
+  CU_ASSERT(regex_match("/[]a]", StringRef::from_lit("/]")));
+  CU_ASSERT(regex_match("/[a-]", StringRef::from_lit("/-")));
+  CU_ASSERT(regex_match("/\\d\\w\\s", StringRef::from_lit("/1_ ")));
+  CU_ASSERT(regex_match("/\\x3a\\.", StringRef::from_lit("/:.")));
+  CU_ASSERT(!regex_match("/\\x3a\\.", StringRef::from_lit("/:a")));
+  CU_ASSERT(regex_match("/a\\&b", StringRef::from_lit("/a&b")));
+
+  // "." matches any byte including NUL.
+  CU_ASSERT(regex_match("/..", StringRef{"/\0\xff", 3}));
+}
+
+void test_shrpx_rule_router_add_rule(void) {
+  RuleRouter router;
+
+  for (auto rule : {"", "path", "foo=bar", "host=a&host=b", "path=a&path=b",
+                    "header.a=b&header.A=c", "header.=a", "path=(a",
+                    "path=a)", "path=*", "path=a**", "path=a{2}*", "path=a{",
+                    "path=a{2", "path=a{3,2}", "path=a{256}", "path=[a",
+                    "path=[b-a]", "path=\\", "path=\\q", "path=\\x1",
+                    "path=a^b", "path=a$b"}) {
+    CU_ASSERT(-1 == router.add_rule(StringRef{rule}, 0));
+  }
+
+  CU_ASSERT(router.empty());
+
+  // Nested repetitions would build about 16M NFA states.
+  CU_ASSERT(-1 == router.add_rule(StringRef::from_lit(
+                                      "path=((a{255}){255}){255}"),
+                                  0));
+  CU_ASSERT(-1 == router.add_rule(StringRef::from_lit("path=(a{255}){255}"),
+                                  0));
+  CU_ASSERT(router.empty());
+
+  CU_ASSERT(0 == router.add_rule(StringRef::from_lit("path=[a-z]{255}"), 0));
+
+  for (size_t i = 0; i <= RuleRouter::MAX_HEADER_NAMES; ++i) {
+    auto rule = "header.x-" + std::to_string(i) + "=a";
+    CU_ASSERT(0 == router.add_rule(StringRef{rule}, i));
+  }
+
+  CU_ASSERT(-1 == router.compile());
+}
+
+} // namespace shrpx
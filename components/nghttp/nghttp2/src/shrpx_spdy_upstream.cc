@@ -42,6 +42,7 @@
 #include "shrpx_worker.h"
 #include "shrpx_http2_session.h"
 #include "shrpx_log.h"
+#include "shrpx_response_cache.h"
 #include "http2.h"
 #include "util.h"
 #include "template.h"
@@ -1082,6 +1083,11 @@ int SpdyUpstream::on_downstream_header_complete(Downstream *downstream) {
   const auto &req = downstream->request();
   auto &balloc = downstream->get_block_allocator();
 
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_header(*downstream);
+  }
+
 #ifdef HAVE_MRUBY
   auto worker = handler_->get_worker();
   auto mruby_ctx = worker->get_mruby_context();
@@ -1208,6 +1214,11 @@ int SpdyUpstream::on_downstream_header_complete(Downstream *downstream) {
 int SpdyUpstream::on_downstream_body(Downstream *downstream,
                                      const uint8_t *data, size_t len,
                                      bool flush) {
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_body(data, len);
+  }
+
   auto body = downstream->get_response_buf();
   body->append(data, len);
 
@@ -1227,6 +1238,11 @@ int SpdyUpstream::on_downstream_body_complete(Downstream *downstream) {
     DLOG(INFO, downstream) << "HTTP response completed";
   }
 
+  auto cache_writer = downstream->get_cache_writer();
+  if (cache_writer) {
+    cache_writer->on_complete(*downstream);
+  }
+
   auto &resp = downstream->response();
 
   if (!downstream->validate_response_recv_body_length()) {
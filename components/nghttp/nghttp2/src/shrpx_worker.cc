@@ -27,20 +27,30 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif // HAVE_UNISTD_H
+#if !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
+#include <pthread.h>
+#endif // !defined(NOTHREADS) && HAVE_DECL_PTHREAD_SETAFFINITY_NP
 
 #include <memory>
+#include <array>
+#include <algorithm>
 
 #include "shrpx_tls.h"
 #include "shrpx_log.h"
 #include "shrpx_client_handler.h"
+#include "shrpx_downstream.h"
 #include "shrpx_http2_session.h"
 #include "shrpx_log_config.h"
 #include "shrpx_memcached_dispatcher.h"
+#include "shrpx_accept_handler.h"
+#include "shrpx_cache_downstream_connection.h"
 #ifdef HAVE_MRUBY
 #include "shrpx_mruby.h"
 #endif // HAVE_MRUBY
+#include "http2.h"
 #include "util.h"
 #include "template.h"
+#include "xsi_strerror.h"
 
 namespace shrpx {
 
@@ -68,6 +78,16 @@ void proc_wev_cb(struct ev_loop *loop, ev_timer *w, int revents) {
 }
 } // namespace
 
+namespace {
+void acceptor_disable_cb(struct ev_loop *loop, ev_timer *w, int revent) {
+  auto worker = static_cast<Worker *>(w->data);
+
+  // If we are in graceful shutdown period, the listening sockets
+  // have been closed already.
+  worker->enable_acceptor();
+}
+} // namespace
+
 namespace {
 bool match_shared_downstream_addr(
     const std::shared_ptr<SharedDownstreamAddr> &lhs,
@@ -77,6 +97,7 @@ bool match_shared_downstream_addr(
   }
 
   if (lhs->affinity != rhs->affinity ||
+      lhs->affinity_key != rhs->affinity_key || lhs->balance != rhs->balance ||
       lhs->redirect_if_not_tls != rhs->redirect_if_not_tls) {
     return false;
   }
@@ -93,7 +114,8 @@ bool match_shared_downstream_addr(
       auto &b = rhs->addrs[i];
       if (a.host == b.host && a.port == b.port && a.host_unix == b.host_unix &&
           a.proto == b.proto && a.tls == b.tls && a.sni == b.sni &&
-          a.fall == b.fall && a.rise == b.rise && a.dns == b.dns) {
+          a.fall == b.fall && a.rise == b.rise && a.weight == b.weight &&
+          a.dns == b.dns) {
         break;
       }
     }
@@ -115,7 +137,8 @@ Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
                const std::shared_ptr<TicketKeys> &ticket_keys,
                ConnectionHandler *conn_handler,
                std::shared_ptr<DownstreamConfig> downstreamconf)
-    : randgen_(util::make_mt19937()),
+    : wakeup_pending_(false),
+      randgen_(util::make_mt19937()),
       worker_stat_{},
       dns_tracker_(loop),
       loop_(loop),
@@ -126,6 +149,9 @@ Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
       ticket_keys_(ticket_keys),
       connect_blocker_(
           make_unique<ConnectBlocker>(randgen_, loop_, []() {}, []() {})),
+      accesslog_buffer_(nullptr),
+      response_cache_(nullptr),
+      cpu_(-1),
       graceful_shutdown_(false) {
   ev_async_init(&w_, eventcb);
   w_.data = this;
@@ -137,6 +163,9 @@ Worker::Worker(struct ev_loop *loop, SSL_CTX *sv_ssl_ctx, SSL_CTX *cl_ssl_ctx,
   ev_timer_init(&proc_wev_timer_, proc_wev_cb, 0., 0.);
   proc_wev_timer_.data = this;
 
+  ev_timer_init(&disable_acceptor_timer_, acceptor_disable_cb, 0., 0.);
+  disable_acceptor_timer_.data = this;
+
   auto &session_cacheconf = get_config()->tls.session_cache;
 
   if (!session_cacheconf.memcached.host.empty()) {
@@ -156,7 +185,7 @@ void Worker::replace_downstream_config(
 
     auto &shared_addr = g->shared_addr;
 
-    if (shared_addr->affinity == AFFINITY_NONE) {
+    if (!shared_addr->per_addr_pool()) {
       shared_addr->dconn_pool.remove_all();
       continue;
     }
@@ -187,7 +216,10 @@ void Worker::replace_downstream_config(
 
     shared_addr->addrs.resize(src.addrs.size());
     shared_addr->affinity = src.affinity;
-    shared_addr->affinity_hash = src.affinity_hash;
+    shared_addr->affinity_table = src.affinity_table;
+    shared_addr->affinity_key =
+        make_string_ref(shared_addr->balloc, src.affinity_key);
+    shared_addr->balance = src.balance;
     shared_addr->redirect_if_not_tls = src.redirect_if_not_tls;
 
     size_t num_http1 = 0;
@@ -208,6 +240,8 @@ void Worker::replace_downstream_config(
       dst_addr.sni = make_string_ref(shared_addr->balloc, src_addr.sni);
       dst_addr.fall = src_addr.fall;
       dst_addr.rise = src_addr.rise;
+      dst_addr.weight = src_addr.weight;
+      dst_addr.stat = src_addr.stat;
       dst_addr.dns = src_addr.dns;
 
       auto shared_addr_ptr = shared_addr.get();
@@ -268,7 +302,7 @@ void Worker::replace_downstream_config(
       shared_addr->http1_pri.weight = num_http1;
       shared_addr->http2_pri.weight = num_http2;
 
-      if (shared_addr->affinity != AFFINITY_NONE) {
+      if (shared_addr->per_addr_pool()) {
         for (auto &addr : shared_addr->addrs) {
           addr.dconn_pool = make_unique<DownstreamConnectionPool>();
         }
@@ -289,6 +323,7 @@ Worker::~Worker() {
   ev_async_stop(loop_, &w_);
   ev_timer_stop(loop_, &mcpool_clear_timer_);
   ev_timer_stop(loop_, &proc_wev_timer_);
+  ev_timer_stop(loop_, &disable_acceptor_timer_);
 }
 
 void Worker::schedule_clear_mcpool() {
@@ -304,10 +339,92 @@ void Worker::wait() {
 #endif // !NOTHREADS
 }
 
+#ifndef NOTHREADS
+namespace {
+void pin_thread(Worker *worker, int cpu) {
+#if HAVE_DECL_PTHREAD_SETAFFINITY_NP
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+
+  auto rv = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (rv != 0) {
+    std::array<char, STRERROR_BUFSIZE> errbuf;
+    WLOG(WARN, worker) << "Could not pin worker thread to CPU " << cpu << ": "
+                       << xsi_strerror(rv, errbuf.data(), errbuf.size());
+    return;
+  }
+
+  if (LOG_ENABLED(INFO)) {
+    WLOG(INFO, worker) << "Worker thread is pinned to CPU " << cpu;
+  }
+#else  // !HAVE_DECL_PTHREAD_SETAFFINITY_NP
+  (void)worker;
+  (void)cpu;
+#endif // !HAVE_DECL_PTHREAD_SETAFFINITY_NP
+}
+} // namespace
+#endif // !NOTHREADS
+
+void Worker::set_cpu_affinity(int cpu) { cpu_ = cpu; }
+
+void Worker::set_accesslog_buffer(AccessLogBuffer *buf) {
+  accesslog_buffer_ = buf;
+}
+
+void Worker::set_response_cache(ResponseCache *cache) {
+  response_cache_ = cache;
+}
+
+ResponseCache *Worker::get_response_cache() const { return response_cache_; }
+
+void Worker::add_cache_waiter(uint64_t hash,
+                              CacheDownstreamConnection *dconn) {
+  cache_waiters_[hash].push_back(dconn);
+}
+
+void Worker::remove_cache_waiter(uint64_t hash,
+                                 CacheDownstreamConnection *dconn) {
+  auto it = cache_waiters_.find(hash);
+  if (it != std::end(cache_waiters_)) {
+    auto &v = (*it).second;
+    v.erase(std::remove(std::begin(v), std::end(v), dconn), std::end(v));
+    if (v.empty()) {
+      cache_waiters_.erase(it);
+    }
+  }
+
+  cache_woken_.erase(
+      std::remove(std::begin(cache_woken_), std::end(cache_woken_), dconn),
+      std::end(cache_woken_));
+}
+
+void Worker::wake_cache_waiters(uint64_t hash) {
+  auto it = cache_waiters_.find(hash);
+  if (it == std::end(cache_waiters_)) {
+    return;
+  }
+
+  // The connections which wait again are added to cache_waiters_.
+  cache_woken_ = std::move((*it).second);
+  cache_waiters_.erase(it);
+
+  while (!cache_woken_.empty()) {
+    auto dconn = cache_woken_.back();
+    cache_woken_.pop_back();
+
+    dconn->on_cache_filled();
+  }
+}
+
 void Worker::run_async() {
 #ifndef NOTHREADS
   fut_ = std::async(std::launch::async, [this] {
     (void)reopen_log_files(get_config()->logging);
+    log_config()->accesslog_buffer = accesslog_buffer_;
+    if (cpu_ != -1) {
+      pin_thread(this, cpu_);
+    }
     ev_run(loop_);
     delete_log_config();
   });
@@ -315,75 +432,72 @@ void Worker::run_async() {
 }
 
 void Worker::send(const WorkerEvent &event) {
+  q_.push(event);
+
+  // acq_rel makes the push above visible to the worker which clears
+  // the flag in fetch_events().
+  if (!wakeup_pending_.exchange(true, std::memory_order_acq_rel)) {
+    ev_async_send(loop_, &w_);
+  }
+}
+
+void Worker::send_replace_downstream(
+    std::shared_ptr<DownstreamConfig> downstreamconf) {
   {
     std::lock_guard<std::mutex> g(m_);
 
-    q_.push_back(event);
+    downstreamconf_q_.push_back(std::move(downstreamconf));
   }
 
-  ev_async_send(loop_, &w_);
+  WorkerEvent wev{};
+  wev.type = REPLACE_DOWNSTREAM;
+
+  send(wev);
+}
+
+void Worker::fetch_events() {
+  // Clear the flag before draining the queue, so that the event
+  // pushed after this point wakes us up again.
+  wakeup_pending_.exchange(false, std::memory_order_acq_rel);
+
+  q_.pop_all(pending_q_);
 }
 
 void Worker::process_events() {
-  WorkerEvent wev;
-  {
-    std::lock_guard<std::mutex> g(m_);
+  // Process event one at a time.  This is important for
+  // NEW_CONNECTION event since accepting large number of new
+  // connections at once may delay time to 1st byte for existing
+  // connections.
 
-    // Process event one at a time.  This is important for
-    // NEW_CONNECTION event since accepting large number of new
-    // connections at once may delay time to 1st byte for existing
-    // connections.
+  if (pending_q_.empty()) {
+    fetch_events();
 
-    if (q_.empty()) {
+    if (pending_q_.empty()) {
       ev_timer_stop(loop_, &proc_wev_timer_);
       return;
     }
-
-    wev = q_.front();
-    q_.pop_front();
   }
 
+  auto wev = pending_q_.front();
+  pending_q_.pop_front();
+
   ev_timer_start(loop_, &proc_wev_timer_);
 
   auto config = get_config();
 
-  auto worker_connections = config->conn.upstream.worker_connections;
-
   switch (wev.type) {
-  case NEW_CONNECTION: {
+  case NEW_CONNECTION:
     if (LOG_ENABLED(INFO)) {
       WLOG(INFO, this) << "WorkerEvent: client_fd=" << wev.client_fd
                        << ", addrlen=" << wev.client_addrlen;
     }
 
-    if (worker_stat_.num_connections >= worker_connections) {
-
-      if (LOG_ENABLED(INFO)) {
-        WLOG(INFO, this) << "Too many connections >= " << worker_connections;
-      }
+    handle_connection(wev.client_fd, &wev.client_addr.sa, wev.client_addrlen,
+                      wev.faddr);
 
-      close(wev.client_fd);
-
-      break;
-    }
-
-    auto client_handler =
-        tls::accept_connection(this, wev.client_fd, &wev.client_addr.sa,
-                               wev.client_addrlen, wev.faddr);
-    if (!client_handler) {
-      if (LOG_ENABLED(INFO)) {
-        WLOG(ERROR, this) << "ClientHandler creation failed";
-      }
-      close(wev.client_fd);
-      break;
-    }
-
-    if (LOG_ENABLED(INFO)) {
-      WLOG(INFO, this) << "CLIENT_HANDLER:" << client_handler << " created ";
-    }
+    --worker_stat_.num_incoming;
 
     break;
-  }
   case REOPEN_LOG:
     WLOG(NOTICE, this) << "Reopening log files: worker process (thread " << this
                        << ")";
@@ -396,6 +510,8 @@ void Worker::process_events() {
 
     graceful_shutdown_ = true;
 
+    close_acceptor();
+
     if (worker_stat_.num_connections == 0) {
       ev_break(loop_);
 
@@ -406,7 +522,33 @@ void Worker::process_events() {
   case REPLACE_DOWNSTREAM:
     WLOG(NOTICE, this) << "Replace downstream";
 
-    replace_downstream_config(wev.downstreamconf);
+    {
+      std::shared_ptr<DownstreamConfig> downstreamconf;
+      {
+        std::lock_guard<std::mutex> g(m_);
+
+        downstreamconf = std::move(downstreamconf_q_.front());
+        downstreamconf_q_.pop_front();
+      }
+
+      replace_downstream_config(std::move(downstreamconf));
+    }
+
+    break;
+  case ENABLE_ACCEPTOR:
+    // Leave acceptors disabled if they are sleeping because of file
+    // descriptor exhaustion.  The timer enables them.
+    if (!ev_is_active(&disable_acceptor_timer_)) {
+      enable_acceptor();
+    }
+
+    break;
+  case DISABLE_ACCEPTOR:
+    disable_acceptor();
+
+    break;
+  case CACHE_FILLED:
+    wake_cache_waiters(wev.cache_hash);
 
     break;
   default:
@@ -416,6 +558,75 @@ void Worker::process_events() {
   }
 }
 
+int Worker::handle_connection(int fd, sockaddr *addr, int addrlen,
+                              const UpstreamAddr *faddr) {
+  auto worker_connections = get_config()->conn.upstream.worker_connections;
+
+  if (worker_stat_.num_connections >= worker_connections) {
+
+    if (LOG_ENABLED(INFO)) {
+      WLOG(INFO, this) << "Too many connections >= " << worker_connections;
+    }
+
+    close(fd);
+
+    return -1;
+  }
+
+  auto client_handler = tls::accept_connection(this, fd, addr, addrlen, faddr);
+  if (!client_handler) {
+    if (LOG_ENABLED(INFO)) {
+      WLOG(ERROR, this) << "ClientHandler creation failed";
+    }
+    close(fd);
+    return -1;
+  }
+
+  if (LOG_ENABLED(INFO)) {
+    WLOG(INFO, this) << "CLIENT_HANDLER:" << client_handler << " created ";
+  }
+
+  return 0;
+}
+
+void Worker::add_acceptor(std::unique_ptr<AcceptHandler> h) {
+  acceptors_.push_back(std::move(h));
+}
+
+void Worker::enable_acceptor() {
+  for (auto &a : acceptors_) {
+    a->enable();
+  }
+}
+
+void Worker::disable_acceptor() {
+  for (auto &a : acceptors_) {
+    a->disable();
+  }
+}
+
+void Worker::sleep_acceptor(ev_tstamp t) {
+  if (t == 0. || ev_is_active(&disable_acceptor_timer_)) {
+    return;
+  }
+
+  disable_acceptor();
+
+  ev_timer_set(&disable_acceptor_timer_, t, 0.);
+  ev_timer_start(loop_, &disable_acceptor_timer_);
+}
+
+void Worker::close_acceptor() {
+  ev_timer_stop(loop_, &disable_acceptor_timer_);
+
+  for (auto &a : acceptors_) {
+    while (a->accept_connection() == 0)
+      ;
+  }
+
+  acceptors_.clear();
+}
+
 tls::CertLookupTree *Worker::get_cert_lookup_tree() const { return cert_tree_; }
 
 std::shared_ptr<TicketKeys> Worker::get_ticket_keys() {
@@ -499,17 +710,45 @@ size_t match_downstream_addr_group_host(
     const RouterConfig &routerconf, const StringRef &host,
     const StringRef &path,
     const std::vector<std::shared_ptr<DownstreamAddrGroup>> &groups,
-    size_t catch_all, BlockAllocator &balloc) {
+    size_t catch_all, BlockAllocator &balloc, const Request *req) {
 
   const auto &router = routerconf.router;
   const auto &rev_wildcard_router = routerconf.rev_wildcard_router;
   const auto &wildcard_patterns = routerconf.wildcard_patterns;
+  const auto &rule_router = routerconf.rule_router;
 
   if (LOG_ENABLED(INFO)) {
     LOG(INFO) << "Perform mapping selection, using host=" << host
               << ", path=" << path;
   }
 
+  if (req && !rule_router.empty()) {
+    auto &names = rule_router.header_names();
+    auto &headers = req->fs.headers();
+    std::array<StringRef, RuleRouter::MAX_HEADER_NAMES> values;
+    for (size_t i = 0; i < names.size(); ++i) {
+      // Rules refer to the first header field of the name.
+      auto it = std::find_if(std::begin(headers), std::end(headers),
+                             [&names, i](const HeaderRefs::value_type &kv) {
+                               return kv.name == names[i];
+                             });
+      if (it != std::end(headers)) {
+        values[i] = it->value;
+      }
+    }
+
+    auto group =
+        rule_router.match(http2::to_method_string(req->method), host, path,
+                          values.data());
+    if (group != -1) {
+      if (LOG_ENABLED(INFO)) {
+        LOG(INFO) << "Found rule with query " << host << path
+                  << ", matched pattern=" << groups[group]->pattern;
+      }
+      return group;
+    }
+  }
+
   auto group = router.match(host, path);
   if (group != -1) {
     if (LOG_ENABLED(INFO)) {
@@ -578,7 +817,7 @@ size_t match_downstream_addr_group(
     const RouterConfig &routerconf, const StringRef &hostport,
     const StringRef &raw_path,
     const std::vector<std::shared_ptr<DownstreamAddrGroup>> &groups,
-    size_t catch_all, BlockAllocator &balloc) {
+    size_t catch_all, BlockAllocator &balloc, const Request *req) {
   if (std::find(std::begin(hostport), std::end(hostport), '/') !=
       std::end(hostport)) {
     // We use '/' specially, and if '/' is included in host, it breaks
@@ -596,7 +835,7 @@ size_t match_downstream_addr_group(
 
   if (hostport.empty()) {
     return match_downstream_addr_group_host(routerconf, hostport, path, groups,
-                                            catch_all, balloc);
+                                            catch_all, balloc, req);
   }
 
   StringRef host;
@@ -628,7 +867,157 @@ size_t match_downstream_addr_group(
     host = StringRef{low_host.base, ep};
   }
   return match_downstream_addr_group_host(routerconf, host, path, groups,
-                                          catch_all, balloc);
+                                          catch_all, balloc, req);
+}
+
+namespace {
+// Returns true if |lhs| has fewer requests in flight than |rhs|
+// relative to their weight.
+bool fewer_requests(const DownstreamAddr &lhs, const DownstreamAddr &rhs) {
+  // Compare (outstanding + 1) / weight without division.
+  return (lhs.stat->num_outstanding + 1) * rhs.weight <
+         (rhs.stat->num_outstanding + 1) * lhs.weight;
+}
+} // namespace
+
+namespace {
+// Returns the cost of sending a request to |addr| for EWMA balancing.
+// The address without response time sample is the cheapest, so that
+// it is tried soon.
+double ewma_cost(const DownstreamAddr &addr) {
+  return static_cast<double>(addr.stat->ewma_rtt + 1) *
+         (addr.stat->num_outstanding + 1) / addr.weight;
+}
+} // namespace
+
+ssize_t select_downstream_addr(SharedDownstreamAddr &shared_addr,
+                               std::mt19937 &gen) {
+  auto &addrs = shared_addr.addrs;
+  auto n = addrs.size();
+
+  switch (shared_addr.balance) {
+  case BALANCE_LEAST_REQUEST: {
+    ssize_t idx = -1;
+
+    // Start from next so that the ties are broken in turn.
+    for (size_t i = 0; i < n; ++i) {
+      auto j = (shared_addr.next + i) % n;
+      auto &addr = addrs[j];
+
+      if (addr.connect_blocker->blocked()) {
+        continue;
+      }
+
+      if (idx == -1 || fewer_requests(addr, addrs[idx])) {
+        idx = j;
+      }
+    }
+
+    if (++shared_addr.next >= n) {
+      shared_addr.next = 0;
+    }
+
+    return idx;
+  }
+  case BALANCE_EWMA: {
+    if (n > 1) {
+      // Power of two choices.  Pick 2 distinct addresses at random.
+      std::uniform_int_distribution<size_t> dist(0, n - 1);
+      std::uniform_int_distribution<size_t> offset_dist(1, n - 1);
+      auto a = dist(gen);
+      auto b = (a + offset_dist(gen)) % n;
+      auto a_ok = !addrs[a].connect_blocker->blocked();
+      auto b_ok = !addrs[b].connect_blocker->blocked();
+
+      if (a_ok && b_ok) {
+        return ewma_cost(addrs[a]) <= ewma_cost(addrs[b]) ? a : b;
+      }
+      if (a_ok) {
+        return a;
+      }
+      if (b_ok) {
+        return b;
+      }
+    }
+
+    // Take any available address.
+    for (size_t i = 0; i < n; ++i) {
+      if (!addrs[i].connect_blocker->blocked()) {
+        return i;
+      }
+    }
+
+    return -1;
+  }
+  default:
+    assert(0);
+    abort();
+  }
+}
+
+namespace {
+// The maximum ratio of outstanding requests of an address to its
+// share with session affinity, expressed as
+// AFFINITY_LOAD_FACTOR_NUM / AFFINITY_LOAD_FACTOR_DEN.  Hot clients
+// spill to the next addresses in affinity table beyond this.
+constexpr uint64_t AFFINITY_LOAD_FACTOR_NUM = 5;
+constexpr uint64_t AFFINITY_LOAD_FACTOR_DEN = 4;
+} // namespace
+
+ssize_t select_affinity_downstream_addr(const SharedDownstreamAddr &shared_addr,
+                                        uint32_t hash) {
+  auto &addrs = shared_addr.addrs;
+  auto &table = *shared_addr.affinity_table;
+
+  uint64_t total_outstanding = 0;
+  uint64_t total_weight = 0;
+
+  for (auto &addr : addrs) {
+    if (addr.connect_blocker->blocked()) {
+      continue;
+    }
+    total_outstanding += addr.stat->num_outstanding;
+    total_weight += addr.weight;
+  }
+
+  if (total_weight == 0) {
+    return -1;
+  }
+
+  // An address can take the new request if its outstanding requests
+  // are at most the load factor times its share of the total
+  // outstanding requests including the new one, rounded up.  The
+  // bound is at least 1 so that a few requests in flight do not break
+  // affinity.  At least one address satisfies this unless the other
+  // workers change the numbers in the meantime.
+  auto base = AFFINITY_LOAD_FACTOR_NUM * (total_outstanding + 1);
+  auto den = AFFINITY_LOAD_FACTOR_DEN * total_weight;
+
+  auto size = table.size();
+  ssize_t fallback = -1;
+
+  for (size_t i = 0, pos = hash % size; i < size; ++i) {
+    auto idx = table[pos];
+    auto &addr = addrs[idx];
+
+    if (!addr.connect_blocker->blocked()) {
+      auto bound = std::max((base * addr.weight + den - 1) / den,
+                            static_cast<uint64_t>(1));
+      if (addr.stat->num_outstanding <= bound) {
+        return idx;
+      }
+
+      if (fallback == -1) {
+        fallback = idx;
+      }
+    }
+
+    if (++pos == size) {
+      pos = 0;
+    }
+  }
+
+  return fallback;
 }
 
 void downstream_failure(DownstreamAddr *addr, const Address *raddr) {
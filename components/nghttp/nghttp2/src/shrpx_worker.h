@@ -28,6 +28,7 @@
 #include "shrpx.h"
 
 #include <mutex>
+#include <atomic>
 #include <vector>
 #include <random>
 #include <unordered_map>
@@ -50,16 +51,22 @@
 #include "shrpx_connect_blocker.h"
 #include "shrpx_dns_tracker.h"
 #include "allocator.h"
+#include "mpsc_queue.h"
 
 using namespace nghttp2;
 
 namespace shrpx {
 
 class Http2Session;
+class AccessLogBuffer;
+class ResponseCache;
+class CacheDownstreamConnection;
 class ConnectBlocker;
 class MemcachedDispatcher;
 struct UpstreamAddr;
+struct Request;
 class ConnectionHandler;
+class AcceptHandler;
 
 #ifdef HAVE_MRUBY
 namespace mruby {
@@ -90,10 +97,15 @@ struct DownstreamAddr {
   std::unique_ptr<ConnectBlocker> connect_blocker;
   std::unique_ptr<LiveCheck> live_check;
   // Connection pool for this particular address if session affinity
-  // is enabled
+  // or balance policy other than round-robin is enabled
   std::unique_ptr<DownstreamConnectionPool> dconn_pool;
+  // Statistics shared by all workers, which balance policies other
+  // than round-robin use.
+  std::shared_ptr<DownstreamAddrStat> stat;
   size_t fall;
   size_t rise;
+  // Weight of this address for load balancing
+  uint32_t weight;
   // Client side TLS session cache
   tls::TLSSessionCache tls_session_cache;
   // Http2Session object created for this address.  This list chains
@@ -137,6 +149,7 @@ struct SharedDownstreamAddr {
         http1_pri{},
         http2_pri{},
         affinity{AFFINITY_NONE},
+        balance{BALANCE_ROUND_ROBIN},
         redirect_if_not_tls{false} {}
 
   SharedDownstreamAddr(const SharedDownstreamAddr &) = delete;
@@ -146,9 +159,9 @@ struct SharedDownstreamAddr {
 
   BlockAllocator balloc;
   std::vector<DownstreamAddr> addrs;
-  // Bunch of session affinity hash.  Only used if affinity ==
-  // AFFINITY_IP.
-  std::vector<AffinityHash> affinity_hash;
+  // Lookup table for session affinity shared by all workers.  Only
+  // used if affinity != AFFINITY_NONE.
+  std::shared_ptr<std::vector<uint32_t>> affinity_table;
   // List of Http2Session which is not fully utilized (i.e., the
   // server advertised maximum concurrency is not reached).  We will
   // coalesce as much stream as possible in one Http2Session to fully
@@ -170,8 +183,19 @@ struct SharedDownstreamAddr {
   // HTTP/1.1.  Otherwise, choose HTTP/2.
   WeightedPri http1_pri;
   WeightedPri http2_pri;
+  // Returns true if a backend address is chosen for each request
+  // before taking a connection, and connections are pooled per
+  // address.  Otherwise, dconn_pool is used.
+  bool per_addr_pool() const {
+    return affinity != AFFINITY_NONE || balance != BALANCE_ROUND_ROBIN;
+  }
+
   // Session affinity
   shrpx_session_affinity affinity;
+  // The name of cookie or header field which session affinity uses.
+  StringRef affinity_key;
+  // Load balancing policy
+  shrpx_balance balance;
   // true if this group requires that client connection must be TLS,
   // and the request must be redirected to https URI.
   bool redirect_if_not_tls;
@@ -193,8 +217,16 @@ struct DownstreamAddrGroup {
   bool retired;
 };
 
+// The counters are updated by the worker thread, and read by the
+// main thread to choose a worker for a new connection.
 struct WorkerStat {
-  size_t num_connections;
+  // The number of client connections this worker serves.
+  std::atomic<size_t> num_connections;
+  // The number of streams (requests) in flight on those connections.
+  std::atomic<size_t> num_streams;
+  // The number of connections which have been dispatched to this
+  // worker by the main thread, but have not been processed yet.
+  std::atomic<size_t> num_incoming;
 };
 
 enum WorkerEventType {
@@ -202,8 +234,14 @@ enum WorkerEventType {
   REOPEN_LOG = 0x02,
   GRACEFUL_SHUTDOWN = 0x03,
   REPLACE_DOWNSTREAM = 0x04,
+  ENABLE_ACCEPTOR = 0x05,
+  DISABLE_ACCEPTOR = 0x06,
+  CACHE_FILLED = 0x07,
 };
 
+// WorkerEvent is copied into the ring buffer of lock-free queue, and
+// must be trivially copyable.  The payload of REPLACE_DOWNSTREAM is
+// passed separately.  See Worker::send_replace_downstream().
 struct WorkerEvent {
   WorkerEventType type;
   struct {
@@ -212,8 +250,8 @@ struct WorkerEvent {
     int client_fd;
     const UpstreamAddr *faddr;
   };
-  std::shared_ptr<TicketKeys> ticket_keys;
-  std::shared_ptr<DownstreamConfig> downstreamconf;
+  // The hash of cache key for CACHE_FILLED.
+  uint64_t cache_hash;
 };
 
 class Worker {
@@ -228,7 +266,51 @@ public:
   void run_async();
   void wait();
   void process_events();
+  // Sends |event| to this worker.  This function can be called from
+  // any thread.
   void send(const WorkerEvent &event);
+  // Sends REPLACE_DOWNSTREAM event with |downstreamconf|.
+  void send_replace_downstream(
+      std::shared_ptr<DownstreamConfig> downstreamconf);
+
+  // Creates ClientHandler for the connection |fd| accepted by this
+  // worker.  Returns 0 if it succeeds.  Otherwise, |fd| is closed,
+  // and returns -1.
+  int handle_connection(int fd, sockaddr *addr, int addrlen,
+                        const UpstreamAddr *faddr);
+
+  // The following functions manage the listening sockets owned by
+  // this worker if --reuseport is enabled.  add_acceptor() must be
+  // called before run_async(), and the others must be called in the
+  // thread which runs this worker.
+  void add_acceptor(std::unique_ptr<AcceptHandler> h);
+  void enable_acceptor();
+  void disable_acceptor();
+  void sleep_acceptor(ev_tstamp t);
+  // Accepts the connections left in the backlog, and closes the
+  // listening sockets.  The connections which arrive at those sockets
+  // after this call are reset by the kernel.
+  void close_acceptor();
+
+  // Pins the thread which runs this worker to |cpu|.  This must be
+  // called before run_async().
+  void set_cpu_affinity(int cpu);
+
+  // Makes the thread which runs this worker append access log lines
+  // to |buf|.  This must be called before run_async().
+  void set_accesslog_buffer(AccessLogBuffer *buf);
+
+  // Makes this worker use |cache| to serve responses.  This must be
+  // called before run_async().
+  void set_response_cache(ResponseCache *cache);
+  // Returns the response cache, or nullptr if it is disabled.
+  ResponseCache *get_response_cache() const;
+
+  // Registers |dconn| which waits for the response for cache key
+  // |hash| being stored.  It is notified when this worker receives
+  // CACHE_FILLED event.
+  void add_cache_waiter(uint64_t hash, CacheDownstreamConnection *dconn);
+  void remove_cache_waiter(uint64_t hash, CacheDownstreamConnection *dconn);
 
   tls::CertLookupTree *get_cert_lookup_tree() const;
 
@@ -276,12 +358,31 @@ private:
 #ifndef NOTHREADS
   std::future<void> fut_;
 #endif // NOTHREADS
+  // Moves the events in q_ to pending_q_.
+  void fetch_events();
+  // Notifies the connections waiting for the response for cache key
+  // |hash|.
+  void wake_cache_waiters(uint64_t hash);
+
+  // Events sent from other threads.
+  MPSCOverflowQueue<WorkerEvent, 512> q_;
+  // Protects downstreamconf_q_.
   std::mutex m_;
-  std::deque<WorkerEvent> q_;
+  // The payloads of REPLACE_DOWNSTREAM events, in the order of the
+  // events.
+  std::deque<std::shared_ptr<DownstreamConfig>> downstreamconf_q_;
+  // true if w_ has been signaled, and the worker has not fetched the
+  // events yet.  The senders do not signal w_ while this is true, so
+  // that one wakeup takes many events.
+  std::atomic<bool> wakeup_pending_;
+  // Events fetched, but not processed yet.  Only the worker thread
+  // accesses this.
+  std::deque<WorkerEvent> pending_q_;
   std::mt19937 randgen_;
   ev_async w_;
   ev_timer mcpool_clear_timer_;
   ev_timer proc_wev_timer_;
+  ev_timer disable_acceptor_timer_;
   MemchunkPool mcpool_;
   WorkerStat worker_stat_;
   DNSTracker dns_tracker_;
@@ -308,6 +409,22 @@ private:
   // Worker level blocker for downstream connection.  For example,
   // this is used when file decriptor is exhausted.
   std::unique_ptr<ConnectBlocker> connect_blocker_;
+  // Listening sockets owned by this worker.  Empty unless
+  // --reuseport is enabled.
+  std::vector<std::unique_ptr<AcceptHandler>> acceptors_;
+  // Buffer of access log lines, or nullptr if access log is written
+  // by this worker.
+  AccessLogBuffer *accesslog_buffer_;
+  ResponseCache *response_cache_;
+  // The connections waiting for the response being stored, keyed by
+  // the hash of cache key.
+  std::unordered_map<uint64_t, std::vector<CacheDownstreamConnection *>>
+      cache_waiters_;
+  // The connections taken from cache_waiters_, and not notified yet.
+  // A notified connection may destroy the others.
+  std::vector<CacheDownstreamConnection *> cache_woken_;
+  // CPU which the thread running this worker is pinned to, or -1.
+  int cpu_;
 
   bool graceful_shutdown_;
 };
@@ -317,12 +434,29 @@ private:
 // contain port.  The |path| may contain query part.  We require the
 // catch-all pattern in place, so this function always selects one
 // group.  The catch-all group index is given in |catch_all|.  All
-// patterns are given in |groups|.
+// patterns are given in |groups|.  If |req| is not nullptr, the
+// routing rules are evaluated against it first.
 size_t match_downstream_addr_group(
     const RouterConfig &routerconfig, const StringRef &hostport,
     const StringRef &path,
     const std::vector<std::shared_ptr<DownstreamAddrGroup>> &groups,
-    size_t catch_all, BlockAllocator &balloc);
+    size_t catch_all, BlockAllocator &balloc, const Request *req = nullptr);
+
+// Selects a backend address in |shared_addr| according to its balance
+// policy, which must not be BALANCE_ROUND_ROBIN.  The addresses which
+// are blocked temporarily are skipped.  This function returns the
+// index of the selected address, or -1 if no address is available.
+ssize_t select_downstream_addr(SharedDownstreamAddr &shared_addr,
+                               std::mt19937 &gen);
+
+// Selects a backend address in |shared_addr| for session affinity
+// |hash|.  The address which |hash| maps to in affinity_table is
+// chosen unless it is blocked or it has more outstanding requests
+// than its bounded share.  Otherwise, the following elements of
+// affinity_table are tried in order.  This function returns the index
+// of the selected address, or -1 if no address is available.
+ssize_t select_affinity_downstream_addr(const SharedDownstreamAddr &shared_addr,
+                                        uint32_t hash);
 
 // Calls this function if connecting to backend failed.  |raddr| is
 // the actual address used to connect to backend, and it could be
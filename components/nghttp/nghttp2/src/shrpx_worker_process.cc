@@ -416,6 +416,11 @@ int worker_process_event_loop(WorkerProcessConfig *wpconf) {
   ConnectionHandler conn_handler(loop, gen);
 
   for (auto &addr : config->conn.listener.addrs) {
+    // With --reuseport, worker threads accept on these sockets by
+    // themselves.  See ConnectionHandler::create_worker_thread().
+    if (accept_in_worker(addr)) {
+      continue;
+    }
     conn_handler.add_acceptor(make_unique<AcceptHandler>(&addr, &conn_handler));
   }
 
@@ -501,6 +506,14 @@ int worker_process_event_loop(WorkerProcessConfig *wpconf) {
     }
   }
 
+  if (tls::upstream_tls_enabled(config->conn) && !config->tls.ocsp.disabled &&
+      config->tls.ocsp.startup) {
+    // This must be done before the workers are created, since they
+    // may have their own acceptors with --reuseport.
+    conn_handler.set_enable_acceptor_on_ocsp_completion(true);
+    conn_handler.disable_acceptor();
+  }
+
   if (config->single_thread) {
     rv = conn_handler.create_single_worker();
     if (rv != 0) {
@@ -547,11 +560,6 @@ int worker_process_event_loop(WorkerProcessConfig *wpconf) {
   ev_io_start(loop, &ipcev);
 
   if (tls::upstream_tls_enabled(config->conn) && !config->tls.ocsp.disabled) {
-    if (config->tls.ocsp.startup) {
-      conn_handler.set_enable_acceptor_on_ocsp_completion(true);
-      conn_handler.disable_acceptor();
-    }
-
     conn_handler.proceed_next_cert_ocsp();
   }
 
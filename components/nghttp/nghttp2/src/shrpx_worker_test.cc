@@ -34,6 +34,7 @@
 
 #include "shrpx_worker.h"
 #include "shrpx_connect_blocker.h"
+#include "shrpx_downstream.h"
 #include "shrpx_log.h"
 
 namespace shrpx {
@@ -244,4 +245,210 @@ void test_shrpx_worker_match_downstream_addr_group(void) {
                       StringRef{}, groups, 255, balloc));
 }
 
+void test_shrpx_worker_match_downstream_addr_group_rule(void) {
+  auto groups = std::vector<std::shared_ptr<DownstreamAddrGroup>>();
+  for (auto &s : {"/", "canary"}) {
+    auto g = std::make_shared<DownstreamAddrGroup>();
+    g->pattern = ImmutableString(s);
+    groups.push_back(std::move(g));
+  }
+
+  BlockAllocator balloc(1024, 1024);
+  RouterConfig routerconf;
+
+  routerconf.router.add_route(StringRef::from_lit("/"), 0);
+
+  auto &rule_router = routerconf.rule_router;
+
+  CU_ASSERT(0 == rule_router.add_rule(
+                     StringRef::from_lit("header.x-env=canary"), 1));
+  CU_ASSERT(0 == rule_router.compile());
+
+  {
+    Request req(balloc);
+
+    CU_ASSERT(0 == match_downstream_addr_group(
+                       routerconf, StringRef::from_lit("nghttp2.org"),
+                       StringRef::from_lit("/"), groups, 255, balloc, &req));
+  }
+
+  {
+    Request req(balloc);
+    req.fs.add_header_token(StringRef::from_lit("x-env"),
+                            StringRef::from_lit("canary"), false, -1);
+
+    CU_ASSERT(1 == match_downstream_addr_group(
+                       routerconf, StringRef::from_lit("nghttp2.org"),
+                       StringRef::from_lit("/"), groups, 255, balloc, &req));
+  }
+
+  // The first header field is used if there are several of them.
+  {
+    Request req(balloc);
+    req.fs.add_header_token(StringRef::from_lit("x-env"),
+                            StringRef::from_lit("canary"), false, -1);
+    req.fs.add_header_token(StringRef::from_lit("x-env"),
+                            StringRef::from_lit("prod"), false, -1);
+
+    CU_ASSERT(1 == match_downstream_addr_group(
+                       routerconf, StringRef::from_lit("nghttp2.org"),
+                       StringRef::from_lit("/"), groups, 255, balloc, &req));
+  }
+
+  {
+    Request req(balloc);
+    req.fs.add_header_token(StringRef::from_lit("x-env"),
+                            StringRef::from_lit("prod"), false, -1);
+    req.fs.add_header_token(StringRef::from_lit("x-env"),
+                            StringRef::from_lit("canary"), false, -1);
+
+    CU_ASSERT(0 == match_downstream_addr_group(
+                       routerconf, StringRef::from_lit("nghttp2.org"),
+                       StringRef::from_lit("/"), groups, 255, balloc, &req));
+  }
+}
+
+namespace {
+// Appends |n| addresses of weight 1 to |shared_addr|.
+void add_downstream_addrs(SharedDownstreamAddr &shared_addr, size_t n,
+                          std::mt19937 &gen) {
+  for (size_t i = 0; i < n; ++i) {
+    shared_addr.addrs.emplace_back();
+    auto &addr = shared_addr.addrs.back();
+    addr.stat = std::make_shared<DownstreamAddrStat>();
+    addr.weight = 1;
+    addr.connect_blocker = make_unique<ConnectBlocker>(
+        gen, EV_DEFAULT, []() {}, []() {});
+  }
+}
+} // namespace
+
+void test_shrpx_worker_select_downstream_addr(void) {
+  std::mt19937 gen(1);
+  SharedDownstreamAddr shared_addr;
+
+  add_downstream_addrs(shared_addr, 3, gen);
+
+  auto &addrs = shared_addr.addrs;
+
+  shared_addr.balance = BALANCE_LEAST_REQUEST;
+
+  // Ties are broken in turn.
+  CU_ASSERT(0 == select_downstream_addr(shared_addr, gen));
+  CU_ASSERT(1 == select_downstream_addr(shared_addr, gen));
+  CU_ASSERT(2 == select_downstream_addr(shared_addr, gen));
+
+  addrs[0].stat->num_outstanding = 2;
+  addrs[1].stat->num_outstanding = 1;
+  addrs[2].stat->num_outstanding = 3;
+
+  CU_ASSERT(1 == select_downstream_addr(shared_addr, gen));
+
+  // Address 2 takes 4 times as many requests as address 1.
+  addrs[2].weight = 4;
+
+  CU_ASSERT(2 == select_downstream_addr(shared_addr, gen));
+
+  addrs[2].connect_blocker->offline();
+
+  CU_ASSERT(1 == select_downstream_addr(shared_addr, gen));
+
+  shared_addr.balance = BALANCE_EWMA;
+
+  addrs[2].connect_blocker->online();
+
+  for (auto &addr : addrs) {
+    addr.stat->num_outstanding = 0;
+    addr.weight = 1;
+  }
+
+  addrs[0].stat->ewma_rtt = 1000;
+  addrs[1].stat->ewma_rtt = 100000;
+  addrs[2].stat->ewma_rtt = 10000;
+
+  // Of the 2 addresses picked at random, the faster one wins.  The
+  // slowest address is never chosen.
+  for (size_t i = 0; i < 16; ++i) {
+    CU_ASSERT(1 != select_downstream_addr(shared_addr, gen));
+  }
+
+  addrs[0].connect_blocker->offline();
+  addrs[2].connect_blocker->offline();
+
+  CU_ASSERT(1 == select_downstream_addr(shared_addr, gen));
+
+  addrs[1].connect_blocker->offline();
+
+  CU_ASSERT(-1 == select_downstream_addr(shared_addr, gen));
+}
+
+void test_shrpx_worker_select_affinity_downstream_addr(void) {
+  std::mt19937 gen(1);
+  SharedDownstreamAddr shared_addr;
+  std::vector<StringRef> keys{
+      StringRef::from_lit("192.168.0.1:80"),
+      StringRef::from_lit("192.168.0.2:80"),
+      StringRef::from_lit("192.168.0.3:80"),
+  };
+
+  add_downstream_addrs(shared_addr, keys.size(), gen);
+
+  auto &addrs = shared_addr.addrs;
+
+  shared_addr.affinity = AFFINITY_IP;
+  shared_addr.affinity_table = std::make_shared<std::vector<uint32_t>>();
+
+  CU_ASSERT(0 == compute_affinity_table(*shared_addr.affinity_table, keys,
+                                        std::vector<uint32_t>{1, 1, 1}));
+
+  auto &table = *shared_addr.affinity_table;
+  uint32_t hash = 1000000007;
+  auto idx = table[hash % table.size()];
+
+  // No request in flight.
+  CU_ASSERT(idx == select_affinity_downstream_addr(shared_addr, hash));
+
+  // A few requests in flight on the address do not break affinity
+  // while the other addresses are idle.
+  addrs[idx].stat->num_outstanding = 1;
+
+  CU_ASSERT(idx == select_affinity_downstream_addr(shared_addr, hash));
+
+  addrs[idx].stat->num_outstanding = 2;
+
+  CU_ASSERT(idx == select_affinity_downstream_addr(shared_addr, hash));
+
+  // 3 requests exceed the bound, which is ceil(5/4 * 4/3) = 2.
+  addrs[idx].stat->num_outstanding = 3;
+
+  CU_ASSERT(idx != select_affinity_downstream_addr(shared_addr, hash));
+
+  // The load is within the bound.
+  addrs[idx].stat->num_outstanding = 2;
+  addrs[(idx + 1) % 3].stat->num_outstanding = 2;
+  addrs[(idx + 2) % 3].stat->num_outstanding = 1;
+
+  CU_ASSERT(idx == select_affinity_downstream_addr(shared_addr, hash));
+
+  // The address has too many requests in flight.
+  addrs[idx].stat->num_outstanding = 10;
+
+  auto rv = select_affinity_downstream_addr(shared_addr, hash);
+
+  CU_ASSERT(-1 != rv);
+  CU_ASSERT(idx != rv);
+
+  // The same for blocked address.
+  addrs[idx].stat->num_outstanding = 0;
+  addrs[idx].connect_blocker->offline();
+
+  CU_ASSERT(rv == select_affinity_downstream_addr(shared_addr, hash));
+
+  for (auto &addr : addrs) {
+    addr.connect_blocker->offline();
+  }
+
+  CU_ASSERT(-1 == select_affinity_downstream_addr(shared_addr, hash));
+}
+
 } // namespace shrpx
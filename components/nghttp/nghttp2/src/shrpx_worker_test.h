@@ -32,6 +32,9 @@
 namespace shrpx {
 
 void test_shrpx_worker_match_downstream_addr_group(void);
+void test_shrpx_worker_match_downstream_addr_group_rule(void);
+void test_shrpx_worker_select_downstream_addr(void);
+void test_shrpx_worker_select_affinity_downstream_addr(void);
 
 } // namespace shrpx
 
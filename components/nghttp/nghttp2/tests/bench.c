@@ -0,0 +1,100 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+/* include benchmarks' include files here */
+#include "nghttp2_session_bench.h"
+#include "nghttp2_hd_bench.h"
+#include "nghttp2_helper_bench.h"
+
+typedef struct {
+  const char *name;
+  void (*run)(void);
+} bench_entry;
+
+static const bench_entry benchmarks[] = {
+    {"session_mem_send", bench_nghttp2_session_mem_send},
+    {"session_mem_send_small", bench_nghttp2_session_mem_send_small},
+    {"session_sched", bench_nghttp2_session_sched},
+    {"session_window", bench_nghttp2_session_window},
+    {"hd_inflate", bench_nghttp2_hd_inflate},
+    {"hd_deflate", bench_nghttp2_hd_deflate},
+    {"check_header", bench_nghttp2_check_header},
+};
+
+static void print_usage(const char *prog) {
+  size_t i;
+
+  fprintf(stderr, "Usage: %s [NAME...]\n"
+                  "Run benchmarks whose names contain one of NAMEs, or all "
+                  "benchmarks if\nno NAME is given.  Set "
+                  "NGHTTP2_BENCH_ITERATIONS to override the\nnumber of "
+                  "iterations.\n\nAvailable benchmarks:\n",
+          prog);
+
+  for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+    fprintf(stderr, "  %s\n", benchmarks[i].name);
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t i;
+  int j;
+  int nrun = 0;
+
+  for (j = 1; j < argc; ++j) {
+    if (strcmp(argv[j], "-h") == 0 || strcmp(argv[j], "--help") == 0) {
+      print_usage(argv[0]);
+      return 0;
+    }
+  }
+
+  for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+    if (argc > 1) {
+      for (j = 1; j < argc; ++j) {
+        if (strstr(benchmarks[i].name, argv[j])) {
+          break;
+        }
+      }
+      if (j == argc) {
+        continue;
+      }
+    }
+
+    benchmarks[i].run();
+    ++nrun;
+  }
+
+  if (nrun == 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  return 0;
+}
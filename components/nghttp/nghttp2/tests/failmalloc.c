@@ -55,6 +55,8 @@ int main() {
   /* add the tests to the suite */
   if (!CU_add_test(pSuite, "failmalloc_session_send",
                    test_nghttp2_session_send) ||
+      !CU_add_test(pSuite, "failmalloc_session_send_slab",
+                   test_nghttp2_session_send_slab) ||
       !CU_add_test(pSuite, "failmalloc_session_send_server",
                    test_nghttp2_session_send_server) ||
       !CU_add_test(pSuite, "failmalloc_session_recv",
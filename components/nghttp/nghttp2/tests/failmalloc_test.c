@@ -124,7 +124,7 @@ static ssize_t fixed_length_data_source_read_callback(
     nghttp2_failmalloc = 0;                                                    \
   } while (0)
 
-static void run_nghttp2_session_send(void) {
+static void run_session_send(const nghttp2_option *option) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
   nghttp2_nv nv[] = {MAKE_NV(":host", "example.org"),
@@ -144,7 +144,7 @@ static void run_nghttp2_session_send(void) {
   iv[1].settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
   iv[1].value = 100;
 
-  rv = nghttp2_session_client_new3(&session, &callbacks, &ud, NULL,
+  rv = nghttp2_session_client_new3(&session, &callbacks, &ud, option,
                                    nghttp2_mem_fm());
   if (rv != 0) {
     goto client_new_fail;
@@ -212,10 +212,43 @@ fail:
 client_new_fail:;
 }
 
+static void run_nghttp2_session_send(void) { run_session_send(NULL); }
+
 void test_nghttp2_session_send(void) {
   TEST_FAILMALLOC_RUN(run_nghttp2_session_send);
 }
 
+static void run_nghttp2_session_send_slab(void) {
+  nghttp2_option *option;
+
+  nghttp2_failmalloc_pause();
+  nghttp2_option_new(&option);
+  nghttp2_failmalloc_unpause();
+
+  nghttp2_option_set_slab_allocator(option, 1);
+
+  run_session_send(option);
+
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_send_slab(void) {
+  int nmalloc_default;
+
+  TEST_FAILMALLOC_RUN(run_nghttp2_session_send_slab);
+
+  nghttp2_nmalloc = 0;
+  run_nghttp2_session_send();
+  nmalloc_default = nghttp2_nmalloc;
+
+  /* With slab allocator, small objects are carved from pages, so the
+     underlying allocator is called less often. */
+  nghttp2_nmalloc = 0;
+  run_nghttp2_session_send_slab();
+
+  CU_ASSERT(nghttp2_nmalloc < nmalloc_default);
+}
+
 static void run_nghttp2_session_send_server(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks *callbacks;
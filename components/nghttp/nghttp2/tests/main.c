@@ -40,6 +40,7 @@
 #include "nghttp2_npn_test.h"
 #include "nghttp2_helper_test.h"
 #include "nghttp2_buf_test.h"
+#include "nghttp2_slab_test.h"
 
 extern int nghttp2_enable_strict_preface;
 
@@ -81,6 +82,10 @@ int main() {
       !CU_add_test(pSuite, "session_recv_eof", test_nghttp2_session_recv_eof) ||
       !CU_add_test(pSuite, "session_recv_data",
                    test_nghttp2_session_recv_data) ||
+      !CU_add_test(pSuite, "session_recv_data_auto_window_size",
+                   test_nghttp2_session_recv_data_auto_window_size) ||
+      !CU_add_test(pSuite, "session_recv_data_rcbuf",
+                   test_nghttp2_session_recv_data_rcbuf) ||
       !CU_add_test(pSuite, "session_recv_data_no_auto_flow_control",
                    test_nghttp2_session_recv_data_no_auto_flow_control) ||
       !CU_add_test(pSuite, "session_recv_continuation",
@@ -89,6 +94,8 @@ int main() {
                    test_nghttp2_session_recv_headers_with_priority) ||
       !CU_add_test(pSuite, "session_recv_headers_early_response",
                    test_nghttp2_session_recv_headers_early_response) ||
+      !CU_add_test(pSuite, "session_recv_headers_borrow",
+                   test_nghttp2_session_recv_headers_borrow) ||
       !CU_add_test(pSuite, "session_server_recv_push_response",
                    test_nghttp2_session_server_recv_push_response) ||
       !CU_add_test(pSuite, "session_recv_premature_headers",
@@ -291,6 +298,18 @@ int main() {
                    test_nghttp2_session_reset_pending_headers) ||
       !CU_add_test(pSuite, "session_send_data_callback",
                    test_nghttp2_session_send_data_callback) ||
+      !CU_add_test(pSuite, "session_mem_send_iov",
+                   test_nghttp2_session_mem_send_iov) ||
+      !CU_add_test(pSuite, "session_mem_send_coalesce",
+                   test_nghttp2_session_mem_send_coalesce) ||
+      !CU_add_test(pSuite, "session_no_rfc7540_priorities",
+                   test_nghttp2_session_no_rfc7540_priorities) ||
+      !CU_add_test(pSuite, "session_get_stats",
+                   test_nghttp2_session_get_stats) ||
+      !CU_add_test(pSuite, "session_get_stats_continuation",
+                   test_nghttp2_session_get_stats_continuation) ||
+      !CU_add_test(pSuite, "session_keep_header_rcbuf",
+                   test_nghttp2_session_keep_header_rcbuf) ||
       !CU_add_test(pSuite, "session_on_begin_headers_temporal_failure",
                    test_nghttp2_session_on_begin_headers_temporal_failure) ||
       !CU_add_test(pSuite, "session_defer_then_close",
@@ -378,6 +397,8 @@ int main() {
                    test_nghttp2_hd_inflate_expect_table_size_update) ||
       !CU_add_test(pSuite, "hd_inflate_unexpected_table_size_update",
                    test_nghttp2_hd_inflate_unexpected_table_size_update) ||
+      !CU_add_test(pSuite, "hd_inflate_borrow",
+                   test_nghttp2_hd_inflate_borrow) ||
       !CU_add_test(pSuite, "hd_ringbuf_reserve",
                    test_nghttp2_hd_ringbuf_reserve) ||
       !CU_add_test(pSuite, "hd_change_table_size",
@@ -389,6 +410,9 @@ int main() {
       !CU_add_test(pSuite, "hd_public_api", test_nghttp2_hd_public_api) ||
       !CU_add_test(pSuite, "hd_deflate_hd_vec",
                    test_nghttp2_hd_deflate_hd_vec) ||
+      !CU_add_test(pSuite, "hd_deflate_static_table",
+                   test_nghttp2_hd_deflate_static_table) ||
+      !CU_add_test(pSuite, "hd_stats", test_nghttp2_hd_stats) ||
       !CU_add_test(pSuite, "hd_decode_length", test_nghttp2_hd_decode_length) ||
       !CU_add_test(pSuite, "hd_huff_encode", test_nghttp2_hd_huff_encode) ||
       !CU_add_test(pSuite, "adjust_local_window_size",
@@ -397,6 +421,8 @@ int main() {
                    test_nghttp2_check_header_name) ||
       !CU_add_test(pSuite, "check_header_value",
                    test_nghttp2_check_header_value) ||
+      !CU_add_test(pSuite, "check_header_chars_exhaustive",
+                   test_nghttp2_check_header_chars_exhaustive) ||
       !CU_add_test(pSuite, "bufs_add", test_nghttp2_bufs_add) ||
       !CU_add_test(pSuite, "bufs_add_stack_buffer_overflow_bug",
                    test_nghttp2_bufs_add_stack_buffer_overflow_bug) ||
@@ -407,7 +433,10 @@ int main() {
       !CU_add_test(pSuite, "bufs_advance", test_nghttp2_bufs_advance) ||
       !CU_add_test(pSuite, "bufs_next_present",
                    test_nghttp2_bufs_next_present) ||
-      !CU_add_test(pSuite, "bufs_realloc", test_nghttp2_bufs_realloc)) {
+      !CU_add_test(pSuite, "bufs_realloc", test_nghttp2_bufs_realloc) ||
+      !CU_add_test(pSuite, "slab", test_nghttp2_slab) ||
+      !CU_add_test(pSuite, "slab_realloc", test_nghttp2_slab_realloc) ||
+      !CU_add_test(pSuite, "slab_release", test_nghttp2_slab_release)) {
     CU_cleanup_registry();
     return CU_get_error();
   }
@@ -0,0 +1,88 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_bench_helper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint64_t bench_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+size_t bench_iterations(size_t dflt) {
+  const char *s;
+  char *end;
+  unsigned long n;
+
+  s = getenv("NGHTTP2_BENCH_ITERATIONS");
+  if (s == NULL || *s == '\0') {
+    return dflt;
+  }
+
+  n = strtoul(s, &end, 10);
+  if (*end != '\0' || n == 0) {
+    return dflt;
+  }
+
+  return (size_t)n;
+}
+
+void bench_start(bench_timer *timer, const char *name, const char *variant) {
+  timer->name = name;
+  timer->variant = variant;
+  timer->start = bench_now();
+}
+
+uint64_t bench_stop(bench_timer *timer, size_t nbytes, size_t nops) {
+  uint64_t elapsed;
+  double sec;
+
+  elapsed = bench_now() - timer->start;
+  if (elapsed == 0) {
+    elapsed = 1;
+  }
+
+  sec = (double)elapsed / 1e9;
+
+  printf("%-32s %-16s %10.3f ms", timer->name, timer->variant, sec * 1e3);
+
+  if (nbytes) {
+    printf(" %10.2f MiB/s", (double)nbytes / (1024 * 1024) / sec);
+  }
+
+  if (nops) {
+    printf(" %12.0f ops/s %8.1f ns/op", (double)nops / sec,
+           (double)elapsed / (double)nops);
+  }
+
+  printf("\n");
+
+  return elapsed;
+}
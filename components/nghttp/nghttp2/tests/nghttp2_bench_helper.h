@@ -0,0 +1,63 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef NGHTTP2_BENCH_HELPER_H
+#define NGHTTP2_BENCH_HELPER_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+  /* The name of benchmark, and the variant being measured */
+  const char *name;
+  const char *variant;
+  /* The start time in nanoseconds */
+  uint64_t start;
+} bench_timer;
+
+/*
+ * Returns the number of iterations each benchmark should run.  This
+ * is taken from NGHTTP2_BENCH_ITERATIONS environment variable if it
+ * is set, or |dflt| otherwise.
+ */
+size_t bench_iterations(size_t dflt);
+
+/*
+ * Starts measuring |variant| of benchmark |name|.
+ */
+void bench_start(bench_timer *timer, const char *name, const char *variant);
+
+/*
+ * Stops measuring, and prints the elapsed time, and the throughput
+ * computed from |nbytes| and |nops| to standard output.  |nbytes|
+ * may be 0 if throughput in bytes is meaningless.  This function
+ * returns elapsed time in nanoseconds.
+ */
+uint64_t bench_stop(bench_timer *timer, size_t nbytes, size_t nops);
+
+#endif /* NGHTTP2_BENCH_HELPER_H */
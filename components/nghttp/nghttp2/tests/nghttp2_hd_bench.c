@@ -0,0 +1,425 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_hd_bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nghttp2/nghttp2.h>
+
+#include "nghttp2_bench_helper.h"
+
+#define MAKE_NV(NAME, VALUE, FLAGS)                                            \
+  {                                                                            \
+    (uint8_t *)(NAME), (uint8_t *)(VALUE), sizeof((NAME)) - 1,                 \
+        sizeof((VALUE)) - 1, FLAGS                                             \
+  }
+
+/* The number of requests in a corpus.  This is the default
+   SETTINGS_MAX_CONCURRENT_STREAMS client assumes. */
+#define BENCH_NREQ 100
+/* The maximum length of a corpus */
+#define BENCH_CORPUSLEN (1024 * 1024)
+
+typedef struct {
+  /* The number of allocations made so far */
+  size_t nalloc;
+  /* The number of header fields server received */
+  size_t nfield;
+  /* The sum of the length of received names and values */
+  size_t nbytes;
+} bench_hd_ctx;
+
+static void bench_fail(const char *what, long rv) {
+  fprintf(stderr, "%s failed: %ld\n", what, rv);
+  exit(EXIT_FAILURE);
+}
+
+static void *counting_malloc(size_t size, void *mem_user_data) {
+  bench_hd_ctx *ctx = mem_user_data;
+
+  ++ctx->nalloc;
+
+  return malloc(size);
+}
+
+static void counting_free(void *ptr, void *mem_user_data) {
+  (void)mem_user_data;
+
+  free(ptr);
+}
+
+static void *counting_calloc(size_t nmemb, size_t size, void *mem_user_data) {
+  bench_hd_ctx *ctx = mem_user_data;
+
+  ++ctx->nalloc;
+
+  return calloc(nmemb, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size, void *mem_user_data) {
+  bench_hd_ctx *ctx = mem_user_data;
+
+  ++ctx->nalloc;
+
+  return realloc(ptr, size);
+}
+
+static int on_header_callback(nghttp2_session *session,
+                              const nghttp2_frame *frame, const uint8_t *name,
+                              size_t namelen, const uint8_t *value,
+                              size_t valuelen, uint8_t flags,
+                              void *user_data) {
+  bench_hd_ctx *ctx = user_data;
+  (void)session;
+  (void)frame;
+  (void)name;
+  (void)value;
+  (void)flags;
+
+  ++ctx->nfield;
+  ctx->nbytes += namelen + valuelen;
+
+  return 0;
+}
+
+/*
+ * Fills |buf| with |len| bytes of per-request unique token which is
+ * composed of characters in |alphabet|.
+ */
+static void make_token(char *buf, size_t len, const char *alphabet,
+                       size_t seed) {
+  size_t i, n = strlen(alphabet);
+
+  for (i = 0; i < len; ++i) {
+    seed = seed * 1103515245 + 12345;
+    buf[i] = alphabet[(seed >> 16) % n];
+  }
+  buf[len] = '\0';
+}
+
+/*
+ * Generates client connection preface, followed by BENCH_NREQ
+ * header-heavy requests into |corpus|, and returns its length.  Each
+ * request has header fields which client indexes, and the
+ * per-request ones which client never indexes.  Some of the latter
+ * are not Huffman encoded because their characters have long Huffman
+ * codes.
+ */
+static size_t make_corpus(uint8_t *corpus) {
+  nghttp2_session *client;
+  nghttp2_session_callbacks *callbacks;
+  char cookie[129], auth[65], reqid[33], trace[49], etag[33];
+  nghttp2_nv nva[] = {
+      MAKE_NV(":method", "GET", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV(":scheme", "https", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV(":authority", "www.example.org", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV(":path", "/index.html", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("accept", "text/html,application/xhtml+xml,application/"
+                        "xml;q=0.9,*/*;q=0.8",
+              NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("accept-encoding", "gzip, deflate, br", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("accept-language", "en-US,en;q=0.5", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:55.0) "
+                            "Gecko/20100101 Firefox/55.0",
+              NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("cache-control", "no-cache", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("cookie", "", NGHTTP2_NV_FLAG_NO_INDEX),
+      MAKE_NV("authorization", "", NGHTTP2_NV_FLAG_NO_INDEX),
+      MAKE_NV("x-request-id", "", NGHTTP2_NV_FLAG_NO_INDEX),
+      MAKE_NV("x-trace-context", "", NGHTTP2_NV_FLAG_NO_INDEX),
+      MAKE_NV("if-none-match", "", NGHTTP2_NV_FLAG_NO_INDEX),
+  };
+  size_t corpuslen = 0;
+  size_t i;
+  const uint8_t *data;
+  ssize_t len;
+  int32_t stream_id;
+  int rv;
+
+  nghttp2_session_callbacks_new(&callbacks);
+
+  rv = nghttp2_session_client_new(&client, callbacks, NULL);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_client_new", rv);
+  }
+
+  nghttp2_session_callbacks_del(callbacks);
+
+  rv = nghttp2_submit_settings(client, NGHTTP2_FLAG_NONE, NULL, 0);
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  for (i = 0; i < BENCH_NREQ; ++i) {
+    /* Huffman encoded */
+    make_token(cookie, sizeof(cookie) - 1, "abcdefghijklmnopqrstuvwxyz=;", i);
+    make_token(reqid, sizeof(reqid) - 1, "0123456789abcdef", i);
+    /* Not Huffman encoded */
+    make_token(auth, sizeof(auth) - 1, "ABCDEFGHIJKLMNOPQRSTUVWXYZ+/", i);
+    make_token(trace, sizeof(trace) - 1, "^|~{}<>", i);
+    make_token(etag, sizeof(etag) - 1, "\"#$&@[]\\", i);
+
+    nva[9].value = (uint8_t *)cookie;
+    nva[9].valuelen = sizeof(cookie) - 1;
+    nva[10].value = (uint8_t *)auth;
+    nva[10].valuelen = sizeof(auth) - 1;
+    nva[11].value = (uint8_t *)reqid;
+    nva[11].valuelen = sizeof(reqid) - 1;
+    nva[12].value = (uint8_t *)trace;
+    nva[12].valuelen = sizeof(trace) - 1;
+    nva[13].value = (uint8_t *)etag;
+    nva[13].valuelen = sizeof(etag) - 1;
+
+    stream_id = nghttp2_submit_request(
+        client, NULL, nva, sizeof(nva) / sizeof(nva[0]), NULL, NULL);
+    if (stream_id < 0) {
+      bench_fail("nghttp2_submit_request", stream_id);
+    }
+
+    /* Serialize now, since nva refers to the token buffers */
+    for (;;) {
+      len = nghttp2_session_mem_send(client, &data);
+      if (len < 0) {
+        bench_fail("nghttp2_session_mem_send", (long)len);
+      }
+      if (len == 0) {
+        break;
+      }
+      if (corpuslen + (size_t)len > BENCH_CORPUSLEN) {
+        bench_fail("corpus length check", (long)corpuslen);
+      }
+
+      memcpy(corpus + corpuslen, data, (size_t)len);
+      corpuslen += (size_t)len;
+    }
+  }
+
+  nghttp2_session_del(client);
+
+  return corpuslen;
+}
+
+/*
+ * Lets fresh server session receive |corpus| of length |corpuslen|
+ * |niter| times, and reports the time and the number of allocations
+ * per request.
+ */
+static void run_inflate(const char *name, const char *variant,
+                        int borrow_header_fields, const uint8_t *corpus,
+                        size_t corpuslen, size_t niter) {
+  bench_hd_ctx ctx;
+  nghttp2_mem mem = {NULL, counting_malloc, counting_free, counting_calloc,
+                     counting_realloc};
+  nghttp2_session *server;
+  nghttp2_session_callbacks *callbacks;
+  nghttp2_option *option;
+  bench_timer timer;
+  size_t i, base, nalloc = 0;
+  ssize_t nread;
+  int rv;
+
+  memset(&ctx, 0, sizeof(ctx));
+
+  mem.mem_user_data = &ctx;
+
+  nghttp2_session_callbacks_new(&callbacks);
+  nghttp2_session_callbacks_set_on_header_callback(callbacks,
+                                                   on_header_callback);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_borrow_header_fields(option, borrow_header_fields);
+
+  bench_start(&timer, name, variant);
+
+  for (i = 0; i < niter; ++i) {
+    rv = nghttp2_session_server_new3(&server, callbacks, &ctx, option, &mem);
+    if (rv != 0) {
+      bench_fail("nghttp2_session_server_new3", rv);
+    }
+
+    /* Exclude allocations made by session creation */
+    base = ctx.nalloc;
+
+    nread = nghttp2_session_mem_recv(server, corpus, corpuslen);
+    if (nread != (ssize_t)corpuslen) {
+      bench_fail("nghttp2_session_mem_recv", (long)nread);
+    }
+
+    nalloc += ctx.nalloc - base;
+
+    nghttp2_session_del(server);
+  }
+
+  bench_stop(&timer, niter * corpuslen, niter * BENCH_NREQ);
+
+  printf("%-32s %-16s %10.2f allocs/request %8.2f fields/request\n", name,
+         variant, (double)nalloc / (double)(niter * BENCH_NREQ),
+         (double)ctx.nfield / (double)(niter * BENCH_NREQ));
+
+  nghttp2_option_del(option);
+  nghttp2_session_callbacks_del(callbacks);
+}
+
+void bench_nghttp2_hd_inflate(void) {
+  size_t niter = bench_iterations(1024);
+  uint8_t *corpus;
+  size_t corpuslen;
+
+  corpus = malloc(BENCH_CORPUSLEN);
+  if (corpus == NULL) {
+    bench_fail("malloc", 0);
+  }
+
+  corpuslen = make_corpus(corpus);
+
+  run_inflate("hd_inflate", "rcbuf", 0, corpus, corpuslen, niter);
+  run_inflate("hd_inflate", "borrow", 1, corpus, corpuslen, niter);
+
+  free(corpus);
+}
+
+/*
+ * Deflates BENCH_NREQ request and response header blocks |niter|
+ * times with a deflater per direction, and reports the time and the
+ * average block length.  Per-request header field values cycle
+ * through |nvariant| sets.  If |nvariant| is 1, all header fields
+ * are found in header table after the first block, and only table
+ * lookup and indexed representations are measured.
+ */
+static void run_deflate_pair(const char *variant, size_t nvariant,
+                             size_t niter) {
+  static char cookie[BENCH_NREQ][129], reqid[BENCH_NREQ][33],
+      etag[BENCH_NREQ][33], date[BENCH_NREQ][30], clen[BENCH_NREQ][16];
+  nghttp2_nv reqnva[] = {
+      MAKE_NV(":method", "GET", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV(":scheme", "https", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV(":authority", "www.example.org", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV(":path", "/", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("accept", "text/html,application/xhtml+xml,application/"
+                        "xml;q=0.9,*/*;q=0.8",
+              NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("accept-encoding", "gzip, deflate", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("accept-language", "en-US,en;q=0.5", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:55.0) "
+                            "Gecko/20100101 Firefox/55.0",
+              NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("upgrade-insecure-requests", "1", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("x-requested-with", "XMLHttpRequest", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("cookie", "", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("x-request-id", "", NGHTTP2_NV_FLAG_NONE),
+  };
+  nghttp2_nv resnva[] = {
+      MAKE_NV(":status", "200", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("server", "nghttpx", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("date", "", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("content-type", "text/html; charset=utf-8",
+              NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("content-length", "", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("etag", "", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("cache-control", "public, max-age=3600", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("vary", "accept-encoding", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("x-content-type-options", "nosniff", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("x-frame-options", "SAMEORIGIN", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("x-xss-protection", "1; mode=block", NGHTTP2_NV_FLAG_NONE),
+      MAKE_NV("access-control-allow-origin", "*", NGHTTP2_NV_FLAG_NONE),
+  };
+  nghttp2_hd_deflater *reqdeflater, *resdeflater;
+  bench_timer timer;
+  uint8_t buf[4096];
+  size_t i, j, nbytes = 0, blocklen = 0;
+  ssize_t rv;
+
+  /* Per-request values are generated in advance, so that only
+     deflation is measured. */
+  for (j = 0; j < BENCH_NREQ; ++j) {
+    make_token(cookie[j], sizeof(cookie[0]) - 1,
+               "abcdefghijklmnopqrstuvwxyz=;", j);
+    make_token(reqid[j], sizeof(reqid[0]) - 1, "0123456789abcdef", j);
+    make_token(etag[j], sizeof(etag[0]) - 1, "0123456789abcdef", j + 1);
+    make_token(date[j], sizeof(date[0]) - 1, "0123456789", j);
+    snprintf(clen[j], sizeof(clen[0]), "%zu", j * 1021);
+  }
+
+  nghttp2_hd_deflate_new(&reqdeflater, 4096);
+  nghttp2_hd_deflate_new(&resdeflater, 4096);
+
+  bench_start(&timer, "hd_deflate", variant);
+
+  for (i = 0; i < niter; ++i) {
+    for (j = 0; j < BENCH_NREQ; ++j) {
+      reqnva[10].value = (uint8_t *)cookie[j % nvariant];
+      reqnva[10].valuelen = sizeof(cookie[0]) - 1;
+      reqnva[11].value = (uint8_t *)reqid[j % nvariant];
+      reqnva[11].valuelen = sizeof(reqid[0]) - 1;
+      resnva[2].value = (uint8_t *)date[j % nvariant];
+      resnva[2].valuelen = sizeof(date[0]) - 1;
+      resnva[4].value = (uint8_t *)clen[j % nvariant];
+      resnva[4].valuelen = strlen(clen[j % nvariant]);
+      resnva[5].value = (uint8_t *)etag[j % nvariant];
+      resnva[5].valuelen = sizeof(etag[0]) - 1;
+
+      rv = nghttp2_hd_deflate_hd(reqdeflater, buf, sizeof(buf), reqnva,
+                                 sizeof(reqnva) / sizeof(reqnva[0]));
+      if (rv < 0) {
+        bench_fail("nghttp2_hd_deflate_hd", (long)rv);
+      }
+
+      blocklen += (size_t)rv;
+
+      rv = nghttp2_hd_deflate_hd(resdeflater, buf, sizeof(buf), resnva,
+                                 sizeof(resnva) / sizeof(resnva[0]));
+      if (rv < 0) {
+        bench_fail("nghttp2_hd_deflate_hd", (long)rv);
+      }
+
+      blocklen += (size_t)rv;
+    }
+  }
+
+  for (j = 0; j < sizeof(reqnva) / sizeof(reqnva[0]); ++j) {
+    nbytes += reqnva[j].namelen + reqnva[j].valuelen;
+  }
+  for (j = 0; j < sizeof(resnva) / sizeof(resnva[0]); ++j) {
+    nbytes += resnva[j].namelen + resnva[j].valuelen;
+  }
+
+  bench_stop(&timer, nbytes * niter * BENCH_NREQ, niter * BENCH_NREQ * 2);
+
+  printf("%-32s %-16s %10.2f bytes/block\n", "hd_deflate", variant,
+         (double)blocklen / (double)(niter * BENCH_NREQ * 2));
+
+  nghttp2_hd_deflate_del(resdeflater);
+  nghttp2_hd_deflate_del(reqdeflater);
+}
+
+void bench_nghttp2_hd_deflate(void) {
+  size_t niter = bench_iterations(1024);
+
+  run_deflate_pair("unique", BENCH_NREQ, niter);
+  run_deflate_pair("indexed", 1, niter);
+}
@@ -657,6 +657,137 @@ void test_nghttp2_hd_inflate_unexpected_table_size_update(void) {
   nghttp2_hd_inflate_free(&inflater);
 }
 
+void test_nghttp2_hd_inflate_borrow(void) {
+  nghttp2_hd_inflater inflater;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  nghttp2_hd_nv hd_nv;
+  ssize_t blocklen, rv;
+  nghttp2_nv nv[] = {/* Expecting huffman for both */
+                     MAKE_NV("my-long-content-length", "nghttp2"),
+                     /* Expecting no huffman for both */
+                     MAKE_NV("x", "y"),
+                     /* Huffman for key only */
+                     MAKE_NV("my-long-content-length", "y"),
+                     /* Huffman for value only */
+                     MAKE_NV("x", "nghttp2"),
+                     /* Name from static table, and value is not
+                        huffman encoded */
+                     MAKE_NV("user-agent", "{}"),
+                     /* Indexed with incremental indexing */
+                     MAKE_NV("x-inc", "{}")};
+  size_t i, j;
+  int inflate_flags;
+  nva_out out;
+  nghttp2_mem *mem;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  nva_out_init(&out);
+  nghttp2_hd_inflate_init(&inflater, mem);
+  inflater.borrow = 1;
+
+  /* Non-huffman literal refers to input */
+  CU_ASSERT(0 == nghttp2_hd_emit_newname_block(&bufs, &nv[1],
+                                               NGHTTP2_HD_WITHOUT_INDEXING));
+
+  buf = &bufs.head->buf;
+
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &hd_nv, &inflate_flags, buf->pos,
+                                nghttp2_buf_len(buf), 1);
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(inflate_flags & NGHTTP2_HD_INFLATE_EMIT);
+  CU_ASSERT(-1 == hd_nv.name->ref);
+  CU_ASSERT(-1 == hd_nv.value->ref);
+  CU_ASSERT(buf->pos < hd_nv.name->base && hd_nv.name->base < buf->last);
+  CU_ASSERT(buf->pos < hd_nv.value->base && hd_nv.value->base < buf->last);
+  CU_ASSERT(1 == hd_nv.value->len);
+  CU_ASSERT('y' == hd_nv.value->base[0]);
+
+  nghttp2_hd_inflate_end_headers(&inflater);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Huffman encoded literal is decoded into arena */
+  CU_ASSERT(0 == nghttp2_hd_emit_newname_block(&bufs, &nv[0],
+                                               NGHTTP2_HD_WITHOUT_INDEXING));
+
+  rv = nghttp2_hd_inflate_hd_nv(&inflater, &hd_nv, &inflate_flags, buf->pos,
+                                nghttp2_buf_len(buf), 1);
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT(-1 == hd_nv.name->ref);
+  CU_ASSERT(-1 == hd_nv.value->ref);
+  CU_ASSERT(inflater.arena.pos == hd_nv.name->base);
+  CU_ASSERT(inflater.arena.pos < hd_nv.value->base &&
+            hd_nv.value->base < inflater.arena.last);
+
+  nghttp2_hd_inflate_end_headers(&inflater);
+  nghttp2_bufs_reset(&bufs);
+
+  /* Encode all header fields in one block */
+  for (i = 0; i < ARRLEN(nv) - 2; ++i) {
+    CU_ASSERT(0 == nghttp2_hd_emit_newname_block(
+                       &bufs, &nv[i], NGHTTP2_HD_WITHOUT_INDEXING));
+  }
+
+  /* user-agent is at index 57 (0-based) of static table */
+  CU_ASSERT(0 == nghttp2_hd_emit_indname_block(&bufs, 57, &nv[4],
+                                               NGHTTP2_HD_NEVER_INDEXING));
+  CU_ASSERT(0 == nghttp2_hd_emit_newname_block(&bufs, &nv[5],
+                                               NGHTTP2_HD_WITH_INDEXING));
+
+  blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+  CU_ASSERT(blocklen > 0);
+  CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+  CU_ASSERT(ARRLEN(nv) == out.nvlen);
+
+  assert_nv_equal(nv, out.nva, ARRLEN(nv), mem);
+
+  CU_ASSERT(NGHTTP2_NV_FLAG_NO_INDEX == out.nva[4].flags);
+  CU_ASSERT(1 == inflater.ctx.hd_table.len);
+
+  nva_out_reset(&out, mem);
+
+  /* Feed one byte at a time, so that name and value are split across
+     the calls. */
+  buf = &bufs.head->buf;
+  j = 0;
+
+  for (i = 0; i < nghttp2_buf_len(buf);) {
+    rv = nghttp2_hd_inflate_hd_nv(&inflater, &hd_nv, &inflate_flags,
+                                  buf->pos + i, 1,
+                                  i + 1 == nghttp2_buf_len(buf));
+
+    CU_ASSERT(rv >= 0);
+
+    if (rv < 0) {
+      break;
+    }
+
+    i += (size_t)rv;
+
+    if (inflate_flags & NGHTTP2_HD_INFLATE_EMIT) {
+      CU_ASSERT(nv[j].namelen == hd_nv.name->len);
+      CU_ASSERT(0 == memcmp(nv[j].name, hd_nv.name->base, nv[j].namelen));
+      CU_ASSERT(nv[j].valuelen == hd_nv.value->len);
+      CU_ASSERT(0 ==
+                memcmp(nv[j].value, hd_nv.value->base, nv[j].valuelen));
+
+      ++j;
+    }
+  }
+
+  CU_ASSERT(ARRLEN(nv) == j);
+
+  nghttp2_hd_inflate_end_headers(&inflater);
+
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_inflate_free(&inflater);
+}
+
 void test_nghttp2_hd_ringbuf_reserve(void) {
   nghttp2_hd_deflater deflater;
   nghttp2_hd_inflater inflater;
@@ -1418,6 +1549,117 @@ void test_nghttp2_hd_deflate_hd_vec(void) {
   nva_out_reset(&out, mem);
 }
 
+void test_nghttp2_hd_deflate_static_table(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_bufs bufs;
+  const nghttp2_nv *ent;
+  nghttp2_nv nv;
+  size_t i;
+  int rv;
+  nghttp2_mem *mem;
+  uint8_t value[] = "GET2";
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  /* Every static table entry is encoded as indexed representation,
+     except for authorization and cookie which are never indexed. */
+  for (i = 1; i <= NGHTTP2_STATIC_TABLE_LENGTH; ++i) {
+    if (i - 1 == NGHTTP2_TOKEN_AUTHORIZATION ||
+        i - 1 == NGHTTP2_TOKEN_COOKIE) {
+      continue;
+    }
+
+    ent = nghttp2_hd_deflate_get_table_entry(&deflater, i);
+    nv = *ent;
+    nv.flags = NGHTTP2_NV_FLAG_NONE;
+
+    rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, &nv, 1);
+
+    CU_ASSERT(0 == rv);
+    CU_ASSERT(1 == nghttp2_bufs_len(&bufs));
+    CU_ASSERT((0x80 | i) == bufs.head->buf.pos[0]);
+
+    nghttp2_bufs_reset(&bufs);
+  }
+
+  CU_ASSERT(0 == deflater.ctx.hd_table.len);
+
+  /* Value which shares the first and the last byte, and length with
+     static entry must not match. */
+  nv.name = (uint8_t *)":method";
+  nv.namelen = strlen(":method");
+  nv.value = value;
+  nv.valuelen = 3;
+  value[1] = 'A';
+
+  rv = nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, &nv, 1);
+
+  CU_ASSERT(0 == rv);
+  CU_ASSERT(1 < nghttp2_bufs_len(&bufs));
+  CU_ASSERT(1 == deflater.ctx.hd_table.len);
+
+  nghttp2_bufs_free(&bufs);
+  nghttp2_hd_deflate_free(&deflater);
+}
+
+void test_nghttp2_hd_stats(void) {
+  nghttp2_hd_deflater deflater;
+  nghttp2_hd_inflater inflater;
+  nghttp2_nv nva[] = {MAKE_NV("x-a", "aaaa"), MAKE_NV("x-b", "bbbb")};
+  const nghttp2_hd_stats *stats;
+  nghttp2_bufs bufs;
+  nva_out out;
+  nghttp2_mem *mem;
+  ssize_t blocklen;
+  size_t i;
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  nva_out_init(&out);
+
+  nghttp2_hd_deflate_init(&deflater, mem);
+  nghttp2_hd_inflate_init(&inflater, mem);
+
+  /* The dynamic table can hold only one of the header fields. */
+  nghttp2_hd_deflate_change_table_size(&deflater, 64);
+  nghttp2_hd_inflate_change_table_size(&inflater, 64);
+
+  for (i = 0; i < ARRLEN(nva); ++i) {
+    CU_ASSERT(0 == nghttp2_hd_deflate_hd_bufs(&deflater, &bufs, &nva[i], 1));
+
+    blocklen = (ssize_t)nghttp2_bufs_len(&bufs);
+
+    CU_ASSERT(blocklen == inflate_hd(&inflater, &out, &bufs, 0, mem));
+
+    nva_out_reset(&out, mem);
+    nghttp2_bufs_reset(&bufs);
+  }
+
+  /* Names are shorter than their Huffman encoding, and values are
+     longer. */
+  stats = nghttp2_hd_deflate_get_stats(&deflater);
+
+  CU_ASSERT(2 == stats->literal);
+  CU_ASSERT(4 == stats->strings);
+  CU_ASSERT(2 == stats->huffman);
+  CU_ASSERT(1 == stats->evicted);
+
+  stats = nghttp2_hd_inflate_get_stats(&inflater);
+
+  CU_ASSERT(2 == stats->literal);
+  CU_ASSERT(4 == stats->strings);
+  CU_ASSERT(2 == stats->huffman);
+  CU_ASSERT(1 == stats->evicted);
+
+  nghttp2_hd_inflate_free(&inflater);
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_bufs_free(&bufs);
+}
+
 static size_t encode_length(uint8_t *buf, uint64_t n, size_t prefix) {
   size_t k = (size_t)((1 << prefix) - 1);
   size_t len = 0;
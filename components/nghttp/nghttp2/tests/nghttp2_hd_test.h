@@ -41,6 +41,7 @@ void test_nghttp2_hd_inflate_clearall_inc(void);
 void test_nghttp2_hd_inflate_zero_length_huffman(void);
 void test_nghttp2_hd_inflate_expect_table_size_update(void);
 void test_nghttp2_hd_inflate_unexpected_table_size_update(void);
+void test_nghttp2_hd_inflate_borrow(void);
 void test_nghttp2_hd_ringbuf_reserve(void);
 void test_nghttp2_hd_change_table_size(void);
 void test_nghttp2_hd_deflate_inflate(void);
@@ -48,6 +49,8 @@ void test_nghttp2_hd_no_index(void);
 void test_nghttp2_hd_deflate_bound(void);
 void test_nghttp2_hd_public_api(void);
 void test_nghttp2_hd_deflate_hd_vec(void);
+void test_nghttp2_hd_deflate_static_table(void);
+void test_nghttp2_hd_stats(void);
 void test_nghttp2_hd_decode_length(void);
 void test_nghttp2_hd_huff_encode(void);
 
@@ -0,0 +1,169 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_helper_bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <nghttp2/nghttp2.h>
+
+#include "nghttp2_bench_helper.h"
+
+/* Byte-at-a-time lookup tables, which is how header fields were
+   validated before. */
+static int name_chars[256];
+static int value_chars[256];
+
+static int check_header_name_bytewise(const uint8_t *name, size_t len) {
+  const uint8_t *last;
+
+  if (len == 0) {
+    return 0;
+  }
+  if (*name == ':') {
+    if (len == 1) {
+      return 0;
+    }
+    ++name;
+    --len;
+  }
+  for (last = name + len; name != last; ++name) {
+    if (!name_chars[*name]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int check_header_value_bytewise(const uint8_t *value, size_t len) {
+  const uint8_t *last;
+
+  for (last = value + len; value != last; ++value) {
+    if (!value_chars[*value]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void init_tables(void) {
+  uint8_t c;
+  size_t i;
+
+  for (i = 0; i < 256; ++i) {
+    c = (uint8_t)i;
+    name_chars[i] = nghttp2_check_header_name(&c, 1);
+    value_chars[i] = nghttp2_check_header_value(&c, 1);
+  }
+}
+
+/*
+ * Fills |buf| of length |len| with the characters which are allowed
+ * by |check|.
+ */
+static void fill(uint8_t *buf, size_t len,
+                 int (*check)(const uint8_t *, size_t)) {
+  size_t i;
+  unsigned int c = 0;
+
+  for (i = 0; i < len; ++i) {
+    do {
+      c = (c + 37) % 256;
+      buf[i] = (uint8_t)c;
+    } while (!check(&buf[i], 1));
+  }
+}
+
+static void run_check(const char *name, const char *variant,
+                      int (*check)(const uint8_t *, size_t),
+                      const uint8_t *buf, size_t len, size_t niter) {
+  bench_timer timer;
+  size_t i;
+  /* Prevent the compiler from optimizing out check */
+  volatile int ok = 1;
+
+  bench_start(&timer, name, variant);
+
+  for (i = 0; i < niter; ++i) {
+    ok &= check(buf, len);
+  }
+
+  bench_stop(&timer, niter * len, niter);
+
+  if (!ok) {
+    fprintf(stderr, "%s: %s: validation failed\n", name, variant);
+  }
+}
+
+void bench_nghttp2_check_header(void) {
+  /* Typical header field names */
+  static const char *names[] = {"content-type",
+                                "access-control-allow-credentials"};
+  /* Lengths of header field names made of all kinds of allowed
+     characters, which are rarely seen in practice */
+  static const size_t namelens[] = {12, 32};
+  /* Typical lengths of cookie and authorization header field value */
+  static const size_t valuelens[] = {64, 4096};
+  uint8_t buf[4096];
+  char name[64];
+  size_t niter = bench_iterations(1 << 20);
+  size_t i, n, len;
+
+  init_tables();
+
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+    len = strlen(names[i]);
+    snprintf(name, sizeof(name), "check_header_name_%zu", len);
+    n = niter * 64 / len;
+
+    run_check(name, "bytewise", check_header_name_bytewise,
+              (const uint8_t *)names[i], len, n);
+    run_check(name, "nghttp2", nghttp2_check_header_name,
+              (const uint8_t *)names[i], len, n);
+  }
+
+  for (i = 0; i < sizeof(namelens) / sizeof(namelens[0]); ++i) {
+    snprintf(name, sizeof(name), "check_header_name_sym_%zu", namelens[i]);
+    fill(buf, namelens[i], nghttp2_check_header_name);
+    n = niter * 64 / namelens[i];
+
+    run_check(name, "bytewise", check_header_name_bytewise, buf, namelens[i],
+              n);
+    run_check(name, "nghttp2", nghttp2_check_header_name, buf, namelens[i],
+              n);
+  }
+
+  for (i = 0; i < sizeof(valuelens) / sizeof(valuelens[0]); ++i) {
+    snprintf(name, sizeof(name), "check_header_value_%zu", valuelens[i]);
+    fill(buf, valuelens[i], nghttp2_check_header_value);
+    n = niter * 64 / valuelens[i];
+
+    run_check(name, "bytewise", check_header_value_bytewise, buf,
+              valuelens[i], n);
+    run_check(name, "nghttp2", nghttp2_check_header_value, buf, valuelens[i],
+              n);
+  }
+}
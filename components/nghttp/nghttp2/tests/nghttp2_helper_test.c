@@ -24,6 +24,8 @@
  */
 #include "nghttp2_helper_test.h"
 
+#include <string.h>
+
 #include <CUnit/CUnit.h>
 
 #include "nghttp2_helper.h"
@@ -167,3 +169,67 @@ void test_nghttp2_check_header_value(void) {
   CU_ASSERT(!check_header_value(badval1));
   CU_ASSERT(!check_header_value(badval2));
 }
+
+static int is_name_char(uint8_t c) {
+  return ('0' <= c && c <= '9') || ('a' <= c && c <= 'z') ||
+         (c != 0 && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static int is_value_char(uint8_t c) {
+  return c == '\t' || (0x20 <= c && c != 0x7f);
+}
+
+/*
+ * Places every byte at every position of strings of various length
+ * and alignment, and checks that |check| agrees with |is_valid|
+ * applied to each byte.
+ */
+static void check_header_chars_exhaustive(int (*check)(const uint8_t *,
+                                                       size_t),
+                                          int (*is_valid)(uint8_t)) {
+  uint8_t buf[64];
+  uint8_t filler[256];
+  size_t nfiller = 0;
+  size_t align, len, pos, i;
+  unsigned int c;
+  int ok = 1;
+
+  for (c = 0; c < 256; ++c) {
+    if (is_valid((uint8_t)c)) {
+      filler[nfiller++] = (uint8_t)c;
+    }
+  }
+
+  for (align = 0; align < 4; ++align) {
+    for (len = 1; len <= 48; ++len) {
+      for (i = 0; i < len; ++i) {
+        buf[align + i] = filler[(len + i) % nfiller];
+      }
+
+      ok = ok && check(buf + align, len);
+
+      for (pos = 0; pos < len; ++pos) {
+        for (c = 0; c < 256; ++c) {
+          buf[align + pos] = (uint8_t)c;
+
+          ok = ok && (!check(buf + align, len) == !is_valid((uint8_t)c));
+        }
+
+        buf[align + pos] = filler[(len + pos) % nfiller];
+      }
+    }
+  }
+
+  CU_ASSERT(ok);
+}
+
+/* Leading ':' of pseudo header field is tested in
+   test_nghttp2_check_header_name. */
+static int check_header_name_no_colon(const uint8_t *name, size_t len) {
+  return name[0] != ':' && nghttp2_check_header_name(name, len);
+}
+
+void test_nghttp2_check_header_chars_exhaustive(void) {
+  check_header_chars_exhaustive(check_header_name_no_colon, is_name_char);
+  check_header_chars_exhaustive(nghttp2_check_header_value, is_value_char);
+}
@@ -0,0 +1,866 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_session_bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nghttp2/nghttp2.h>
+
+#include "nghttp2_bench_helper.h"
+
+#define MAKE_NV(NAME, VALUE)                                                   \
+  {                                                                            \
+    (uint8_t *)(NAME), (uint8_t *)(VALUE), sizeof((NAME)) - 1,                 \
+        sizeof((VALUE)) - 1, NGHTTP2_NV_FLAG_NONE                              \
+  }
+
+/* The length of response body per request in bulk transfer */
+#define BENCH_BODYLEN (4 * 1024 * 1024)
+/* The length of response body per request in small-response
+   workload */
+#define BENCH_SMALL_BODYLEN 64
+/* The number of concurrent requests in small-response workload */
+#define BENCH_SMALL_NSTREAMS 100
+/* The maximum length of DATA payload with default SETTINGS */
+#define BENCH_CHUNKLEN 16384
+/* The size of buffer which emulates socket send buffer */
+#define BENCH_WIRELEN (256 * 1024)
+/* The number of nghttp2_vec passed to nghttp2_session_mem_send_iov */
+#define BENCH_VECCNT 16
+/* The number of concurrent streams in scheduler workload */
+#define BENCH_SCHED_NSTREAMS 1024
+/* The length of DATA payload in scheduler workload.  It is kept
+   small so that the cost of choosing stream dominates. */
+#define BENCH_SCHED_CHUNKLEN 256
+/* One-way delay of emulated link in milliseconds */
+#define BENCH_LINK_DELAY 50
+/* Bandwidth of emulated link in bytes per millisecond (100Mbps) */
+#define BENCH_LINK_RATE 12500
+/* The length of response body transferred over emulated link */
+#define BENCH_LINK_BODYLEN (32 * 1024 * 1024)
+/* The maximum window size used in emulated link workload */
+#define BENCH_LINK_MAX_WINDOW_SIZE (16 * 1024 * 1024)
+
+typedef enum { BENCH_MEM_SEND, BENCH_MEM_SEND_IOV } bench_send_mode;
+
+typedef struct {
+  nghttp2_session *client;
+  nghttp2_session *server;
+  bench_send_mode mode;
+  /* Bytes written by server, and not yet read by client */
+  uint8_t wire[BENCH_WIRELEN];
+  size_t wirelen;
+  /* The length of response body per request */
+  size_t bodylen;
+  /* The number of response body bytes client received */
+  size_t nrecv;
+  /* The number of writes server made */
+  size_t nwrite;
+  /* The number of streams closed in client */
+  size_t nclosed;
+} bench_session_ctx;
+
+static uint8_t body[BENCH_CHUNKLEN];
+
+static void bench_fail(const char *what, long rv) {
+  fprintf(stderr, "%s failed: %ld\n", what, rv);
+  exit(EXIT_FAILURE);
+}
+
+static ssize_t body_read_callback(nghttp2_session *session, int32_t stream_id,
+                                  uint8_t *buf, size_t length,
+                                  uint32_t *data_flags,
+                                  nghttp2_data_source *source,
+                                  void *user_data) {
+  bench_session_ctx *ctx = user_data;
+  size_t n;
+  (void)session;
+  (void)stream_id;
+
+  /* source->ptr is abused to hold the number of bytes left */
+  n = (size_t)(uintptr_t)source->ptr;
+  if (n > length) {
+    n = length;
+  }
+  if (n > sizeof(body)) {
+    n = sizeof(body);
+  }
+
+  if (ctx->mode == BENCH_MEM_SEND_IOV) {
+    *data_flags |= NGHTTP2_DATA_FLAG_NO_COPY;
+  } else {
+    memcpy(buf, body, n);
+  }
+
+  source->ptr = (void *)((uintptr_t)source->ptr - n);
+
+  if (source->ptr == NULL) {
+    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+  }
+
+  return (ssize_t)n;
+}
+
+static int ref_data_callback(nghttp2_session *session, nghttp2_frame *frame,
+                             const uint8_t **data_ptr, size_t length,
+                             nghttp2_data_source *source, void *user_data) {
+  (void)session;
+  (void)frame;
+  (void)length;
+  (void)source;
+  (void)user_data;
+
+  *data_ptr = body;
+
+  return 0;
+}
+
+static int server_on_frame_recv_callback(nghttp2_session *session,
+                                         const nghttp2_frame *frame,
+                                         void *user_data) {
+  bench_session_ctx *ctx = user_data;
+  nghttp2_nv resnv[] = {MAKE_NV(":status", "200")};
+  nghttp2_data_provider data_prd;
+  int rv;
+
+  if (frame->hd.type != NGHTTP2_HEADERS ||
+      frame->headers.cat != NGHTTP2_HCAT_REQUEST ||
+      !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+    return 0;
+  }
+
+  data_prd.source.ptr = (void *)(uintptr_t)ctx->bodylen;
+  data_prd.read_callback = body_read_callback;
+
+  rv = nghttp2_submit_response(session, frame->hd.stream_id, resnv,
+                               sizeof(resnv) / sizeof(resnv[0]), &data_prd);
+  if (rv != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  return 0;
+}
+
+static int client_on_data_chunk_recv_callback(nghttp2_session *session,
+                                              uint8_t flags, int32_t stream_id,
+                                              const uint8_t *data, size_t len,
+                                              void *user_data) {
+  bench_session_ctx *ctx = user_data;
+  (void)session;
+  (void)flags;
+  (void)stream_id;
+  (void)data;
+
+  ctx->nrecv += len;
+
+  return 0;
+}
+
+static int client_on_stream_close_callback(nghttp2_session *session,
+                                           int32_t stream_id,
+                                           uint32_t error_code,
+                                           void *user_data) {
+  bench_session_ctx *ctx = user_data;
+  (void)session;
+  (void)stream_id;
+  (void)error_code;
+
+  ++ctx->nclosed;
+
+  return 0;
+}
+
+static void client_to_server(bench_session_ctx *ctx) {
+  const uint8_t *data;
+  ssize_t len, nread;
+
+  for (;;) {
+    len = nghttp2_session_mem_send(ctx->client, &data);
+    if (len < 0) {
+      bench_fail("nghttp2_session_mem_send", (long)len);
+    }
+    if (len == 0) {
+      return;
+    }
+
+    nread = nghttp2_session_mem_recv(ctx->server, data, (size_t)len);
+    if (nread != len) {
+      bench_fail("nghttp2_session_mem_recv", (long)nread);
+    }
+  }
+}
+
+/*
+ * Lets client read all bytes in ctx->wire.
+ */
+static void flush_wire(bench_session_ctx *ctx) {
+  ssize_t nread;
+
+  if (ctx->wirelen == 0) {
+    return;
+  }
+
+  nread = nghttp2_session_mem_recv(ctx->client, ctx->wire, ctx->wirelen);
+  if (nread != (ssize_t)ctx->wirelen) {
+    bench_fail("nghttp2_session_mem_recv", (long)nread);
+  }
+
+  ctx->wirelen = 0;
+}
+
+/*
+ * Copies |len| bytes pointed by |data| to ctx->wire, just like
+ * write(2) copies data to socket buffer.
+ */
+static void write_wire(bench_session_ctx *ctx, const uint8_t *data,
+                       size_t len) {
+  memcpy(ctx->wire + ctx->wirelen, data, len);
+  ctx->wirelen += len;
+}
+
+static void server_to_client(bench_session_ctx *ctx) {
+  const uint8_t *data;
+  nghttp2_vec vec[BENCH_VECCNT];
+  ssize_t len, nvec, i;
+  size_t total;
+
+  for (;;) {
+    if (ctx->mode == BENCH_MEM_SEND) {
+      len = nghttp2_session_mem_send(ctx->server, &data);
+      if (len < 0) {
+        bench_fail("nghttp2_session_mem_send", (long)len);
+      }
+      if (len == 0) {
+        break;
+      }
+
+      if (ctx->wirelen + (size_t)len > sizeof(ctx->wire)) {
+        flush_wire(ctx);
+      }
+
+      write_wire(ctx, data, (size_t)len);
+      ++ctx->nwrite;
+
+      continue;
+    }
+
+    nvec = nghttp2_session_mem_send_iov(ctx->server, vec, BENCH_VECCNT);
+    if (nvec < 0) {
+      bench_fail("nghttp2_session_mem_send_iov", (long)nvec);
+    }
+    if (nvec == 0) {
+      break;
+    }
+
+    total = 0;
+    for (i = 0; i < nvec; ++i) {
+      total += vec[i].len;
+    }
+
+    if (total > sizeof(ctx->wire)) {
+      bench_fail("nghttp2_session_mem_send_iov batch", (long)total);
+    }
+
+    if (ctx->wirelen + total > sizeof(ctx->wire)) {
+      flush_wire(ctx);
+    }
+
+    /* This is what writev(2) does */
+    for (i = 0; i < nvec; ++i) {
+      write_wire(ctx, vec[i].base, vec[i].len);
+    }
+    ++ctx->nwrite;
+  }
+
+  flush_wire(ctx);
+}
+
+/*
+ * Makes client send |nstreams| requests at once, and server respond
+ * to them with |bodylen| bytes of body, |niter| times.  If
+ * |coalesce_length| is nonzero, server coalesces frames in
+ * nghttp2_session_mem_send().
+ */
+static void run_mem_send(const char *name, const char *variant,
+                         bench_send_mode mode, size_t coalesce_length,
+                         size_t bodylen, size_t nstreams, size_t niter) {
+  bench_session_ctx *ctx;
+  nghttp2_session_callbacks *callbacks;
+  nghttp2_option *option;
+  nghttp2_settings_entry iv[] = {
+      {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, 1 << 30}};
+  nghttp2_nv reqnv[] = {
+      MAKE_NV(":method", "GET"), MAKE_NV(":scheme", "https"),
+      MAKE_NV(":authority", "localhost"), MAKE_NV(":path", "/"),
+  };
+  bench_timer timer;
+  size_t i, j, nreq;
+  int32_t stream_id;
+  int rv;
+
+  ctx = calloc(1, sizeof(*ctx));
+  if (ctx == NULL) {
+    bench_fail("calloc", 0);
+  }
+
+  ctx->mode = mode;
+  ctx->bodylen = bodylen;
+
+  nghttp2_session_callbacks_new(&callbacks);
+
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+      callbacks, client_on_data_chunk_recv_callback);
+  nghttp2_session_callbacks_set_on_stream_close_callback(
+      callbacks, client_on_stream_close_callback);
+
+  rv = nghttp2_session_client_new(&ctx->client, callbacks, ctx);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_client_new", rv);
+  }
+
+  nghttp2_session_callbacks_del(callbacks);
+
+  nghttp2_session_callbacks_new(&callbacks);
+
+  nghttp2_session_callbacks_set_on_frame_recv_callback(
+      callbacks, server_on_frame_recv_callback);
+  nghttp2_session_callbacks_set_ref_data_callback(callbacks,
+                                                  ref_data_callback);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_send_coalesce_length(option, coalesce_length);
+
+  rv = nghttp2_session_server_new2(&ctx->server, callbacks, ctx, option);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_server_new2", rv);
+  }
+
+  nghttp2_option_del(option);
+  nghttp2_session_callbacks_del(callbacks);
+
+  /* Make flow control window large enough so that we measure the
+     send path rather than round trips of WINDOW_UPDATE. */
+  rv = nghttp2_submit_settings(ctx->client, NGHTTP2_FLAG_NONE, iv,
+                               sizeof(iv) / sizeof(iv[0]));
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  rv = nghttp2_session_set_local_window_size(ctx->client, NGHTTP2_FLAG_NONE,
+                                             0, 1 << 30);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_set_local_window_size", rv);
+  }
+
+  rv = nghttp2_submit_settings(ctx->server, NGHTTP2_FLAG_NONE, NULL, 0);
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  bench_start(&timer, name, variant);
+
+  for (i = 0; i < niter; ++i) {
+    for (j = 0; j < nstreams; ++j) {
+      stream_id = nghttp2_submit_request(ctx->client, NULL, reqnv,
+                                         sizeof(reqnv) / sizeof(reqnv[0]),
+                                         NULL, NULL);
+      if (stream_id < 0) {
+        bench_fail("nghttp2_submit_request", stream_id);
+      }
+    }
+
+    ctx->nclosed = 0;
+
+    while (ctx->nclosed < nstreams) {
+      client_to_server(ctx);
+      server_to_client(ctx);
+    }
+  }
+
+  nreq = niter * nstreams;
+
+  bench_stop(&timer, nreq * bodylen, nreq);
+
+  printf("%-32s %-16s %10.2f writes/request\n", name, variant,
+         (double)ctx->nwrite / (double)nreq);
+
+  if (ctx->nrecv != nreq * bodylen) {
+    bench_fail("response body length check", (long)ctx->nrecv);
+  }
+
+  nghttp2_session_del(ctx->client);
+  nghttp2_session_del(ctx->server);
+
+  free(ctx);
+}
+
+void bench_nghttp2_session_mem_send(void) {
+  size_t niter = bench_iterations(256);
+
+  run_mem_send("session_mem_send", "mem_send", BENCH_MEM_SEND, 0,
+               BENCH_BODYLEN, 1, niter);
+  run_mem_send("session_mem_send", "mem_send_iov", BENCH_MEM_SEND_IOV, 0,
+               BENCH_BODYLEN, 1, niter);
+}
+
+void bench_nghttp2_session_mem_send_small(void) {
+  size_t niter = bench_iterations(256);
+
+  run_mem_send("session_mem_send_small", "mem_send", BENCH_MEM_SEND, 0,
+               BENCH_SMALL_BODYLEN, BENCH_SMALL_NSTREAMS, niter);
+  run_mem_send("session_mem_send_small", "coalesce_16k", BENCH_MEM_SEND,
+               16384, BENCH_SMALL_BODYLEN, BENCH_SMALL_NSTREAMS, niter);
+  run_mem_send("session_mem_send_small", "mem_send_iov", BENCH_MEM_SEND_IOV,
+               0, BENCH_SMALL_BODYLEN, BENCH_SMALL_NSTREAMS, niter);
+}
+
+typedef struct {
+  nghttp2_session *client;
+  nghttp2_session *server;
+  /* Nonzero if server uses the flat urgency-based scheduler */
+  int no_rfc7540_priorities;
+  /* The number of streams which server has responded to */
+  size_t nstreams;
+} bench_sched_ctx;
+
+static ssize_t sched_read_callback(nghttp2_session *session,
+                                   int32_t stream_id, uint8_t *buf,
+                                   size_t length, uint32_t *data_flags,
+                                   nghttp2_data_source *source,
+                                   void *user_data) {
+  (void)session;
+  (void)stream_id;
+  (void)buf;
+  (void)data_flags;
+  (void)source;
+  (void)user_data;
+
+  /* Response body never ends, and its content is not interesting
+     here. */
+  if (length > BENCH_SCHED_CHUNKLEN) {
+    length = BENCH_SCHED_CHUNKLEN;
+  }
+
+  return (ssize_t)length;
+}
+
+static int sched_on_frame_recv_callback(nghttp2_session *session,
+                                        const nghttp2_frame *frame,
+                                        void *user_data) {
+  bench_sched_ctx *ctx = user_data;
+  nghttp2_nv resnv[] = {MAKE_NV(":status", "200")};
+  nghttp2_data_provider data_prd;
+  nghttp2_extpri extpri;
+  int rv;
+
+  if (frame->hd.type != NGHTTP2_HEADERS ||
+      frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
+    return 0;
+  }
+
+  if (ctx->no_rfc7540_priorities) {
+    /* Spread streams over urgency levels, just like weights are
+       spread in dependency tree. */
+    extpri.urgency = (uint32_t)(ctx->nstreams % NGHTTP2_EXTPRI_URGENCY_LEVELS);
+    extpri.inc = 1;
+
+    rv = nghttp2_session_change_extpri_stream_priority(
+        session, frame->hd.stream_id, &extpri);
+    if (rv != 0) {
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+  }
+
+  data_prd.source.ptr = NULL;
+  data_prd.read_callback = sched_read_callback;
+
+  rv = nghttp2_submit_response(session, frame->hd.stream_id, resnv,
+                               sizeof(resnv) / sizeof(resnv[0]), &data_prd);
+  if (rv != 0) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  ++ctx->nstreams;
+
+  return 0;
+}
+
+/*
+ * Opens |nstreams| streams which never end, and measures how fast
+ * server produces DATA frames with the scheduler selected by
+ * |no_rfc7540_priorities|.  Each stream has a distinct priority.
+ */
+static void run_sched(const char *name, const char *variant,
+                      int no_rfc7540_priorities, size_t nstreams,
+                      size_t nframes) {
+  bench_sched_ctx ctx;
+  nghttp2_session_callbacks *callbacks;
+  nghttp2_option *option;
+  nghttp2_settings_entry iv[] = {
+      {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, NGHTTP2_MAX_WINDOW_SIZE},
+      {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, BENCH_SCHED_NSTREAMS}};
+  nghttp2_nv reqnv[] = {
+      MAKE_NV(":method", "GET"), MAKE_NV(":scheme", "https"),
+      MAKE_NV(":authority", "localhost"), MAKE_NV(":path", "/"),
+  };
+  nghttp2_priority_spec pri_spec;
+  bench_timer timer;
+  const uint8_t *data;
+  ssize_t len, nread;
+  size_t i;
+  int32_t stream_id;
+  int rv;
+
+  memset(&ctx, 0, sizeof(ctx));
+
+  ctx.no_rfc7540_priorities = no_rfc7540_priorities;
+
+  nghttp2_session_callbacks_new(&callbacks);
+
+  rv = nghttp2_session_client_new(&ctx.client, callbacks, &ctx);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_client_new", rv);
+  }
+
+  nghttp2_session_callbacks_set_on_frame_recv_callback(
+      callbacks, sched_on_frame_recv_callback);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_rfc7540_priorities(option, no_rfc7540_priorities);
+
+  rv = nghttp2_session_server_new2(&ctx.server, callbacks, &ctx, option);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_server_new2", rv);
+  }
+
+  nghttp2_option_del(option);
+  nghttp2_session_callbacks_del(callbacks);
+
+  rv = nghttp2_submit_settings(ctx.client, NGHTTP2_FLAG_NONE, iv,
+                               sizeof(iv) / sizeof(iv[0]));
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  rv = nghttp2_session_set_local_window_size(ctx.client, NGHTTP2_FLAG_NONE, 0,
+                                             NGHTTP2_MAX_WINDOW_SIZE);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_set_local_window_size", rv);
+  }
+
+  rv = nghttp2_submit_settings(ctx.server, NGHTTP2_FLAG_NONE, iv,
+                               sizeof(iv) / sizeof(iv[0]));
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  /* Let client know MAX_CONCURRENT_STREAMS */
+  len = nghttp2_session_mem_send(ctx.server, &data);
+  if (len <= 0) {
+    bench_fail("nghttp2_session_mem_send", (long)len);
+  }
+
+  nread = nghttp2_session_mem_recv(ctx.client, data, (size_t)len);
+  if (nread != len) {
+    bench_fail("nghttp2_session_mem_recv", (long)nread);
+  }
+
+  for (i = 0; i < nstreams; ++i) {
+    nghttp2_priority_spec_init(&pri_spec, 0, (int32_t)(i % 256) + 1, 0);
+
+    stream_id = nghttp2_submit_request(ctx.client, &pri_spec, reqnv,
+                                       sizeof(reqnv) / sizeof(reqnv[0]), NULL,
+                                       NULL);
+    if (stream_id < 0) {
+      bench_fail("nghttp2_submit_request", stream_id);
+    }
+  }
+
+  for (;;) {
+    len = nghttp2_session_mem_send(ctx.client, &data);
+    if (len < 0) {
+      bench_fail("nghttp2_session_mem_send", (long)len);
+    }
+    if (len == 0) {
+      break;
+    }
+
+    nread = nghttp2_session_mem_recv(ctx.server, data, (size_t)len);
+    if (nread != len) {
+      bench_fail("nghttp2_session_mem_recv", (long)nread);
+    }
+  }
+
+  if (ctx.nstreams != nstreams) {
+    bench_fail("stream count check", (long)ctx.nstreams);
+  }
+
+  /* Send SETTINGS ACK and response HEADERS so that only DATA frames
+     are measured */
+  do {
+    len = nghttp2_session_mem_send(ctx.server, &data);
+    if (len <= 0) {
+      bench_fail("nghttp2_session_mem_send", (long)len);
+    }
+  } while (data[3] != NGHTTP2_DATA);
+
+  bench_start(&timer, name, variant);
+
+  for (i = 0; i < nframes; ++i) {
+    len = nghttp2_session_mem_send(ctx.server, &data);
+    if (len <= 0) {
+      bench_fail("nghttp2_session_mem_send", (long)len);
+    }
+  }
+
+  bench_stop(&timer, nframes * BENCH_SCHED_CHUNKLEN, nframes);
+
+  nghttp2_session_del(ctx.client);
+  nghttp2_session_del(ctx.server);
+}
+
+void bench_nghttp2_session_sched(void) {
+  size_t nframes = bench_iterations(256) * 4096;
+
+  run_sched("session_sched", "dependency_tree", 0, BENCH_SCHED_NSTREAMS,
+            nframes);
+  run_sched("session_sched", "urgency", 1, BENCH_SCHED_NSTREAMS, nframes);
+}
+
+/* The bytes written to one direction of emulated link at the same
+   millisecond */
+typedef struct {
+  uint8_t *data;
+  size_t len, cap;
+} bench_link_slot;
+
+/* One direction of emulated link.  The bytes written at time t are
+   delivered at t + BENCH_LINK_DELAY. */
+typedef struct {
+  bench_link_slot slots[BENCH_LINK_DELAY + 1];
+} bench_link;
+
+static void link_write(bench_link *link, uint64_t now, const uint8_t *data,
+                       size_t len) {
+  bench_link_slot *slot =
+      &link->slots[(now + BENCH_LINK_DELAY) % (BENCH_LINK_DELAY + 1)];
+
+  if (slot->len + len > slot->cap) {
+    slot->cap = (slot->len + len) * 2;
+    slot->data = realloc(slot->data, slot->cap);
+    if (slot->data == NULL) {
+      bench_fail("realloc", 0);
+    }
+  }
+
+  memcpy(slot->data + slot->len, data, len);
+  slot->len += len;
+}
+
+/*
+ * Lets |session| read the bytes delivered at |now|.
+ */
+static void link_deliver(bench_link *link, uint64_t now,
+                         nghttp2_session *session) {
+  bench_link_slot *slot = &link->slots[now % (BENCH_LINK_DELAY + 1)];
+  ssize_t nread;
+
+  if (slot->len == 0) {
+    return;
+  }
+
+  nread = nghttp2_session_mem_recv(session, slot->data, slot->len);
+  if (nread != (ssize_t)slot->len) {
+    bench_fail("nghttp2_session_mem_recv", (long)nread);
+  }
+
+  slot->len = 0;
+}
+
+static void link_free(bench_link *link) {
+  size_t i;
+
+  for (i = 0; i < BENCH_LINK_DELAY + 1; ++i) {
+    free(link->slots[i].data);
+  }
+}
+
+/*
+ * Makes server write as many frames as |*credit| bytes allow to
+ * |link|.  The frame which exceeds the credit is still written, and
+ * the excess is carried over to the next millisecond.
+ */
+static void link_send(bench_link *link, uint64_t now, nghttp2_session *session,
+                      int64_t *credit) {
+  const uint8_t *data;
+  ssize_t len;
+
+  while (*credit > 0) {
+    len = nghttp2_session_mem_send(session, &data);
+    if (len < 0) {
+      bench_fail("nghttp2_session_mem_send", (long)len);
+    }
+    if (len == 0) {
+      /* Link is idle, and unused bandwidth is lost */
+      *credit = 0;
+      return;
+    }
+
+    link_write(link, now, data, (size_t)len);
+    *credit -= len;
+  }
+}
+
+/*
+ * Transfers BENCH_LINK_BODYLEN bytes of response body over emulated
+ * link with BENCH_LINK_DELAY one-way delay and BENCH_LINK_RATE
+ * bandwidth, and prints the throughput and the final connection
+ * window size of client.  If |window_size| is nonzero, client sets its
+ * windows to that size up front.  If |max_auto_window_size| is
+ * nonzero, client tunes windows automatically up to that size.
+ */
+static void run_link(const char *name, const char *variant,
+                     int32_t window_size, int32_t max_auto_window_size) {
+  bench_session_ctx *ctx;
+  bench_link *downlink, *uplink;
+  nghttp2_session_callbacks *callbacks;
+  nghttp2_option *option;
+  nghttp2_settings_entry iv;
+  nghttp2_nv reqnv[] = {
+      MAKE_NV(":method", "GET"), MAKE_NV(":scheme", "https"),
+      MAKE_NV(":authority", "localhost"), MAKE_NV(":path", "/"),
+  };
+  uint64_t now;
+  int64_t credit, server_credit = 0;
+  double sec;
+  int32_t stream_id;
+  int rv;
+
+  ctx = calloc(1, sizeof(*ctx));
+  downlink = calloc(1, sizeof(*downlink));
+  uplink = calloc(1, sizeof(*uplink));
+  if (ctx == NULL || downlink == NULL || uplink == NULL) {
+    bench_fail("calloc", 0);
+  }
+
+  ctx->mode = BENCH_MEM_SEND;
+  ctx->bodylen = BENCH_LINK_BODYLEN;
+
+  nghttp2_session_callbacks_new(&callbacks);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(
+      callbacks, server_on_frame_recv_callback);
+
+  rv = nghttp2_session_server_new(&ctx->server, callbacks, ctx);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_server_new", rv);
+  }
+
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, NULL);
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+      callbacks, client_on_data_chunk_recv_callback);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_max_auto_window_size(option, max_auto_window_size);
+
+  rv = nghttp2_session_client_new2(&ctx->client, callbacks, ctx, option);
+  if (rv != 0) {
+    bench_fail("nghttp2_session_client_new2", rv);
+  }
+
+  nghttp2_option_del(option);
+  nghttp2_session_callbacks_del(callbacks);
+
+  iv.settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+  iv.value = window_size ? (uint32_t)window_size : NGHTTP2_INITIAL_WINDOW_SIZE;
+
+  rv = nghttp2_submit_settings(ctx->client, NGHTTP2_FLAG_NONE, &iv, 1);
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  if (window_size) {
+    rv = nghttp2_session_set_local_window_size(ctx->client, NGHTTP2_FLAG_NONE,
+                                               0, window_size);
+    if (rv != 0) {
+      bench_fail("nghttp2_session_set_local_window_size", rv);
+    }
+  }
+
+  rv = nghttp2_submit_settings(ctx->server, NGHTTP2_FLAG_NONE, NULL, 0);
+  if (rv != 0) {
+    bench_fail("nghttp2_submit_settings", rv);
+  }
+
+  stream_id =
+      nghttp2_submit_request(ctx->client, NULL, reqnv,
+                             sizeof(reqnv) / sizeof(reqnv[0]), NULL, NULL);
+  if (stream_id < 0) {
+    bench_fail("nghttp2_submit_request", stream_id);
+  }
+
+  /* Time is measured from when client sends request, one millisecond
+     at a time. */
+  for (now = 0; ctx->nrecv < ctx->bodylen; ++now) {
+    if (now > (uint64_t)BENCH_LINK_BODYLEN) {
+      bench_fail("transfer over emulated link", (long)ctx->nrecv);
+    }
+
+    link_deliver(uplink, now, ctx->server);
+    link_deliver(downlink, now, ctx->client);
+
+    /* Client only sends small frames, and its bandwidth is not
+       limited. */
+    credit = INT64_MAX;
+    link_send(uplink, now, ctx->client, &credit);
+
+    server_credit += BENCH_LINK_RATE;
+    link_send(downlink, now, ctx->server, &server_credit);
+  }
+
+  sec = (double)now / 1000;
+
+  printf("%-32s %-16s %10.3f s %10.2f Mbps %10d window\n", name, variant, sec,
+         (double)ctx->bodylen * 8 / 1000000 / sec,
+         nghttp2_session_get_effective_local_window_size(ctx->client));
+
+  nghttp2_session_del(ctx->client);
+  nghttp2_session_del(ctx->server);
+
+  link_free(uplink);
+  link_free(downlink);
+
+  free(uplink);
+  free(downlink);
+  free(ctx);
+}
+
+void bench_nghttp2_session_window(void) {
+  run_link("session_window", "default", 0, 0);
+  run_link("session_window", "fixed_16MiB", BENCH_LINK_MAX_WINDOW_SIZE, 0);
+  run_link("session_window", "auto_16MiB", 0, BENCH_LINK_MAX_WINDOW_SIZE);
+}
@@ -78,6 +78,9 @@ typedef struct {
   int begin_frame_cb_called;
   nghttp2_buf scratchbuf;
   size_t data_source_read_cb_paused;
+  nghttp2_rcbuf *data_chunk_rcbuf;
+  const uint8_t *data_chunk;
+  nghttp2_rcbuf *header_rcbuf;
 } my_user_data;
 
 static const nghttp2_nv reqnv[] = {
@@ -272,6 +275,28 @@ static int on_data_chunk_recv_callback(nghttp2_session *session, uint8_t flags,
   return 0;
 }
 
+static int on_data_chunk_recv_callback2(nghttp2_session *session,
+                                        uint8_t flags, int32_t stream_id,
+                                        nghttp2_rcbuf *buf,
+                                        const uint8_t *data, size_t len,
+                                        void *user_data) {
+  my_user_data *ud = (my_user_data *)user_data;
+  (void)session;
+  (void)flags;
+  (void)stream_id;
+
+  ++ud->data_chunk_recv_cb_called;
+  ud->data_chunk_len = len;
+  ud->data_chunk = data;
+  ud->data_chunk_rcbuf = buf;
+
+  if (buf) {
+    nghttp2_rcbuf_incref(buf);
+  }
+
+  return 0;
+}
+
 static int pause_on_data_chunk_recv_callback(nghttp2_session *session,
                                              uint8_t flags, int32_t stream_id,
                                              const uint8_t *data, size_t len,
@@ -441,6 +466,19 @@ static int send_data_callback(nghttp2_session *session, nghttp2_frame *frame,
   return 0;
 }
 
+static int ref_data_callback(nghttp2_session *session, nghttp2_frame *frame,
+                             const uint8_t **data_ptr, size_t length,
+                             nghttp2_data_source *source, void *user_data) {
+  (void)session;
+  (void)frame;
+  (void)user_data;
+
+  *data_ptr = source->ptr;
+  source->ptr = (uint8_t *)source->ptr + length;
+
+  return 0;
+}
+
 static ssize_t block_count_send_callback(nghttp2_session *session,
                                          const uint8_t *data, size_t len,
                                          int flags, void *user_data) {
@@ -475,6 +513,27 @@ static int on_header_callback(nghttp2_session *session,
   return 0;
 }
 
+static int keep_on_header_callback2(nghttp2_session *session,
+                                    const nghttp2_frame *frame,
+                                    nghttp2_rcbuf *name, nghttp2_rcbuf *value,
+                                    uint8_t flags, void *user_data) {
+  my_user_data *ud = (my_user_data *)user_data;
+  nghttp2_vec namebuf = nghttp2_rcbuf_get_buf(name);
+  (void)session;
+  (void)frame;
+  (void)flags;
+
+  ++ud->header_cb_called;
+
+  if (namebuf.len == sizeof("alpha") - 1 &&
+      memcmp("alpha", namebuf.base, namebuf.len) == 0) {
+    nghttp2_rcbuf_incref(value);
+    ud->header_rcbuf = value;
+  }
+
+  return 0;
+}
+
 static int pause_on_header_callback(nghttp2_session *session,
                                     const nghttp2_frame *frame,
                                     const uint8_t *name, size_t namelen,
@@ -1077,6 +1136,205 @@ void test_nghttp2_session_recv_data(void) {
   nghttp2_session_del(session);
 }
 
+void test_nghttp2_session_recv_data_auto_window_size(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  uint8_t data[NGHTTP2_FRAME_HDLEN + 16384];
+  ssize_t rv;
+  nghttp2_outbound_item *item;
+  nghttp2_stream *stream;
+  nghttp2_frame_hd hd;
+  nghttp2_frame frame;
+  uint8_t opaque_data[8];
+  int i;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  memset(data, 0, sizeof(data));
+  hd.length = 16384;
+  hd.type = NGHTTP2_DATA;
+  hd.flags = NGHTTP2_FLAG_NONE;
+  hd.stream_id = 1;
+  nghttp2_frame_pack_frame_hd(data, &hd);
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_max_auto_window_size(option, 150000);
+
+  nghttp2_session_client_new2(&session, &callbacks, NULL, option);
+
+  stream = open_sent_stream(session, 1);
+
+  /* The first DATA sends PING to measure round trip */
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT((ssize_t)sizeof(data) == rv);
+
+  item = nghttp2_outbound_queue_top(&session->ob_urgent);
+
+  CU_ASSERT(NGHTTP2_PING == item->frame.hd.type);
+  CU_ASSERT(NGHTTP2_FLAG_NONE == item->frame.hd.flags);
+
+  memcpy(opaque_data, item->frame.ping.opaque_data, sizeof(opaque_data));
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  /* 48KiB is received during the round trip, which is more than 1/3
+     of the window.  The windows are doubled. */
+  for (i = 0; i < 2; ++i) {
+    rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+    CU_ASSERT((ssize_t)sizeof(data) == rv);
+  }
+
+  CU_ASSERT(NULL == nghttp2_outbound_queue_top(&session->ob_urgent));
+
+  nghttp2_frame_ping_init(&frame.ping, NGHTTP2_FLAG_ACK, opaque_data);
+
+  CU_ASSERT(0 == nghttp2_session_on_ping_received(session, &frame));
+  CU_ASSERT(131070 == session->local_window_size);
+  CU_ASSERT(131070 == session->auto_window_size);
+
+  item = nghttp2_outbound_queue_top(&session->ob_urgent);
+
+  CU_ASSERT(NGHTTP2_SETTINGS == item->frame.hd.type);
+  CU_ASSERT(1 == item->frame.settings.niv);
+  CU_ASSERT(NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE ==
+            item->frame.settings.iv[0].settings_id);
+  CU_ASSERT(131070 == item->frame.settings.iv[0].value);
+
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  /* The stream window is increased when SETTINGS is acknowledged */
+  nghttp2_frame_settings_init(&frame.settings, NGHTTP2_FLAG_ACK, NULL, 0);
+
+  CU_ASSERT(0 == nghttp2_session_on_settings_received(session, &frame, 0));
+  CU_ASSERT(131070 == stream->local_window_size);
+
+  /* Only 16KiB is received during the next round trip.  The windows
+     are not changed. */
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT((ssize_t)sizeof(data) == rv);
+
+  item = nghttp2_outbound_queue_top(&session->ob_urgent);
+
+  CU_ASSERT(NGHTTP2_PING == item->frame.hd.type);
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  nghttp2_frame_ping_init(&frame.ping, NGHTTP2_FLAG_ACK, opaque_data);
+
+  CU_ASSERT(0 == nghttp2_session_on_ping_received(session, &frame));
+  CU_ASSERT(131070 == session->local_window_size);
+  CU_ASSERT(NULL == nghttp2_outbound_queue_top(&session->ob_urgent));
+
+  /* The window never exceeds the maximum */
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT((ssize_t)sizeof(data) == rv);
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  for (i = 0; i < 4; ++i) {
+    rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+    CU_ASSERT((ssize_t)sizeof(data) == rv);
+  }
+
+  CU_ASSERT(0 == nghttp2_session_on_ping_received(session, &frame));
+  CU_ASSERT(150000 == session->local_window_size);
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  /* No more PING is sent once the window reaches the maximum */
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT((ssize_t)sizeof(data) == rv);
+  CU_ASSERT(0 == session->bdp_ping_inflight);
+
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_recv_data_rcbuf(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  my_user_data ud;
+  nghttp2_rcbuf *buf;
+  nghttp2_vec vec;
+  nghttp2_frame_hd hd;
+  uint8_t data[NGHTTP2_FRAME_HDLEN + 100];
+  ssize_t rv;
+  size_t i;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_data_chunk_recv_callback = on_data_chunk_recv_callback;
+  callbacks.on_data_chunk_recv_callback2 = on_data_chunk_recv_callback2;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  open_sent_stream(session, 1);
+
+  rv = nghttp2_rcbuf_alloc(&buf, 2 * sizeof(data), NULL);
+
+  CU_ASSERT(0 == rv);
+
+  vec = nghttp2_rcbuf_get_buf(buf);
+
+  CU_ASSERT(2 * sizeof(data) == vec.len);
+
+  hd.length = 100;
+  hd.type = NGHTTP2_DATA;
+  hd.flags = NGHTTP2_FLAG_NONE;
+  hd.stream_id = 1;
+  hd.reserved = 0;
+  nghttp2_frame_pack_frame_hd(vec.base, &hd);
+  memset(vec.base + NGHTTP2_FRAME_HDLEN, 'a', 100);
+
+  /* DATA payload is passed as the slice of the given buffer, and it
+     stays valid after the application drops its own reference. */
+  memset(&ud, 0, sizeof(ud));
+  rv = nghttp2_session_mem_recv_rcbuf(session, buf, vec.base,
+                                      NGHTTP2_FRAME_HDLEN + 100);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 100 == rv);
+  CU_ASSERT(1 == ud.data_chunk_recv_cb_called);
+  CU_ASSERT(100 == ud.data_chunk_len);
+  CU_ASSERT(buf == ud.data_chunk_rcbuf);
+  CU_ASSERT(vec.base + NGHTTP2_FRAME_HDLEN == ud.data_chunk);
+
+  nghttp2_rcbuf_decref(buf);
+
+  for (i = 0; i < 100; ++i) {
+    CU_ASSERT('a' == ud.data_chunk[i]);
+  }
+
+  /* Input must lie inside the buffer */
+  buf = ud.data_chunk_rcbuf;
+  rv = nghttp2_session_mem_recv_rcbuf(session, buf, vec.base + 1, vec.len);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+
+  rv = nghttp2_session_mem_recv_rcbuf(session, buf, data, sizeof(data));
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT == rv);
+
+  nghttp2_rcbuf_decref(buf);
+
+  /* Without the buffer, the callback gets NULL */
+  nghttp2_frame_pack_frame_hd(data, &hd);
+  memset(data + NGHTTP2_FRAME_HDLEN, 'b', 100);
+
+  memset(&ud, 0, sizeof(ud));
+  rv = nghttp2_session_mem_recv(session, data, sizeof(data));
+
+  CU_ASSERT(sizeof(data) == rv);
+  CU_ASSERT(1 == ud.data_chunk_recv_cb_called);
+  CU_ASSERT(NULL == ud.data_chunk_rcbuf);
+  CU_ASSERT(data + NGHTTP2_FRAME_HDLEN == ud.data_chunk);
+
+  nghttp2_session_del(session);
+}
+
 void test_nghttp2_session_recv_data_no_auto_flow_control(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
@@ -1653,6 +1911,79 @@ void test_nghttp2_session_recv_headers_early_response(void) {
   nghttp2_bufs_free(&bufs);
 }
 
+void test_nghttp2_session_recv_headers_borrow(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_bufs bufs;
+  nghttp2_buf *buf;
+  nghttp2_hd_deflater deflater;
+  nghttp2_mem *mem;
+  nghttp2_nv *nva;
+  size_t nvlen, i;
+  nghttp2_frame frame;
+  ssize_t rv;
+  my_user_data ud;
+  nghttp2_nv nv[] = {
+      MAKE_NV(":method", "GET"), MAKE_NV(":path", "/"),
+      MAKE_NV(":scheme", "https"), MAKE_NV(":authority", "localhost"),
+      MAKE_NV("x-token", "{}"),
+  };
+
+  mem = nghttp2_mem_default();
+  frame_pack_bufs_init(&bufs);
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.on_header_callback = on_header_callback;
+  callbacks.on_frame_recv_callback = on_frame_recv_callback;
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_borrow_header_fields(option, 1);
+
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  nghttp2_hd_deflate_init(&deflater, mem);
+
+  for (i = 0; i < ARRLEN(nv); ++i) {
+    nv[i].flags = NGHTTP2_NV_FLAG_NO_INDEX;
+  }
+
+  nvlen = ARRLEN(nv);
+  nghttp2_nv_array_copy(&nva, nv, nvlen, mem);
+  nghttp2_frame_headers_init(&frame.headers,
+                             NGHTTP2_FLAG_END_HEADERS | NGHTTP2_FLAG_END_STREAM,
+                             1, NGHTTP2_HCAT_REQUEST, NULL, nva, nvlen);
+
+  rv = nghttp2_frame_pack_headers(&bufs, &frame.headers, &deflater);
+
+  CU_ASSERT(0 == rv);
+
+  nghttp2_frame_headers_free(&frame.headers, mem);
+
+  buf = &bufs.head->buf;
+
+  ud.header_cb_called = 0;
+  ud.frame_recv_cb_called = 0;
+
+  rv = nghttp2_session_mem_recv(session, buf->pos, nghttp2_buf_len(buf));
+
+  CU_ASSERT((ssize_t)nghttp2_buf_len(buf) == rv);
+  CU_ASSERT((int)ARRLEN(nv) == ud.header_cb_called);
+  CU_ASSERT(1 == ud.frame_recv_cb_called);
+  CU_ASSERT(NGHTTP2_HEADERS == ud.recv_frame_type);
+
+  /* The last header field is not huffman encoded, and refers to
+     input directly */
+  CU_ASSERT(buf->pos < ud.nv.value && ud.nv.value < buf->last);
+  CU_ASSERT(2 == ud.nv.valuelen);
+  CU_ASSERT(0 == memcmp("{}", ud.nv.value, ud.nv.valuelen));
+
+  nghttp2_hd_deflate_free(&deflater);
+  nghttp2_session_del(session);
+  nghttp2_option_del(option);
+  nghttp2_bufs_free(&bufs);
+}
+
 void test_nghttp2_session_server_recv_push_response(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
@@ -9345,6 +9676,571 @@ void test_nghttp2_session_send_data_callback(void) {
   nghttp2_session_del(session);
 }
 
+void test_nghttp2_session_mem_send_iov(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_data_provider data_prd;
+  my_user_data ud;
+  accumulator acc;
+  nghttp2_frame_hd hd;
+  nghttp2_vec vec[8];
+  ssize_t nvec;
+  static uint8_t data[NGHTTP2_DATA_PAYLOADLEN * 2];
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.ref_data_callback = ref_data_callback;
+
+  data_prd.read_callback = no_copy_data_source_read_callback;
+  data_prd.source.ptr = data;
+
+  ud.data_source_length = sizeof(data);
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_mem_send_iov(session, vec, 2));
+
+  open_sent_stream(session, 1);
+
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  nvec = nghttp2_session_mem_send_iov(session, vec, ARRLEN(vec));
+
+  CU_ASSERT(4 == nvec);
+
+  /* PING and the frame header of the first DATA are serialized into
+     the same buffer. */
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 + NGHTTP2_FRAME_HDLEN == vec[0].len);
+
+  nghttp2_frame_unpack_frame_hd(&hd, vec[0].base);
+
+  CU_ASSERT(NGHTTP2_PING == hd.type);
+
+  nghttp2_frame_unpack_frame_hd(&hd, vec[0].base + NGHTTP2_FRAME_HDLEN + 8);
+
+  CU_ASSERT(NGHTTP2_DATA == hd.type);
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == hd.length);
+  CU_ASSERT(NGHTTP2_FLAG_NONE == hd.flags);
+
+  /* Application data is not copied */
+  CU_ASSERT(data == vec[1].base);
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == vec[1].len);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN == vec[2].len);
+
+  nghttp2_frame_unpack_frame_hd(&hd, vec[2].base);
+
+  CU_ASSERT(NGHTTP2_DATA == hd.type);
+  CU_ASSERT(NGHTTP2_FLAG_END_STREAM == hd.flags);
+
+  CU_ASSERT(data + NGHTTP2_DATA_PAYLOADLEN == vec[3].base);
+  CU_ASSERT(NGHTTP2_DATA_PAYLOADLEN == vec[3].len);
+
+  CU_ASSERT(0 == nghttp2_session_mem_send_iov(session, vec, ARRLEN(vec)));
+
+  nghttp2_session_del(session);
+
+  /* Frames are split into several batches if |vec| is short */
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  data_prd.source.ptr = data;
+  ud.data_source_length = sizeof(data);
+
+  open_sent_stream(session, 1);
+
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  CU_ASSERT(1 == nghttp2_session_mem_send_iov(session, vec, 3));
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 == vec[0].len);
+
+  CU_ASSERT(2 == nghttp2_session_mem_send_iov(session, vec, 3));
+  CU_ASSERT(data == vec[1].base);
+
+  CU_ASSERT(2 == nghttp2_session_mem_send_iov(session, vec, 3));
+  CU_ASSERT(data + NGHTTP2_DATA_PAYLOADLEN == vec[1].base);
+
+  CU_ASSERT(0 == nghttp2_session_mem_send_iov(session, vec, 3));
+
+  nghttp2_session_del(session);
+
+  /* Without ref_data_callback, send_data_callback is used after the
+     preceding frames are returned. */
+  callbacks.ref_data_callback = NULL;
+  callbacks.send_data_callback = send_data_callback;
+
+  acc.length = 0;
+  ud.acc = &acc;
+  ud.data_source_length = NGHTTP2_DATA_PAYLOADLEN;
+
+  nghttp2_session_client_new(&session, &callbacks, &ud);
+
+  open_sent_stream(session, 1);
+
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  CU_ASSERT(1 == nghttp2_session_mem_send_iov(session, vec, ARRLEN(vec)));
+  CU_ASSERT(0 == acc.length);
+
+  CU_ASSERT(0 == nghttp2_session_mem_send_iov(session, vec, ARRLEN(vec)));
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + NGHTTP2_DATA_PAYLOADLEN == acc.length);
+
+  nghttp2_session_del(session);
+}
+
+void test_nghttp2_session_mem_send_coalesce(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_data_provider data_prd;
+  my_user_data ud;
+  nghttp2_frame_hd hd;
+  const uint8_t *data;
+  ssize_t len;
+  size_t off;
+  uint8_t types[5];
+  size_t ntypes;
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_send_coalesce_length(option, 4096);
+
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  open_recv_stream(session, 1);
+  open_recv_stream(session, 3);
+
+  nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, NULL, 0);
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_window_update(session, NGHTTP2_FLAG_NONE, 0, 100);
+  nghttp2_submit_response(session, 1, resnv, ARRLEN(resnv), NULL);
+  nghttp2_submit_response(session, 3, resnv, ARRLEN(resnv), NULL);
+
+  /* All frames are returned in one call */
+  len = nghttp2_session_mem_send(session, &data);
+
+  CU_ASSERT(len > 0);
+
+  ntypes = 0;
+  for (off = 0; off < (size_t)len && ntypes < ARRLEN(types);) {
+    nghttp2_frame_unpack_frame_hd(&hd, data + off);
+    types[ntypes++] = hd.type;
+    off += NGHTTP2_FRAME_HDLEN + hd.length;
+  }
+
+  CU_ASSERT((size_t)len == off);
+  CU_ASSERT(5 == ntypes);
+  CU_ASSERT(NGHTTP2_SETTINGS == types[0]);
+  CU_ASSERT(NGHTTP2_PING == types[1]);
+  CU_ASSERT(NGHTTP2_WINDOW_UPDATE == types[2]);
+  CU_ASSERT(NGHTTP2_HEADERS == types[3]);
+  CU_ASSERT(NGHTTP2_HEADERS == types[4]);
+
+  /* Streams are half-closed as if each frame was returned
+     separately */
+  CU_ASSERT(nghttp2_session_get_stream(session, 1)->shut_flags &
+            NGHTTP2_SHUT_WR);
+  CU_ASSERT(nghttp2_session_get_stream(session, 3)->shut_flags &
+            NGHTTP2_SHUT_WR);
+
+  CU_ASSERT(0 == nghttp2_session_mem_send(session, &data));
+
+  nghttp2_session_del(session);
+
+  /* Frame which does not fit in the buffer is returned in the next
+     call. */
+  nghttp2_option_set_send_coalesce_length(option, 30);
+
+  nghttp2_session_client_new2(&session, &callbacks, &ud, option);
+
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 ==
+            nghttp2_session_mem_send(session, &data));
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 ==
+            nghttp2_session_mem_send(session, &data));
+  CU_ASSERT(0 == nghttp2_session_mem_send(session, &data));
+
+  nghttp2_session_del(session);
+
+  /* DATA frame larger than the buffer is returned alone */
+  nghttp2_option_set_send_coalesce_length(option, 4096);
+
+  nghttp2_session_client_new2(&session, &callbacks, &ud, option);
+
+  open_sent_stream(session, 1);
+
+  data_prd.read_callback = fixed_length_data_source_read_callback;
+  ud.data_source_length = NGHTTP2_DATA_PAYLOADLEN;
+
+  nghttp2_submit_ping(session, NGHTTP2_FLAG_NONE, NULL);
+  nghttp2_submit_data(session, NGHTTP2_FLAG_END_STREAM, 1, &data_prd);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + 8 ==
+            nghttp2_session_mem_send(session, &data));
+
+  len = nghttp2_session_mem_send(session, &data);
+
+  CU_ASSERT(NGHTTP2_FRAME_HDLEN + NGHTTP2_DATA_PAYLOADLEN == len);
+  CU_ASSERT(session->aob.framebufs.cur->buf.begin <= data &&
+            data < session->aob.framebufs.cur->buf.end);
+  CU_ASSERT(0 == nghttp2_session_mem_send(session, &data));
+
+  nghttp2_session_del(session);
+
+  nghttp2_option_del(option);
+}
+
+void test_nghttp2_session_no_rfc7540_priorities(void) {
+  nghttp2_session *session;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  nghttp2_data_provider data_prd;
+  my_user_data ud;
+  nghttp2_stream *stream;
+  nghttp2_frame frame;
+  nghttp2_priority_spec pri_spec;
+  nghttp2_extpri extpri;
+  nghttp2_frame_hd hd;
+  const uint8_t *data;
+  int32_t stream_id;
+  size_t i;
+  static const int32_t sched1[] = {1, 3, 1, 3, 1};
+  static const int32_t sched2[] = {5, 5, 5};
+  static const int32_t sched3[] = {7, 7, 3, 1, 3};
+
+  memset(&callbacks, 0, sizeof(nghttp2_session_callbacks));
+  callbacks.send_callback = null_send_callback;
+
+  nghttp2_option_new(&option);
+  nghttp2_option_set_no_rfc7540_priorities(option, 1);
+
+  /* Priority signals of RFC 7540 are ignored */
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  stream = open_recv_stream(session, 1);
+
+  CU_ASSERT(stream->flags & NGHTTP2_STREAM_FLAG_NO_RFC7540_PRIORITIES);
+  CU_ASSERT(!nghttp2_stream_in_dep_tree(stream));
+
+  nghttp2_priority_spec_init(&pri_spec, 3, 256, 1);
+  nghttp2_frame_priority_init(&frame.priority, 1, &pri_spec);
+
+  CU_ASSERT(0 == nghttp2_session_on_priority_received(session, &frame));
+  CU_ASSERT(!nghttp2_stream_in_dep_tree(stream));
+  CU_ASSERT(NULL == nghttp2_session_get_stream_raw(session, 3));
+
+  nghttp2_frame_priority_free(&frame.priority);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_STATE ==
+            nghttp2_session_create_idle_stream(session, 3, &pri_spec));
+
+  CU_ASSERT(0 == nghttp2_session_get_extpri_stream_priority(session, &extpri,
+                                                            1));
+  CU_ASSERT(NGHTTP2_EXTPRI_DEFAULT_URGENCY == extpri.urgency);
+  CU_ASSERT(0 == extpri.inc);
+
+  CU_ASSERT(NGHTTP2_ERR_INVALID_ARGUMENT ==
+            nghttp2_session_get_extpri_stream_priority(session, &extpri, 3));
+
+  /* Out of range values are clamped */
+  extpri.urgency = 100;
+  extpri.inc = 1000;
+
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 1, &extpri));
+  CU_ASSERT(0 == nghttp2_session_get_extpri_stream_priority(session, &extpri,
+                                                            1));
+  CU_ASSERT(NGHTTP2_EXTPRI_URGENCY_LOW == extpri.urgency);
+  CU_ASSERT(1 == extpri.inc);
+
+  nghttp2_session_del(session);
+
+  /* Scheduling by urgency and incremental parameters */
+  nghttp2_session_server_new2(&session, &callbacks, &ud, option);
+
+  session->remote_window_size = NGHTTP2_MAX_WINDOW_SIZE;
+
+  data_prd.read_callback = fixed_length_data_source_read_callback;
+  ud.data_source_length = 1 << 30;
+
+  for (stream_id = 1; stream_id <= 7; stream_id += 2) {
+    stream = open_recv_stream(session, stream_id);
+    stream->remote_window_size = NGHTTP2_MAX_WINDOW_SIZE;
+
+    extpri.urgency = stream_id <= 3 ? 2 : NGHTTP2_EXTPRI_DEFAULT_URGENCY;
+    extpri.inc = stream_id <= 3;
+
+    CU_ASSERT(0 == nghttp2_session_change_extpri_stream_priority(
+                       session, stream_id, &extpri));
+
+    nghttp2_submit_data(session, NGHTTP2_FLAG_NONE, stream_id, &data_prd);
+  }
+
+  /* Incremental streams 1 and 3 are served in round-robin */
+  for (i = 0; i < ARRLEN(sched1); ++i) {
+    CU_ASSERT(0 < nghttp2_session_mem_send(session, &data));
+
+    nghttp2_frame_unpack_frame_hd(&hd, data);
+
+    CU_ASSERT(NGHTTP2_DATA == hd.type);
+    CU_ASSERT(sched1[i] == hd.stream_id);
+  }
+
+  /* Non-incremental stream with higher urgency comes first, and it
+     is served until it finishes. */
+  extpri.urgency = NGHTTP2_EXTPRI_URGENCY_HIGH;
+  extpri.inc = 0;
+
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 5, &extpri));
+
+  for (i = 0; i < ARRLEN(sched2); ++i) {
+    CU_ASSERT(0 < nghttp2_session_mem_send(session, &data));
+
+    nghttp2_frame_unpack_frame_hd(&hd, data);
+
+    CU_ASSERT(sched2[i] == hd.stream_id);
+  }
+
+  /* Closing stream removes it from scheduler */
+  CU_ASSERT(0 == nghttp2_session_close_stream(session, 5, NGHTTP2_NO_ERROR));
+
+  /* Lowering urgency value of stream 7 lets it preempt streams 1 and
+     3 */
+  extpri.urgency = 1;
+
+  CU_ASSERT(0 ==
+            nghttp2_session_change_extpri_stream_priority(session, 7, &extpri));
+
+  for (i = 0; i < ARRLEN(sched3); ++i) {
+    if (i == 2) {
+      CU_ASSERT(0 ==
+                nghttp2_session_close_stream(session, 7, NGHTTP2_NO_ERROR));
+    }
+
+    CU_ASSERT(0 < nghttp2_session_mem_send(session, &data));
+
+    nghttp2_frame_unpack_frame_hd(&hd, data);
+
+    CU_ASSERT(sched3[i] == hd.stream_id);
+  }
+
+  nghttp2_session_del(session);
+
+  /* Client ignores priority given to the request */
+  nghttp2_session_client_new2(&session, &callbacks, &ud, option);
+
+  nghttp2_priority_spec_init(&pri_spec, 101, 256, 1);
+
+  stream_id = nghttp2_submit_request(session, &pri_spec, reqnv, ARRLEN(reqnv),
+                                     NULL, NULL);
+
+  CU_ASSERT(1 == stream_id);
+  CU_ASSERT(0 == nghttp2_session_send(session));
+
+  stream = nghttp2_session_get_stream(session, 1);
+
+  CU_ASSERT(!nghttp2_stream_in_dep_tree(stream));
+  CU_ASSERT(NULL == nghttp2_session_get_stream_raw(session, 101));
+
+  nghttp2_session_del(session);
+
+  nghttp2_option_del(option);
+}
+
+/*
+ * Sends all frames queued in |src| to |dst|.
+ */
+static void session_transfer(nghttp2_session *src, nghttp2_session *dst) {
+  const uint8_t *data;
+  ssize_t len;
+
+  for (;;) {
+    len = nghttp2_session_mem_send(src, &data);
+
+    CU_ASSERT(len >= 0);
+
+    if (len <= 0) {
+      return;
+    }
+
+    CU_ASSERT(len == nghttp2_session_mem_recv(dst, data, (size_t)len));
+  }
+}
+
+void test_nghttp2_session_get_stats(void) {
+  nghttp2_session *client, *server;
+  nghttp2_session_callbacks callbacks;
+  my_user_data ud;
+  nghttp2_data_provider data_prd;
+  const nghttp2_session_stats *cstats, *sstats;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  nghttp2_session_client_new(&client, &callbacks, &ud);
+  nghttp2_session_server_new(&server, &callbacks, &ud);
+
+  cstats = nghttp2_session_get_stats(client);
+  sstats = nghttp2_session_get_stats(server);
+
+  CU_ASSERT(0 == cstats->bytes_sent);
+  CU_ASSERT(0 == cstats->frames_recv[NGHTTP2_SETTINGS]);
+  CU_ASSERT(0 < cstats->allocations);
+
+  CU_ASSERT(0 == nghttp2_submit_settings(client, NGHTTP2_FLAG_NONE, NULL, 0));
+  CU_ASSERT(0 == nghttp2_submit_settings(server, NGHTTP2_FLAG_NONE, NULL, 0));
+  CU_ASSERT(1 == nghttp2_submit_request(client, NULL, reqnv, ARRLEN(reqnv),
+                                        NULL, NULL));
+
+  session_transfer(client, server);
+
+  cstats = nghttp2_session_get_stats(client);
+  sstats = nghttp2_session_get_stats(server);
+
+  CU_ASSERT(1 == cstats->frames_sent[NGHTTP2_SETTINGS]);
+  CU_ASSERT(1 == cstats->frames_sent[NGHTTP2_HEADERS]);
+  /* :method, :path, and :scheme are in static table, and only the
+     name of :authority is. */
+  CU_ASSERT(3 == cstats->hd_deflate_indexed);
+  CU_ASSERT(1 == cstats->hd_deflate_indexed_name);
+  CU_ASSERT(0 == cstats->hd_deflate_literal);
+  CU_ASSERT(47 == cstats->hd_deflate_nvlen);
+  CU_ASSERT(0 < cstats->hd_deflate_blocklen);
+  CU_ASSERT(cstats->hd_deflate_blocklen < cstats->hd_deflate_nvlen);
+
+  CU_ASSERT(1 == sstats->frames_recv[NGHTTP2_SETTINGS]);
+  CU_ASSERT(1 == sstats->frames_recv[NGHTTP2_HEADERS]);
+  CU_ASSERT(cstats->bytes_sent == sstats->bytes_recv);
+  CU_ASSERT(3 == sstats->hd_inflate_indexed);
+  CU_ASSERT(1 == sstats->hd_inflate_indexed_name);
+  CU_ASSERT(0 == sstats->hd_inflate_literal);
+  CU_ASSERT(47 == sstats->hd_inflate_nvlen);
+  CU_ASSERT(cstats->hd_deflate_blocklen == sstats->hd_inflate_blocklen);
+
+  ud.data_source_length = 100;
+  data_prd.read_callback = fixed_length_data_source_read_callback;
+
+  CU_ASSERT(0 == nghttp2_submit_response(server, 1, resnv, ARRLEN(resnv),
+                                         &data_prd));
+
+  session_transfer(server, client);
+
+  cstats = nghttp2_session_get_stats(client);
+  sstats = nghttp2_session_get_stats(server);
+
+  /* SETTINGS and its ACK */
+  CU_ASSERT(2 == sstats->frames_sent[NGHTTP2_SETTINGS]);
+  CU_ASSERT(1 == sstats->frames_sent[NGHTTP2_HEADERS]);
+  CU_ASSERT(1 == sstats->frames_sent[NGHTTP2_DATA]);
+  CU_ASSERT(100 == sstats->data_bytes_sent);
+
+  CU_ASSERT(2 == cstats->frames_recv[NGHTTP2_SETTINGS]);
+  CU_ASSERT(1 == cstats->frames_recv[NGHTTP2_DATA]);
+  CU_ASSERT(100 == cstats->data_bytes_recv);
+  CU_ASSERT(sstats->bytes_sent == cstats->bytes_recv);
+
+  nghttp2_session_del(client);
+  nghttp2_session_del(server);
+}
+
+void test_nghttp2_session_get_stats_continuation(void) {
+  nghttp2_session *client, *server;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_nv nv[2];
+  uint8_t value[2][16384];
+  const nghttp2_session_stats *cstats, *sstats;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  nghttp2_session_client_new(&client, &callbacks, NULL);
+  nghttp2_session_server_new(&server, &callbacks, NULL);
+
+  memset(value, 'a', sizeof(value));
+
+  nv[0].name = (uint8_t *)"alpha";
+  nv[0].namelen = strlen("alpha");
+  nv[0].value = value[0];
+  nv[0].valuelen = sizeof(value[0]);
+  nv[0].flags = NGHTTP2_NV_FLAG_NONE;
+  nv[1] = nv[0];
+  nv[1].name = (uint8_t *)"bravo";
+  nv[1].value = value[1];
+
+  CU_ASSERT(0 == nghttp2_submit_settings(client, NGHTTP2_FLAG_NONE, NULL, 0));
+  CU_ASSERT(1 == nghttp2_submit_request(client, NULL, nv, ARRLEN(nv), NULL,
+                                        NULL));
+
+  session_transfer(client, server);
+
+  cstats = nghttp2_session_get_stats(client);
+  sstats = nghttp2_session_get_stats(server);
+
+  /* Header block which does not fit in 16KiB is split into
+     CONTINUATION frames */
+  CU_ASSERT(1 == cstats->frames_sent[NGHTTP2_HEADERS]);
+  CU_ASSERT(0 < cstats->frames_sent[NGHTTP2_CONTINUATION]);
+  CU_ASSERT(2 == cstats->hd_deflate_literal);
+  CU_ASSERT(cstats->frames_sent[NGHTTP2_CONTINUATION] ==
+            sstats->frames_recv[NGHTTP2_CONTINUATION]);
+  CU_ASSERT(cstats->bytes_sent == sstats->bytes_recv);
+
+  nghttp2_session_del(client);
+  nghttp2_session_del(server);
+}
+
+void test_nghttp2_session_keep_header_rcbuf(void) {
+  nghttp2_session *client, *server;
+  nghttp2_session_callbacks callbacks;
+  nghttp2_option *option;
+  my_user_data ud;
+  nghttp2_nv nv[] = {MAKE_NV(":method", "GET"), MAKE_NV(":path", "/"),
+                     MAKE_NV(":scheme", "https"),
+                     MAKE_NV(":authority", "localhost"),
+                     MAKE_NV("alpha", "bravo")};
+  nghttp2_vec value;
+  int slab;
+
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.on_header_callback2 = keep_on_header_callback2;
+
+  /* Header field kept by application outlives the session, with and
+     without slab allocator. */
+  for (slab = 0; slab < 2; ++slab) {
+    nghttp2_option_new(&option);
+    nghttp2_option_set_slab_allocator(option, slab);
+
+    ud.header_rcbuf = NULL;
+
+    nghttp2_session_client_new(&client, &callbacks, NULL);
+    nghttp2_session_server_new2(&server, &callbacks, &ud, option);
+
+    CU_ASSERT(1 == nghttp2_submit_request(client, NULL, nv, ARRLEN(nv), NULL,
+                                          NULL));
+
+    session_transfer(client, server);
+
+    CU_ASSERT(0 < nghttp2_session_get_stats(server)->allocations);
+
+    nghttp2_session_del(client);
+    nghttp2_session_del(server);
+    nghttp2_option_del(option);
+
+    CU_ASSERT(NULL != ud.header_rcbuf);
+
+    value = nghttp2_rcbuf_get_buf(ud.header_rcbuf);
+
+    CU_ASSERT(sizeof("bravo") - 1 == value.len);
+    CU_ASSERT(0 == memcmp("bravo", value.base, value.len));
+
+    nghttp2_rcbuf_decref(ud.header_rcbuf);
+  }
+}
+
 void test_nghttp2_session_on_begin_headers_temporal_failure(void) {
   nghttp2_session *session;
   nghttp2_session_callbacks callbacks;
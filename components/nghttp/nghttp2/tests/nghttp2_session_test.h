@@ -34,10 +34,13 @@ void test_nghttp2_session_recv_invalid_stream_id(void);
 void test_nghttp2_session_recv_invalid_frame(void);
 void test_nghttp2_session_recv_eof(void);
 void test_nghttp2_session_recv_data(void);
+void test_nghttp2_session_recv_data_auto_window_size(void);
+void test_nghttp2_session_recv_data_rcbuf(void);
 void test_nghttp2_session_recv_data_no_auto_flow_control(void);
 void test_nghttp2_session_recv_continuation(void);
 void test_nghttp2_session_recv_headers_with_priority(void);
 void test_nghttp2_session_recv_headers_early_response(void);
+void test_nghttp2_session_recv_headers_borrow(void);
 void test_nghttp2_session_server_recv_push_response(void);
 void test_nghttp2_session_recv_premature_headers(void);
 void test_nghttp2_session_recv_unknown_frame(void);
@@ -142,6 +145,12 @@ void test_nghttp2_session_open_idle_stream(void);
 void test_nghttp2_session_cancel_reserved_remote(void);
 void test_nghttp2_session_reset_pending_headers(void);
 void test_nghttp2_session_send_data_callback(void);
+void test_nghttp2_session_mem_send_iov(void);
+void test_nghttp2_session_mem_send_coalesce(void);
+void test_nghttp2_session_no_rfc7540_priorities(void);
+void test_nghttp2_session_get_stats(void);
+void test_nghttp2_session_get_stats_continuation(void);
+void test_nghttp2_session_keep_header_rcbuf(void);
 void test_nghttp2_session_on_begin_headers_temporal_failure(void);
 void test_nghttp2_session_defer_then_close(void);
 void test_nghttp2_session_detach_item_from_closed_stream(void);
@@ -0,0 +1,191 @@
+/*
+ * nghttp2 - HTTP/2 C Library
+ *
+ * Copyright (c) 2017 Tatsuhiro Tsujikawa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "nghttp2_slab_test.h"
+
+#include <CUnit/CUnit.h>
+
+#include "nghttp2_slab.h"
+
+void test_nghttp2_slab(void) {
+  nghttp2_slab *slab;
+  nghttp2_mem *mem;
+  void *a, *b, *c, *large;
+  int rv;
+
+  rv = nghttp2_slab_new(&slab, nghttp2_mem_default());
+
+  CU_ASSERT(0 == rv);
+
+  mem = nghttp2_slab_get_mem(slab);
+
+  a = nghttp2_mem_malloc(mem, 10);
+  b = nghttp2_mem_malloc(mem, 32);
+
+  CU_ASSERT(NULL != a);
+  CU_ASSERT(NULL != b);
+  CU_ASSERT(a != b);
+  CU_ASSERT(1 == slab->stat[0].npage);
+  CU_ASSERT(2 == slab->stat[0].nused);
+  CU_ASSERT(2 == nghttp2_slab_get_num_outstanding(slab));
+
+  /* Freed object is reused by the next allocation in the same size
+     class. */
+  nghttp2_mem_free(mem, a);
+
+  CU_ASSERT(1 == slab->stat[0].nused);
+
+  c = nghttp2_mem_malloc(mem, 20);
+
+  CU_ASSERT(a == c);
+  CU_ASSERT(1 == slab->stat[0].npage);
+  CU_ASSERT(3 == slab->stat[0].nalloc);
+
+  nghttp2_mem_free(mem, b);
+  nghttp2_mem_free(mem, c);
+
+  /* Objects of other size class are taken from other page */
+  a = nghttp2_mem_calloc(mem, 1, 200);
+
+  CU_ASSERT(NULL != a);
+  CU_ASSERT(0 == *(uint8_t *)a);
+  CU_ASSERT(1 == slab->stat[NGHTTP2_SLAB_NCLASS - 1].npage);
+  CU_ASSERT(1 == slab->stat[NGHTTP2_SLAB_NCLASS - 1].nused);
+
+  nghttp2_mem_free(mem, a);
+
+  /* Exhaust one page to see that new page is allocated */
+  {
+    void *objs[NGHTTP2_SLAB_PAGE_NOBJ + 1];
+    size_t i;
+
+    for (i = 0; i < NGHTTP2_SLAB_PAGE_NOBJ + 1; ++i) {
+      objs[i] = nghttp2_mem_malloc(mem, 64);
+      CU_ASSERT(NULL != objs[i]);
+    }
+
+    CU_ASSERT(2 == slab->stat[1].npage);
+
+    for (i = 0; i < NGHTTP2_SLAB_PAGE_NOBJ + 1; ++i) {
+      nghttp2_mem_free(mem, objs[i]);
+    }
+  }
+
+  /* Large object is allocated by parent allocator */
+  large = nghttp2_mem_malloc(mem, 4096);
+
+  CU_ASSERT(NULL != large);
+  CU_ASSERT(1 == slab->nlarge);
+  CU_ASSERT(1 == slab->nlarge_alloc);
+
+  nghttp2_mem_free(mem, large);
+
+  CU_ASSERT(0 == slab->nlarge);
+  CU_ASSERT(0 == nghttp2_slab_get_num_outstanding(slab));
+
+  /* Freeing NULL is allowed */
+  nghttp2_mem_free(mem, NULL);
+
+  nghttp2_slab_release(slab);
+}
+
+void test_nghttp2_slab_realloc(void) {
+  nghttp2_slab *slab;
+  nghttp2_mem *mem;
+  uint8_t *p, *q;
+
+  nghttp2_slab_new(&slab, nghttp2_mem_default());
+  mem = nghttp2_slab_get_mem(slab);
+
+  p = nghttp2_mem_realloc(mem, NULL, 16);
+
+  CU_ASSERT(NULL != p);
+  CU_ASSERT(1 == slab->stat[0].nused);
+
+  memset(p, 'a', 16);
+
+  /* Shrinking or growing within size class returns the same
+     object */
+  q = nghttp2_mem_realloc(mem, p, 32);
+
+  CU_ASSERT(p == q);
+
+  /* Growing beyond size class moves object to the larger class */
+  q = nghttp2_mem_realloc(mem, p, 100);
+
+  CU_ASSERT(NULL != q);
+  CU_ASSERT(0 == slab->stat[0].nused);
+  CU_ASSERT(1 == slab->stat[3].nused);
+  CU_ASSERT('a' == q[0]);
+  CU_ASSERT('a' == q[15]);
+
+  /* ... and then to parent allocator */
+  p = nghttp2_mem_realloc(mem, q, 1000);
+
+  CU_ASSERT(NULL != p);
+  CU_ASSERT(0 == slab->stat[3].nused);
+  CU_ASSERT(1 == slab->nlarge);
+  CU_ASSERT('a' == p[0]);
+  CU_ASSERT('a' == p[15]);
+
+  p = nghttp2_mem_realloc(mem, p, 2000);
+
+  CU_ASSERT(NULL != p);
+  CU_ASSERT(1 == slab->nlarge);
+  CU_ASSERT('a' == p[15]);
+
+  nghttp2_mem_free(mem, p);
+
+  nghttp2_slab_release(slab);
+}
+
+void test_nghttp2_slab_release(void) {
+  nghttp2_slab *slab;
+  nghttp2_mem *mem;
+  nghttp2_free free_func;
+  void *mem_user_data;
+  void *a, *b;
+
+  nghttp2_slab_new(&slab, nghttp2_mem_default());
+  mem = nghttp2_slab_get_mem(slab);
+
+  a = nghttp2_mem_malloc(mem, 48);
+  b = nghttp2_mem_malloc(mem, 4096);
+
+  /* nghttp2_rcbuf keeps these to free itself */
+  free_func = mem->free;
+  mem_user_data = mem->mem_user_data;
+
+  /* Slab outlives its owner while objects are outstanding */
+  nghttp2_slab_release(slab);
+
+  CU_ASSERT(slab->released);
+
+  nghttp2_mem_free2(free_func, a, mem_user_data);
+
+  CU_ASSERT(1 == nghttp2_slab_get_num_outstanding(slab));
+
+  /* This frees slab as well */
+  nghttp2_mem_free2(free_func, b, mem_user_data);
+}